@@ -1606,6 +1606,9 @@ int CAndorSDK3Camera::InsertImage()
    mst.SetValue(ss.str().c_str());
    md.SetTag(mst);
 
+   // Raw FPGA clock ticks, for MMCore to correlate with the host clock
+   md.PutImageTag(MM::g_Keyword_Metadata_DeviceTimestamp, timeStamp_);
+
    MMThreadGuard g(imgPixelsLock_);
    return InsertMMImage(img_, md);
 }
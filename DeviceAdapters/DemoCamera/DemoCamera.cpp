@@ -32,6 +32,7 @@
 #include "WriteCompactTiffRGB.h"
 #include <iostream>
 #include <future>
+#include <thread>
 
 
 
@@ -4251,15 +4252,15 @@ void DemoGalvo::GetName(char* pName) const
 }
 int DemoGalvo::Initialize() 
 {
-   // generate Gaussian kernal
+   // generate Gaussian kernal (row-major, so that spots are added row by row)
    // Size is determined in the header file
-   int xSize = sizeof(gaussianMask_) / sizeof(gaussianMask_[0]);
-   int ySize = sizeof(gaussianMask_[0]) / 2;
-   for (int x = 0; x < xSize; x++)
+   int xSize = sizeof(gaussianMask_[0]) / sizeof(gaussianMask_[0][0]);
+   int ySize = sizeof(gaussianMask_) / sizeof(gaussianMask_[0]);
+   for (int y = 0; y < ySize; y++)
    { 
-      for (int y =0; y < ySize; y++) 
+      for (int x = 0; x < xSize; x++) 
       {
-         gaussianMask_[x][y] =(unsigned short) GaussValue(41, 0.5, 0.5, xSize / 2, ySize / 2, x, y);
+         gaussianMask_[y][x] = (unsigned short) GaussValue(41, 0.5, 0.5, xSize / 2, ySize / 2, x, y);
       }
    }
 
@@ -4414,6 +4415,159 @@ double DemoGalvo::GetYRange()
 }
 
 
+namespace {
+
+/**
+ * Non-horizontal polygon edge, oriented top to bottom, as used by the
+ * scanline fill in DemoGalvo::ChangePixels
+ */
+struct GalvoEdge
+{
+   int polygon;
+   double yTop;
+   double yBottom;
+   double xTop;
+   double dxdy;
+};
+
+bool EdgeStartsAbove(const GalvoEdge& a, const GalvoEdge& b)
+{
+   return a.yTop < b.yTop;
+}
+
+struct GalvoCrossing
+{
+   int polygon;
+   double x;
+   bool operator<(const GalvoCrossing& other) const
+   {
+      return polygon < other.polygon ||
+         (polygon == other.polygon && x < other.x);
+   }
+};
+
+/**
+ * Adds highValue once to every pixel of rows [y0, y1) whose center lies
+ * inside at least one polygon (even-odd rule per polygon).
+ * edges must be sorted by yTop.
+ */
+template <typename T>
+void FillPolygonRows(T* pBuf, unsigned width, unsigned y0, unsigned y1,
+      const std::vector<GalvoEdge>& edges, T highValue)
+{
+   std::vector<const GalvoEdge*> active;
+   std::vector<GalvoCrossing> crossings;
+   std::vector<std::pair<unsigned, unsigned> > spans;
+   std::size_t next = 0;
+   for (unsigned y = y0; y < y1; y++)
+   {
+      const double yc = y + 0.5;
+      while (next < edges.size() && edges[next].yTop <= yc)
+      {
+         if (edges[next].yBottom > yc)
+            active.push_back(&edges[next]);
+         next++;
+      }
+      std::size_t kept = 0;
+      for (std::size_t i = 0; i < active.size(); i++)
+      {
+         if (active[i]->yBottom > yc)
+            active[kept++] = active[i];
+      }
+      active.resize(kept);
+      if (active.empty())
+         continue;
+
+      crossings.clear();
+      for (std::size_t i = 0; i < active.size(); i++)
+      {
+         GalvoCrossing c;
+         c.polygon = active[i]->polygon;
+         c.x = active[i]->xTop + (yc - active[i]->yTop) * active[i]->dxdy;
+         crossings.push_back(c);
+      }
+      std::sort(crossings.begin(), crossings.end());
+
+      // Pixels with centers in [left, right) of each pair of crossings (a
+      // closed polygon always crosses a row an even number of times)
+      spans.clear();
+      for (std::size_t i = 0; i + 1 < crossings.size(); i += 2)
+      {
+         double left = std::max(0.0, std::ceil(crossings[i].x - 0.5));
+         double right = std::min((double) width, std::ceil(crossings[i + 1].x - 0.5));
+         if (left < right)
+            spans.push_back(std::make_pair((unsigned) left, (unsigned) right));
+      }
+      std::sort(spans.begin(), spans.end());
+
+      // Overlapping ROIs are lit only once
+      T* row = pBuf + (std::size_t) y * width;
+      unsigned end = 0;
+      for (std::size_t i = 0; i < spans.size(); i++)
+      {
+         unsigned x = std::max(spans[i].first, end);
+         for (; x < spans[i].second; x++)
+            row[x] = (T) (row[x] + highValue);
+         end = std::max(end, spans[i].second);
+      }
+   }
+}
+
+/**
+ * Fills the polygons in bands of rows, in parallel for large images
+ */
+template <typename T>
+void FillPolygons(ImgBuffer& img, const std::vector<GalvoEdge>& edges, T highValue)
+{
+   T* pBuf = (T*) const_cast<unsigned char*>(img.GetPixels());
+   const unsigned width = img.Width();
+   const unsigned height = img.Height();
+   if (edges.empty() || height == 0)
+      return;
+
+   const unsigned minRowsPerBand = 64;
+   unsigned bands = std::min(std::max(1u, std::thread::hardware_concurrency()),
+         height / minRowsPerBand);
+   if (bands <= 1 || (std::size_t) width * height < 512 * 512)
+   {
+      FillPolygonRows(pBuf, width, 0, height, edges, highValue);
+      return;
+   }
+
+   const unsigned rowsPerBand = (height + bands - 1) / bands;
+   std::vector<std::future<void> > futures;
+   for (unsigned y0 = rowsPerBand; y0 < height; y0 += rowsPerBand)
+   {
+      unsigned y1 = std::min(height, y0 + rowsPerBand);
+      futures.push_back(std::async(std::launch::async,
+               &FillPolygonRows<T>, pBuf, width, y0, y1, std::cref(edges),
+               highValue));
+   }
+   FillPolygonRows(pBuf, width, 0, rowsPerBand, edges, highValue);
+   for (std::size_t i = 0; i < futures.size(); i++)
+      futures[i].get();
+}
+
+/**
+ * Adds the (scaled) spot kernel with its top left corner at xPos, yPos,
+ * one image row at a time
+ */
+template <typename T, int N>
+void AddSpot(ImgBuffer& img, const unsigned short (&mask)[N][N], int xPos,
+      int yPos, T scale)
+{
+   T* pBuf = (T*) const_cast<unsigned char*>(img.GetPixels());
+   for (int y = 0; y < N; y++)
+   {
+      T* row = pBuf + (std::size_t) (yPos + y) * img.Width() + xPos;
+      const unsigned short* maskRow = mask[y];
+      for (int x = 0; x < N; x++)
+         row[x] = (T) (row[x] + scale * (T) maskRow[x]);
+   }
+}
+
+} // anonymous namespace
+
 /**
  * Callback function that will be called by DemoCamera everytime
  * a new image is generated.
@@ -4434,77 +4588,53 @@ int DemoGalvo::ChangePixels(ImgBuffer& img)
 
    if (runROIS_)
    {
-      // establish the bounding boxes around the ROIs in image coordinates
-      std::vector<std::vector<Point> > bBoxes = std::vector<std::vector<
-         Point> >();
-      for (unsigned int i = 0; i < vertices_.size(); i++) {
+      // edge table of the ROIs in image coordinates
+      std::vector<GalvoEdge> edges;
+      for (std::map<int, std::vector<PointD> >::iterator it = vertices_.begin();
+            it != vertices_.end(); ++it)
+      {
          std::vector<Point> vertex;
-         for (std::vector<PointD>::iterator it = vertices_[i].begin();
-               it != vertices_[i].end(); ++it)
+         for (std::vector<PointD>::iterator vit = it->second.begin();
+               vit != it->second.end(); ++vit)
          {
-            Point p = GalvoToCameraPoint(*it, img);
-            vertex.push_back(p);
+            vertex.push_back(GalvoToCameraPoint(*vit, img));
          }
-         std::vector<Point> bBox;
-         GetBoundingBox(vertex, bBox);
-         bBoxes.push_back(bBox);
-         //std::ostringstream os;
-         //os << "BBox: " << bBox[0].x << ", " << bBox[0].y << ", " <<
-         //  bBox[1].x << ", " << bBox[1].y;
-         //LogMessage(os.str().c_str());
-      }
-      if (img.Depth() == 1)
-      {
-         const unsigned char highValue = 240;
-         unsigned char* pBuf = (unsigned char*) const_cast<unsigned char*>(img.GetPixels());
-
-         // now iterate through the image pixels and set high 
-         // if they are within a bounding box
-         for (unsigned int x = 0; x < img.Width(); x++)
+         if (vertex.empty())
+            continue;
+         if (vertex.size() < 3)
          {
-            for (unsigned int y = 0; y < img.Height(); y++)
-            {
-               bool inROI = false;
-               for (unsigned int i = 0; i < bBoxes.size(); i++) 
-               {
-                  if (InBoundingBox(bBoxes[i], Point(x, y)))
-                     inROI = true;
-               }
-               if (inROI)
-               {
-                  long count = y * img.Width() + x;
-                  *(pBuf + count) = *(pBuf + count) + highValue;
-               }
-            }
+            // Points and lines light up the pixels they cover
+            std::vector<Point> bBox;
+            GetBoundingBox(vertex, bBox);
+            vertex.clear();
+            vertex.push_back(bBox[0]);
+            vertex.push_back(Point(bBox[1].x + 1, bBox[0].y));
+            vertex.push_back(Point(bBox[1].x + 1, bBox[1].y + 1));
+            vertex.push_back(Point(bBox[0].x, bBox[1].y + 1));
          }
-         img.SetPixels(pBuf);
-      }
-      else if (img.Depth() == 2)
-      {
-         const unsigned short highValue = 2048;
-         unsigned short* pBuf = (unsigned short*) const_cast<unsigned char*>(img.GetPixels());
-
-         // now iterate through the image pixels and set high 
-         // if they are within a bounding box
-         for (unsigned int x = 0; x < img.Width(); x++)
+         for (std::size_t i = 0; i < vertex.size(); i++)
          {
-            for (unsigned int y = 0; y < img.Height(); y++)
-            {
-               bool inROI = false;
-               for (unsigned int i = 0; i < bBoxes.size(); i++) 
-               {
-                  if (InBoundingBox(bBoxes[i], Point(x, y)))
-                     inROI = true;
-               }
-               if (inROI)
-               {
-                  long count = y * img.Width() + x;
-                  *(pBuf + count) = *(pBuf + count) + highValue;
-               }
-            }
+            Point a = vertex[i];
+            Point b = vertex[(i + 1) % vertex.size()];
+            if (a.y == b.y)
+               continue;
+            if (a.y > b.y)
+               std::swap(a, b);
+            GalvoEdge edge;
+            edge.polygon = it->first;
+            edge.yTop = a.y;
+            edge.yBottom = b.y;
+            edge.xTop = a.x;
+            edge.dxdy = (double) (b.x - a.x) / (double) (b.y - a.y);
+            edges.push_back(edge);
          }
-         img.SetPixels(pBuf);
       }
+      std::sort(edges.begin(), edges.end(), EdgeStartsAbove);
+
+      if (img.Depth() == 1)
+         FillPolygons<unsigned char>(img, edges, 240);
+      else if (img.Depth() == 2)
+         FillPolygons<unsigned short>(img, edges, 2048);
       runROIS_ = false;
    } else
    {
@@ -4514,42 +4644,15 @@ int DemoGalvo::ChangePixels(ImgBuffer& img)
       std::ostringstream os;
       os << "XPos: " << xPos << ", YPos: " << yPos;
       LogMessage(os.str().c_str());
-      int xSpotSize = sizeof(gaussianMask_) / sizeof(gaussianMask_[0]);
-      int ySpotSize = sizeof(gaussianMask_[0]) / 2;
+      const int spotSize = sizeof(gaussianMask_) / sizeof(gaussianMask_[0]);
 
-      if (xPos > xSpotSize && xPos < (int) (img.Width() - xSpotSize - 1)  && 
-         yPos > ySpotSize && yPos < (int) (img.Height() - ySpotSize - 1) )
+      if (xPos > spotSize && xPos < (int) (img.Width() - spotSize - 1)  && 
+         yPos > spotSize && yPos < (int) (img.Height() - spotSize - 1) )
       {
          if (img.Depth() == 1)
-         {
-            unsigned char* pBuf = (unsigned char*) const_cast<unsigned char*>(img.GetPixels());
-            for (int x = 0; x < xSpotSize; x++) 
-            {
-               for (int y = 0; y < ySpotSize; y++) 
-               {
-                  int w = xPos + x;
-                  int h = yPos + y;
-                  long count = h * img.Width() + w;
-                  *(pBuf + count) = *(pBuf + count) + 5 * (unsigned char) gaussianMask_[x][y];
-               }
-            }
-            img.SetPixels(pBuf);
-         }
+            AddSpot<unsigned char>(img, gaussianMask_, xPos, yPos, 5);
          else if (img.Depth() == 2)
-         {
-            unsigned short* pBuf = (unsigned short*) const_cast<unsigned char*>(img.GetPixels());
-            for (int x = 0; x < xSpotSize; x++) 
-            {
-               for (int y = 0; y < ySpotSize; y++) 
-               {
-                  int w = xPos + x;
-                  int h = yPos + y;
-                  long count = h * img.Width() + w;
-                  *(pBuf + count) = *(pBuf + count) + 30 * (unsigned short) gaussianMask_[x][y];
-               }
-            }
-            img.SetPixels(pBuf);
-         }
+            AddSpot<unsigned short>(img, gaussianMask_, xPos, yPos, 30);
       }
       if (pointAndFire_)
       {
@@ -4640,19 +4743,6 @@ void DemoGalvo::GetBoundingBox(std::vector<Point>& vertex, std::vector<Point>& b
    bBox.push_back(Point(maxX, maxY));
 }
 
-/**
- * Determines whether the given point is in the boundingBox
- * boundingBox should have two members, one with the minimum x, y position,
- * the second with the maximum x, y positions
- */
-bool DemoGalvo::InBoundingBox(std::vector<Point> boundingBox, Point testPoint)
-{
-   if (testPoint.x >= boundingBox[0].x && testPoint.x <= boundingBox[1].x &&
-         testPoint.y >= boundingBox[0].y && testPoint.y <= boundingBox[1].y)
-      return true;
-   return false;
-}
-
 /**
  * Not used (yet), intent was to use this to determine whether 
  * a point is within the ROI, rather than drawing a bounding box
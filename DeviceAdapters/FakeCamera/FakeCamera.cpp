@@ -23,6 +23,8 @@
 
 #include "FakeCamera.h"
 
+#include <algorithm>
+
 const char* cameraName = "FakeCamera";
 
 const char* label_CV_8U = "8bit";
@@ -40,7 +42,8 @@ FakeCamera::FakeCamera() :
 	byteCount_(1),
 	type_(CV_8UC1),
 	emptyImg(1, 1, type_),
-	exposure_(10)
+	exposure_(10),
+	sequenceFrames_(0)
 {
 	resetCurImg();
 
@@ -49,6 +52,11 @@ FakeCamera::FakeCamera() :
 
 	CreateProperty("FrameCount", "0", MM::Integer, false, new CPropertyAction(this, &FakeCamera::OnFrameCount));
 
+	// Decoded images are kept in memory; when enabled, all images next to
+	// the resolved path are decoded ahead of time in the background
+	CreateProperty("Image cache size (MB)", "0", MM::Integer, false, new CPropertyAction(this, &FakeCamera::OnCacheSize));
+	CreateProperty("Image cache status", "", MM::String, true, new CPropertyAction(this, &FakeCamera::OnCacheStatus));
+
 	CreateProperty(MM::g_Keyword_Name, cameraName, MM::String, true);
 
 	// Description
@@ -97,11 +105,14 @@ int FakeCamera::Initialize()
 
 	initialized_ = true;
 
+	restartCache();
+
 	return DEVICE_OK;
 }
 
 int FakeCamera::Shutdown()
 {
+	cache_.StopPreload();
 	initialized_ = false;
 
 	return DEVICE_OK;
@@ -248,6 +259,8 @@ ERRH_END
 int FakeCamera::StartSequenceAcquisition(long numImages, double interval_ms, bool stopOnOverflow)
 {
 	capturing_ = true;
+	sequenceStart_ = GetCoreCallback()->GetCurrentMMTime();
+	sequenceFrames_ = 0;
 	return CCameraBase::StartSequenceAcquisition(numImages, interval_ms, stopOnOverflow);
 }
 
@@ -263,6 +276,28 @@ void FakeCamera::OnThreadExiting() throw()
 	CCameraBase::OnThreadExiting();
 }
 
+// Frames are released at fixed times relative to the start of the sequence
+// (the exposure or the requested interval, whichever is longer), so that the
+// frame rate does not drift with the time spent loading images
+int FakeCamera::ThreadRun()
+{
+ERRH_START
+	++frameCount_;
+	initSize();
+
+	getImg();
+
+	double period = (std::max)(exposure_, GetIntervalMs());
+	MM::MMTime due = sequenceStart_ + MM::MMTime::fromMs(period * ++sequenceFrames_);
+	double rem = (due - GetCoreCallback()->GetCurrentMMTime()).getMsec();
+
+	if (rem > 0)
+		CDeviceUtils::SleepMs((long)rem);
+
+	error_code::ThrowErr(InsertImage());
+ERRH_END
+}
+
 int FakeCamera::OnPath(MM::PropertyBase * pProp, MM::ActionType eAct)
 {
 	if (eAct == MM::BeforeGet)
@@ -277,6 +312,8 @@ int FakeCamera::OnPath(MM::PropertyBase * pProp, MM::ActionType eAct)
 
 		if (initialized_)
 		{
+			restartCache();
+
 			ERRH_START
 				try
 			{
@@ -312,11 +349,6 @@ int FakeCamera::ResolvePath(MM::PropertyBase * pProp, MM::ActionType eAct)
 	return DEVICE_OK;
 }
 
-double scaleFac(int bef, int aft)
-{
-	return (double)(1 << (8 * aft)) / (1 << (8 * bef));
-}
-
 int FakeCamera::OnPixelType(MM::PropertyBase * pProp, MM::ActionType eAct)
 {
 	if (eAct == MM::BeforeGet)
@@ -375,6 +407,7 @@ int FakeCamera::OnPixelType(MM::PropertyBase * pProp, MM::ActionType eAct)
 		// emptyImg = 0;
 
 		resetCurImg();
+		restartCache();
 	}
 
 	return DEVICE_OK;
@@ -397,6 +430,36 @@ int FakeCamera::OnFrameCount(MM::PropertyBase * pProp, MM::ActionType eAct)
 	return DEVICE_OK;
 }
 
+int FakeCamera::OnCacheSize(MM::PropertyBase * pProp, MM::ActionType eAct)
+{
+	if (eAct == MM::BeforeGet)
+	{
+		pProp->Set((long)(cache_.GetCapacity() / (1024 * 1024)));
+	}
+	else if (eAct == MM::AfterSet)
+	{
+		long sizeMB;
+		pProp->Get(sizeMB);
+		if (sizeMB < 0)
+			return OUT_OF_RANGE;
+
+		cache_.SetCapacity((size_t)sizeMB * 1024 * 1024);
+		restartCache();
+	}
+
+	return DEVICE_OK;
+}
+
+int FakeCamera::OnCacheStatus(MM::PropertyBase * pProp, MM::ActionType eAct)
+{
+	if (eAct == MM::BeforeGet)
+	{
+		pProp->Set(cache_.GetStatus().c_str());
+	}
+
+	return DEVICE_OK;
+}
+
 std::string FakeCamera::parseUntil(const char*& it, const char delim) const throw (parse_error)
 {
 	std::ostringstream ret;
@@ -655,7 +718,15 @@ void FakeCamera::getImg() const
 	if (path == curPath_)
 		return;
 
-	cv::Mat img = path == lastFailedPath_ ? lastFailedImg_ : cv::imread(path, cv::IMREAD_ANYDEPTH | (color_ ? cv::IMREAD_COLOR : cv::IMREAD_GRAYSCALE));
+	cv::Mat img;
+	if (path == lastFailedPath_)
+		img = lastFailedImg_;
+	else if (!cache_.Get(path, img))
+	{
+		img = decodeImage(path, type_, byteCount_, color_);
+		if (img.data != NULL)
+			cache_.Put(path, img);
+	}
 
 	if (img.data == NULL)
 	{
@@ -671,8 +742,6 @@ void FakeCamera::getImg() const
 		}
 	}
 
-	img.convertTo(img, type_, scaleFac((int)img.elemSize() / img.channels(), byteCount_));
-
 	bool dimChanged = (unsigned)img.cols != width_ || (unsigned)img.rows != height_;
 
 	if (dimChanged)
@@ -685,24 +754,8 @@ void FakeCamera::getImg() const
 		}
 	}
 
-	if (color_)
-	{
-		if (alphaChannel_.rows != img.rows || alphaChannel_.cols != img.cols || alphaChannel_.depth() != img.depth())
-		{
-			alphaChannel_ = cv::Mat(img.rows, img.cols, byteCount_ == 2 ? CV_16U : CV_8U);
-			alphaChannel_ = 1 << (8 * byteCount_);
-		}
-
-		if (dimChanged)
-			curImg_ = cv::Mat(img.rows, img.cols, type_);
-
-		int fromTo[] = { 0,0 , 1,1 , 2,2 , 3,3 };
-		cv::Mat from[] = { img, alphaChannel_ };
-
-		cv::mixChannels(from, 2, &curImg_, 1, fromTo, 4);
-	}
-	else
-		curImg_ = img;
+	// Cached images are shared, not copied; the ROI is a view into them
+	curImg_ = img;
 
 	curPath_ = path;
 
@@ -759,3 +812,23 @@ void FakeCamera::resetCurImg()
 	ClearROI();
 	updateROI();
 }
+
+// Drops all cached images (they depend on the pixel type) and starts
+// preloading the images next to the currently resolved path
+void FakeCamera::restartCache()
+{
+	cache_.StopPreload();
+	cache_.Clear();
+
+	if (!initialized_ || cache_.GetCapacity() == 0)
+		return;
+
+	try
+	{
+		cache_.StartPreload(parseMask(path_), type_, byteCount_, color_);
+	}
+	catch (error_code)
+	{
+		// Invalid mask; images will be cached as they are loaded
+	}
+}
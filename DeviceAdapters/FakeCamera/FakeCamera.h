@@ -40,6 +40,7 @@
 #define CONTROLLER_ERROR 10002
 
 #include "error_code.h"
+#include "ImageCache.h"
 
 extern const char* cameraName;
 extern const char* label_CV_8U;
@@ -78,6 +79,7 @@ public:
 	int StartSequenceAcquisition(long numImages, double interval_ms, bool stopOnOverflow);
 	int StopSequenceAcquisition();
 	void OnThreadExiting() throw();
+	int ThreadRun();
 
 	unsigned GetNumberOfComponents() const;
 	const unsigned int* GetImageBufferAsRGB32();
@@ -86,6 +88,8 @@ public:
 	int ResolvePath(MM::PropertyBase* pProp, MM::ActionType eAct);
 	int OnPixelType(MM::PropertyBase* pProp, MM::ActionType eAct);
 	int OnFrameCount(MM::PropertyBase* pProp, MM::ActionType eAct);
+	int OnCacheSize(MM::PropertyBase* pProp, MM::ActionType eAct);
+	int OnCacheStatus(MM::PropertyBase* pProp, MM::ActionType eAct);
 
 	std::string parseUntil(const char*& it, const char delim) const throw (parse_error);
 	std::string parsePlaceholder(const char*& it) const;
@@ -97,6 +101,7 @@ public:
 	void updateROI() const;
 
 	void initSize(bool loadImg = true) const;
+	void restartCache();
 
 private:
 	bool initialized_;
@@ -120,7 +125,6 @@ private:
 	cv::Mat emptyImg;
 
 	mutable cv::Mat curImg_;
-	mutable cv::Mat alphaChannel_;
 	mutable cv::Mat lastFailedImg_;
 	mutable cv::Mat roi_;
 	mutable std::string curPath_;
@@ -129,4 +133,11 @@ private:
 	void resetCurImg();
 
 	double exposure_;
+
+	// Decoded images, keyed by resolved path
+	mutable ImageCache cache_;
+
+	// Pacing of sequence acquisitions
+	MM::MMTime sequenceStart_;
+	long sequenceFrames_;
 };
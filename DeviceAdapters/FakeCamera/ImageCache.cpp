@@ -0,0 +1,211 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          ImageCache.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   LRU cache of decoded images for FakeCamera, with an optional
+//                background thread that preloads a whole directory
+//
+// AUTHOR:        Lukas Lang
+//
+// COPYRIGHT:     2017 Lukas Lang
+// LICENSE:       Licensed under the Apache License, Version 2.0 (the "License");
+//                you may not use this file except in compliance with the License.
+//                You may obtain a copy of the License at
+//                
+//                http://www.apache.org/licenses/LICENSE-2.0
+//                
+//                Unless required by applicable law or agreed to in writing, software
+//                distributed under the License is distributed on an "AS IS" BASIS,
+//                WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//                See the License for the specific language governing permissions and
+//                limitations under the License.
+
+#include "ImageCache.h"
+
+#include <sstream>
+
+static double scaleFac(int bef, int aft)
+{
+	return (double)(1 << (8 * aft)) / (1 << (8 * bef));
+}
+
+cv::Mat decodeImage(const std::string& path, int type, unsigned byteCount, bool color)
+{
+	cv::Mat img = cv::imread(path, cv::IMREAD_ANYDEPTH | (color ? cv::IMREAD_COLOR : cv::IMREAD_GRAYSCALE));
+
+	if (img.data == NULL)
+		return img;
+
+	img.convertTo(img, type, scaleFac((int)img.elemSize() / img.channels(), byteCount));
+
+	if (!color)
+		return img;
+
+	cv::Mat alphaChannel(img.rows, img.cols, byteCount == 2 ? CV_16U : CV_8U);
+	alphaChannel = 1 << (8 * byteCount);
+
+	cv::Mat res(img.rows, img.cols, type);
+	int fromTo[] = { 0,0 , 1,1 , 2,2 , 3,3 };
+	cv::Mat from[] = { img, alphaChannel };
+
+	cv::mixChannels(from, 2, &res, 1, fromTo, 4);
+
+	return res;
+}
+
+ImageCache::ImageCache() :
+	capacity_(0),
+	size_(0),
+	hits_(0),
+	misses_(0),
+	stopPreload_(false),
+	preloading_(false)
+{
+}
+
+ImageCache::~ImageCache()
+{
+	StopPreload();
+}
+
+void ImageCache::SetCapacity(size_t bytes)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	capacity_ = bytes;
+	EvictLocked();
+}
+
+size_t ImageCache::GetCapacity() const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return capacity_;
+}
+
+bool ImageCache::Get(const std::string& path, cv::Mat& img)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	// Nothing is cached, so lookups are neither hits nor misses
+	if (capacity_ == 0)
+		return false;
+
+	std::map<std::string, EntryList::iterator>::iterator it = index_.find(path);
+	if (it == index_.end())
+	{
+		++misses_;
+		return false;
+	}
+
+	++hits_;
+	entries_.splice(entries_.begin(), entries_, it->second);
+	img = it->second->second;
+	return true;
+}
+
+void ImageCache::Put(const std::string& path, const cv::Mat& img)
+{
+	size_t bytes = img.total() * img.elemSize();
+
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	if (bytes > capacity_ || index_.count(path) > 0)
+		return;
+
+	entries_.push_front(std::make_pair(path, img));
+	index_[path] = entries_.begin();
+	size_ += bytes;
+
+	EvictLocked();
+}
+
+void ImageCache::Clear()
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	entries_.clear();
+	index_.clear();
+	size_ = 0;
+	hits_ = 0;
+	misses_ = 0;
+}
+
+void ImageCache::EvictLocked()
+{
+	while (size_ > capacity_ && !entries_.empty())
+	{
+		const cv::Mat& img = entries_.back().second;
+		size_ -= img.total() * img.elemSize();
+		index_.erase(entries_.back().first);
+		entries_.pop_back();
+	}
+}
+
+bool ImageCache::Contains(const std::string& path) const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return index_.count(path) > 0;
+}
+
+bool ImageCache::IsFull() const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return capacity_ == 0 || size_ >= capacity_;
+}
+
+void ImageCache::StartPreload(const std::string& samplePath, int type, unsigned byteCount, bool color)
+{
+	StopPreload();
+
+	if (GetCapacity() == 0)
+		return;
+
+	size_t sepPos = samplePath.find_last_of("/\\");
+	size_t extPos = samplePath.find_last_of('.');
+	std::string dir = sepPos == std::string::npos ? "." : samplePath.substr(0, sepPos);
+	std::string ext = extPos == std::string::npos || (sepPos != std::string::npos && extPos < sepPos) ? "" : samplePath.substr(extPos);
+
+	std::vector<cv::String> found;
+	cv::glob(dir + "/*" + ext, found, false);
+
+	std::vector<std::string> files;
+	for (size_t i = 0; i < found.size(); ++i)
+		files.push_back(found[i]);
+
+	stopPreload_ = false;
+	preloading_ = true;
+	preloadThread_ = std::thread(&ImageCache::PreloadThread, this, files, type, byteCount, color);
+}
+
+void ImageCache::StopPreload()
+{
+	stopPreload_ = true;
+	if (preloadThread_.joinable())
+		preloadThread_.join();
+	preloading_ = false;
+}
+
+void ImageCache::PreloadThread(std::vector<std::string> files, int type, unsigned byteCount, bool color)
+{
+	for (size_t i = 0; i < files.size() && !stopPreload_ && !IsFull(); ++i)
+	{
+		if (Contains(files[i]))
+			continue;
+
+		cv::Mat img = decodeImage(files[i], type, byteCount, color);
+		if (img.data != NULL)
+			Put(files[i], img);
+	}
+	preloading_ = false;
+}
+
+std::string ImageCache::GetStatus() const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	std::ostringstream os;
+	os << entries_.size() << " images, " << size_ / (1024 * 1024) << " MB, "
+		<< hits_ << " hits, " << misses_ << " misses";
+	if (preloading_)
+		os << ", preloading";
+	return os.str();
+}
@@ -0,0 +1,86 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          ImageCache.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   LRU cache of decoded images for FakeCamera, with an optional
+//                background thread that preloads a whole directory
+//
+// AUTHOR:        Lukas Lang
+//
+// COPYRIGHT:     2017 Lukas Lang
+// LICENSE:       Licensed under the Apache License, Version 2.0 (the "License");
+//                you may not use this file except in compliance with the License.
+//                You may obtain a copy of the License at
+//                
+//                http://www.apache.org/licenses/LICENSE-2.0
+//                
+//                Unless required by applicable law or agreed to in writing, software
+//                distributed under the License is distributed on an "AS IS" BASIS,
+//                WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//                See the License for the specific language governing permissions and
+//                limitations under the License.
+
+#pragma once
+
+#include <atomic>
+#include <list>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <opencv/cv.hpp>
+#else
+#include "opencv/highgui.h"
+#endif
+
+// Decodes an image file and converts it to the given pixel type. Colour
+// images get an opaque alpha channel. Returns an empty matrix if the file
+// cannot be read.
+cv::Mat decodeImage(const std::string& path, int type, unsigned byteCount, bool color);
+
+class ImageCache
+{
+public:
+	ImageCache();
+	~ImageCache();
+
+	// A capacity of 0 disables caching
+	void SetCapacity(size_t bytes);
+	size_t GetCapacity() const;
+
+	// On a hit, img shares the cached pixels (no copy)
+	bool Get(const std::string& path, cv::Mat& img);
+	void Put(const std::string& path, const cv::Mat& img);
+	void Clear();
+
+	// Decodes all files in the directory of samplePath that have the same
+	// extension, on a background thread, until the cache is full
+	void StartPreload(const std::string& samplePath, int type, unsigned byteCount, bool color);
+	void StopPreload();
+
+	std::string GetStatus() const;
+
+private:
+	bool Contains(const std::string& path) const;
+	bool IsFull() const;
+	void EvictLocked();
+	void PreloadThread(std::vector<std::string> files, int type, unsigned byteCount, bool color);
+
+	typedef std::list<std::pair<std::string, cv::Mat> > EntryList;
+
+	mutable std::mutex mutex_;
+	EntryList entries_; // most recently used first
+	std::map<std::string, EntryList::iterator> index_;
+	size_t capacity_;
+	size_t size_;
+	unsigned long hits_;
+	unsigned long misses_;
+
+	std::thread preloadThread_;
+	std::atomic<bool> stopPreload_;
+	std::atomic<bool> preloading_;
+};
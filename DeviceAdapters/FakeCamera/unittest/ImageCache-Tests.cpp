@@ -0,0 +1,69 @@
+#include <gtest/gtest.h>
+
+#include "ImageCache.h"
+
+#include <string>
+
+namespace
+{
+	// 10 x 10 8-bit images take 100 bytes
+	cv::Mat SmallImage()
+	{
+		return cv::Mat(10, 10, CV_8UC1);
+	}
+}
+
+TEST(ImageCacheTests, DisabledCacheKeepsNoStatistics)
+{
+	ImageCache cache;
+	cache.Put("a.tif", SmallImage());
+	cv::Mat img;
+	EXPECT_FALSE(cache.Get("a.tif", img));
+	EXPECT_FALSE(cache.Get("b.tif", img));
+	EXPECT_EQ("0 images, 0 MB, 0 hits, 0 misses", cache.GetStatus());
+}
+
+TEST(ImageCacheTests, HitsShareThePixels)
+{
+	ImageCache cache;
+	cache.SetCapacity(1000);
+	cv::Mat stored = SmallImage();
+	cache.Put("a.tif", stored);
+
+	cv::Mat img;
+	ASSERT_TRUE(cache.Get("a.tif", img));
+	EXPECT_EQ(stored.data, img.data);
+	EXPECT_FALSE(cache.Get("b.tif", img));
+	EXPECT_EQ("1 images, 0 MB, 1 hits, 1 misses", cache.GetStatus());
+
+	cache.Clear();
+	EXPECT_FALSE(cache.Get("a.tif", img));
+	EXPECT_EQ("0 images, 0 MB, 0 hits, 1 misses", cache.GetStatus());
+}
+
+TEST(ImageCacheTests, EvictsLeastRecentlyUsed)
+{
+	ImageCache cache;
+	cache.SetCapacity(250);
+	cache.Put("a.tif", SmallImage());
+	cache.Put("b.tif", SmallImage());
+	cv::Mat img;
+	ASSERT_TRUE(cache.Get("a.tif", img)); // b becomes the oldest
+	cache.Put("c.tif", SmallImage());
+	EXPECT_TRUE(cache.Get("a.tif", img));
+	EXPECT_FALSE(cache.Get("b.tif", img));
+	EXPECT_TRUE(cache.Get("c.tif", img));
+
+	// Images larger than the whole cache are not cached
+	cache.Put("big.tif", cv::Mat(20, 20, CV_8UC1));
+	EXPECT_FALSE(cache.Get("big.tif", img));
+
+	cache.SetCapacity(100);
+	EXPECT_EQ(0, cache.GetStatus().find("1 images"));
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
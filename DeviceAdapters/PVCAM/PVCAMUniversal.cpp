@@ -4214,6 +4214,8 @@ int Universal::ProcessNotification( const NotificationEntry& entry )
         md.PutImageTag<int32>( "PVCAM-ReadoutTime",   frameNfo.PvReadoutTime() );
         md.PutImageTag<long64>( "PVCAM-TimeStamp",    frameNfo.PvTimeStamp() );
         md.PutImageTag<long64>( "PVCAM-TimeStampBOF", frameNfo.PvTimeStampBOF() );
+        // Lets MMCore correlate the camera clock with the host clock
+        md.PutImageTag<long64>( MM::g_Keyword_Metadata_DeviceTimestamp, frameNfo.PvTimeStamp() );
         if (circBufFrameRecoveryEnabled_)
         {
             md.PutImageTag<bool>( "PVCAM-FrameRecovered", frameNfo.IsRecovered() );
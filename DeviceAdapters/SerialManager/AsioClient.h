@@ -30,6 +30,7 @@
 #include <boost/bind.hpp>
 #include <boost/lexical_cast.hpp>
 
+#include <algorithm>
 #include <deque>
 #include <exception>
 #include <string>
@@ -60,6 +61,8 @@ public:
       active_(true),
       io_service_(ioService),
       serialPortImplementation_(ioService, nativeHandle),
+      pacingTimer_(ioService),
+      pendingWriteSize_(0),
       pSerialPortAdapter_(pPort),
       device_(deviceName),
       shutDownInProgress_(false)
@@ -79,6 +82,8 @@ public:
       active_(true),
       io_service_(ioService),
       serialPortImplementation_(ioService, deviceName),
+      pacingTimer_(ioService),
+      pendingWriteSize_(0),
       pSerialPortAdapter_(pPort),
       device_(deviceName),
       shutDownInProgress_(false)
@@ -251,15 +256,35 @@ public:
 
    void WriteOneCharacterAsynchronously(const char ch)
    {
-      io_service_.post(boost::bind(&AsioClient::DoWriteCh, this, ch));
+      WriteCharactersAsynchronously(&ch, 1);
    }
 
-   void WriteCharactersAsynchronously(const char* pmsg, size_t len)
+   // With a nonzero interCharDelayMs, the characters are sent one at a time,
+   // each followed by the delay. The pacing is done on the I/O thread, so
+   // this returns immediately in either case.
+   void WriteCharactersAsynchronously(const char* pmsg, size_t len,
+         double interCharDelayMs = 0.0)
    {
-      std::vector<char> msg(pmsg, pmsg + len);
+      PendingWrite msg;
+      msg.data.assign(pmsg, pmsg + len);
+      msg.sent = 0;
+      msg.inFlight = 0;
+      msg.interCharDelayMs = interCharDelayMs;
+      {
+         MMThreadGuard g(writeBufferLock_);
+         pendingWriteSize_ += len;
+      }
       io_service_.post(boost::bind(&AsioClient::DoWriteMsg, this, msg));
    }
 
+   // Number of characters passed to WriteCharactersAsynchronously() that
+   // have not been sent yet (including their pacing delay)
+   size_t GetPendingWriteSize()
+   {
+      MMThreadGuard g(writeBufferLock_);
+      return pendingWriteSize_;
+   }
+
 
    bool WriteCharactersSynchronously(const char* msg, size_t len)
    {
@@ -308,10 +333,16 @@ public:
          data_read_.clear();
       }
 
-      // clear write buffer
+      // clear write buffer, except for the characters being written
       {
          MMThreadGuard g(writeBufferLock_);
+         if (write_msgs_.empty())
+            return;
+         PendingWrite current = write_msgs_.front();
          write_msgs_.clear(); // buffered write data
+         current.data.resize(current.sent + current.inFlight);
+         write_msgs_.push_back(current);
+         pendingWriteSize_ = current.inFlight;
       }
    }
 
@@ -385,7 +416,15 @@ private:
 
 
    // for asynchronous write operations:
-   void DoWriteMsg(const std::vector<char>& msg)
+   struct PendingWrite
+   {
+      std::vector<char> data;
+      size_t sent; // characters written (and paced)
+      size_t inFlight; // characters in the current async_write
+      double interCharDelayMs;
+   };
+
+   void DoWriteMsg(const PendingWrite& msg)
    { // callback to handle write call from outside this class
       MMThreadGuard writeBufferGuard(writeBufferLock_);
       bool write_in_progress = !write_msgs_.empty(); // is there anything currently being written?
@@ -395,31 +434,56 @@ private:
          WriteStart();
    }
 
-   void DoWriteCh(const char ch)
-   {
-      std::vector<char> msg(1, ch);
-      DoWriteMsg(msg);
-   }
-
    // Must be called with writeBufferLock_ acquired!
    void WriteStart()
    { // Start an asynchronous write and call WriteComplete when it completes or fails
+      PendingWrite& msg = write_msgs_.front();
+      if (msg.sent >= msg.data.size()) // empty message
+      {
+         WriteNext();
+         return;
+      }
+      // Paced messages are written one character at a time
+      msg.inFlight = msg.interCharDelayMs > 0.0 ? 1 : msg.data.size() - msg.sent;
       boost::asio::async_write(serialPortImplementation_,
-         boost::asio::buffer(&write_msgs_.front()[0], write_msgs_.front().size()),
+         boost::asio::buffer(&msg.data[msg.sent], msg.inFlight),
          boost::bind(&AsioClient::WriteComplete,
          this,
          boost::asio::placeholders::error));
    }
 
+   // Must be called with writeBufferLock_ acquired!
+   void WriteNext()
+   {
+      if (0 < write_msgs_.size() && // Should always be true, unless purged
+            write_msgs_.front().sent >= write_msgs_.front().data.size())
+         write_msgs_.pop_front(); // remove the completed data
+      if (!write_msgs_.empty()) // if there is anthing left to be written
+         WriteStart(); // then start sending the next item in the buffer
+   }
+
    void WriteComplete(const boost::system::error_code& error)
    { // the asynchronous read operation has now completed or failed and returned an error
       if (!error)
       { // write completed, so send next write data
          MMThreadGuard writeBufferGuard(writeBufferLock_);
-         if (0 < write_msgs_.size()) // Should always be true, unless purged
-            write_msgs_.pop_front(); // remove the completed data
-         if (!write_msgs_.empty()) // if there is anthing left to be written
-            WriteStart(); // then start sending the next item in the buffer
+         if (write_msgs_.empty()) // Should never happen
+            return;
+         PendingWrite& msg = write_msgs_.front();
+         const size_t written = msg.inFlight;
+         msg.sent += written;
+         msg.inFlight = 0;
+         if (msg.interCharDelayMs > 0.0)
+         {
+            // The character counts as pending until its delay has elapsed
+            pacingTimer_.expires_from_now(boost::posix_time::microseconds(
+                     static_cast<long>(1000.0 * msg.interCharDelayMs)));
+            pacingTimer_.async_wait(boost::bind(&AsioClient::PacingComplete,
+                     this, boost::asio::placeholders::error));
+            return;
+         }
+         pendingWriteSize_ -= std::min(pendingWriteSize_, written);
+         WriteNext();
       }
       else
       {
@@ -428,6 +492,16 @@ private:
       }
    }
 
+   void PacingComplete(const boost::system::error_code& error)
+   {
+      if (error) // cancelled by DoClose()
+         return;
+      MMThreadGuard writeBufferGuard(writeBufferLock_);
+      if (0 < pendingWriteSize_)
+         --pendingWriteSize_;
+      WriteNext();
+   }
+
 
 
    void DoClose(const boost::system::error_code& error)
@@ -449,6 +523,8 @@ private:
 
       if (active_)
       {
+         boost::system::error_code ignored;
+         pacingTimer_.cancel(ignored);
          MMThreadGuard g(implementationLock_);
          serialPortImplementation_.close();
       }
@@ -461,7 +537,9 @@ private:
    boost::asio::io_service& io_service_; // the main IO service that runs this connection
    boost::asio::serial_port serialPortImplementation_; // the serial port this instance is connected to
    char read_msg_[max_read_length]; // data read from the socket
-   std::deque< std::vector<char> > write_msgs_; // buffered write data
+   std::deque<PendingWrite> write_msgs_; // buffered write data
+   boost::asio::deadline_timer pacingTimer_; // delay after paced characters
+   size_t pendingWriteSize_;
    std::deque<char> data_read_;
    SerialPort* pSerialPortAdapter_;
    std::string device_;
@@ -756,18 +756,9 @@ int SerialPort::SetCommand(const char* command, const char* term)
       return DEVICE_OK;
    }
 
-   if (transmitCharWaitMs_ < 0.001)
-   {
-      pPort_->WriteCharactersAsynchronously(sendText.c_str(), sendText.length());
-   }
-   else
-   {
-      for (std::string::iterator jj = sendText.begin(); jj != sendText.end(); ++jj)
-      {
-         pPort_->WriteOneCharacterAsynchronously(*jj);
-         CDeviceUtils::SleepMs(static_cast<long>(0.5 + transmitCharWaitMs_));
-      }
-   }
+   // Any delay between characters is applied on the I/O thread
+   pPort_->WriteCharactersAsynchronously(sendText.c_str(), sendText.length(),
+         GetInterCharDelayMs());
 
    LogAsciiCommunication("SetCommand", false, sendText);
 
@@ -789,7 +780,18 @@ int SerialPort::GetAnswer(char* answer, unsigned bufLen, const char* term)
    memset(answer,0,bufLen);
    char theData = 0;
 
+   // A paced command may still be going out; the answer cannot arrive before
+   // it has been sent, so the timeout starts from then
    MM::MMTime startTime = GetCurrentMMTime();
+   MM::MMTime writeTimeout((answerTimeoutMs_ + pPort_->GetPendingWriteSize() *
+            GetInterCharDelayMs()) * 1000.0);
+   while (0 < pPort_->GetPendingWriteSize() &&
+         (GetCurrentMMTime() - startTime) < writeTimeout)
+   {
+      CDeviceUtils::SleepMs(1);
+   }
+
+   startTime = GetCurrentMMTime();
    MM::MMTime answerTimeout(answerTimeoutMs_ * 1000.0);
    MM::MMTime nonTerminatedAnswerTimeout(5.0 * 1000.0); // For bug-compatibility
    while ((GetCurrentMMTime() - startTime)  < answerTimeout)
@@ -860,18 +862,8 @@ int SerialPort::Write(const unsigned char* buf, unsigned long bufLen)
       return DEVICE_OK;
    }
 
-   if (transmitCharWaitMs_ < 0.001)
-   {
-      pPort_->WriteCharactersAsynchronously(reinterpret_cast<const char*>(buf), bufLen);
-   }
-   else
-   {
-      for (size_t i = 0; i < bufLen; ++i)
-      {
-         pPort_->WriteOneCharacterAsynchronously(buf[i]);
-         CDeviceUtils::SleepMs(static_cast<long>(0.5 + transmitCharWaitMs_));
-      }
-   }
+   pPort_->WriteCharactersAsynchronously(reinterpret_cast<const char*>(buf), bufLen,
+         GetInterCharDelayMs());
 
    if (verbose_)
    {
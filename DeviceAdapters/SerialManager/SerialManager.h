@@ -155,6 +155,8 @@ private:
    int OnDTR(MM::PropertyBase* pProp, MM::ActionType eAct);
    int OnFastUSB2Serial(MM::PropertyBase* pProp, MM::ActionType eAct);
 #endif
+   double GetInterCharDelayMs() const
+   { return transmitCharWaitMs_ < 0.001 ? 0.0 : transmitCharWaitMs_; }
    void LogAsciiCommunication(const char* prefix, bool isInput, const std::string& content);
    void LogBinaryCommunication(const char* prefix, bool isInput, const unsigned char* content, std::size_t length);
 };
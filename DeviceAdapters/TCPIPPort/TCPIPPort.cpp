@@ -30,6 +30,9 @@
 
 #include "Util.h"
 
+#include <algorithm>
+#include <chrono>
+
 using boost::asio::ip::tcp;
 
 const char* deviceName = "TCP/IP serial port adapter";
@@ -42,7 +45,9 @@ TCPIPPort::TCPIPPort(int index) :
 	port_(0),
 	initialized_(false),
 	sock_(ios_),
-	answerTimeoutMs_(500)
+	answerTimeoutMs_(500),
+	noDelay_(true),
+	keepAlive_(false)
 {
 	SetErrorText(ERR_BUFFER_OVERRUN, "Buffer overrun occured during read");
 	SetErrorText(ERR_TERM_TIMEOUT, "Timeout occured during init or read");
@@ -52,10 +57,18 @@ TCPIPPort::TCPIPPort(int index) :
 	CreateProperty("Host", "127.0.0.1", MM::String, false, new CPropertyAction(this, &TCPIPPort::OnHost), true);
 	CreateProperty("TCP Port", "0", MM::Integer, false, new CPropertyAction(this, &TCPIPPort::OnPort), true);
 	CreateProperty("Answer timeout", "500", MM::Integer, false, new CPropertyAction(this, &TCPIPPort::OnAnswerTimeout), false);
+
+	CreateProperty("TCP_NODELAY", "Yes", MM::String, false, new CPropertyAction(this, &TCPIPPort::OnNoDelay), true);
+	AddAllowedValue("TCP_NODELAY", "Yes");
+	AddAllowedValue("TCP_NODELAY", "No");
+	CreateProperty("Keep alive", "No", MM::String, false, new CPropertyAction(this, &TCPIPPort::OnKeepAlive), true);
+	AddAllowedValue("Keep alive", "Yes");
+	AddAllowedValue("Keep alive", "No");
 }
 
 TCPIPPort::~TCPIPPort()
 {
+	StopIOThread();
 }
 
 bool TCPIPPort::Busy()
@@ -74,6 +87,8 @@ ERRH_START
 	if (initialized_)
 		return DEVICE_OK;
 
+	ios_.reset();
+
 	tcp::endpoint endpoint(boost::asio::ip::address::from_string(host_), port_);
 
 	tcp::resolver::iterator it = tcp::resolver(ios_).resolve(endpoint);
@@ -82,15 +97,37 @@ ERRH_START
 
 	boost::asio::deadline_timer deadline(ios_);
 	deadline.expires_from_now(boost::posix_time::millisec(answerTimeoutMs_));
-	deadline.async_wait(boost::lambda::bind(&TCPIPPort::close_sock, this));
+	deadline.async_wait([this](const boost::system::error_code& timerEc) {
+		if (!timerEc)
+			close_sock();
+	});
 	
 	boost::asio::async_connect(sock_, it, boost::lambda::var(ec) = boost::lambda::_1);
 
 	do ios_.run_one(); while (ec == boost::asio::error::would_block);
 
+	deadline.cancel();
+	ios_.poll();
+
 	if (ec || !sock_.is_open())
 		return ERR_TERM_TIMEOUT;
 
+	sock_.set_option(tcp::no_delay(noDelay_));
+	sock_.set_option(boost::asio::socket_base::keep_alive(keepAlive_));
+
+	{
+		std::lock_guard<std::mutex> lock(rxMutex_);
+		rxBuffer_.clear();
+		rxError_ = boost::system::error_code();
+		txError_ = boost::system::error_code();
+	}
+	txQueue_.clear();
+
+	ios_.reset();
+	work_.reset(new boost::asio::io_service::work(ios_));
+	StartReceive();
+	ioThread_ = std::thread([this]() { ios_.run(); });
+
 	initialized_ = true;
 
 	if (index_ == GetCount())
@@ -104,8 +141,7 @@ ERRH_START
 	if (!initialized_)
 		return DEVICE_OK;
 
-	sock_.shutdown(tcp::socket::shutdown_both);
-	sock_.close();
+	StopIOThread();
 
 	initialized_ = false;
 ERRH_END
@@ -121,6 +157,87 @@ std::string TCPIPPort::GetStringName() const
 	return to_string(deviceName) + " (" + to_string(index_) + ")";
 }
 
+void TCPIPPort::StopIOThread()
+{
+	if (!ioThread_.joinable())
+		return;
+
+	ios_.post([this]() {
+		boost::system::error_code ec;
+		sock_.shutdown(tcp::socket::shutdown_both, ec);
+		sock_.close(ec);
+	});
+	work_.reset();
+	ioThread_.join();
+}
+
+void TCPIPPort::StartReceive()
+{
+	sock_.async_read_some(boost::asio::buffer(rxChunk_, sizeof(rxChunk_)),
+		[this](const boost::system::error_code& ec, std::size_t bytes) { OnReceive(ec, bytes); });
+}
+
+// Runs on ioThread_
+void TCPIPPort::OnReceive(const boost::system::error_code& ec, std::size_t bytes)
+{
+	{
+		std::lock_guard<std::mutex> lock(rxMutex_);
+		rxBuffer_.insert(rxBuffer_.end(), rxChunk_, rxChunk_ + bytes);
+		if (ec)
+			rxError_ = ec;
+	}
+	rxCond_.notify_all();
+
+	if (!ec)
+		StartReceive();
+}
+
+// Queues the data to be written on ioThread_ (as SerialManager's AsioClient
+// does), so that the caller does not block on the socket and the socket is
+// only used from ioThread_. A failed write is reported by the next Send().
+void TCPIPPort::Send(const void* data, std::size_t len)
+{
+	{
+		std::lock_guard<std::mutex> lock(rxMutex_);
+		if (txError_)
+			throw boost::system::system_error(txError_);
+	}
+
+	std::shared_ptr<std::string> msg = std::make_shared<std::string>(
+		static_cast<const char*>(data), len);
+	ios_.post([this, msg]() {
+		bool writing = !txQueue_.empty();
+		txQueue_.push_back(msg);
+		if (!writing)
+			StartSend();
+	});
+}
+
+// Runs on ioThread_; writes the oldest queued data
+void TCPIPPort::StartSend()
+{
+	boost::asio::async_write(sock_, boost::asio::buffer(*txQueue_.front()),
+		[this](const boost::system::error_code& ec, std::size_t) { OnSent(ec); });
+}
+
+// Runs on ioThread_
+void TCPIPPort::OnSent(const boost::system::error_code& ec)
+{
+	if (ec)
+	{
+		{
+			std::lock_guard<std::mutex> lock(rxMutex_);
+			txError_ = ec;
+		}
+		txQueue_.clear();
+		return;
+	}
+
+	txQueue_.pop_front();
+	if (!txQueue_.empty())
+		StartSend();
+}
+
 MM::PortType TCPIPPort::GetPortType() const
 {
 	return MM::SerialPort;
@@ -137,13 +254,25 @@ int TCPIPPort::SetCommand(const char* command, const char* term)
 	if (term != 0)
 		cmd += term;
 
-	boost::asio::write(sock_, boost::asio::buffer(cmd));
+	Send(cmd.data(), cmd.size());
 
 	LogAsciiCommunication("SetCommand", false, cmd);
 	ERRH_END
 }
 
-//mostly copied from SerialManager.cpp (Serialport::GetAnswer)
+// Copies the first len received bytes to txt, then drops them and the
+// following skip bytes (the terminator) from the receive buffer.
+// rxMutex_ must be held.
+int TCPIPPort::TakeAnswer(std::size_t len, std::size_t skip, char* txt)
+{
+	std::copy(rxBuffer_.begin(), rxBuffer_.begin() + len, txt);
+	txt[len] = '\0';
+	rxBuffer_.erase(rxBuffer_.begin(), rxBuffer_.begin() + len + skip);
+	return DEVICE_OK;
+}
+
+// Same semantics as SerialManager.cpp (Serialport::GetAnswer), but waits on
+// the receive buffer instead of polling the socket
 int TCPIPPort::GetAnswer(char* txt, unsigned maxChars, const char* term)
 {
 ERRH_START
@@ -155,52 +284,42 @@ ERRH_START
 		LogMessage("BUFFER_OVERRUN error occured!");
 		return ERR_BUFFER_OVERRUN;
 	}
-	std::ostringstream logMsg;
-	unsigned long answerOffset = 0;
-	memset(txt, 0, maxChars);
-	char theData = 0;
-
-	MM::MMTime startTime = GetCurrentMMTime();
-	MM::MMTime answerTimeout(answerTimeoutMs_ * 1000.0);
-	MM::MMTime nonTerminatedAnswerTimeout(5.0 * 1000.0); // For bug-compatibility
-	while ((GetCurrentMMTime() - startTime) < answerTimeout)
+	txt[0] = '\0';
+
+	const std::string termStr = term ? term : "";
+	const std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+	const std::chrono::steady_clock::time_point deadline = startTime +
+		std::chrono::milliseconds(answerTimeoutMs_);
+	const std::chrono::steady_clock::time_point nonTerminatedDeadline = startTime +
+		std::chrono::seconds(5); // For bug-compatibility
+
+	std::unique_lock<std::mutex> lock(rxMutex_);
+	std::size_t searchFrom = 0;
+	for (;;)
 	{
-		boost::asio::socket_base::bytes_readable command(true);
-		sock_.io_control(command);
-		size_t bytes_readable = command.get();
-
-		if (bytes_readable > 0)
-		{
-			sock_.read_some(boost::asio::buffer(&theData, 1));
-
-			if (maxChars <= answerOffset)
-			{
-				txt[answerOffset] = '\0';
-				LogMessage("BUFFER_OVERRUN error occured!");
-				return ERR_BUFFER_OVERRUN;
-			}
-			txt[answerOffset++] = theData;
-		}
-		else
-		{
-			//Yield to other threads:
-			CDeviceUtils::SleepMs(1);
-		}
-
-		// look for the terminator, if any
-		if (term && term[0])
+		if (!termStr.empty())
 		{
-			// check for terminating sequence
-			char* termPos = strstr(txt, term);
-			if (termPos != 0) // found the terminator
+			// look for the terminator, starting where the last search left off
+			std::deque<char>::iterator termPos = std::search(rxBuffer_.begin() + searchFrom,
+				rxBuffer_.end(), termStr.begin(), termStr.end());
+			std::size_t answerLen = termPos - rxBuffer_.begin();
+			if (termPos != rxBuffer_.end() && answerLen < maxChars)
 			{
+				TakeAnswer(answerLen, termStr.size(), txt);
+				lock.unlock();
 				LogAsciiCommunication("GetAnswer", true, txt);
-
-				// erase the terminator from the answer:
-				*termPos = '\0';
-
 				return DEVICE_OK;
 			}
+			if (answerLen >= maxChars)
+			{
+				// The rest stays in the receive buffer for the next read
+				TakeAnswer(maxChars - 1, 0, txt);
+				lock.unlock();
+				LogMessage("BUFFER_OVERRUN error occured!");
+				return ERR_BUFFER_OVERRUN;
+			}
+			searchFrom = rxBuffer_.size() >= termStr.size() ?
+				rxBuffer_.size() - termStr.size() + 1 : 0;
 		}
 		else
 		{
@@ -208,23 +327,35 @@ ERRH_START
 			// TODO Make it a precondition check (immediate error) once we've made
 			// sure that no device adapter calls us without a terminator. For now,
 			// keep the behavior for the sake of bug-compatibility.
-
-			MM::MMTime elapsed = GetCurrentMMTime() - startTime;
-			if (elapsed > nonTerminatedAnswerTimeout)
+			std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+			if (now >= nonTerminatedDeadline && now < deadline)
 			{
+				TakeAnswer((std::min)(rxBuffer_.size(), (std::size_t)maxChars - 1), 0, txt);
+				lock.unlock();
 				LogAsciiCommunication("GetAnswer", true, txt);
-				long millisecs = static_cast<long>(elapsed.getMsec());
+				long millisecs = (long)std::chrono::duration_cast<std::chrono::milliseconds>(now - startTime).count();
 				LogMessage(("GetAnswer without terminator returning after " +
 					boost::lexical_cast<std::string>(millisecs) +
 					"msec").c_str(), true);
 				return DEVICE_OK;
 			}
 		}
+
+		if (rxError_)
+			throw boost::system::system_error(rxError_);
+
+		std::chrono::steady_clock::time_point wakeUp = deadline;
+		if (termStr.empty() && nonTerminatedDeadline < wakeUp)
+			wakeUp = nonTerminatedDeadline;
+		if (std::chrono::steady_clock::now() >= deadline)
+			break;
+		rxCond_.wait_until(lock, wakeUp);
 	}
 
+	lock.unlock();
 	LogMessage("TERM_TIMEOUT error occured!");
 	return ERR_TERM_TIMEOUT;
-	ERRH_END
+ERRH_END
 }
 
 int TCPIPPort::Write(const unsigned char* buf, unsigned long bufLen)
@@ -233,24 +364,29 @@ int TCPIPPort::Write(const unsigned char* buf, unsigned long bufLen)
 		if (!initialized_)
 			return ERR_PORT_NOTINITIALIZED;
 
-	boost::asio::write(sock_, boost::asio::buffer(buf, bufLen));
+	Send(buf, bufLen);
 
 	LogBinaryCommunication("Write", false, buf, bufLen);
 	ERRH_END
 }
 
+// Returns whatever has been received so far, up to bufLen bytes, without
+// waiting (like SerialManager's Read)
 int TCPIPPort::Read(unsigned char* buf, unsigned long bufLen, unsigned long& charsRead)
 {
 	ERRH_START
 		if (!initialized_)
 			return ERR_PORT_NOTINITIALIZED;
 
-	if (bufLen < 0)
-		return ERR_BUFFER_OVERRUN;
-
-	memset(buf, 0, bufLen);
+	{
+		std::lock_guard<std::mutex> lock(rxMutex_);
+		charsRead = (unsigned long)(std::min)(rxBuffer_.size(), (std::size_t)bufLen);
+		std::copy(rxBuffer_.begin(), rxBuffer_.begin() + charsRead, buf);
+		rxBuffer_.erase(rxBuffer_.begin(), rxBuffer_.begin() + charsRead);
 
-	charsRead = (unsigned long)boost::asio::read(sock_, boost::asio::buffer(buf, bufLen));
+		if (charsRead == 0 && rxError_)
+			throw boost::system::system_error(rxError_);
+	}
 
 	if (charsRead > 0)
 		LogBinaryCommunication("Read", true, buf, charsRead);
@@ -259,6 +395,8 @@ int TCPIPPort::Read(unsigned char* buf, unsigned long bufLen, unsigned long& cha
 
 int TCPIPPort::Purge()
 {
+	std::lock_guard<std::mutex> lock(rxMutex_);
+	rxBuffer_.clear();
 	return DEVICE_OK;
 }
 
@@ -320,6 +458,50 @@ int TCPIPPort::OnAnswerTimeout(MM::PropertyBase* pProp, MM::ActionType eAct)
 	return DEVICE_OK;
 }
 
+int TCPIPPort::OnNoDelay(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+	if (eAct == MM::BeforeGet)
+	{
+		pProp->Set(noDelay_ ? "Yes" : "No");
+	}
+	else if (eAct == MM::AfterSet)
+	{
+		if (initialized_)
+		{
+			// revert
+			pProp->Set(noDelay_ ? "Yes" : "No");
+			return ERR_PORT_CHANGE_FORBIDDEN;
+		}
+		std::string s;
+		pProp->Get(s);
+		noDelay_ = (s == "Yes");
+	}
+
+	return DEVICE_OK;
+}
+
+int TCPIPPort::OnKeepAlive(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+	if (eAct == MM::BeforeGet)
+	{
+		pProp->Set(keepAlive_ ? "Yes" : "No");
+	}
+	else if (eAct == MM::AfterSet)
+	{
+		if (initialized_)
+		{
+			// revert
+			pProp->Set(keepAlive_ ? "Yes" : "No");
+			return ERR_PORT_CHANGE_FORBIDDEN;
+		}
+		std::string s;
+		pProp->Get(s);
+		keepAlive_ = (s == "Yes");
+	}
+
+	return DEVICE_OK;
+}
+
 int TCPIPPort::GetCount()
 {
 	return count_;
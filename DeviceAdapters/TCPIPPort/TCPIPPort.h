@@ -25,7 +25,13 @@
 
 #include "boost/asio.hpp"
 
+#include <condition_variable>
+#include <deque>
 #include <istream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
 
 #include "MMDevice.h"
 #include "DeviceBase.h"
@@ -67,6 +73,8 @@ public:
 	int OnHost(MM::PropertyBase* pProp, MM::ActionType eAct);
 	int OnPort(MM::PropertyBase* pProp, MM::ActionType eAct);
 	int OnAnswerTimeout(MM::PropertyBase* pProp, MM::ActionType eAct);
+	int OnNoDelay(MM::PropertyBase* pProp, MM::ActionType eAct);
+	int OnKeepAlive(MM::PropertyBase* pProp, MM::ActionType eAct);
 
 	void close_sock();
 
@@ -84,6 +92,29 @@ private:
 	std::string host_;
 	unsigned short port_;
 	unsigned int answerTimeoutMs_;
+	bool noDelay_;
+	bool keepAlive_;
+
+	// After Initialize(), received data is collected in rxBuffer_ by a
+	// continuous async_read_some loop running on ioThread_, and data to send
+	// is queued to ioThread_, which writes it out in order.
+	std::thread ioThread_;
+	std::unique_ptr<boost::asio::io_service::work> work_;
+	std::mutex rxMutex_;
+	std::condition_variable rxCond_;
+	std::deque<char> rxBuffer_;
+	boost::system::error_code rxError_;
+	boost::system::error_code txError_; // Guarded by rxMutex_
+	char rxChunk_[4096];
+	std::deque<std::shared_ptr<std::string> > txQueue_; // Only used on ioThread_
+
+	void StartReceive();
+	void OnReceive(const boost::system::error_code& ec, std::size_t bytes);
+	void Send(const void* data, std::size_t len);
+	void StartSend();
+	void OnSent(const boost::system::error_code& ec);
+	void StopIOThread();
+	int TakeAnswer(std::size_t len, std::size_t skip, char* txt);
 
 	void LogAsciiCommunication(const char * prefix, bool isInput, const std::string & data);
 	void LogBinaryCommunication(const char* prefix, bool isInput, const unsigned char* content, std::size_t length);
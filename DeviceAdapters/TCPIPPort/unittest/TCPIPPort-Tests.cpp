@@ -0,0 +1,152 @@
+#include <gtest/gtest.h>
+
+#include "TCPIPPort.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using boost::asio::ip::tcp;
+
+namespace
+{
+	// Echoes everything it receives, on its own thread, to one client
+	class EchoServer
+	{
+	public:
+		EchoServer() :
+			acceptor_(ios_, tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0)),
+			socket_(ios_)
+		{
+			thread_ = std::thread([this]() {
+				boost::system::error_code ec;
+				acceptor_.accept(socket_, ec);
+				char buf[4096];
+				while (!ec)
+				{
+					std::size_t n = socket_.read_some(boost::asio::buffer(buf), ec);
+					if (!ec)
+						boost::asio::write(socket_, boost::asio::buffer(buf, n), ec);
+				}
+			});
+		}
+
+		~EchoServer()
+		{
+			thread_.join();
+		}
+
+		unsigned short Port() const { return acceptor_.local_endpoint().port(); }
+
+	private:
+		boost::asio::io_service ios_;
+		tcp::acceptor acceptor_;
+		tcp::socket socket_;
+		std::thread thread_;
+	};
+
+	class TCPIPPortTests : public ::testing::Test
+	{
+	protected:
+		TCPIPPortTests() : port_(1) {}
+
+		void SetUp()
+		{
+			ASSERT_EQ(DEVICE_OK, port_.SetProperty("TCP Port",
+				std::to_string(server_.Port()).c_str()));
+			ASSERT_EQ(DEVICE_OK, port_.Initialize());
+		}
+
+		void TearDown()
+		{
+			port_.Shutdown();
+		}
+
+		EchoServer server_;
+		TCPIPPort port_;
+	};
+}
+
+TEST_F(TCPIPPortTests, AnswersAreSplitAtTheTerminator)
+{
+	char answer[256];
+	ASSERT_EQ(DEVICE_OK, port_.SetCommand("hello", "\r\n"));
+	ASSERT_EQ(DEVICE_OK, port_.GetAnswer(answer, sizeof(answer), "\r\n"));
+	EXPECT_STREQ("hello", answer);
+
+	ASSERT_EQ(DEVICE_OK, port_.SetCommand("a\r\nb", "\r\n"));
+	ASSERT_EQ(DEVICE_OK, port_.GetAnswer(answer, sizeof(answer), "\r\n"));
+	EXPECT_STREQ("a", answer);
+	ASSERT_EQ(DEVICE_OK, port_.GetAnswer(answer, sizeof(answer), "\r\n"));
+	EXPECT_STREQ("b", answer);
+}
+
+TEST_F(TCPIPPortTests, MissingAnswerTimesOut)
+{
+	ASSERT_EQ(DEVICE_OK, port_.SetProperty("Answer timeout", "50"));
+	char answer[256];
+	EXPECT_EQ(ERR_TERM_TIMEOUT, port_.GetAnswer(answer, sizeof(answer), "\r"));
+}
+
+TEST_F(TCPIPPortTests, OverrunKeepsTheRestOfTheAnswer)
+{
+	char answer[4];
+	ASSERT_EQ(DEVICE_OK, port_.SetCommand("abcdef", "\r"));
+	EXPECT_EQ(ERR_BUFFER_OVERRUN, port_.GetAnswer(answer, sizeof(answer), "\r"));
+	EXPECT_STREQ("abc", answer);
+	ASSERT_EQ(DEVICE_OK, port_.GetAnswer(answer, sizeof(answer), "\r"));
+	EXPECT_STREQ("def", answer);
+}
+
+TEST_F(TCPIPPortTests, QueuedWritesKeepTheirOrder)
+{
+	std::string sent;
+	for (int i = 0; i < 1000; ++i)
+	{
+		std::string chunk = std::to_string(i) + ",";
+		ASSERT_EQ(DEVICE_OK, port_.Write(
+			reinterpret_cast<const unsigned char*>(chunk.data()), chunk.size()));
+		sent += chunk;
+	}
+
+	std::string received;
+	const std::chrono::steady_clock::time_point deadline =
+		std::chrono::steady_clock::now() + std::chrono::seconds(5);
+	while (received.size() < sent.size() && std::chrono::steady_clock::now() < deadline)
+	{
+		unsigned char buf[4096];
+		unsigned long n;
+		ASSERT_EQ(DEVICE_OK, port_.Read(buf, sizeof(buf), n));
+		received.append(reinterpret_cast<const char*>(buf), n);
+		if (n == 0)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	EXPECT_EQ(sent, received);
+}
+
+// Not a pass/fail check; reports the command/answer round trip time
+TEST_F(TCPIPPortTests, RoundTripLatency)
+{
+	std::vector<double> us;
+	char answer[256];
+	for (int i = 0; i < 2000; ++i)
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		ASSERT_EQ(DEVICE_OK, port_.SetCommand("?POS", "\r"));
+		ASSERT_EQ(DEVICE_OK, port_.GetAnswer(answer, sizeof(answer), "\r"));
+		us.push_back(std::chrono::duration<double, std::micro>(
+			std::chrono::steady_clock::now() - start).count());
+	}
+	std::sort(us.begin(), us.end());
+	std::cout << "Round trip: median " << us[us.size() / 2] << " us, 99th percentile " <<
+		us[us.size() * 99 / 100] << " us" << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+	::testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
@@ -187,6 +187,7 @@ public:
    int SendDASequence();
    int ClearDASequence();
    int AddToDASequence(double voltage);
+   int AddArrayToDASequence(const double* voltages, long count);
 
    int OnVolts(MM::PropertyBase* pProp, MM::ActionType eAct);
    int OnVoltRange(MM::PropertyBase* pProp, MM::ActionType eAct);
@@ -480,3 +480,12 @@ int CTriggerScopeMMDAC::AddToDASequence(double voltage)
 
    return DEVICE_OK;
 }
+
+int CTriggerScopeMMDAC::AddArrayToDASequence(const double* voltages, long count)
+{
+   if (count < 0 || (long)sequence_.size() + count > nrEvents_)
+      return DEVICE_SEQUENCE_TOO_LARGE;
+
+   sequence_.insert(sequence_.end(), voltages, voltages + count);
+   return DEVICE_OK;
+}
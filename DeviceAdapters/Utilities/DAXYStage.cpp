@@ -448,15 +448,9 @@ int DAXYStage::ClearXYStageSequence()
    return DEVICE_OK;
 }
 
-int DAXYStage::AddToXYStageSequence(double positionX, double positionY)
+void DAXYStage::SequenceVoltages(double positionX, double positionY,
+      double& voltageX, double& voltageY) const
 {
-   MM::SignalIO* da_x = (MM::SignalIO*)GetDevice(DADeviceNameX_.c_str());
-   MM::SignalIO* da_y = (MM::SignalIO*)GetDevice(DADeviceNameY_.c_str());
-   if (da_x == 0 || da_y == 0)
-      return ERR_NO_DA_DEVICE;
-
-   double voltageX, voltageY;
-
    voltageX = ((positionX + originPosX_) / (maxStagePosX_ - minStagePosX_)) *
       (maxStageVoltX_ - minStageVoltX_);
    if (voltageX > maxStageVoltX_)
@@ -470,6 +464,17 @@ int DAXYStage::AddToXYStageSequence(double positionX, double positionY)
       voltageY = maxStageVoltY_;
    else if (voltageY < minStageVoltY_)
       voltageY = minStageVoltY_;
+}
+
+int DAXYStage::AddToXYStageSequence(double positionX, double positionY)
+{
+   MM::SignalIO* da_x = (MM::SignalIO*)GetDevice(DADeviceNameX_.c_str());
+   MM::SignalIO* da_y = (MM::SignalIO*)GetDevice(DADeviceNameY_.c_str());
+   if (da_x == 0 || da_y == 0)
+      return ERR_NO_DA_DEVICE;
+
+   double voltageX, voltageY;
+   SequenceVoltages(positionX, positionY, voltageX, voltageY);
 
    int ret = da_x->AddToDASequence(voltageX);
    if (ret != DEVICE_OK) return ret;
@@ -480,6 +485,24 @@ int DAXYStage::AddToXYStageSequence(double positionX, double positionY)
    return DEVICE_OK;
 }
 
+int DAXYStage::AddArrayToXYStageSequence(const double* positionsX,
+      const double* positionsY, long count)
+{
+   MM::SignalIO* da_x = (MM::SignalIO*)GetDevice(DADeviceNameX_.c_str());
+   MM::SignalIO* da_y = (MM::SignalIO*)GetDevice(DADeviceNameY_.c_str());
+   if (da_x == 0 || da_y == 0)
+      return ERR_NO_DA_DEVICE;
+
+   std::vector<double> voltagesX(count), voltagesY(count);
+   for (long i = 0; i < count; ++i)
+      SequenceVoltages(positionsX[i], positionsY[i], voltagesX[i], voltagesY[i]);
+
+   int ret = da_x->AddArrayToDASequence(voltagesX.data(), count);
+   if (ret != DEVICE_OK) return ret;
+
+   return da_y->AddArrayToDASequence(voltagesY.data(), count);
+}
+
 int DAXYStage::SendXYStageSequence()
 {
    MM::SignalIO* da_x = (MM::SignalIO*)GetDevice(DADeviceNameX_.c_str());
@@ -315,20 +315,37 @@ int DAZStage::ClearStageSequence()
    return da->ClearDASequence();
 }
 
-int DAZStage::AddToStageSequence(double pos)
+double DAZStage::SequenceVoltage(double pos) const
 {
-   MM::SignalIO* da = (MM::SignalIO*)GetDevice(DADeviceName_.c_str());
-   if (da == 0)
-      return ERR_NO_DA_DEVICE;
-
    double voltage = (pos - minStagePos_) / (maxStagePos_ - minStagePos_) * (maxStageVolt_ - minStageVolt_) + minStageVolt_;
 
    if (voltage > maxStageVolt_)
       voltage = maxStageVolt_;
    else if (voltage < minStageVolt_)
       voltage = minStageVolt_;
+   return voltage;
+}
+
+int DAZStage::AddToStageSequence(double pos)
+{
+   MM::SignalIO* da = (MM::SignalIO*)GetDevice(DADeviceName_.c_str());
+   if (da == 0)
+      return ERR_NO_DA_DEVICE;
+
+   return da->AddToDASequence(SequenceVoltage(pos));
+}
+
+int DAZStage::AddArrayToStageSequence(const double* positions, long count)
+{
+   MM::SignalIO* da = (MM::SignalIO*)GetDevice(DADeviceName_.c_str());
+   if (da == 0)
+      return ERR_NO_DA_DEVICE;
+
+   std::vector<double> voltages(count);
+   for (long i = 0; i < count; ++i)
+      voltages[i] = SequenceVoltage(positions[i]);
 
-   return da->AddToDASequence(voltage);
+   return da->AddArrayToDASequence(voltages.data(), count);
 }
 
 int DAZStage::SendStageSequence()
@@ -0,0 +1,981 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          ImageAutoFocus.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Image-based autofocus that moves a focus stage and snaps
+//                images with a camera, maximizing a focus metric.
+//
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+//
+
+#ifdef _WIN32
+// Prevent windows.h from defining min and max macros,
+// which clash with std::min and std::max.
+#define NOMINMAX
+#endif
+
+#include "Utilities.h"
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <deque>
+#include <functional>
+#include <future>
+#include <sstream>
+#include <thread>
+
+extern const char* g_DeviceNameImageAutoFocus;
+extern const char* g_Undefined;
+
+/**
+ * A fixed set of threads that run posted tasks, so that scoring each image
+ * does not start threads of its own.
+ */
+class FocusMetricWorkers
+{
+public:
+   explicit FocusMetricWorkers(unsigned count) : quit_(false)
+   {
+      for (unsigned i = 0; i < count; ++i)
+         threads_.push_back(std::thread([this]() { Run(); }));
+   }
+
+   ~FocusMetricWorkers()
+   {
+      {
+         std::lock_guard<std::mutex> lock(mutex_);
+         quit_ = true;
+      }
+      wake_.notify_all();
+      for (std::thread& thread : threads_)
+         thread.join();
+   }
+
+   unsigned Count() const { return static_cast<unsigned>(threads_.size()); }
+
+   template <typename F>
+   std::future<typename std::result_of<F()>::type> Post(F f)
+   {
+      typedef typename std::result_of<F()>::type Result;
+      std::shared_ptr<std::packaged_task<Result()> > task =
+         std::make_shared<std::packaged_task<Result()> >(std::move(f));
+      std::future<Result> result = task->get_future();
+      {
+         std::lock_guard<std::mutex> lock(mutex_);
+         tasks_.push_back([task]() { (*task)(); });
+      }
+      wake_.notify_one();
+      return result;
+   }
+
+private:
+   void Run()
+   {
+      for (;;)
+      {
+         std::function<void()> task;
+         {
+            std::unique_lock<std::mutex> lock(mutex_);
+            wake_.wait(lock, [this]() { return quit_ || !tasks_.empty(); });
+            if (tasks_.empty())
+               return;
+            task = std::move(tasks_.front());
+            tasks_.pop_front();
+         }
+         task();
+      }
+   }
+
+   std::mutex mutex_;
+   std::condition_variable wake_;
+   std::deque<std::function<void()> > tasks_;
+   bool quit_;
+   std::vector<std::thread> threads_;
+};
+
+namespace {
+
+const char* const g_PropCamera = "Camera";
+const char* const g_PropFocusStage = "Focus Stage";
+const char* const g_PropMetric = "Metric";
+const char* const g_PropSearchRange = "Search Range(um)";
+const char* const g_PropCoarseStep = "Coarse Step(um)";
+const char* const g_PropFineStep = "Fine Step(um)";
+const char* const g_PropThreads = "Threads";
+const char* const g_PropBandLow = "FFT Band Low(fraction of Nyquist)";
+const char* const g_PropBandHigh = "FFT Band High(fraction of Nyquist)";
+const char* const g_PropLastTimings = "Last Search Timings";
+
+enum FocusMetric
+{
+   NormalizedVariance,
+   Brenner,
+   Tenengrad,
+   FFTBandPass,
+};
+
+const char* const g_MetricNames[] = {
+   "Normalized Variance",
+   "Brenner",
+   "Tenengrad",
+   "FFT Band-Pass",
+};
+
+const unsigned maxFFTSize = 512;
+const long maxSearchSteps = 1000;
+
+double MsSince(std::chrono::steady_clock::time_point start)
+{
+   return std::chrono::duration<double, std::milli>(
+         std::chrono::steady_clock::now() - start).count();
+}
+
+// Sums f(firstRow, endRow) over stripes of rows, one stripe per thread:
+// the first on the calling thread, the others on the workers (of which one
+// may be busy with the calling thread, when scoring in the background)
+template <typename F>
+double ParallelSum(unsigned rows, FocusMetricWorkers& workers, F f)
+{
+   const unsigned threads = std::max(1u, std::min(workers.Count(), rows));
+   if (threads == 1)
+      return f(0, rows);
+
+   std::vector<std::future<double> > partial;
+   const unsigned stripe = (rows + threads - 1) / threads;
+   for (unsigned t = 1; t < threads; ++t)
+   {
+      const unsigned first = std::min(rows, t * stripe);
+      const unsigned end = std::min(rows, first + stripe);
+      partial.push_back(workers.Post([&f, first, end]() { return f(first, end); }));
+   }
+   double sum = f(0, std::min(rows, stripe));
+   for (std::future<double>& p : partial)
+      sum += p.get();
+   return sum;
+}
+
+// The inner loops below are written without branches or cross-iteration
+// dependencies (other than the float reductions) so that the compiler can
+// vectorize them.
+
+double NormalizedVarianceScore(const float* img, unsigned w, unsigned h,
+      FocusMetricWorkers& workers)
+{
+   const double n = static_cast<double>(w) * h;
+   const double sum = ParallelSum(h, workers, [=](unsigned r0, unsigned r1)
+   {
+      double s = 0.0;
+      for (unsigned y = r0; y < r1; ++y)
+      {
+         const float* row = img + static_cast<std::size_t>(y) * w;
+         float rowSum = 0.0f;
+         for (unsigned x = 0; x < w; ++x)
+            rowSum += row[x];
+         s += rowSum;
+      }
+      return s;
+   });
+   const double mean = sum / n;
+   if (mean <= 0.0)
+      return 0.0;
+   const float m = static_cast<float>(mean);
+   const double ss = ParallelSum(h, workers, [=](unsigned r0, unsigned r1)
+   {
+      double s = 0.0;
+      for (unsigned y = r0; y < r1; ++y)
+      {
+         const float* row = img + static_cast<std::size_t>(y) * w;
+         float rowSum = 0.0f;
+         for (unsigned x = 0; x < w; ++x)
+         {
+            const float d = row[x] - m;
+            rowSum += d * d;
+         }
+         s += rowSum;
+      }
+      return s;
+   });
+   return ss / (n * mean);
+}
+
+double BrennerScore(const float* img, unsigned w, unsigned h,
+      FocusMetricWorkers& workers)
+{
+   if (w < 3)
+      return 0.0;
+   const double sum = ParallelSum(h, workers, [=](unsigned r0, unsigned r1)
+   {
+      double s = 0.0;
+      for (unsigned y = r0; y < r1; ++y)
+      {
+         const float* row = img + static_cast<std::size_t>(y) * w;
+         float rowSum = 0.0f;
+         for (unsigned x = 0; x + 2 < w; ++x)
+         {
+            const float d = row[x + 2] - row[x];
+            rowSum += d * d;
+         }
+         s += rowSum;
+      }
+      return s;
+   });
+   return sum / (static_cast<double>(w - 2) * h);
+}
+
+double TenengradScore(const float* img, unsigned w, unsigned h,
+      FocusMetricWorkers& workers)
+{
+   if (w < 3 || h < 3)
+      return 0.0;
+   const double sum = ParallelSum(h - 2, workers, [=](unsigned r0, unsigned r1)
+   {
+      double s = 0.0;
+      for (unsigned y = r0 + 1; y < r1 + 1; ++y)
+      {
+         const float* above = img + static_cast<std::size_t>(y - 1) * w;
+         const float* row = above + w;
+         const float* below = row + w;
+         float rowSum = 0.0f;
+         for (unsigned x = 1; x + 1 < w; ++x)
+         {
+            // Sobel operator
+            const float gx = (above[x + 1] + 2.0f * row[x + 1] + below[x + 1]) -
+               (above[x - 1] + 2.0f * row[x - 1] + below[x - 1]);
+            const float gy = (below[x - 1] + 2.0f * below[x] + below[x + 1]) -
+               (above[x - 1] + 2.0f * above[x] + above[x + 1]);
+            rowSum += gx * gx + gy * gy;
+         }
+         s += rowSum;
+      }
+      return s;
+   });
+   return sum / (static_cast<double>(w - 2) * (h - 2));
+}
+
+// In-place iterative radix-2 FFT of n (a power of 2) values at the given
+// stride
+void FFT(std::complex<float>* data, unsigned n, unsigned stride)
+{
+   for (unsigned i = 1, j = 0; i < n; ++i)
+   {
+      unsigned bit = n >> 1;
+      for (; j & bit; bit >>= 1)
+         j ^= bit;
+      j ^= bit;
+      if (i < j)
+         std::swap(data[i * stride], data[j * stride]);
+   }
+   const double pi = 3.14159265358979323846;
+   for (unsigned len = 2; len <= n; len <<= 1)
+   {
+      const double angle = -2.0 * pi / len;
+      const std::complex<float> wlen(static_cast<float>(std::cos(angle)),
+            static_cast<float>(std::sin(angle)));
+      for (unsigned i = 0; i < n; i += len)
+      {
+         std::complex<float> wk(1.0f, 0.0f);
+         for (unsigned k = 0; k < len / 2; ++k)
+         {
+            std::complex<float>& a = data[(i + k) * stride];
+            std::complex<float>& b = data[(i + k + len / 2) * stride];
+            const std::complex<float> t = b * wk;
+            b = a - t;
+            a += t;
+            wk *= wlen;
+         }
+      }
+   }
+}
+
+// Fraction of the (non-DC) spectral power of a centered square crop that
+// lies in the given band of radial frequencies
+double FFTBandPassScore(const float* img, unsigned w, unsigned h,
+      FocusMetricWorkers& workers, double bandLow, double bandHigh)
+{
+   unsigned n = 1;
+   while (n * 2 <= std::min(std::min(w, h), maxFFTSize))
+      n *= 2;
+   if (n < 8)
+      return 0.0;
+
+   const unsigned x0 = (w - n) / 2;
+   const unsigned y0 = (h - n) / 2;
+   std::vector<std::complex<float> > spectrum(static_cast<std::size_t>(n) * n);
+   std::complex<float>* data = &spectrum[0];
+   ParallelSum(n, workers, [=](unsigned r0, unsigned r1)
+   {
+      for (unsigned y = r0; y < r1; ++y)
+      {
+         const float* row = img + static_cast<std::size_t>(y0 + y) * w + x0;
+         std::complex<float>* out = data + static_cast<std::size_t>(y) * n;
+         for (unsigned x = 0; x < n; ++x)
+            out[x] = row[x];
+         FFT(out, n, 1);
+      }
+      return 0.0;
+   });
+   ParallelSum(n, workers, [=](unsigned c0, unsigned c1)
+   {
+      for (unsigned x = c0; x < c1; ++x)
+         FFT(data + x, n, n);
+      return 0.0;
+   });
+
+   const double nyquist = n / 2;
+   const double low2 = bandLow * nyquist * bandLow * nyquist;
+   const double high2 = bandHigh * nyquist * bandHigh * nyquist;
+   double band = 0.0;
+   double total = 0.0;
+   for (unsigned y = 0; y < n; ++y)
+   {
+      const double fy = y < n / 2 ? y : static_cast<double>(y) - n;
+      for (unsigned x = 0; x < n; ++x)
+      {
+         if (x == 0 && y == 0)
+            continue;
+         const double fx = x < n / 2 ? x : static_cast<double>(x) - n;
+         const double r2 = fx * fx + fy * fy;
+         const double power = std::norm(spectrum[static_cast<std::size_t>(y) * n + x]);
+         total += power;
+         if (r2 >= low2 && r2 <= high2)
+            band += power;
+      }
+   }
+   return total > 0.0 ? band / total : 0.0;
+}
+
+// Vertex of the parabola through three equally spaced samples around the
+// middle one, limited to the sampled interval
+double ParabolicPeak(double z, double step, double before, double at, double after)
+{
+   const double curvature = before - 2.0 * at + after;
+   if (curvature >= 0.0)
+      return z;
+   const double shift = 0.5 * step * (before - after) / curvature;
+   return z + std::max(-step, std::min(step, shift));
+}
+
+} // anonymous namespace
+
+
+ImageAutoFocus::ImageAutoFocus() :
+   cameraName_(g_Undefined),
+   stageName_(g_Undefined),
+   metric_(NormalizedVariance),
+   searchRange_(20.0),
+   coarseStep_(2.0),
+   fineStep_(0.25),
+   threads_(std::max(1u, std::thread::hardware_concurrency())),
+   bandLow_(0.05),
+   bandHigh_(0.5),
+   offset_(0.0),
+   lastScore_(0.0),
+   initialized_(false)
+{
+   InitializeDefaultErrorMessages();
+
+   SetErrorText(ERR_INVALID_DEVICE_NAME, "Please select a valid camera and focus stage");
+   SetErrorText(ERR_NO_PHYSICAL_CAMERA, "No camera selected");
+   SetErrorText(ERR_NO_PHYSICAL_STAGE, "No focus stage selected");
+   SetErrorText(ERR_AUTOFOCUS_NOT_SUPPORTED, "Continuous focusing is not supported");
+   SetErrorText(ERR_INVALID_FOCUS_SEARCH, "Search range and steps must be positive, with the fine step smaller than the coarse step");
+   SetErrorText(ERR_TIMEOUT, "Timed out waiting for the focus stage");
+
+   // Name
+   CreateProperty(MM::g_Keyword_Name, g_DeviceNameImageAutoFocus, MM::String, true);
+
+   // Description
+   CreateProperty(MM::g_Keyword_Description, "Image-based autofocus using a camera and a focus stage", MM::String, true);
+}
+
+ImageAutoFocus::~ImageAutoFocus()
+{
+}
+
+void ImageAutoFocus::GetName(char* name) const
+{
+   CDeviceUtils::CopyLimitedString(name, g_DeviceNameImageAutoFocus);
+}
+
+int ImageAutoFocus::Initialize()
+{
+   char deviceName[MM::MaxStrLength];
+   availableCameras_.clear();
+   availableStages_.clear();
+   unsigned int deviceIterator = 0;
+   for (;;)
+   {
+      GetLoadedDeviceOfType(MM::CameraDevice, deviceName, deviceIterator++);
+      if (0 < strlen(deviceName))
+         availableCameras_.push_back(std::string(deviceName));
+      else
+         break;
+   }
+   deviceIterator = 0;
+   for (;;)
+   {
+      GetLoadedDeviceOfType(MM::StageDevice, deviceName, deviceIterator++);
+      if (0 < strlen(deviceName))
+         availableStages_.push_back(std::string(deviceName));
+      else
+         break;
+   }
+   availableCameras_.push_back(g_Undefined);
+   availableStages_.push_back(g_Undefined);
+
+   CPropertyAction* pAct = new CPropertyAction(this, &ImageAutoFocus::OnCamera);
+   CreateProperty(g_PropCamera, availableCameras_[0].c_str(), MM::String, false, pAct);
+   SetAllowedValues(g_PropCamera, availableCameras_);
+   cameraName_ = availableCameras_[0];
+
+   pAct = new CPropertyAction(this, &ImageAutoFocus::OnFocusStage);
+   CreateProperty(g_PropFocusStage, availableStages_[0].c_str(), MM::String, false, pAct);
+   SetAllowedValues(g_PropFocusStage, availableStages_);
+   stageName_ = availableStages_[0];
+
+   pAct = new CPropertyAction(this, &ImageAutoFocus::OnMetric);
+   CreateProperty(g_PropMetric, g_MetricNames[metric_], MM::String, false, pAct);
+   for (const char* name : g_MetricNames)
+      AddAllowedValue(g_PropMetric, name);
+
+   pAct = new CPropertyAction(this, &ImageAutoFocus::OnSearchRange);
+   CreateFloatProperty(g_PropSearchRange, searchRange_, false, pAct);
+   pAct = new CPropertyAction(this, &ImageAutoFocus::OnCoarseStep);
+   CreateFloatProperty(g_PropCoarseStep, coarseStep_, false, pAct);
+   pAct = new CPropertyAction(this, &ImageAutoFocus::OnFineStep);
+   CreateFloatProperty(g_PropFineStep, fineStep_, false, pAct);
+
+   pAct = new CPropertyAction(this, &ImageAutoFocus::OnThreads);
+   CreateIntegerProperty(g_PropThreads, threads_, false, pAct);
+   SetPropertyLimits(g_PropThreads, 1, 64);
+
+   pAct = new CPropertyAction(this, &ImageAutoFocus::OnBandLow);
+   CreateFloatProperty(g_PropBandLow, bandLow_, false, pAct);
+   SetPropertyLimits(g_PropBandLow, 0.0, 1.0);
+   pAct = new CPropertyAction(this, &ImageAutoFocus::OnBandHigh);
+   CreateFloatProperty(g_PropBandHigh, bandHigh_, false, pAct);
+   SetPropertyLimits(g_PropBandHigh, 0.0, 1.0);
+
+   pAct = new CPropertyAction(this, &ImageAutoFocus::OnLastTimings);
+   CreateStringProperty(g_PropLastTimings, "", true, pAct);
+
+   int ret = UpdateStatus();
+   if (ret != DEVICE_OK)
+      return ret;
+
+   initialized_ = true;
+   return DEVICE_OK;
+}
+
+int ImageAutoFocus::Shutdown()
+{
+   workers_.reset();
+   initialized_ = false;
+   return DEVICE_OK;
+}
+
+int ImageAutoFocus::SetContinuousFocusing(bool state)
+{
+   return state ? ERR_AUTOFOCUS_NOT_SUPPORTED : DEVICE_OK;
+}
+
+/**
+ * Scans the search range around the current position with the coarse step,
+ * then the neighborhood of the best coarse position with the fine step,
+ * refining each peak by parabolic interpolation, and moves to the result
+ * (plus the offset).
+ */
+int ImageAutoFocus::FullFocus()
+{
+   if (searchRange_ <= 0.0 || coarseStep_ <= 0.0 || fineStep_ <= 0.0 ||
+         fineStep_ > coarseStep_)
+      return ERR_INVALID_FOCUS_SEARCH;
+
+   MM::Stage* stage = (MM::Stage*)GetDevice(stageName_.c_str());
+   if (stage == 0)
+      return ERR_NO_PHYSICAL_STAGE;
+   double start;
+   int ret = stage->GetPositionUm(start);
+   if (ret != DEVICE_OK)
+      return ret;
+
+   StartWorkers();
+   const auto t0 = std::chrono::steady_clock::now();
+   std::vector<Step> steps;
+   double coarseZ, coarseScore;
+   ret = Search(start, searchRange_ / 2.0, coarseStep_, steps, coarseZ, coarseScore);
+   double bestZ, bestScore;
+   if (ret == DEVICE_OK)
+      ret = Search(coarseZ, coarseStep_, fineStep_, steps, bestZ, bestScore);
+   if (ret != DEVICE_OK)
+   {
+      MoveTo(start);
+      return ret;
+   }
+
+   ret = MoveTo(bestZ + offset_);
+   if (ret != DEVICE_OK)
+      return ret;
+   lastScore_ = bestScore;
+   ReportTimings("Full focus", steps, MsSince(t0));
+
+   std::ostringstream os;
+   os << "Focus found at " << bestZ << " um (score " << bestScore << ")";
+   LogMessage(os.str().c_str());
+   return DEVICE_OK;
+}
+
+/**
+ * Fine search only, around the current position.
+ */
+int ImageAutoFocus::IncrementalFocus()
+{
+   if (coarseStep_ <= 0.0 || fineStep_ <= 0.0 || fineStep_ > coarseStep_)
+      return ERR_INVALID_FOCUS_SEARCH;
+
+   MM::Stage* stage = (MM::Stage*)GetDevice(stageName_.c_str());
+   if (stage == 0)
+      return ERR_NO_PHYSICAL_STAGE;
+   double start;
+   int ret = stage->GetPositionUm(start);
+   if (ret != DEVICE_OK)
+      return ret;
+
+   StartWorkers();
+   const auto t0 = std::chrono::steady_clock::now();
+   std::vector<Step> steps;
+   double bestZ, bestScore;
+   ret = Search(start - offset_, coarseStep_, fineStep_, steps, bestZ, bestScore);
+   if (ret != DEVICE_OK)
+   {
+      MoveTo(start);
+      return ret;
+   }
+   ret = MoveTo(bestZ + offset_);
+   if (ret != DEVICE_OK)
+      return ret;
+   lastScore_ = bestScore;
+   ReportTimings("Incremental focus", steps, MsSince(t0));
+   return DEVICE_OK;
+}
+
+int ImageAutoFocus::GetCurrentFocusScore(double& score)
+{
+   MM::Shutter* shutter;
+   int ret = OpenCoreShutter(shutter);
+   if (ret != DEVICE_OK)
+      return ret;
+   std::vector<float> frame;
+   unsigned width, height;
+   ret = SnapFrame(frame, width, height);
+   if (shutter != 0)
+   {
+      int closeRet = shutter->SetOpen(false);
+      if (ret == DEVICE_OK)
+         ret = closeRet;
+   }
+   if (ret != DEVICE_OK)
+      return ret;
+   StartWorkers();
+   score = Score(frame, width, height);
+   return DEVICE_OK;
+}
+
+/**
+ * Scores positions center - halfRange to center + halfRange at the given
+ * step. Each image is scored (on the workers) while the stage moves to the
+ * next position and the next image is snapped. The Core's shutter is kept
+ * open meanwhile, if it would be opened for snapping.
+ */
+int ImageAutoFocus::Search(double center, double halfRange, double step,
+      std::vector<Step>& steps, double& bestZ, double& bestScore)
+{
+   const long n = std::min(maxSearchSteps,
+         2 * static_cast<long>(std::floor(halfRange / step + 1e-9)) + 1);
+   const std::size_t first = steps.size();
+   // No reallocation while a pending metric holds a pointer into steps
+   steps.reserve(first + n);
+   std::vector<float> frames[2];
+   unsigned width = 0, height = 0;
+   std::future<double> pending;
+   std::size_t pendingStep = 0;
+
+   MM::Shutter* shutter;
+   int ret = OpenCoreShutter(shutter);
+   for (long i = 0; i < n && ret == DEVICE_OK; ++i)
+   {
+      Step s;
+      s.z = center + (i - (n - 1) / 2) * step;
+      s.score = 0.0;
+      s.metricMs = 0.0;
+
+      auto t = std::chrono::steady_clock::now();
+      ret = MoveTo(s.z);
+      s.moveMs = MsSince(t);
+      if (ret != DEVICE_OK)
+         break;
+
+      // The buffer not being scored by the pending task
+      std::vector<float>& frame = frames[i % 2];
+      t = std::chrono::steady_clock::now();
+      ret = SnapFrame(frame, width, height);
+      s.snapMs = MsSince(t);
+      if (ret != DEVICE_OK)
+         break;
+
+      if (pending.valid())
+         steps[pendingStep].score = pending.get();
+      steps.push_back(s);
+      pendingStep = steps.size() - 1;
+      Step* target = &steps.back();
+      pending = workers_->Post([this, &frame, width, height, target]()
+      {
+         auto start = std::chrono::steady_clock::now();
+         double score = Score(frame, width, height);
+         target->metricMs = MsSince(start);
+         return score;
+      });
+   }
+   if (pending.valid())
+      steps[pendingStep].score = pending.get();
+   if (shutter != 0)
+   {
+      int closeRet = shutter->SetOpen(false);
+      if (ret == DEVICE_OK)
+         ret = closeRet;
+   }
+   if (ret != DEVICE_OK)
+      return ret;
+
+   std::size_t best = first;
+   for (std::size_t i = first; i < steps.size(); ++i)
+   {
+      if (steps[i].score > steps[best].score)
+         best = i;
+   }
+   bestScore = steps[best].score;
+   bestZ = steps[best].z;
+   if (best > first && best + 1 < steps.size())
+   {
+      bestZ = ParabolicPeak(steps[best].z, step, steps[best - 1].score,
+            steps[best].score, steps[best + 1].score);
+   }
+   return DEVICE_OK;
+}
+
+int ImageAutoFocus::MoveTo(double z)
+{
+   MM::Stage* stage = (MM::Stage*)GetDevice(stageName_.c_str());
+   if (stage == 0)
+      return ERR_NO_PHYSICAL_STAGE;
+   int ret = stage->SetPositionUm(z);
+   if (ret != DEVICE_OK)
+      return ret;
+   return WaitForDevice(stage);
+}
+
+int ImageAutoFocus::WaitForDevice(MM::Device* device)
+{
+   char timeout[MM::MaxStrLength];
+   GetCoreCallback()->GetDeviceProperty("Core", "TimeoutMs", timeout);
+   MM::MMTime dTimeout = MM::MMTime(atof(timeout) * 1000.0);
+   MM::MMTime start = GetCoreCallback()->GetCurrentMMTime();
+   bool busy = device->Busy();
+   while (busy && (GetCoreCallback()->GetCurrentMMTime() - start) < dTimeout)
+   {
+      CDeviceUtils::SleepMs(1);
+      busy = device->Busy();
+   }
+   return busy ? ERR_TIMEOUT : DEVICE_OK;
+}
+
+/**
+ * Snapping with the camera directly bypasses the Core's auto-shutter; so,
+ * if auto-shutter is on, opens the Core's shutter as the Core would. Sets
+ * opened to the shutter, to be closed when done, or to 0 if there is none
+ * or it was already open.
+ */
+int ImageAutoFocus::OpenCoreShutter(MM::Shutter*& opened)
+{
+   opened = 0;
+   char value[MM::MaxStrLength];
+   int ret = GetCoreCallback()->GetDeviceProperty(MM::g_Keyword_CoreDevice,
+         MM::g_Keyword_CoreAutoShutter, value);
+   if (ret != DEVICE_OK || atoi(value) == 0)
+      return ret;
+   ret = GetCoreCallback()->GetDeviceProperty(MM::g_Keyword_CoreDevice,
+         MM::g_Keyword_CoreShutter, value);
+   if (ret != DEVICE_OK || strlen(value) == 0)
+      return ret;
+   MM::Shutter* shutter = (MM::Shutter*)GetDevice(value);
+   if (shutter == 0)
+      return DEVICE_OK;
+
+   bool open;
+   ret = shutter->GetOpen(open);
+   if (ret != DEVICE_OK || open)
+      return ret;
+   ret = shutter->SetOpen(true);
+   if (ret != DEVICE_OK)
+      return ret;
+   opened = shutter;
+   ret = WaitForDevice(shutter);
+   if (ret != DEVICE_OK)
+   {
+      shutter->SetOpen(false);
+      opened = 0;
+   }
+   return ret;
+}
+
+/**
+ * (Re)starts the scoring threads if the Threads property has changed.
+ */
+void ImageAutoFocus::StartWorkers()
+{
+   const unsigned count = static_cast<unsigned>(std::max(1L, threads_));
+   if (!workers_ || workers_->Count() != count)
+   {
+      workers_.reset();
+      workers_.reset(new FocusMetricWorkers(count));
+   }
+}
+
+/**
+ * Snaps an image and converts it to gray levels (RGB is averaged).
+ */
+int ImageAutoFocus::SnapFrame(std::vector<float>& frame, unsigned& width,
+      unsigned& height)
+{
+   MM::Camera* camera = (MM::Camera*)GetDevice(cameraName_.c_str());
+   if (camera == 0)
+      return ERR_NO_PHYSICAL_CAMERA;
+   int ret = camera->SnapImage();
+   if (ret != DEVICE_OK)
+      return ret;
+   const unsigned char* pixels = camera->GetImageBuffer();
+   if (pixels == 0)
+      return DEVICE_SNAP_IMAGE_FAILED;
+
+   width = camera->GetImageWidth();
+   height = camera->GetImageHeight();
+   const unsigned byteDepth = camera->GetImageBytesPerPixel();
+   const unsigned components = camera->GetNumberOfComponents();
+   const std::size_t count = static_cast<std::size_t>(width) * height;
+   frame.resize(count);
+   float* out = frame.empty() ? 0 : &frame[0];
+   if (byteDepth == 1 && components == 1)
+   {
+      for (std::size_t i = 0; i < count; ++i)
+         out[i] = pixels[i];
+   }
+   else if (byteDepth == 2 && components == 1)
+   {
+      const unsigned short* in = reinterpret_cast<const unsigned short*>(pixels);
+      for (std::size_t i = 0; i < count; ++i)
+         out[i] = in[i];
+   }
+   else if (byteDepth == 4 && components == 4)
+   {
+      for (std::size_t i = 0; i < count; ++i)
+      {
+         const unsigned char* bgra = pixels + 4 * i;
+         out[i] = (bgra[0] + bgra[1] + bgra[2]) / 3.0f;
+      }
+   }
+   else if (byteDepth == 4 && components == 1)
+   {
+      const float* in = reinterpret_cast<const float*>(pixels);
+      std::copy(in, in + count, out);
+   }
+   else
+   {
+      return DEVICE_UNSUPPORTED_DATA_FORMAT;
+   }
+   return DEVICE_OK;
+}
+
+double ImageAutoFocus::Score(const std::vector<float>& frame, unsigned width,
+      unsigned height) const
+{
+   if (frame.empty())
+      return 0.0;
+   FocusMetricWorkers& workers = *workers_;
+   switch (metric_)
+   {
+      case Brenner:
+         return BrennerScore(&frame[0], width, height, workers);
+      case Tenengrad:
+         return TenengradScore(&frame[0], width, height, workers);
+      case FFTBandPass:
+         return FFTBandPassScore(&frame[0], width, height, workers,
+               bandLow_, bandHigh_);
+      default:
+         return NormalizedVarianceScore(&frame[0], width, height, workers);
+   }
+}
+
+/**
+ * Publishes a summary of a search in the "Last Search Timings" property, and
+ * logs each step (debug only).
+ */
+void ImageAutoFocus::ReportTimings(const char* kind,
+      const std::vector<Step>& steps, double totalMs)
+{
+   double move = 0.0, snap = 0.0, metric = 0.0;
+   std::ostringstream detail;
+   detail << kind << " steps (z um, score, move ms, snap ms, metric ms):";
+   for (const Step& s : steps)
+   {
+      move += s.moveMs;
+      snap += s.snapMs;
+      metric += s.metricMs;
+      detail << "\n" << s.z << "\t" << s.score << "\t" << s.moveMs << "\t" <<
+         s.snapMs << "\t" << s.metricMs;
+   }
+   LogMessage(detail.str().c_str(), true);
+
+   const double count = steps.empty() ? 1.0 : static_cast<double>(steps.size());
+   std::ostringstream os;
+   os.precision(3);
+   os << steps.size() << " steps in " << totalMs << " ms; per step: move " <<
+      move / count << " ms, snap " << snap / count << " ms, metric " <<
+      metric / count << " ms (overlapped)";
+   lastTimings_ = os.str();
+   OnPropertyChanged(g_PropLastTimings, lastTimings_.c_str());
+}
+
+
+///////////////////////////////////////
+// Action Interface
+//////////////////////////////////////
+int ImageAutoFocus::OnCamera(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(cameraName_.c_str());
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      std::string name;
+      pProp->Get(name);
+      if (name != g_Undefined && GetDevice(name.c_str()) == 0)
+      {
+         pProp->Set(cameraName_.c_str());
+         return ERR_INVALID_DEVICE_NAME;
+      }
+      cameraName_ = name;
+   }
+   return DEVICE_OK;
+}
+
+int ImageAutoFocus::OnFocusStage(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(stageName_.c_str());
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      std::string name;
+      pProp->Get(name);
+      if (name != g_Undefined && GetDevice(name.c_str()) == 0)
+      {
+         pProp->Set(stageName_.c_str());
+         return ERR_INVALID_DEVICE_NAME;
+      }
+      stageName_ = name;
+   }
+   return DEVICE_OK;
+}
+
+int ImageAutoFocus::OnMetric(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(g_MetricNames[metric_]);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      std::string name;
+      pProp->Get(name);
+      for (long i = 0; i < static_cast<long>(sizeof(g_MetricNames) / sizeof(g_MetricNames[0])); ++i)
+      {
+         if (name == g_MetricNames[i])
+            metric_ = i;
+      }
+   }
+   return DEVICE_OK;
+}
+
+int ImageAutoFocus::OnSearchRange(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+      pProp->Set(searchRange_);
+   else if (eAct == MM::AfterSet)
+      pProp->Get(searchRange_);
+   return DEVICE_OK;
+}
+
+int ImageAutoFocus::OnCoarseStep(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+      pProp->Set(coarseStep_);
+   else if (eAct == MM::AfterSet)
+      pProp->Get(coarseStep_);
+   return DEVICE_OK;
+}
+
+int ImageAutoFocus::OnFineStep(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+      pProp->Set(fineStep_);
+   else if (eAct == MM::AfterSet)
+      pProp->Get(fineStep_);
+   return DEVICE_OK;
+}
+
+int ImageAutoFocus::OnThreads(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+      pProp->Set(threads_);
+   else if (eAct == MM::AfterSet)
+      pProp->Get(threads_);
+   return DEVICE_OK;
+}
+
+int ImageAutoFocus::OnBandLow(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+      pProp->Set(bandLow_);
+   else if (eAct == MM::AfterSet)
+      pProp->Get(bandLow_);
+   return DEVICE_OK;
+}
+
+int ImageAutoFocus::OnBandHigh(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+      pProp->Set(bandHigh_);
+   else if (eAct == MM::AfterSet)
+      pProp->Get(bandHigh_);
+   return DEVICE_OK;
+}
+
+int ImageAutoFocus::OnLastTimings(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+      pProp->Set(lastTimings_.c_str());
+   return DEVICE_OK;
+}
@@ -39,8 +39,25 @@ extern const char* g_DeviceNameMultiCamera;
 extern const char* g_Undefined;
 
 
+int CameraSnapThread::svc()
+{
+   owner_->RunSnapWorker(slot_);
+   return 0;
+}
+
+
 MultiCamera::MultiCamera() :
    imageBuffer_(0),
+   snapGeneration_(0),
+   snapPending_(0),
+   stopSnapWorkers_(false),
+   snapCameras_(MAX_NUMBER_PHYSICAL_CAMERAS, 0),
+   snapResults_(MAX_NUMBER_PHYSICAL_CAMERAS, DEVICE_OK),
+   snapDoneTimes_(MAX_NUMBER_PHYSICAL_CAMERAS),
+   lastSnapSkewMs_(0.0),
+   totalSnapSkewMs_(0.0),
+   maxSnapSkewMs_(0.0),
+   nrSkewSamples_(0),
    nrCamerasInUse_(0),
    initialized_(false)
 {
@@ -69,7 +86,10 @@ MultiCamera::~MultiCamera()
 
 int MultiCamera::Shutdown()
 {
+   StopSnapWorkers();
    delete imageBuffer_;
+   imageBuffer_ = 0;
+   initialized_ = false;
    // Rely on the cameras to shut themselves down
    return DEVICE_OK;
 }
@@ -118,6 +138,17 @@ int MultiCamera::Initialize()
    CPropertyAction* pAct = new CPropertyAction(this, &MultiCamera::OnBinning);
    CreateProperty(MM::g_Keyword_Binning, "1", MM::Integer, false, pAct, false);
 
+   // Read-only statistics on how far apart (in time) the physical cameras
+   // finish a snap
+   const char* skewProps[] = { "Snap Skew Last (ms)", "Snap Skew Mean (ms)", "Snap Skew Max (ms)" };
+   for (long i = 0; i < 3; i++)
+   {
+      CPropertyActionEx* pActEx = new CPropertyActionEx(this, &MultiCamera::OnSnapSkew, i);
+      CreateProperty(skewProps[i], "0.0", MM::Float, true, pActEx, false);
+   }
+
+   StartSnapWorkers();
+
    initialized_ = true;
 
    return DEVICE_OK;
@@ -136,20 +167,119 @@ int MultiCamera::SnapImage()
    if (!ImageSizesAreEqual())
       return ERR_NO_EQUAL_SIZE;
 
-   CameraSnapThread t[MAX_NUMBER_PHYSICAL_CAMERAS];
+   std::unique_lock<std::mutex> lock(snapMutex_);
+   snapPending_ = 0;
    for (unsigned int i = 0; i < usedCameras_.size(); i++)
    {
-      MM::Camera* camera = (MM::Camera*)GetDevice(usedCameras_[i].c_str());
-      if (camera != 0)
+      snapCameras_[i] = (MM::Camera*)GetDevice(usedCameras_[i].c_str());
+      snapResults_[i] = DEVICE_OK;
+      if (snapCameras_[i] != 0)
+         snapPending_++;
+   }
+
+   // Release all workers at once and wait until every camera is done
+   snapGeneration_++;
+   snapStartCond_.notify_all();
+   snapDoneCond_.wait(lock, [this] { return snapPending_ == 0; });
+
+   int ret = DEVICE_OK;
+   bool first = true;
+   std::chrono::steady_clock::time_point earliest, latest;
+   for (unsigned int i = 0; i < usedCameras_.size(); i++)
+   {
+      if (snapCameras_[i] == 0)
+         continue;
+      if (ret == DEVICE_OK)
+         ret = snapResults_[i];
+      if (first || snapDoneTimes_[i] < earliest)
+         earliest = snapDoneTimes_[i];
+      if (first || snapDoneTimes_[i] > latest)
+         latest = snapDoneTimes_[i];
+      first = false;
+   }
+
+   lastSnapSkewMs_ = std::chrono::duration<double, std::milli>(latest - earliest).count();
+   totalSnapSkewMs_ += lastSnapSkewMs_;
+   nrSkewSamples_++;
+   if (lastSnapSkewMs_ > maxSnapSkewMs_)
+      maxSnapSkewMs_ = lastSnapSkewMs_;
+
+   return ret;
+}
+
+void MultiCamera::RunSnapWorker(unsigned slot)
+{
+   // StartSnapWorkers() resets the generation, so a SnapImage() issued before
+   // this thread gets scheduled is not missed
+   unsigned long seenGeneration = 0;
+   for (;;)
+   {
+      MM::Camera* camera;
       {
-         t[i].SetCamera(camera);
-         t[i].Start();
+         std::unique_lock<std::mutex> lock(snapMutex_);
+         snapStartCond_.wait(lock, [&] {
+            return stopSnapWorkers_ || snapGeneration_ != seenGeneration;
+         });
+         if (stopSnapWorkers_)
+            return;
+         seenGeneration = snapGeneration_;
+         camera = snapCameras_[slot];
       }
+      if (camera == 0)
+         continue;
+
+      int ret = camera->SnapImage();
+      std::chrono::steady_clock::time_point done = std::chrono::steady_clock::now();
+
+      std::lock_guard<std::mutex> lock(snapMutex_);
+      snapResults_[slot] = ret;
+      snapDoneTimes_[slot] = done;
+      if (--snapPending_ == 0)
+         snapDoneCond_.notify_all();
    }
-   // I think that the CameraSnapThread destructor waits until the SnapImage function is done
-   // So, we are likely to be waiting here until all cameras are done snapping
+}
 
-   return DEVICE_OK;
+void MultiCamera::StartSnapWorkers()
+{
+   if (!snapThreads_.empty())
+      return;
+
+   {
+      std::lock_guard<std::mutex> lock(snapMutex_);
+      stopSnapWorkers_ = false;
+      snapGeneration_ = 0;
+   }
+   for (unsigned i = 0; i < MAX_NUMBER_PHYSICAL_CAMERAS; i++)
+   {
+      CameraSnapThread* thread = new CameraSnapThread(this, i);
+      thread->activate();
+      snapThreads_.push_back(thread);
+   }
+}
+
+void MultiCamera::StopSnapWorkers()
+{
+   {
+      std::lock_guard<std::mutex> lock(snapMutex_);
+      stopSnapWorkers_ = true;
+   }
+   snapStartCond_.notify_all();
+
+   for (unsigned i = 0; i < snapThreads_.size(); i++)
+   {
+      snapThreads_[i]->wait();
+      delete snapThreads_[i];
+   }
+   snapThreads_.clear();
+}
+
+void MultiCamera::ResetSnapSkewStatistics()
+{
+   std::lock_guard<std::mutex> lock(snapMutex_);
+   lastSnapSkewMs_ = 0.0;
+   totalSnapSkewMs_ = 0.0;
+   maxSnapSkewMs_ = 0.0;
+   nrSkewSamples_ = 0;
 }
 
 /**
@@ -184,19 +314,24 @@ const unsigned char* MultiCamera::GetImageBuffer(unsigned channelNr)
             return camera->GetImageBuffer();
          else
          {
+            // Pad the smaller image into the top-left corner of a buffer of
+            // the common size
             img_.Resize(width, height, pixDepth);
             img_.ResetPixels();
+            const unsigned char* pixels = camera->GetImageBuffer();
             if (width == thisWidth)
             {
-               memcpy(img_.GetPixelsRW(), camera->GetImageBuffer(), thisHeight * thisWidth * pixDepth);
+               memcpy(img_.GetPixelsRW(), pixels, thisHeight * thisWidth * pixDepth);
             }
             else
             {
                // we need to copy line by line
-               const unsigned char* pixels = camera->GetImageBuffer();
+               const unsigned srcStride = thisWidth * pixDepth;
+               const unsigned dstStride = width * pixDepth;
+               unsigned char* dst = img_.GetPixelsRW();
                for (unsigned k = 0; k < thisHeight; k++)
                {
-                  memcpy(img_.GetPixelsRW() + k * width, pixels + k * thisWidth, thisWidth);
+                  memcpy(dst + k * dstStride, pixels + k * srcStride, srcStride);
                }
             }
             return img_.GetPixels();
@@ -632,6 +767,7 @@ int MultiCamera::OnPhysicalCamera(MM::PropertyBase* pProp, MM::ActionType eAct,
          else
             return ERR_INVALID_DEVICE_NAME;
       }
+      ResetSnapSkewStatistics();
       nrCamerasInUse_ = 0;
       for (unsigned int usedCameraCounter = 0; usedCameraCounter < usedCameras_.size(); usedCameraCounter++)
       {
@@ -675,3 +811,20 @@ int MultiCamera::OnBinning(MM::PropertyBase* pProp, MM::ActionType eAct)
 }
 
 
+
+int MultiCamera::OnSnapSkew(MM::PropertyBase* pProp, MM::ActionType eAct, long which)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      std::lock_guard<std::mutex> lock(snapMutex_);
+      double value = 0.0;
+      if (which == 0)
+         value = lastSnapSkewMs_;
+      else if (which == 1)
+         value = nrSkewSamples_ > 0 ? totalSnapSkewMs_ / nrSkewSamples_ : 0.0;
+      else
+         value = maxSnapSkewMs_;
+      pProp->Set(value);
+   }
+   return DEVICE_OK;
+}
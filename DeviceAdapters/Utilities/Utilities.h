@@ -27,8 +27,13 @@
 #include "MMDevice.h"
 #include "DeviceBase.h"
 #include "ImgBuffer.h"
-#include <string>
+#include <chrono>
+#include <condition_variable>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
 
 //////////////////////////////////////////////////////////////////////////////
 // Error codes
@@ -49,6 +54,7 @@
 #define ERR_NO_PHYSICAL_STAGE              10013
 #define ERR_NO_SHUTTER_DEVICE_FOUND        10014
 #define ERR_TIMEOUT                        10021
+#define ERR_INVALID_FOCUS_SEARCH           10022
 
 
 //////////////////////////////////////////////////////////////////////////////
@@ -110,28 +116,26 @@ private:
    MMThreadLock physicalShutterLock_;
 };
 
+class MultiCamera;
+
 /**
- * CameraSnapThread: helper thread for MultiCamera
+ * CameraSnapThread: persistent helper thread for MultiCamera. One thread is
+ * kept per physical camera slot for the lifetime of the MultiCamera; all of
+ * them are released together for each SnapImage().
  */
 class CameraSnapThread : public MMDeviceThreadBase
 {
    public:
-      CameraSnapThread() :
-         camera_(0),
-         started_(false)
+      CameraSnapThread(MultiCamera* owner, unsigned slot) :
+         owner_(owner),
+         slot_(slot)
       {}
 
-      ~CameraSnapThread() { if (started_) wait(); }
-
-      void SetCamera(MM::Camera* camera) { camera_ = camera; }
-
-      int svc() { camera_->SnapImage(); return 0; }
-
-      void Start() { activate(); started_ = true; }
+      int svc();
 
    private:
-      MM::Camera* camera_;
-      bool started_;
+      MultiCamera* owner_;
+      unsigned slot_;
 };
 
 /*
@@ -177,12 +181,39 @@ public:
    // ---------------
    int OnPhysicalCamera(MM::PropertyBase* pProp, MM::ActionType eAct, long nr);
    int OnBinning(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnSnapSkew(MM::PropertyBase* pProp, MM::ActionType eAct, long which);
+
+   // Called from CameraSnapThread::svc()
+   void RunSnapWorker(unsigned slot);
 
 private:
    int Logical2Physical(int logical);
    bool ImageSizesAreEqual();
+   void StartSnapWorkers();
+   void StopSnapWorkers();
+   void ResetSnapSkewStatistics();
    unsigned char* imageBuffer_;
 
+   // Snap workers. snapGeneration_ is bumped to release all workers at once;
+   // each worker with a camera assigned in snapCameras_ decrements
+   // snapPending_ when done.
+   std::vector<CameraSnapThread*> snapThreads_;
+   std::mutex snapMutex_;
+   std::condition_variable snapStartCond_;
+   std::condition_variable snapDoneCond_;
+   unsigned long snapGeneration_;
+   unsigned snapPending_;
+   bool stopSnapWorkers_;
+   std::vector<MM::Camera*> snapCameras_;
+   std::vector<int> snapResults_;
+   std::vector<std::chrono::steady_clock::time_point> snapDoneTimes_;
+
+   // Spread of the snap completion times between physical cameras
+   double lastSnapSkewMs_;
+   double totalSnapSkewMs_;
+   double maxSnapSkewMs_;
+   long nrSkewSamples_;
+
    std::vector<std::string> availableCameras_;
    std::vector<std::string> usedCameras_;
    std::vector<int> cameraWidths_;
@@ -487,9 +518,13 @@ public:
    int StopStageSequence();
    int ClearStageSequence();
    int AddToStageSequence(double position);
+   int AddArrayToStageSequence(const double* positions, long count);
    int SendStageSequence();
 
 private:
+   // Voltage for a position, clipped to the stage's voltage range
+   double SequenceVoltage(double pos) const;
+
    std::vector<std::string> availableDAs_;
    std::string DADeviceName_;
    bool initialized_;
@@ -545,6 +580,7 @@ public:
    int StopXYStageSequence();
    int ClearXYStageSequence();
    int AddToXYStageSequence(double positionX, double positionY);
+   int AddArrayToXYStageSequence(const double* positionsX, const double* positionsY, long count);
    int SendXYStageSequence();
    
    // action interface
@@ -567,6 +603,9 @@ public:
 
 private:
    void UpdateStepSize();
+   // Voltages for a position, clipped to the stage's voltage ranges
+   void SequenceVoltages(double positionX, double positionY,
+         double& voltageX, double& voltageY) const;
    std::vector<std::string> availableDAs_;
    std::string DADeviceNameX_;
    std::string DADeviceNameY_;
@@ -833,5 +872,90 @@ private:
    MM::MMTime lastMoveStartTime_;
 };
 
+class FocusMetricWorkers;
+
+/**
+ * ImageAutoFocus: Image-based autofocus that drives a focus stage and a
+ * camera directly, scoring each image with a focus metric
+ */
+class ImageAutoFocus : public CAutoFocusBase<ImageAutoFocus>
+{
+public:
+   ImageAutoFocus();
+   ~ImageAutoFocus();
+
+   // Device API
+   // ----------
+   int Initialize();
+   int Shutdown();
+
+   void GetName(char* pszName) const;
+   bool Busy() { return false; }
+
+   // AutoFocus API
+   // -------------
+   int SetContinuousFocusing(bool state);
+   int GetContinuousFocusing(bool& state) { state = false; return DEVICE_OK; }
+   bool IsContinuousFocusLocked() { return false; }
+   int FullFocus();
+   int IncrementalFocus();
+   int GetLastFocusScore(double& score) { score = lastScore_; return DEVICE_OK; }
+   int GetCurrentFocusScore(double& score);
+   int GetOffset(double& offset) { offset = offset_; return DEVICE_OK; }
+   int SetOffset(double offset) { offset_ = offset; return DEVICE_OK; }
+
+   // action interface
+   // ----------------
+   int OnCamera(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnFocusStage(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnMetric(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnSearchRange(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnCoarseStep(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnFineStep(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnThreads(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnBandLow(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnBandHigh(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnLastTimings(MM::PropertyBase* pProp, MM::ActionType eAct);
+
+private:
+   struct Step
+   {
+      double z;
+      double score;
+      double moveMs;
+      double snapMs;
+      double metricMs;
+   };
+
+   int Search(double center, double halfRange, double step,
+         std::vector<Step>& steps, double& bestZ, double& bestScore);
+   int MoveTo(double z);
+   int WaitForDevice(MM::Device* device);
+   int OpenCoreShutter(MM::Shutter*& opened);
+   void StartWorkers();
+   int SnapFrame(std::vector<float>& frame, unsigned& width, unsigned& height);
+   double Score(const std::vector<float>& frame, unsigned width,
+         unsigned height) const;
+   void ReportTimings(const char* kind, const std::vector<Step>& steps,
+         double totalMs);
+
+   std::vector<std::string> availableCameras_;
+   std::vector<std::string> availableStages_;
+   std::string cameraName_;
+   std::string stageName_;
+   long metric_;
+   double searchRange_;
+   double coarseStep_;
+   double fineStep_;
+   long threads_;
+   double bandLow_;
+   double bandHigh_;
+   double offset_;
+   double lastScore_;
+   std::string lastTimings_;
+   std::unique_ptr<FocusMetricWorkers> workers_;
+   bool initialized_;
+};
+
 
 #endif //_UTILITIES_H_
\ No newline at end of file
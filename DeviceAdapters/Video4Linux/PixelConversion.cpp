@@ -0,0 +1,254 @@
+// Conversion of V4L2 capture formats into Micro-Manager pixel layouts.
+// See PixelConversion.h.
+//
+// LICENSE:       This file is distributed under the "LGPL" license.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "PixelConversion.h"
+
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define V4L2CONV_USE_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace v4l2conv {
+
+namespace {
+
+inline unsigned char clip(int val)
+{
+  if (val <= 0)
+    return 0;
+  else if (val >= 255)
+    return 255;
+  else
+    return (unsigned char) val;
+}
+
+// BT.601, studio swing, 8 fractional bits
+inline void yuvToBGRA(int y, int u, int v, unsigned char* out)
+{
+  int c = y - 16;
+  int d = u - 128;
+  int e = v - 128;
+  out[0] = clip((298 * c + 516 * d + 128) >> 8); // blue
+  out[1] = clip((298 * c - 100 * d - 208 * e + 128) >> 8); // green
+  out[2] = clip((298 * c + 409 * e + 128) >> 8); // red
+  out[3] = 255; // alpha
+}
+
+#ifdef V4L2CONV_USE_SSE2
+
+inline __m128i coeffPair(short a, short b)
+{
+  return _mm_setr_epi16(a, b, a, b, a, b, a, b);
+}
+
+inline __m128i descale(__m128i v)
+{
+  return _mm_srai_epi32(_mm_add_epi32(v, _mm_set1_epi32(128)), 8);
+}
+
+// Converts 8 pixels. y holds 8 16-bit luma values; uv holds the 4 chroma
+// pairs as 16-bit values in the order U0 V0 U1 V1 U2 V2 U3 V3. Writes 32
+// bytes of BGRA.
+inline void yuvToBGRA8(__m128i y, __m128i uv, unsigned char* out)
+{
+  const __m128i zero = _mm_setzero_si128();
+
+  // Duplicate each chroma sample for the two pixels sharing it
+  __m128i u = _mm_and_si128(uv, _mm_set1_epi32(0xFFFF));
+  u = _mm_or_si128(u, _mm_slli_epi32(u, 16));
+  __m128i v = _mm_srli_epi32(uv, 16);
+  v = _mm_or_si128(v, _mm_slli_epi32(v, 16));
+
+  __m128i c = _mm_sub_epi16(y, _mm_set1_epi16(16));
+  __m128i d = _mm_sub_epi16(u, _mm_set1_epi16(128));
+  __m128i e = _mm_sub_epi16(v, _mm_set1_epi16(128));
+
+  __m128i cdLo = _mm_unpacklo_epi16(c, d);
+  __m128i cdHi = _mm_unpackhi_epi16(c, d);
+  __m128i ceLo = _mm_unpacklo_epi16(c, e);
+  __m128i ceHi = _mm_unpackhi_epi16(c, e);
+  __m128i e0Lo = _mm_unpacklo_epi16(e, zero);
+  __m128i e0Hi = _mm_unpackhi_epi16(e, zero);
+
+  const __m128i kBlue = coeffPair(298, 516);
+  const __m128i kGreen = coeffPair(298, -100);
+  const __m128i kGreenE = coeffPair(-208, 0);
+  const __m128i kRed = coeffPair(298, 409);
+
+  __m128i b = _mm_packs_epi32(
+      descale(_mm_madd_epi16(cdLo, kBlue)),
+      descale(_mm_madd_epi16(cdHi, kBlue)));
+  __m128i g = _mm_packs_epi32(
+      descale(_mm_add_epi32(_mm_madd_epi16(cdLo, kGreen), _mm_madd_epi16(e0Lo, kGreenE))),
+      descale(_mm_add_epi32(_mm_madd_epi16(cdHi, kGreen), _mm_madd_epi16(e0Hi, kGreenE))));
+  __m128i r = _mm_packs_epi32(
+      descale(_mm_madd_epi16(ceLo, kRed)),
+      descale(_mm_madd_epi16(ceHi, kRed)));
+
+  // Saturate to 8 bits (this is the clip) and interleave as B G R A
+  b = _mm_packus_epi16(b, b);
+  g = _mm_packus_epi16(g, g);
+  r = _mm_packus_epi16(r, r);
+  __m128i bg = _mm_unpacklo_epi8(b, g);
+  __m128i ra = _mm_unpacklo_epi8(r, _mm_set1_epi8((char) 0xFF));
+  _mm_storeu_si128((__m128i*) out, _mm_unpacklo_epi16(bg, ra));
+  _mm_storeu_si128((__m128i*) (out + 16), _mm_unpackhi_epi16(bg, ra));
+}
+
+#endif // V4L2CONV_USE_SSE2
+
+} // anonymous namespace
+
+void PackedYUV422ToBGRA(const unsigned char* in, size_t bytesPerLine,
+    unsigned width, unsigned height, bool uyvy, unsigned char* out)
+{
+  const int yOff = uyvy ? 1 : 0;
+  const int uOff = uyvy ? 0 : 1;
+  for (unsigned j = 0; j < height; ++j) {
+    const unsigned char* src = in + j * bytesPerLine;
+    unsigned char* dst = out + (size_t) j * width * 4;
+    unsigned x = 0;
+#ifdef V4L2CONV_USE_SSE2
+    const __m128i lowBytes = _mm_set1_epi16(0x00FF);
+    for (; x + 8 <= width; x += 8) {
+      __m128i v = _mm_loadu_si128((const __m128i*) (src + 2 * x));
+      __m128i y = uyvy ? _mm_srli_epi16(v, 8) : _mm_and_si128(v, lowBytes);
+      __m128i uv = uyvy ? _mm_and_si128(v, lowBytes) : _mm_srli_epi16(v, 8);
+      yuvToBGRA8(y, uv, dst + 4 * x);
+    }
+#endif
+    for (; x < width; x += 2) {
+      const unsigned char* p = src + 2 * x;
+      int u = p[uOff];
+      int v = p[uOff + 2];
+      yuvToBGRA(p[yOff], u, v, dst + 4 * x);
+      if (x + 1 < width)
+        yuvToBGRA(p[yOff + 2], u, v, dst + 4 * x + 4);
+    }
+  }
+}
+
+void PackedYUV422ToGray8(const unsigned char* in, size_t bytesPerLine,
+    unsigned width, unsigned height, bool uyvy, unsigned char* out)
+{
+  const int yOff = uyvy ? 1 : 0;
+  for (unsigned j = 0; j < height; ++j) {
+    const unsigned char* src = in + j * bytesPerLine;
+    unsigned char* dst = out + (size_t) j * width;
+    unsigned x = 0;
+#ifdef V4L2CONV_USE_SSE2
+    const __m128i lowBytes = _mm_set1_epi16(0x00FF);
+    for (; x + 16 <= width; x += 16) {
+      __m128i a = _mm_loadu_si128((const __m128i*) (src + 2 * x));
+      __m128i b = _mm_loadu_si128((const __m128i*) (src + 2 * x + 16));
+      if (uyvy) {
+        a = _mm_srli_epi16(a, 8);
+        b = _mm_srli_epi16(b, 8);
+      }
+      else {
+        a = _mm_and_si128(a, lowBytes);
+        b = _mm_and_si128(b, lowBytes);
+      }
+      _mm_storeu_si128((__m128i*) (dst + x), _mm_packus_epi16(a, b));
+    }
+#endif
+    for (; x < width; ++x)
+      dst[x] = src[2 * x + yOff];
+  }
+}
+
+void NV12ToBGRA(const unsigned char* in, size_t bytesPerLine,
+    unsigned width, unsigned height, unsigned char* out)
+{
+  const unsigned char* chroma = in + bytesPerLine * height;
+  for (unsigned j = 0; j < height; ++j) {
+    const unsigned char* ySrc = in + j * bytesPerLine;
+    const unsigned char* uvSrc = chroma + (j / 2) * bytesPerLine;
+    unsigned char* dst = out + (size_t) j * width * 4;
+    unsigned x = 0;
+#ifdef V4L2CONV_USE_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    for (; x + 8 <= width; x += 8) {
+      __m128i y = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*) (ySrc + x)), zero);
+      __m128i uv = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*) (uvSrc + x)), zero);
+      yuvToBGRA8(y, uv, dst + 4 * x);
+    }
+#endif
+    for (; x < width; ++x) {
+      const unsigned char* uv = uvSrc + (x & ~1u);
+      yuvToBGRA(ySrc[x], uv[0], uv[1], dst + 4 * x);
+    }
+  }
+}
+
+void Gray8ToBGRA(const unsigned char* in, size_t bytesPerLine,
+    unsigned width, unsigned height, unsigned char* out)
+{
+  for (unsigned j = 0; j < height; ++j) {
+    const unsigned char* src = in + j * bytesPerLine;
+    unsigned char* dst = out + (size_t) j * width * 4;
+    unsigned x = 0;
+#ifdef V4L2CONV_USE_SSE2
+    const __m128i alpha = _mm_set1_epi8((char) 0xFF);
+    for (; x + 16 <= width; x += 16) {
+      __m128i g = _mm_loadu_si128((const __m128i*) (src + x));
+      __m128i ggLo = _mm_unpacklo_epi8(g, g);
+      __m128i ggHi = _mm_unpackhi_epi8(g, g);
+      __m128i gaLo = _mm_unpacklo_epi8(g, alpha);
+      __m128i gaHi = _mm_unpackhi_epi8(g, alpha);
+      _mm_storeu_si128((__m128i*) (dst + 4 * x), _mm_unpacklo_epi16(ggLo, gaLo));
+      _mm_storeu_si128((__m128i*) (dst + 4 * x + 16), _mm_unpackhi_epi16(ggLo, gaLo));
+      _mm_storeu_si128((__m128i*) (dst + 4 * x + 32), _mm_unpacklo_epi16(ggHi, gaHi));
+      _mm_storeu_si128((__m128i*) (dst + 4 * x + 48), _mm_unpackhi_epi16(ggHi, gaHi));
+    }
+#endif
+    for (; x < width; ++x) {
+      dst[4 * x] = dst[4 * x + 1] = dst[4 * x + 2] = src[x];
+      dst[4 * x + 3] = 255;
+    }
+  }
+}
+
+void CopyRows(const unsigned char* in, size_t bytesPerLine,
+    size_t rowBytes, unsigned height, unsigned char* out)
+{
+  if (bytesPerLine == rowBytes) {
+    memcpy(out, in, rowBytes * height);
+    return;
+  }
+  for (unsigned j = 0; j < height; ++j)
+    memcpy(out + j * rowBytes, in + j * bytesPerLine, rowBytes);
+}
+
+void Gray16ToGray8(const unsigned char* in, size_t bytesPerLine,
+    unsigned width, unsigned height, unsigned char* out)
+{
+  for (unsigned j = 0; j < height; ++j) {
+    const unsigned char* src = in + j * bytesPerLine;
+    unsigned char* dst = out + (size_t) j * width;
+    unsigned x = 0;
+#ifdef V4L2CONV_USE_SSE2
+    for (; x + 16 <= width; x += 16) {
+      __m128i a = _mm_srli_epi16(_mm_loadu_si128((const __m128i*) (src + 2 * x)), 8);
+      __m128i b = _mm_srli_epi16(_mm_loadu_si128((const __m128i*) (src + 2 * x + 16)), 8);
+      _mm_storeu_si128((__m128i*) (dst + x), _mm_packus_epi16(a, b));
+    }
+#endif
+    for (; x < width; ++x)
+      dst[x] = src[2 * x + 1];
+  }
+}
+
+} // namespace v4l2conv
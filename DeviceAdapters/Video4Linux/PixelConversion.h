@@ -0,0 +1,52 @@
+// Conversion of V4L2 capture formats into the pixel layouts understood by
+// Micro-Manager (8-bit and 16-bit grayscale, 32-bit BGRA).
+//
+// All functions take the V4L2 buffer as laid out by the driver, i.e. with
+// bytesPerLine possibly larger than the visible width. The YUV to RGB
+// conversion uses the same BT.601 fixed-point coefficients as the original
+// scalar code. On x86 the inner loops use SSE2; other platforms fall back to
+// plain C++.
+//
+// LICENSE:       This file is distributed under the "LGPL" license.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include <cstddef>
+
+namespace v4l2conv {
+
+// Packed 4:2:2 (YUYV or UYVY) to BGRA, alpha set to 255
+void PackedYUV422ToBGRA(const unsigned char* in, size_t bytesPerLine,
+    unsigned width, unsigned height, bool uyvy, unsigned char* out);
+
+// Packed 4:2:2 (YUYV or UYVY) to 8-bit gray, taking the luma only
+void PackedYUV422ToGray8(const unsigned char* in, size_t bytesPerLine,
+    unsigned width, unsigned height, bool uyvy, unsigned char* out);
+
+// NV12 (Y plane followed by interleaved CbCr plane at half resolution) to
+// BGRA. The chroma plane is assumed to start at bytesPerLine * height.
+void NV12ToBGRA(const unsigned char* in, size_t bytesPerLine,
+    unsigned width, unsigned height, unsigned char* out);
+
+// 8-bit gray to BGRA, replicating the value into all three colors
+void Gray8ToBGRA(const unsigned char* in, size_t bytesPerLine,
+    unsigned width, unsigned height, unsigned char* out);
+
+// Drops the row padding of a single-plane image (used for the pass-through
+// formats GREY, Y16 and the luma plane of NV12)
+void CopyRows(const unsigned char* in, size_t bytesPerLine,
+    size_t rowBytes, unsigned height, unsigned char* out);
+
+// Little-endian 16-bit gray to 8-bit gray, keeping the most significant byte
+void Gray16ToGray8(const unsigned char* in, size_t bytesPerLine,
+    unsigned width, unsigned height, unsigned char* out);
+
+} // namespace v4l2conv
@@ -58,6 +58,7 @@ strace -f java -Djava.library.path=/usr/lib/micro-manager -classpath /usr/share/
 #include "DeviceBase.h"
 #include "ModuleInterface.h"
 #include "ImgBuffer.h"
+#include "PixelConversion.h"
 #include <sstream>
 #include <map>
 #include <vector>
@@ -83,7 +84,9 @@ const char
   *gPropertyDevicePath = "DevicePath",
   *gPropertyDevicePathDefault = "/dev/video0",
   *gPropertyNameResolution = "Resolution",
-  *gResolutionDefault = "640x480";
+  *gResolutionDefault = "640x480",
+  *gPropertyNameCaptureFormat = "CaptureFormat",
+  *gCaptureFormatDefault = "YUYV";
 
 const long gWidthDefault = 640,
            gHeightDefault = 480;
@@ -93,10 +96,26 @@ struct VidBuffer {
   size_t length;
 };
 
+// Capture formats that can be requested from the driver
+struct CaptureFormat {
+  const char *name;
+  unsigned int fourcc;
+};
+
+const CaptureFormat gCaptureFormats[] = {
+  { "YUYV", V4L2_PIX_FMT_YUYV },
+  { "UYVY", V4L2_PIX_FMT_UYVY },
+  { "NV12", V4L2_PIX_FMT_NV12 },
+  { "GREY", V4L2_PIX_FMT_GREY },
+  { "Y16", V4L2_PIX_FMT_Y16 },
+};
+
 // v4l2 state
 typedef struct State State;
 struct State {
   int W, H, fd;
+  unsigned int fourcc;
+  unsigned int bytesPerLine;
   struct VidBuffer *buffers;
   unsigned int buffers_count;
   struct v4l2_buffer *buf;
@@ -116,6 +135,14 @@ class PixelType {
     unsigned GetNumberOfComponents() const { return m_numberOfComponents; }
     unsigned GetBitDepth() const { return m_bitDepth; }
 
+    // true if images in the given capture format can be converted to this
+    // pixel type
+    virtual bool canConvert(unsigned int fourcc) const = 0;
+
+    // true if the capture format already has the layout of this pixel type,
+    // so that rows can be used as they are
+    virtual bool isPassThrough(unsigned int fourcc) const { (void) fourcc; return false; }
+
     virtual void convertV4l2ToOutput(
         State *state, unsigned char* in, unsigned char* output) const = 0;
   private:
@@ -133,20 +160,59 @@ class PixelType8Bit : public PixelType {
       PixelType(PROPERTY_VALUE, 1, 1, 8) {
       }
 
+    virtual bool canConvert(unsigned int fourcc) const {
+      (void) fourcc;
+      return true;
+    }
+
+    virtual bool isPassThrough(unsigned int fourcc) const {
+      return fourcc == V4L2_PIX_FMT_GREY;
+    }
+
     virtual void convertV4l2ToOutput(
         State *state, unsigned char* in, unsigned char* output) const {
-      int i,j;
-      for (j = 0; j < state->H; j++) {
-        int wj = state->W * j;
-        for (i = 0; i < state->W; i++) {
-          output[i + wj] = in[2*i + 2*wj];
-        }
+      switch (state->fourcc) {
+        case V4L2_PIX_FMT_YUYV:
+        case V4L2_PIX_FMT_UYVY:
+          v4l2conv::PackedYUV422ToGray8(in, state->bytesPerLine, state->W, state->H,
+              state->fourcc == V4L2_PIX_FMT_UYVY, output);
+          break;
+        case V4L2_PIX_FMT_Y16:
+          v4l2conv::Gray16ToGray8(in, state->bytesPerLine, state->W, state->H, output);
+          break;
+        default: // GREY, or the luma plane of NV12
+          v4l2conv::CopyRows(in, state->bytesPerLine, state->W, state->H, output);
+          break;
       }
     }
 };
 string PixelType8Bit::PROPERTY_VALUE = "8bit";
 PixelType8Bit PIXELTYPE_8BIT;
 
+class PixelType16Bit : public PixelType {
+  public:
+    static string PROPERTY_VALUE;
+
+    PixelType16Bit() :
+      PixelType(PROPERTY_VALUE, 2, 1, 16) {
+      }
+
+    virtual bool canConvert(unsigned int fourcc) const {
+      return fourcc == V4L2_PIX_FMT_Y16;
+    }
+
+    virtual bool isPassThrough(unsigned int fourcc) const {
+      return fourcc == V4L2_PIX_FMT_Y16;
+    }
+
+    virtual void convertV4l2ToOutput(
+        State *state, unsigned char* in, unsigned char* output) const {
+      v4l2conv::CopyRows(in, state->bytesPerLine, 2 * state->W, state->H, output);
+    }
+};
+string PixelType16Bit::PROPERTY_VALUE = "16bit";
+PixelType16Bit PIXELTYPE_16BIT;
+
 class PixelTypeYUYV : public PixelType {
   public:
     static string PROPERTY_VALUE;
@@ -155,42 +221,28 @@ class PixelTypeYUYV : public PixelType {
       PixelType(PROPERTY_VALUE, 4, 4, 8) {
       }
 
+    virtual bool canConvert(unsigned int fourcc) const {
+      return fourcc != V4L2_PIX_FMT_Y16;
+    }
+
     virtual void convertV4l2ToOutput(
         State *state, unsigned char* ptrIn, unsigned char* ptrOut) const {
-      /* Convert YUYV to RGBA32, apparently mm does only display colors
+      /* Convert to RGBA32, apparently mm does only display colors
        * in this format */
-      for (int i = 0;  i < state->W * state->H / 2; ++i) {
-        int y0 = ptrIn[0];
-        int u0 = ptrIn[1];
-        int y1 = ptrIn[2];
-        int v0 = ptrIn[3];
-        ptrIn += 4;
-        int c = y0 - 16;
-        int d = u0 - 128;
-        int e = v0 - 128;
-
-        ptrOut[0] = clip((298 * c + 516 * d + 128) >> 8); // blue
-        ptrOut[1] = clip((298 * c - 100 * d - 208 * e + 128) >> 8); // green
-        ptrOut[2] = clip((298 * c + 409 * e + 128) >> 8); // red
-        ptrOut[4] = 255; // alpha
-        c = y1 - 16;
-        ptrOut[4] = clip((298 * c + 516 * d + 128) >> 8); // blue
-        ptrOut[5] = clip((298 * c - 100 * d - 208 * e + 128) >> 8); // green
-        ptrOut[6] = clip((298 * c + 409 * e + 128) >> 8); // red
-        ptrOut[7] = 255; // alpha
-        ptrOut += 8;
+      switch (state->fourcc) {
+        case V4L2_PIX_FMT_YUYV:
+        case V4L2_PIX_FMT_UYVY:
+          v4l2conv::PackedYUV422ToBGRA(ptrIn, state->bytesPerLine, state->W, state->H,
+              state->fourcc == V4L2_PIX_FMT_UYVY, ptrOut);
+          break;
+        case V4L2_PIX_FMT_NV12:
+          v4l2conv::NV12ToBGRA(ptrIn, state->bytesPerLine, state->W, state->H, ptrOut);
+          break;
+        case V4L2_PIX_FMT_GREY:
+          v4l2conv::Gray8ToBGRA(ptrIn, state->bytesPerLine, state->W, state->H, ptrOut);
+          break;
       }
     }
-
-  private:
-    inline unsigned char clip(int val) const {
-      if (val <= 0)
-        return 0;
-      else if (val >= 255)
-        return 255;
-      else
-        return val;
-    }
 };
 string PixelTypeYUYV::PROPERTY_VALUE = "YUYV";
 PixelTypeYUYV PIXELTYPE_YUYV;
@@ -241,6 +293,17 @@ public:
     if (nRet != DEVICE_OK)
       return nRet;
 
+    // Format requested from the driver
+    pAct = new CPropertyAction(this, &V4L2::OnCaptureFormat);
+    nRet = CreateProperty(
+        gPropertyNameCaptureFormat, gCaptureFormatDefault, MM::String, false, pAct);
+    if (nRet != DEVICE_OK)
+      return nRet;
+
+    for (size_t i = 0; i < sizeof(gCaptureFormats) / sizeof(gCaptureFormats[0]); i++) {
+      AddAllowedValue(gPropertyNameCaptureFormat, gCaptureFormats[i].name);
+    }
+
     // Binning
     pAct = new CPropertyAction(this, &V4L2::OnBinning);
     nRet = CreateProperty(MM::g_Keyword_Binning, "1", MM::Integer, false, pAct);
@@ -256,6 +319,7 @@ public:
 
     vector<string> pixTypes;
     pixTypes.push_back(PixelType8Bit::PROPERTY_VALUE);
+    pixTypes.push_back(PixelType16Bit::PROPERTY_VALUE);
     pixTypes.push_back(PixelTypeYUYV::PROPERTY_VALUE);
     nRet = SetAllowedValues(MM::g_Keyword_PixelType, pixTypes);
     if (nRet != DEVICE_OK)
@@ -303,7 +367,9 @@ public:
   int SnapImage()
   {
     unsigned char* data = VideoTakeBuffer();
-    pixelType->convertV4l2ToOutput(state, data, const_cast<unsigned char*>(imageBuffer.GetPixels()));
+    if (data == 0)
+      return DEVICE_ERR;
+    pixelType->convertV4l2ToOutput(state, data, imageBuffer.GetPixelsRW());
     VideoReturnBuffer();
     return DEVICE_OK;
   }
@@ -427,6 +493,27 @@ public:
     return DEVICE_OK;
   }
 
+  int OnCaptureFormat(MM::PropertyBase* pProp, MM::ActionType eAct)
+  {
+    if (eAct == MM::AfterSet) {
+      if (IsCapturing())
+         return DEVICE_CAMERA_BUSY_ACQUIRING;
+
+      string format;
+      pProp->Get(format);
+      if (!pixelType->canConvert(lookupFourcc(format))) {
+        LogMessage("capture format " + format + " cannot be converted to pixel type " +
+            pixelType->GetPropertyValue());
+        return DEVICE_INVALID_PROPERTY_VALUE;
+      }
+
+      LogMessage("capture format changed to " + format);
+      return reinitializeDeviceIfRunning();
+    }
+
+    return DEVICE_OK;
+  }
+
   int OnBinning(MM::PropertyBase* pProp, MM::ActionType eAct)
   {
     if(eAct == MM::BeforeGet){
@@ -445,15 +532,25 @@ public:
 
       string pixType;
       pProp->Get(pixType);
+      PixelType *newPixelType;
       if (pixType == PixelType8Bit::PROPERTY_VALUE) {
-        pixelType = &PIXELTYPE_8BIT;
+        newPixelType = &PIXELTYPE_8BIT;
+      }
+      else if (pixType == PixelType16Bit::PROPERTY_VALUE) {
+        newPixelType = &PIXELTYPE_16BIT;
       }
       else if (pixType == PixelTypeYUYV::PROPERTY_VALUE) {
-        pixelType = &PIXELTYPE_YUYV;
+        newPixelType = &PIXELTYPE_YUYV;
       }
       else {
         return DEVICE_INVALID_PROPERTY;
       }
+
+      if (initialized_ && !newPixelType->canConvert(state->fourcc)) {
+        LogMessage("pixel type " + pixType + " is not available for the current capture format");
+        return DEVICE_INVALID_PROPERTY_VALUE;
+      }
+      pixelType = newPixelType;
   
       LogMessage("setting pixelType " + pixelType->GetPropertyValue());
       return this->resizeBuffer();
@@ -482,9 +579,54 @@ public:
      isSequenceable = false; 
      return DEVICE_OK;
   }
-  
+
+protected:
+
+  // Called from the sequence acquisition thread. Converts straight from the
+  // V4L2 mmap buffer; for pass-through formats without row padding the
+  // driver's buffer is handed to the core without an intermediate copy.
+  int ThreadRun()
+  {
+    unsigned char* data = VideoTakeBuffer();
+    if (data == 0)
+      return DEVICE_ERR;
+
+    const unsigned char* pixels = data;
+    const unsigned bytesPerPixel = pixelType->GetImageBytesPerPixel();
+    if (!pixelType->isPassThrough(state->fourcc) ||
+        state->bytesPerLine != state->W * bytesPerPixel) {
+      pixelType->convertV4l2ToOutput(state, data, imageBuffer.GetPixelsRW());
+      pixels = imageBuffer.GetPixels();
+    }
+
+    char label[MM::MaxStrLength];
+    GetLabel(label);
+    Metadata md;
+    md.put("Camera", label);
+    int ret = GetCoreCallback()->InsertImage(this, pixels, state->W, state->H,
+        bytesPerPixel, md.Serialize().c_str());
+    if (!isStopOnOverflow() && ret == DEVICE_BUFFER_OVERFLOW) {
+      // do not stop on overflow - just reset the buffer
+      GetCoreCallback()->ClearImageBuffer(this);
+      ret = GetCoreCallback()->InsertImage(this, pixels, state->W, state->H,
+          bytesPerPixel, md.Serialize().c_str());
+    }
+
+    VideoReturnBuffer();
+    return ret;
+  }
+
 private:
 
+  static unsigned int lookupFourcc(const string& name)
+  {
+    for (size_t i = 0; i < sizeof(gCaptureFormats) / sizeof(gCaptureFormats[0]); i++) {
+      if (name == gCaptureFormats[i].name)
+        return gCaptureFormats[i].fourcc;
+    }
+    return V4L2_PIX_FMT_YUYV;
+  }
+
   bool
   VideoInit()
   {
@@ -510,7 +652,14 @@ private:
       return false;
     }
 
-    ret = initDevice(devicePath, requestedWidth, requestedHeight);
+    char captureFormat[MM::MaxStrLength];
+    ret = GetProperty(gPropertyNameCaptureFormat, captureFormat);
+    if (ret != DEVICE_OK) {
+      LogMessage("could not read capture format property");
+      return false;
+    }
+
+    ret = initDevice(devicePath, requestedWidth, requestedHeight, lookupFourcc(captureFormat));
     if (ret != DEVICE_OK)
       return false;
 
@@ -591,7 +740,8 @@ private:
   }
 
   int
-  initDevice(const char* devicePath, long requestedWidth, long requestedHeight)
+  initDevice(const char* devicePath, long requestedWidth, long requestedHeight,
+      unsigned int fourcc)
   {
     struct v4l2_capability cap;
     struct v4l2_format fmt;
@@ -625,18 +775,31 @@ private:
     memset(&fmt, 0, sizeof(fmt));
 
     fmt.type                = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    fmt.fmt.pix.pixelformat = V4L2_PIX_FMT_YUYV;
+    fmt.fmt.pix.pixelformat = fourcc;
     fmt.fmt.pix.field       = V4L2_FIELD_INTERLACED;
-    fmt.fmt.pix.height      = (unsigned) requestedWidth;
-    fmt.fmt.pix.width       = (unsigned) requestedHeight;
+    fmt.fmt.pix.width       = (unsigned) requestedWidth;
+    fmt.fmt.pix.height      = (unsigned) requestedHeight;
 
     if (-1 == tryIoctl(state->fd, VIDIOC_S_FMT, &fmt)) {
       ostringstream msg;
-      msg << "error: could not set format YUYV: " << strerror(errno);
+      msg << "error: could not set capture format: " << strerror(errno);
       LogMessage(msg.str().c_str());
       return DEVICE_ERR;
     }
 
+    if (fmt.fmt.pix.pixelformat != fourcc) {
+      ostringstream msg;
+      msg << "error: device does not support the requested capture format";
+      LogMessage(msg.str().c_str());
+      return DEVICE_ERR;
+    }
+
+    if (!pixelType->canConvert(fourcc)) {
+      LogMessage("error: capture format cannot be converted to pixel type " +
+          pixelType->GetPropertyValue());
+      return DEVICE_ERR;
+    }
+
     if (fmt.fmt.pix.width != requestedWidth) {
       ostringstream msg;
       msg << "warning: device did not match requested pixel width: "
@@ -655,11 +818,19 @@ private:
 
     state->W = fmt.fmt.pix.width;
     state->H = fmt.fmt.pix.height;
+    state->fourcc = fourcc;
+    state->bytesPerLine = fmt.fmt.pix.bytesperline;
+    if (state->bytesPerLine == 0) {
+      // bytesperline is optional for single-plane formats
+      unsigned bytesPerSample = (fourcc == V4L2_PIX_FMT_YUYV || fourcc == V4L2_PIX_FMT_UYVY ||
+          fourcc == V4L2_PIX_FMT_Y16) ? 2 : 1;
+      state->bytesPerLine = state->W * bytesPerSample;
+    }
 
     ostringstream formatMsg;
     formatMsg << "device is configured for " << state->W << "x" << state->H << " pixel"
               << " and " << fmt.fmt.pix.bytesperline << " bytes per line ("
-              << (fmt.fmt.pix.bytesperline / state->H) <<" bpp)";
+              << (state->bytesPerLine / state->W) <<" bytes per pixel)";
     LogMessage(formatMsg.str().c_str());
     return DEVICE_OK;
   }
@@ -702,7 +873,7 @@ private:
       ostringstream msg;
       msg << "error: could not prepare next image buffer: " << strerror(errno);
       LogMessage(msg.str().c_str());
-      assert(false);
+      return 0;
     }
 
     assert(state->buf->index < state->buffers_count);
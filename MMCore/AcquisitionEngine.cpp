@@ -0,0 +1,766 @@
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//
+// DESCRIPTION:   Runs an AcquisitionPlan on its own thread, using hardware
+//                sequencing where the devices support it
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "AcquisitionEngine.h"
+
+#include "CircularBuffer.h"
+#include "CoreUtils.h"
+#include "DeviceManager.h"
+#include "Devices/CameraInstance.h"
+#include "MMCore.h"
+#include "TraceRecorder.h"
+
+#include <algorithm>
+#include <sstream>
+
+namespace mm
+{
+
+const char* const g_Keyword_AcqFrameIndex = "FrameIndex";
+const char* const g_Keyword_AcqPositionIndex = "PositionIndex";
+const char* const g_Keyword_AcqChannelIndex = "ChannelIndex";
+const char* const g_Keyword_AcqSliceIndex = "SliceIndex";
+const char* const g_Keyword_AcqChannel = "Channel";
+const char* const g_Keyword_AcqZPosition = "ZPositionUm";
+
+
+namespace
+{
+
+// Fills in the run's sequenced axes if the events can be taken as a single
+// camera burst, with every changing setting driven by a device sequence
+bool
+TrySequence(const std::vector<AcquisitionEvent>& events,
+      const AcquisitionPlan& plan, const SequencingLimits& limits,
+      AcquisitionRun& run)
+{
+   const long n = static_cast<long>(events.size());
+   if (!limits.cameraBurst || n < 2)
+      return false;
+
+   bool zVaries = false;
+   bool channelVaries = false;
+   for (long i = 1; i < n; ++i)
+   {
+      zVaries = zVaries || events[i].slice != events[0].slice;
+      channelVaries = channelVaries || events[i].channel != events[0].channel;
+   }
+
+   if (zVaries && limits.zStage < n)
+      return false;
+
+   std::vector<std::pair<std::string, std::string> > properties;
+   bool exposureVaries = false;
+   if (channelVaries)
+   {
+      for (long i = 0; i < n; ++i)
+      {
+         if (events[i].channel >= static_cast<long>(limits.channelSettings.size()))
+            return false;
+      }
+
+      const double exposure0 = plan.getChannelExposure(events[0].channel);
+      for (long i = 1; i < n; ++i)
+      {
+         double exposure = plan.getChannelExposure(events[i].channel);
+         if (exposure != exposure0)
+         {
+            if (exposure <= 0.0 || exposure0 <= 0.0)
+               return false; // Cannot sequence "unchanged"
+            exposureVaries = true;
+         }
+      }
+      if (exposureVaries && limits.exposure < n)
+         return false;
+
+      // Every channel must set the same properties; those whose values
+      // differ must be sequenceable
+      Configuration first = limits.channelSettings[events[0].channel];
+      for (long i = 1; i < n; ++i)
+      {
+         if (limits.channelSettings[events[i].channel].size() != first.size())
+            return false;
+      }
+      for (std::size_t s = 0; s < first.size(); ++s)
+      {
+         PropertySetting setting = first.getSetting(s);
+         const std::string device = setting.getDeviceLabel();
+         const std::string property = setting.getPropertyName();
+         bool varies = false;
+         for (long i = 1; i < n; ++i)
+         {
+            Configuration other = limits.channelSettings[events[i].channel];
+            if (!other.isPropertyIncluded(device.c_str(), property.c_str()))
+               return false;
+            if (other.getSetting(device.c_str(), property.c_str()).
+                  getPropertyValue() != setting.getPropertyValue())
+               varies = true;
+         }
+         if (!varies)
+            continue;
+
+         std::map<std::string, long>::const_iterator it =
+            limits.properties.find(setting.getKey());
+         if (it == limits.properties.end() || it->second < n)
+            return false;
+         properties.push_back(std::make_pair(device, property));
+      }
+   }
+
+   run.events = events;
+   run.sequenceZ = zVaries;
+   run.sequenceExposure = exposureVaries;
+   run.sequencedProperties = properties;
+   return true;
+}
+
+} // anonymous namespace
+
+
+AcquisitionEngine::AcquisitionEngine(CMMCore* core) :
+   core_(core),
+   currentPosition_(-1),
+   currentChannel_(-1),
+   currentSlice_(-1),
+   stopRequested_(false),
+   running_(false),
+   burstFinished_(false),
+   burstComplete_(false)
+{
+}
+
+AcquisitionEngine::~AcquisitionEngine()
+{
+   Stop();
+}
+
+std::vector<AcquisitionRun>
+AcquisitionEngine::Compile(const AcquisitionPlan& plan,
+      const SequencingLimits& limits)
+{
+   const long nFrames = (std::max)(1L, plan.getTimepointCount());
+   const long nPositions = (std::max)(1L, plan.getXYPositionCount());
+   const long nChannels = (std::max)(1L, plan.getChannelCount());
+   const long nSlices = (std::max)(1L, plan.getZPositionCount());
+
+   // The exposure of the only channel, if the plan sets one
+   double exposureMs = limits.cameraExposureMs;
+   if (plan.getChannelCount() == 1 && plan.getChannelExposure(0) > 0.0)
+      exposureMs = plan.getChannelExposure(0);
+
+   std::vector<AcquisitionRun> runs;
+   if (nPositions == 1 && nChannels == 1 && nSlices == 1 && nFrames > 1 &&
+         limits.cameraBurst && plan.getIntervalMs() <= exposureMs)
+   {
+      AcquisitionRun run(AcquisitionRun::TimeSequence);
+      for (long t = 0; t < nFrames; ++t)
+         run.events.push_back(AcquisitionEvent(t, 0, 0, 0));
+      runs.push_back(run);
+      return runs;
+   }
+
+   const bool channelsFirst = plan.isChannelsFirst();
+   const long nOuter = channelsFirst ? nSlices : nChannels;
+   const long nInner = channelsFirst ? nChannels : nSlices;
+   for (long t = 0; t < nFrames; ++t)
+   {
+      for (long p = 0; p < nPositions; ++p)
+      {
+         std::vector<std::vector<AcquisitionEvent> > groups(nOuter);
+         std::vector<AcquisitionEvent> block;
+         for (long o = 0; o < nOuter; ++o)
+         {
+            for (long i = 0; i < nInner; ++i)
+            {
+               AcquisitionEvent e = channelsFirst ?
+                  AcquisitionEvent(t, p, i, o) : AcquisitionEvent(t, p, o, i);
+               groups[o].push_back(e);
+               block.push_back(e);
+            }
+         }
+
+         AcquisitionRun blockRun(AcquisitionRun::DeviceSequence);
+         if (TrySequence(block, plan, limits, blockRun))
+         {
+            runs.push_back(blockRun);
+            continue;
+         }
+
+         for (long o = 0; o < nOuter; ++o)
+         {
+            AcquisitionRun groupRun(AcquisitionRun::DeviceSequence);
+            if (TrySequence(groups[o], plan, limits, groupRun))
+               runs.push_back(groupRun);
+            else
+            {
+               AcquisitionRun softwareRun(AcquisitionRun::Software);
+               softwareRun.events = groups[o];
+               runs.push_back(softwareRun);
+            }
+         }
+      }
+   }
+   return runs;
+}
+
+std::string
+AcquisitionEngine::Describe(const std::vector<AcquisitionRun>& runs)
+{
+   std::ostringstream os;
+   for (std::size_t i = 0; i < runs.size(); ++i)
+   {
+      const AcquisitionRun& run = runs[i];
+      const AcquisitionEvent& first = run.events.front();
+      const AcquisitionEvent& last = run.events.back();
+      if (first.frame == last.frame)
+         os << "Frame " << first.frame;
+      else
+         os << "Frames " << first.frame << "-" << last.frame;
+      os << ", position " << first.position << ": ";
+
+      switch (run.kind)
+      {
+         case AcquisitionRun::Software:
+            os << run.events.size() << " software-timed image(s)";
+            break;
+         case AcquisitionRun::DeviceSequence:
+         {
+            os << "hardware sequence of " << run.events.size() << " images (";
+            const char* sep = "";
+            if (run.sequenceZ)
+            {
+               os << sep << "Z";
+               sep = ", ";
+            }
+            if (run.sequenceExposure)
+            {
+               os << sep << "exposure";
+               sep = ", ";
+            }
+            for (std::size_t j = 0; j < run.sequencedProperties.size(); ++j)
+            {
+               os << sep << run.sequencedProperties[j].first << "-" <<
+                  run.sequencedProperties[j].second;
+               sep = ", ";
+            }
+            os << ")";
+            break;
+         }
+         case AcquisitionRun::TimeSequence:
+            os << "camera burst of " << run.events.size() << " images";
+            break;
+      }
+      os << '\n';
+   }
+   return os.str();
+}
+
+void
+AcquisitionEngine::Validate(const AcquisitionPlan& plan) throw (CMMError)
+{
+   if (plan.getTimepointCount() < 1)
+      throw CMMError("Acquisition plan must have at least one time point");
+   if (plan.getIntervalMs() < 0.0)
+      throw CMMError("Acquisition plan interval must not be negative");
+   if (core_->getCameraDevice().empty())
+      throw CMMError(core_->getCoreErrorText(MMERR_CameraNotAvailable).c_str(),
+            MMERR_CameraNotAvailable);
+
+   if (plan.getChannelCount() > 0)
+   {
+      const std::string group = plan.getChannelGroup();
+      if (group.empty())
+         throw CMMError("Acquisition plan has channels but no channel group");
+      for (long i = 0; i < plan.getChannelCount(); ++i)
+      {
+         const std::string channel = plan.getChannel(i);
+         if (!core_->isConfigDefined(group.c_str(), channel.c_str()))
+            throw CMMError("Channel " + ToQuotedString(channel) +
+                  " is not a preset of group " + ToQuotedString(group),
+                  MMERR_NoConfiguration);
+      }
+   }
+
+   if (plan.getZPositionCount() > 0 && plan.getZStage().empty() &&
+         core_->getFocusDevice().empty())
+      throw CMMError("Acquisition plan has Z slices but there is no focus device",
+            MMERR_InvalidStageDevice);
+
+   if (plan.getXYPositionCount() > 0 && core_->getXYStageDevice().empty())
+      throw CMMError("Acquisition plan has XY positions but there is no XY stage",
+            MMERR_InvalidXYStageDevice);
+}
+
+SequencingLimits
+AcquisitionEngine::GetLimits(const AcquisitionPlan& plan) throw (CMMError)
+{
+   Validate(plan);
+
+   SequencingLimits limits;
+   const std::string camera = core_->getCameraDevice();
+   limits.cameraBurst = core_->getNumberOfCameraChannels() == 1;
+   limits.cameraExposureMs = core_->getExposure();
+
+   if (plan.getZPositionCount() > 1)
+   {
+      std::string zStage = plan.getZStage();
+      if (zStage.empty())
+         zStage = core_->getFocusDevice();
+      if (core_->isStageSequenceable(zStage.c_str()))
+         limits.zStage = core_->getStageSequenceMaxLength(zStage.c_str());
+   }
+
+   const std::string group = plan.getChannelGroup();
+   for (long i = 0; i < plan.getChannelCount(); ++i)
+   {
+      const std::string channel = plan.getChannel(i);
+      limits.channelSettings.push_back(
+            core_->getConfigData(group.c_str(), channel.c_str()));
+   }
+   if (plan.getChannelCount() > 1)
+   {
+      if (core_->isExposureSequenceable(camera.c_str()))
+         limits.exposure = core_->getExposureSequenceMaxLength(camera.c_str());
+
+      for (std::size_t c = 0; c < limits.channelSettings.size(); ++c)
+      {
+         const Configuration& config = limits.channelSettings[c];
+         for (std::size_t s = 0; s < config.size(); ++s)
+         {
+            PropertySetting setting = config.getSetting(s);
+            if (limits.properties.count(setting.getKey()))
+               continue;
+            const std::string device = setting.getDeviceLabel();
+            const std::string property = setting.getPropertyName();
+            long maxLength = 0;
+            if (core_->isPropertySequenceable(device.c_str(), property.c_str()))
+               maxLength = core_->getPropertySequenceMaxLength(device.c_str(),
+                     property.c_str());
+            limits.properties[setting.getKey()] = maxLength;
+         }
+      }
+   }
+   return limits;
+}
+
+void
+AcquisitionEngine::Start(const AcquisitionPlan& plan) throw (CMMError)
+{
+   if (IsRunning())
+      throw CMMError("An acquisition plan is already running",
+            MMERR_NotAllowedDuringSequenceAcquisition);
+   if (core_->isSequenceRunning())
+      throw CMMError(core_->getCoreErrorText(
+               MMERR_NotAllowedDuringSequenceAcquisition).c_str(),
+            MMERR_NotAllowedDuringSequenceAcquisition);
+
+   SequencingLimits limits = GetLimits(plan);
+   std::vector<AcquisitionRun> runs = Compile(plan, limits);
+
+   Join(); // A previous plan that has finished
+   core_->initializeCircularBuffer();
+   core_->clearCircularBuffer();
+
+   plan_ = plan;
+   camera_ = core_->getCameraDevice();
+   zStage_ = plan.getZStage().empty() ? core_->getFocusDevice() : plan.getZStage();
+   xyStage_ = core_->getXYStageDevice();
+   channelSettings_ = limits.channelSettings;
+   currentPosition_ = currentChannel_ = currentSlice_ = -1;
+   error_.clear();
+   stopRequested_ = false;
+   running_ = true;
+
+   LOG_INFO(core_->coreLogger_) << "Starting acquisition plan:\n" <<
+      Describe(runs);
+   try
+   {
+      thread_ = std::thread(&AcquisitionEngine::RunPlan, this, runs);
+   }
+   catch (const std::system_error& e)
+   {
+      running_ = false;
+      throw CMMError(std::string("Cannot start acquisition thread: ") + e.what());
+   }
+}
+
+void
+AcquisitionEngine::Stop()
+{
+   stopRequested_ = true;
+   {
+      std::lock_guard<std::mutex> lock(waitMutex_);
+   }
+   stopCondition_.notify_all();
+   Join();
+}
+
+bool
+AcquisitionEngine::IsRunning() const
+{
+   return running_;
+}
+
+void
+AcquisitionEngine::Wait() throw (CMMError)
+{
+   Join();
+   std::lock_guard<std::mutex> lock(joinMutex_);
+   if (!error_.empty())
+      throw CMMError(error_);
+}
+
+void
+AcquisitionEngine::Join()
+{
+   std::lock_guard<std::mutex> lock(joinMutex_);
+   if (thread_.joinable())
+      thread_.join();
+}
+
+void
+AcquisitionEngine::TagInsertedImage(const std::string& cameraLabel,
+      Metadata& md)
+{
+   std::lock_guard<std::mutex> lock(tagsMutex_);
+   if (pendingTags_.empty() || cameraLabel != tagCamera_)
+      return;
+   md.Merge(pendingTags_.front());
+   pendingTags_.pop_front();
+   if (pendingTags_.empty())
+   {
+      {
+         std::lock_guard<std::mutex> waitLock(waitMutex_);
+         burstComplete_ = true;
+      }
+      stopCondition_.notify_all();
+   }
+}
+
+void
+AcquisitionEngine::SequenceFinished(const std::string& cameraLabel)
+{
+   {
+      std::lock_guard<std::mutex> lock(tagsMutex_);
+      if (cameraLabel != tagCamera_)
+         return;
+   }
+   {
+      std::lock_guard<std::mutex> lock(waitMutex_);
+      burstFinished_ = true;
+   }
+   stopCondition_.notify_all();
+}
+
+void
+AcquisitionEngine::RunPlan(std::vector<AcquisitionRun> runs)
+{
+   TraceRecorder::SetCurrentThreadName("Acquisition engine");
+   startTime_ = std::chrono::steady_clock::now();
+   std::string error;
+   try
+   {
+      for (std::size_t i = 0; i < runs.size() && !stopRequested_; ++i)
+      {
+         const AcquisitionRun& run = runs[i];
+         if (run.kind != AcquisitionRun::TimeSequence)
+            WaitForFrame(run.events.front().frame);
+         if (stopRequested_)
+            break;
+
+         if (run.kind == AcquisitionRun::Software)
+            RunSoftware(run);
+         else
+            RunSequence(run);
+      }
+   }
+   catch (const CMMError& e)
+   {
+      error = e.getMsg();
+   }
+
+   if (!error.empty())
+      LOG_ERROR(core_->coreLogger_) << "Acquisition plan failed: " << error;
+   else if (stopRequested_)
+      LOG_INFO(core_->coreLogger_) << "Acquisition plan stopped";
+   else
+      LOG_INFO(core_->coreLogger_) << "Acquisition plan finished";
+   error_ = error;
+   running_ = false;
+}
+
+void
+AcquisitionEngine::WaitForFrame(long frame)
+{
+   const double intervalMs = plan_.getIntervalMs();
+   if (frame == 0 || intervalMs <= 0.0)
+      return;
+   std::chrono::steady_clock::time_point due = startTime_ +
+      std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double, std::milli>(frame * intervalMs));
+   std::unique_lock<std::mutex> lock(waitMutex_);
+   stopCondition_.wait_until(lock, due, [this] { return stopRequested_.load(); });
+}
+
+void
+AcquisitionEngine::ApplyEvent(const AcquisitionEvent& event) throw (CMMError)
+{
+   if (plan_.getXYPositionCount() > 0 && event.position != currentPosition_)
+   {
+      core_->setXYPosition(xyStage_.c_str(),
+            plan_.getXPosition(event.position),
+            plan_.getYPosition(event.position));
+      core_->waitForDevice(xyStage_.c_str());
+      currentPosition_ = event.position;
+   }
+
+   if (plan_.getChannelCount() > 0 && event.channel != currentChannel_)
+   {
+      const std::string group = plan_.getChannelGroup();
+      const std::string channel = plan_.getChannel(event.channel);
+      core_->setConfig(group.c_str(), channel.c_str());
+      core_->waitForConfig(group.c_str(), channel.c_str());
+      const double exposure = plan_.getChannelExposure(event.channel);
+      if (exposure > 0.0)
+         core_->setExposure(camera_.c_str(), exposure);
+      currentChannel_ = event.channel;
+   }
+
+   if (plan_.getZPositionCount() > 0 && event.slice != currentSlice_)
+   {
+      core_->setPosition(zStage_.c_str(), plan_.getZPosition(event.slice));
+      core_->waitForDevice(zStage_.c_str());
+      currentSlice_ = event.slice;
+   }
+}
+
+Metadata
+AcquisitionEngine::MakeTags(const AcquisitionEvent& event) const
+{
+   Metadata md;
+   md.PutImageTag(g_Keyword_AcqFrameIndex, event.frame);
+   md.PutImageTag(g_Keyword_AcqPositionIndex, event.position);
+   md.PutImageTag(g_Keyword_AcqChannelIndex, event.channel);
+   md.PutImageTag(g_Keyword_AcqSliceIndex, event.slice);
+   if (plan_.getChannelCount() > 0)
+      md.PutImageTag(g_Keyword_AcqChannel, plan_.getChannel(event.channel));
+   if (plan_.getZPositionCount() > 0)
+      md.PutImageTag(g_Keyword_AcqZPosition, plan_.getZPosition(event.slice));
+   return md;
+}
+
+void
+AcquisitionEngine::RunSoftware(const AcquisitionRun& run) throw (CMMError)
+{
+   for (std::size_t i = 0; i < run.events.size() && !stopRequested_; ++i)
+   {
+      const AcquisitionEvent& event = run.events[i];
+      ApplyEvent(event);
+      core_->snapImage();
+
+      const unsigned nChannels = core_->getNumberOfCameraChannels();
+      const unsigned width = core_->getImageWidth();
+      const unsigned height = core_->getImageHeight();
+      const unsigned byteDepth = core_->getBytesPerPixel();
+      const unsigned nComponents = core_->getNumberOfComponents();
+      const unsigned bitDepth = core_->getImageBitDepth();
+      const MM::Device* cameraKey =
+         core_->deviceManager_->GetDevice(camera_)->GetRawPtr();
+      for (unsigned ch = 0; ch < nChannels; ++ch)
+      {
+         Metadata md = MakeTags(event);
+         md.PutImageTag("Camera", camera_);
+         if (nChannels > 1)
+            md.PutImageTag(MM::g_Keyword_CameraChannelIndex, ch);
+         const unsigned char* pixels =
+            static_cast<const unsigned char*>(core_->getImage(ch));
+         if (!core_->cbuf_->InsertImage(pixels, width, height, byteDepth,
+                  nComponents, &md, cameraKey, bitDepth))
+            throw CMMError("Circular buffer is full; images were not retrieved "
+                  "fast enough");
+      }
+   }
+}
+
+void
+AcquisitionEngine::RunSequence(const AcquisitionRun& run) throw (CMMError)
+{
+   const long n = static_cast<long>(run.events.size());
+   try
+   {
+      ApplyEvent(run.events.front());
+
+      if (run.sequenceZ)
+      {
+         std::vector<double> positions;
+         for (long i = 0; i < n; ++i)
+            positions.push_back(plan_.getZPosition(run.events[i].slice));
+         core_->loadStageSequence(zStage_.c_str(), positions);
+         core_->startStageSequence(zStage_.c_str());
+      }
+      if (run.sequenceExposure)
+      {
+         std::vector<double> exposures;
+         for (long i = 0; i < n; ++i)
+            exposures.push_back(plan_.getChannelExposure(run.events[i].channel));
+         core_->loadExposureSequence(camera_.c_str(), exposures);
+         core_->startExposureSequence(camera_.c_str());
+      }
+      for (std::size_t p = 0; p < run.sequencedProperties.size(); ++p)
+      {
+         const std::string& device = run.sequencedProperties[p].first;
+         const std::string& property = run.sequencedProperties[p].second;
+         std::vector<std::string> values;
+         for (long i = 0; i < n; ++i)
+         {
+            values.push_back(channelSettings_[run.events[i].channel].
+                  getSetting(device.c_str(), property.c_str()).getPropertyValue());
+         }
+         core_->loadPropertySequence(device.c_str(), property.c_str(), values);
+         core_->startPropertySequence(device.c_str(), property.c_str());
+      }
+
+      {
+         std::lock_guard<std::mutex> lock(tagsMutex_);
+         tagCamera_ = camera_;
+         for (long i = 0; i < n; ++i)
+            pendingTags_.push_back(MakeTags(run.events[i]));
+      }
+
+      const double intervalMs = run.kind == AcquisitionRun::TimeSequence ?
+         plan_.getIntervalMs() : 0.0;
+      std::shared_ptr<CameraInstance> camera =
+         core_->deviceManager_->GetDeviceOfType<CameraInstance>(camera_);
+      {
+         std::lock_guard<std::mutex> lock(waitMutex_);
+         burstFinished_ = false;
+         burstComplete_ = false;
+      }
+      {
+         mm::DeviceModuleLockGuard guard(camera);
+         core_->cacheStatisticsBitDepth(camera);
+         int nRet = camera->StartSequenceAcquisition(n, intervalMs, true);
+         if (nRet != DEVICE_OK)
+            throw CMMError(core_->getDeviceErrorText(nRet, camera).c_str(),
+                  MMERR_DEVICE_GENERIC);
+      }
+      WaitForBurst(n);
+   }
+   catch (const CMMError&)
+   {
+      StopSequences(run);
+      throw;
+   }
+   StopSequences(run);
+}
+
+void
+AcquisitionEngine::WaitForBurst(long expectedImages) throw (CMMError)
+{
+   // Woken by SequenceFinished(), by TagInsertedImage() once the last image
+   // is in (for cameras that do not report the end of their sequences) or by
+   // Stop()
+   for (;;)
+   {
+      {
+         std::unique_lock<std::mutex> lock(waitMutex_);
+         stopCondition_.wait(lock, [this]
+               { return stopRequested_.load() || burstFinished_ || burstComplete_; });
+         if (stopRequested_ || burstComplete_)
+            break;
+         burstFinished_ = false;
+      }
+      // Cameras may stop reporting IsCapturing() before their sequence thread
+      // calls AcqFinished(), in which case stopSequenceAcquisition() does not
+      // join it and the previous burst's notification can arrive during this
+      // one; it is only taken as the end of the burst once the camera is idle
+      if (!core_->isSequenceRunning(camera_.c_str()))
+         break;
+   }
+
+   // Stops the camera if needed, and otherwise waits for its sequence
+   // thread to exit, so that the next burst can start
+   core_->stopSequenceAcquisition(camera_.c_str());
+
+   std::size_t missing;
+   {
+      std::lock_guard<std::mutex> lock(tagsMutex_);
+      missing = pendingTags_.size();
+   }
+   if (missing > 0 && !stopRequested_)
+   {
+      std::ostringstream os;
+      os << "Camera sequence ended after " << expectedImages - missing <<
+         " of " << expectedImages << " images";
+      throw CMMError(os.str());
+   }
+}
+
+void
+AcquisitionEngine::StopSequences(const AcquisitionRun& run)
+{
+   {
+      std::lock_guard<std::mutex> lock(tagsMutex_);
+      pendingTags_.clear();
+      tagCamera_.clear();
+   }
+
+   // Stopping is attempted for every sequenced device even if one fails; the
+   // settings after a sequence are unknown, so they are applied anew
+   try
+   {
+      if (run.sequenceZ)
+      {
+         currentSlice_ = -1;
+         core_->stopStageSequence(zStage_.c_str());
+      }
+   }
+   catch (const CMMError& e)
+   {
+      LOG_ERROR(core_->coreLogger_) << "Cannot stop Z sequence: " << e.getMsg();
+   }
+   try
+   {
+      if (run.sequenceExposure)
+      {
+         currentChannel_ = -1;
+         core_->stopExposureSequence(camera_.c_str());
+      }
+   }
+   catch (const CMMError& e)
+   {
+      LOG_ERROR(core_->coreLogger_) << "Cannot stop exposure sequence: " <<
+         e.getMsg();
+   }
+   for (std::size_t p = 0; p < run.sequencedProperties.size(); ++p)
+   {
+      currentChannel_ = -1;
+      const std::string& device = run.sequencedProperties[p].first;
+      const std::string& property = run.sequencedProperties[p].second;
+      try
+      {
+         core_->stopPropertySequence(device.c_str(), property.c_str());
+      }
+      catch (const CMMError& e)
+      {
+         LOG_ERROR(core_->coreLogger_) << "Cannot stop sequence of " <<
+            device << "-" << property << ": " << e.getMsg();
+      }
+   }
+}
+
+} // namespace mm
@@ -0,0 +1,193 @@
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//
+// DESCRIPTION:   Runs an AcquisitionPlan on its own thread, using hardware
+//                sequencing where the devices support it
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include "../MMDevice/ImageMetadata.h"
+#include "AcquisitionPlan.h"
+#include "Configuration.h"
+#include "Error.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+class CMMCore;
+
+namespace mm
+{
+
+// Metadata tags added to every image of an acquisition plan
+extern const char* const g_Keyword_AcqFrameIndex;
+extern const char* const g_Keyword_AcqPositionIndex;
+extern const char* const g_Keyword_AcqChannelIndex;
+extern const char* const g_Keyword_AcqSliceIndex;
+extern const char* const g_Keyword_AcqChannel;
+extern const char* const g_Keyword_AcqZPosition;
+
+
+// One image of a plan, by its index on each axis (0 for absent axes)
+struct AcquisitionEvent
+{
+   long frame;
+   long position;
+   long channel;
+   long slice;
+
+   AcquisitionEvent(long f, long p, long c, long s) :
+      frame(f), position(p), channel(c), slice(s)
+   {}
+};
+
+
+// What the devices can sequence, as found when the plan is started
+struct SequencingLimits
+{
+   // Maximum sequence lengths; 0 if not sequenceable
+   long zStage;
+   long exposure;
+   std::map<std::string, long> properties; // By PropertySetting::getKey()
+
+   // Whether the camera can run bursts of tagged images (single channel)
+   bool cameraBurst;
+
+   // The camera's exposure; a burst is at least this far apart
+   double cameraExposureMs;
+
+   // The settings of each channel preset, in plan order
+   std::vector<Configuration> channelSettings;
+
+   SequencingLimits() :
+      zStage(0), exposure(0), cameraBurst(false), cameraExposureMs(0.0)
+   {}
+};
+
+
+// A group of consecutive events executed together
+struct AcquisitionRun
+{
+   enum Kind
+   {
+      Software, // Set the devices and snap, for each event
+      DeviceSequence, // Load device sequences, then one camera burst
+      TimeSequence, // Camera burst, no faster than the plan's interval
+   };
+
+   Kind kind;
+   std::vector<AcquisitionEvent> events;
+   bool sequenceZ;
+   bool sequenceExposure;
+   std::vector<std::pair<std::string, std::string> > sequencedProperties;
+
+   explicit AcquisitionRun(Kind k) :
+      kind(k), sequenceZ(false), sequenceExposure(false)
+   {}
+};
+
+
+class AcquisitionEngine
+{
+public:
+   explicit AcquisitionEngine(CMMCore* core);
+   ~AcquisitionEngine();
+
+   AcquisitionEngine(const AcquisitionEngine&) = delete;
+   AcquisitionEngine& operator=(const AcquisitionEngine&) = delete;
+
+   // Splits the plan into runs: the events of each time point and position
+   // are sequenced as a whole if possible, otherwise in groups along the
+   // outer of Z and channel, otherwise executed one by one. A plan with a
+   // single image per time point and no positions becomes one time burst if
+   // the camera's exposure is at least the interval (cameras generally run
+   // bursts as fast as they can, ignoring the interval requested); with a
+   // longer interval, its frames are timed in software.
+   static std::vector<AcquisitionRun> Compile(const AcquisitionPlan& plan,
+         const SequencingLimits& limits);
+
+   // One line per run
+   static std::string Describe(const std::vector<AcquisitionRun>& runs);
+
+   // Queries the current devices
+   SequencingLimits GetLimits(const AcquisitionPlan& plan) throw (CMMError);
+
+   // Validates and compiles the plan, prepares the circular buffer and runs
+   // the plan on a new thread
+   void Start(const AcquisitionPlan& plan) throw (CMMError);
+
+   // Requests the running plan to stop and waits for it
+   void Stop();
+
+   bool IsRunning() const;
+
+   // Waits for the plan to finish; throws if it failed
+   void Wait() throw (CMMError);
+
+   // Adds the axis tags to an image inserted by a camera during a sequence
+   // run. Called on the camera's thread.
+   void TagInsertedImage(const std::string& cameraLabel, Metadata& md);
+
+   // Called when a camera reports the end of a sequence acquisition
+   void SequenceFinished(const std::string& cameraLabel);
+
+private:
+   void Validate(const AcquisitionPlan& plan) throw (CMMError);
+   void Join();
+   void RunPlan(std::vector<AcquisitionRun> runs);
+   void RunSoftware(const AcquisitionRun& run) throw (CMMError);
+   void RunSequence(const AcquisitionRun& run) throw (CMMError);
+   void ApplyEvent(const AcquisitionEvent& event) throw (CMMError);
+   void WaitForFrame(long frame);
+   void WaitForBurst(long expectedImages) throw (CMMError);
+   void StopSequences(const AcquisitionRun& run);
+   Metadata MakeTags(const AcquisitionEvent& event) const;
+
+   CMMCore* const core_;
+
+   // The plan being run and its settings, owned by the run thread
+   AcquisitionPlan plan_;
+   std::string camera_;
+   std::string zStage_;
+   std::string xyStage_;
+   std::vector<Configuration> channelSettings_;
+   std::chrono::steady_clock::time_point startTime_;
+   long currentPosition_;
+   long currentChannel_;
+   long currentSlice_;
+
+   std::atomic<bool> stopRequested_;
+   std::atomic<bool> running_;
+   std::mutex waitMutex_; // For interruptible interval and burst waits
+   std::condition_variable stopCondition_;
+   bool burstFinished_; // Under waitMutex_
+   bool burstComplete_; // All images of the burst inserted; under waitMutex_
+   std::mutex joinMutex_;
+   std::thread thread_;
+   std::string error_; // Set by the run thread; read after joining it
+
+   std::mutex tagsMutex_;
+   std::string tagCamera_;
+   std::deque<Metadata> pendingTags_;
+};
+
+} // namespace mm
@@ -0,0 +1,114 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          AcquisitionPlan.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Declarative description of a multi-dimensional acquisition,
+//                run by the Core's acquisition engine
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+
+/**
+ * Multi-dimensional acquisition to be run by CMMCore::startAcquisition().
+ *
+ * The acquisition visits time points, then XY positions, then (within each
+ * position) Z slices and channels, taking one image from the current camera
+ * for each combination. By default the channels are cycled for each slice
+ * (channels innermost); setChannelsFirst(false) takes a full Z stack in each
+ * channel instead.
+ *
+ * Axes that are not set up have a single, implicit element: a plan with
+ * nothing set takes one image with the current settings.
+ */
+class AcquisitionPlan
+{
+public:
+   AcquisitionPlan() :
+      timepoints_(1),
+      intervalMs_(0.0),
+      channelsFirst_(true)
+   {}
+
+   /**
+    * Sets the number of time points and the interval between their starts.
+    */
+   void setTimepoints(long count, double intervalMs)
+   { timepoints_ = count; intervalMs_ = intervalMs; }
+   long getTimepointCount() const { return timepoints_; }
+   double getIntervalMs() const { return intervalMs_; }
+
+   /**
+    * Adds an XY stage position (for the current XY stage) to visit.
+    */
+   void addXYPosition(double x, double y)
+   { xPositions_.push_back(x); yPositions_.push_back(y); }
+   long getXYPositionCount() const { return (long)xPositions_.size(); }
+   double getXPosition(long index) const { return xPositions_.at(index); }
+   double getYPosition(long index) const { return yPositions_.at(index); }
+
+   /**
+    * Sets the stage (default: the current focus device) for the Z slices.
+    */
+   void setZStage(const char* label) { zStage_ = label ? label : ""; }
+   std::string getZStage() const { return zStage_; }
+
+   /**
+    * Adds a Z slice, as an absolute position in micrometers.
+    */
+   void addZPosition(double positionUm) { zPositions_.push_back(positionUm); }
+   long getZPositionCount() const { return (long)zPositions_.size(); }
+   double getZPosition(long index) const { return zPositions_.at(index); }
+
+   /**
+    * Sets the configuration group whose presets are the channels.
+    */
+   void setChannelGroup(const char* group) { channelGroup_ = group ? group : ""; }
+   std::string getChannelGroup() const { return channelGroup_; }
+
+   /**
+    * Adds a channel: a preset of the channel group and the exposure to use
+    * with it (zero or negative to leave the exposure unchanged).
+    */
+   void addChannel(const char* config, double exposureMs)
+   {
+      channels_.push_back(config ? config : "");
+      exposuresMs_.push_back(exposureMs);
+   }
+   long getChannelCount() const { return (long)channels_.size(); }
+   std::string getChannel(long index) const { return channels_.at(index); }
+   double getChannelExposure(long index) const { return exposuresMs_.at(index); }
+
+   /**
+    * Whether the channels are cycled at each Z slice (true, the default) or
+    * a Z stack is taken in each channel in turn (false).
+    */
+   void setChannelsFirst(bool channelsFirst) { channelsFirst_ = channelsFirst; }
+   bool isChannelsFirst() const { return channelsFirst_; }
+
+private:
+   long timepoints_;
+   double intervalMs_;
+   std::vector<double> xPositions_;
+   std::vector<double> yPositions_;
+   std::string zStage_;
+   std::vector<double> zPositions_;
+   std::string channelGroup_;
+   std::vector<std::string> channels_;
+   std::vector<double> exposuresMs_;
+   bool channelsFirst_;
+};
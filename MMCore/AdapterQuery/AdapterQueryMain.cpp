@@ -0,0 +1,46 @@
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//
+// DESCRIPTION:   mmcore-query-adapter: loads a device adapter module and
+//                writes its catalog entry to stdout, so that the Core can
+//                catalog modules without loading them into its own process
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "../DeviceAdapterCatalog.h"
+#include "../PluginManager.h"
+
+#include <cstdio>
+#include <string>
+
+#include <unistd.h>
+
+// Usage: mmcore-query-adapter <module name> <module file>
+int main(int argc, char* argv[])
+{
+   if (argc != 3)
+   {
+      std::fprintf(stderr, "usage: %s <module name> <module file>\n", argv[0]);
+      return 2;
+   }
+
+   const std::string moduleName(argv[1]);
+   const mm::DeviceAdapterCatalogEntry entry =
+      CPluginManager::DescribeModuleFile(moduleName, argv[2]);
+   const std::string reply = mm::SerializeCatalogEntry(moduleName, entry);
+   std::fwrite(reply.data(), 1, reply.size(), stdout);
+   std::fflush(stdout);
+
+   // Skip static destructors and atexit handlers of the module, which may
+   // hang or crash after the reply has been written
+   _exit(0);
+}
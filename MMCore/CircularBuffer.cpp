@@ -25,8 +25,15 @@
 // 
 #include "CircularBuffer.h"
 #include "CoreUtils.h"
+#include "DiskStreamWriter.h"
+#include "FrameTimestamps.h"
+#include "LatestFrameMailbox.h"
+#include "SharedFrameRingWriter.h"
 
 #include "TaskSet_CopyMemory.h"
+#include "TaskSet_FrameCompression.h"
+#include "TaskSet_FrameStatistics.h"
+#include "TraceRecorder.h"
 
 #include "../MMDevice/DeviceUtils.h"
 
@@ -34,11 +41,12 @@
 #include <cstdio>
 #include <ctime>
 #include <memory>
+#include <sstream>
 #include <string>
+#include <utility>
 
 
 const long long bytesInMB = 1 << 20;
-const long adjustThreshold = LONG_MAX / 2;
 
 // Maximum number of images allowed in the buffer. This arbitrary limit is code
 // smell, but kept for now until careful checks for integer overflow and
@@ -49,14 +57,26 @@ CircularBuffer::CircularBuffer(unsigned int memorySizeMB) :
    width_(0), 
    height_(0), 
    pixDepth_(0), 
+   numChannels_(0),
    imageCounter_(0), 
-   insertIndex_(0), 
-   saveIndex_(0), 
+   firstUnread_(0),
+   unreadCount_(0),
+   bytesInUse_(0),
+   unreadBytes_(0),
+   insertSerial_(0),
    memorySizeMB_(memorySizeMB), 
    overflow_(false),
    threadPool_(std::make_shared<ThreadPool>()),
-   tasksMemCopy_(std::make_shared<TaskSet_CopyMemory>(threadPool_))
+   tasksMemCopy_(std::make_shared<TaskSet_CopyMemory>(threadPool_)),
+   compress_(false),
+   tasksCompress_(std::make_shared<TaskSet_FrameCompression>(threadPool_)),
+   tasksDecompress_(std::make_shared<TaskSet_FrameCompression>(threadPool_)),
+   statisticsBins_(0),
+   tasksStatistics_(std::make_shared<TaskSet_FrameStatistics>(threadPool_)),
+   streamOnly_(false),
+   localTimeSecond_(0)
 {
+   localTimePrefix_[0] = '\0';
 }
 
 CircularBuffer::~CircularBuffer() {}
@@ -64,7 +84,6 @@ CircularBuffer::~CircularBuffer() {}
 bool CircularBuffer::Initialize(unsigned channels, unsigned int w, unsigned int h, unsigned int pixDepth)
 {
    MMThreadGuard guard(g_bufferLock);
-   imageNumbers_.clear();
    startTime_ = std::chrono::steady_clock::now();
 
    bool ret = true;
@@ -74,51 +93,83 @@ bool CircularBuffer::Initialize(unsigned channels, unsigned int w, unsigned int
          return false; // does not make sense
 
       if (w == width_ && height_ == h && pixDepth_ == pixDepth && channels == numChannels_)
-         if (frameArray_.size() > 0)
+      {
+         if (!slots_.empty())
+         {
+            for (std::size_t i = 0; i < cameras_.size(); ++i)
+               cameras_[i].imageNumber = 0;
             return true; // nothing to change
+         }
+      }
 
       width_ = w;
       height_ = h;
       pixDepth_ = pixDepth;
       numChannels_ = channels;
 
-      insertIndex_ = 0;
-      saveIndex_ = 0;
+      // Discard all images, keeping the slots of the new geometry
+      for (std::size_t i = 0; i < slots_.size(); ++i)
+         slots_[i]->popped = true;
+      firstUnread_ = slots_.size();
+      unreadCount_ = 0;
+      unreadBytes_ = 0;
+      cameras_.clear();
       overflow_ = false;
 
-      // calculate the size of the entire buffer array once all images get allocated
-      // the actual size at the time of the creation is going to be less, because
-      // images are not allocated until pixels become available
-      unsigned long frameSizeBytes = width_ * height_ * pixDepth_ * numChannels_;
-      unsigned long cbSize = (unsigned long) ((memorySizeMB_ * bytesInMB) / frameSizeBytes);
+      std::size_t frameSizeBytes = (std::size_t)w * h * pixDepth * channels;
+      std::size_t budget = (std::size_t)(memorySizeMB_ * bytesInMB);
+      if (frameSizeBytes > budget)
+         return false; // memory footprint too small
 
-      if (cbSize == 0) 
+      // Slots still queued to the disk stream, pinned or displayed are left
+      // to those
+      std::deque<std::shared_ptr<Slot> > kept;
+      std::size_t keptBytes = 0;
+      for (std::size_t i = 0; i < slots_.size(); ++i)
       {
-         frameArray_.resize(0);
-         return false; // memory footprint too small
+         const Slot& slot = *slots_[i];
+         if (!slot.compressed && !slot.streaming && !slot.pinned &&
+               !slot.displayed && slot.numChannels == channels &&
+               slot.frame.Width() == w && slot.frame.Height() == h &&
+               slot.frame.Depth() == pixDepth)
+         {
+            keptBytes += slot.bytes;
+            kept.push_back(std::move(slots_[i]));
+         }
       }
+      slots_.swap(kept);
+      kept.clear();
+      bytesInUse_ = keptBytes;
 
-      // set a reasonable limit to circular buffer capacity 
-      if (cbSize > maxCBSize)
-         cbSize = maxCBSize; 
-
+      // Preallocate slots so that acquisition at the nominal geometry does
+      // not allocate; this could conceivably throw an out-of-memory exception
+      // (Compressed images are sized as they come.)
       // TODO: verify if we have enough RAM to satisfy this request
-
-      for (unsigned long i=0; i<frameArray_.size(); i++)
-         frameArray_[i].Clear();
-
-      // allocate buffers  - could conceivably throw an out-of-memory exception
-      frameArray_.resize(cbSize);
-      for (unsigned long i=0; i<frameArray_.size(); i++)
+      while (!compress_ && bytesInUse_ + frameSizeBytes <= budget && slots_.size() < maxCBSize)
       {
-         frameArray_[i].Resize(w, h, pixDepth);
-         frameArray_[i].Preallocate(numChannels_);
+         std::shared_ptr<Slot> slot = std::make_shared<Slot>();
+         slot->frame.Resize(w, h, pixDepth);
+         slot->frame.Preallocate(channels);
+         slot->numChannels = channels;
+         slot->bytes = frameSizeBytes;
+         slot->camera = 0;
+         slot->popped = true;
+         slot->compressed = false;
+         slot->serial = 0;
+         slot->streaming = false;
+         slot->pinned = false;
+         slot->displayed = false;
+         slots_.push_back(std::move(slot));
+         bytesInUse_ += frameSizeBytes;
       }
+      firstUnread_ = slots_.size();
    }
 
    catch( ... /* std::bad_alloc& ex */)
    {
-      frameArray_.resize(0);
+      slots_.clear();
+      firstUnread_ = 0;
+      bytesInUse_ = 0;
       ret = false;
    }
    return ret;
@@ -127,36 +178,208 @@ bool CircularBuffer::Initialize(unsigned channels, unsigned int w, unsigned int
 void CircularBuffer::Clear() 
 {
    MMThreadGuard guard(g_bufferLock); 
-   insertIndex_=0; 
-   saveIndex_=0; 
+   for (std::size_t i = firstUnread_; i < slots_.size(); ++i)
+      slots_[i]->popped = true;
+   firstUnread_ = slots_.size();
+   unreadCount_ = 0;
+   unreadBytes_ = 0;
    overflow_ = false;
    startTime_ = std::chrono::steady_clock::now();
-   imageNumbers_.clear();
+   cameras_.clear();
+}
+
+/**
+* The memory taken by an image of the nominal geometry: when compressing,
+* scaled by the compression ratio so far. Requires g_bufferLock.
+*/
+std::size_t CircularBuffer::NominalSlotBytes() const
+{
+   std::size_t frameSizeBytes = (std::size_t)width_ * height_ * pixDepth_ * numChannels_;
+   if (compress_ && compressionStats_.rawBytes > 0)
+   {
+      double ratio = (double)compressionStats_.compressedBytes / compressionStats_.rawBytes;
+      frameSizeBytes = (std::size_t)(frameSizeBytes * ratio);
+      if (frameSizeBytes == 0)
+         frameSizeBytes = 1;
+   }
+   return frameSizeBytes;
 }
 
 unsigned long CircularBuffer::GetSize() const
 {
    MMThreadGuard guard(g_bufferLock);
-   return (unsigned long)frameArray_.size();
+   std::size_t frameSizeBytes = NominalSlotBytes();
+   if (frameSizeBytes == 0)
+      return 0;
+   std::size_t size = (std::size_t)(memorySizeMB_ * bytesInMB) / frameSizeBytes;
+   return (unsigned long)(size > maxCBSize ? maxCBSize : size);
 }
 
 unsigned long CircularBuffer::GetFreeSize() const
 {
    MMThreadGuard guard(g_bufferLock);
-   long freeSize = (long)frameArray_.size() - (insertIndex_ - saveIndex_);
-   if (freeSize < 0)
+   std::size_t frameSizeBytes = NominalSlotBytes();
+   std::size_t budget = (std::size_t)(memorySizeMB_ * bytesInMB);
+   if (frameSizeBytes == 0 || unreadBytes_ >= budget)
       return 0;
-   else
-      return (unsigned long)freeSize;
+   std::size_t freeSize = (budget - unreadBytes_) / frameSizeBytes;
+   if (freeSize + unreadCount_ > maxCBSize)
+      freeSize = unreadCount_ < maxCBSize ? maxCBSize - unreadCount_ : 0;
+   return (unsigned long)freeSize;
 }
 
 unsigned long CircularBuffer::GetRemainingImageCount() const
 {
    MMThreadGuard guard(g_bufferLock);
-   return (unsigned long)(insertIndex_ - saveIndex_);
+   return (unsigned long)unreadCount_;
+}
+
+unsigned long CircularBuffer::GetRemainingImageCount(const void* camera) const
+{
+   MMThreadGuard guard(g_bufferLock);
+   const CameraQueue* queue = FindCameraQueue(camera);
+   return queue ? (unsigned long)queue->unread.size() : 0;
+}
+
+CircularBuffer::CameraQueue& CircularBuffer::GetCameraQueue(const void* camera)
+{
+   for (std::size_t i = 0; i < cameras_.size(); ++i)
+   {
+      if (cameras_[i].camera == camera)
+         return cameras_[i];
+   }
+   CameraQueue queue;
+   queue.camera = camera;
+   queue.imageNumber = 0;
+   cameras_.push_back(queue);
+   return cameras_.back();
+}
+
+const CircularBuffer::CameraQueue* CircularBuffer::FindCameraQueue(const void* camera) const
+{
+   for (std::size_t i = 0; i < cameras_.size(); ++i)
+   {
+      if (cameras_[i].camera == camera)
+         return &cameras_[i];
+   }
+   return 0;
+}
+
+/**
+* Frees the oldest popped slot, if any and if neither the disk stream, a
+* pinned image nor the latest-frame mailbox still uses it. Requires
+* g_bufferLock.
+*/
+bool CircularBuffer::ReclaimOldest()
+{
+   if (firstUnread_ == 0 || slots_.front()->streaming || slots_.front()->pinned ||
+         slots_.front()->displayed)
+      return false;
+   bytesInUse_ -= slots_.front()->bytes;
+   slots_.pop_front();
+   --firstUnread_;
+   return true;
+}
+
+/**
+* Moves firstUnread_ past popped slots. Requires g_bufferLock.
+*/
+void CircularBuffer::AdvanceFirstUnread()
+{
+   while (firstUnread_ < slots_.size() && slots_[firstUnread_]->popped)
+      ++firstUnread_;
+}
+
+/**
+* Finds memory for an image taking the given bytes: reuses the oldest popped
+* slot if it has the same geometry (or, for compressed images, if it is also
+* compressed and the budget allows), otherwise frees popped slots until a new
+* slot fits in the budget. Slots still queued to the disk stream, pinned or
+* displayed are neither reused nor freed; displayed ones (normally only the
+* newest image) are passed over rather than holding up the popped slots
+* behind them. Returns null if the buffer is full. Requires
+* g_bufferLock; the slot is removed from slots_.
+*/
+std::shared_ptr<CircularBuffer::Slot> CircularBuffer::AcquireSlot(std::size_t bytes,
+      unsigned numChannels, unsigned width, unsigned height, unsigned byteDepth,
+      bool compressed) throw (CMMError)
+{
+   std::size_t budget = (std::size_t)(memorySizeMB_ * bytesInMB);
+   if (bytes > budget)
+      throw CMMError("Image too large for the circular buffer", MMERR_CircularBufferIncompatibleImage);
+
+   for (;;)
+   {
+      if (firstUnread_ > 1 && slots_.front()->displayed)
+      {
+         // The popped slots need not stay in insertion order
+         for (std::size_t i = 1; i < firstUnread_; ++i)
+         {
+            if (!slots_[i]->displayed)
+            {
+               std::shared_ptr<Slot> slot = std::move(slots_[i]);
+               slots_.erase(slots_.begin() + i);
+               slots_.push_front(std::move(slot));
+               break;
+            }
+         }
+      }
+
+      bool full = unreadCount_ >= maxCBSize;
+      if (!full && firstUnread_ > 0 && !slots_.front()->streaming &&
+            !slots_.front()->pinned && !slots_.front()->displayed)
+      {
+         const Slot& oldest = *slots_.front();
+         bool reusable;
+         if (compressed)
+            reusable = oldest.compressed && bytesInUse_ - oldest.bytes + bytes <= budget;
+         else
+            reusable = !oldest.compressed && oldest.numChannels == numChannels &&
+               oldest.frame.Width() == width && oldest.frame.Height() == height &&
+               oldest.frame.Depth() == byteDepth;
+         if (reusable)
+         {
+            std::shared_ptr<Slot> slot = std::move(slots_.front());
+            slots_.pop_front();
+            --firstUnread_;
+            bytesInUse_ -= slot->bytes;
+            if (compressed)
+            {
+               slot->frame.Resize(width, height, byteDepth);
+               slot->numChannels = numChannels;
+            }
+            return slot;
+         }
+      }
+      if (!full && bytesInUse_ + bytes <= budget)
+         break;
+      if (!full && ReclaimOldest())
+         continue;
+      overflow_ = true;
+      return std::shared_ptr<Slot>();
+   }
+
+   // Allocate outside of the slot deque; could throw std::bad_alloc
+   std::shared_ptr<Slot> slot = std::make_shared<Slot>();
+   slot->frame.Resize(width, height, byteDepth);
+   if (!compressed)
+      slot->frame.Preallocate(numChannels);
+   slot->numChannels = numChannels;
+   slot->bytes = bytes;
+   slot->compressed = compressed;
+   slot->streaming = false;
+   slot->pinned = false;
+   slot->displayed = false;
+   return slot;
 }
 
-static std::string FormatLocalTime(std::chrono::time_point<std::chrono::system_clock> tp) {
+/**
+* Formats the time as local time, "yyyy-mm-dd hh:mm:ss.uuuuuu" (26 chars).
+* The date and time of day are only converted when the second changes.
+* Requires g_insertLock.
+*/
+void CircularBuffer::FormatLocalTime(std::chrono::time_point<std::chrono::system_clock> tp, char (&buf)[32])
+{
    using namespace std::chrono;
    auto us = duration_cast<microseconds>(tp.time_since_epoch());
    auto secs = duration_cast<seconds>(us);
@@ -167,20 +390,44 @@ static std::string FormatLocalTime(std::chrono::time_point<std::chrono::system_c
    // date-time formatting
 
    std::time_t t(secs.count()); // time_t is seconds on platforms we support
-   std::tm *ptm;
+   if (t != localTimeSecond_ || localTimePrefix_[0] == '\0')
+   {
+      std::tm *ptm;
 #ifdef _WIN32 // Windows localtime() is documented thread-safe
-   ptm = std::localtime(&t);
+      ptm = std::localtime(&t);
 #else // POSIX has localtime_r()
-   std::tm tmstruct;
-   ptm = localtime_r(&t, &tmstruct);
+      std::tm tmstruct;
+      ptm = localtime_r(&t, &tmstruct);
 #endif
+      const char *timeFmt = "%Y-%m-%d %H:%M:%S";
+      if (std::strftime(localTimePrefix_, sizeof(localTimePrefix_), timeFmt, ptm) == 0)
+         localTimePrefix_[0] = '\0';
+      localTimeSecond_ = t;
+   }
+   std::snprintf(buf, sizeof(buf), "%s.%06d", localTimePrefix_, frac);
+}
 
-   // Format as "yyyy-mm-dd hh:mm:ss.uuuuuu" (26 chars)
-   const char *timeFmt = "%Y-%m-%d %H:%M:%S";
+// Adds a tag, already formatted, without going through a string stream
+static void PutFrameTag(Metadata& md, const char* key, const char* value)
+{
+   MetadataSingleTag tag(key, "_", true);
+   tag.SetValue(value);
+   md.SetTag(tag);
+}
+
+static void PutFrameTag(Metadata& md, const char* key, long long value)
+{
+   char buf[24];
+   std::snprintf(buf, sizeof(buf), "%lld", value);
+   PutFrameTag(md, key, buf);
+}
+
+// Times in ms, to the microsecond
+static void PutFrameTimeTag(Metadata& md, const char* key, double valueMs)
+{
    char buf[32];
-   std::size_t len = std::strftime(buf, sizeof(buf), timeFmt, ptm);
-   std::snprintf(buf + len, sizeof(buf) - len, ".%06d", frac);
-   return buf;
+   std::snprintf(buf, sizeof(buf), "%.3f", valueMs);
+   PutFrameTag(md, key, buf);
 }
 
 /**
@@ -202,123 +449,385 @@ bool CircularBuffer::InsertMultiChannel(const unsigned char* pixArray, unsigned
 /**
 * Inserts a single image, possibly with multiple components, in the buffer.
 */
-bool CircularBuffer::InsertImage(const unsigned char* pixArray, unsigned int width, unsigned int height, unsigned int byteDepth, unsigned int nComponents, const Metadata* pMd) throw (CMMError)
+bool CircularBuffer::InsertImage(const unsigned char* pixArray, unsigned int width, unsigned int height, unsigned int byteDepth, unsigned int nComponents, const Metadata* pMd, const void* camera, unsigned int bitDepth) throw (CMMError)
 {
-    return InsertMultiChannel(pixArray, 1, width, height, byteDepth, nComponents, pMd);
+    return InsertMultiChannel(pixArray, 1, width, height, byteDepth, nComponents, pMd, camera, bitDepth);
 }
  
 /**
-* Inserts a multi-channel frame in the buffer.
+* Inserts a multi-channel frame in the buffer. The frame may have any size;
+* camera identifies its source for per-camera image numbers and pops;
+* bitDepth (0 for the full byte depth) sets the range of the statistics.
+* If the metadata has a device timestamp, the frame also gets its corrected
+* time and latency from the camera's clock model (see FrameTimestamps.h).
 */
-bool CircularBuffer::InsertMultiChannel(const unsigned char* pixArray, unsigned int numChannels, unsigned int width, unsigned int height, unsigned int byteDepth, unsigned int nComponents, const Metadata* pMd) throw (CMMError)
+bool CircularBuffer::InsertMultiChannel(const unsigned char* pixArray, unsigned int numChannels, unsigned int width, unsigned int height, unsigned int byteDepth, unsigned int nComponents, const Metadata* pMd, const void* camera, unsigned int bitDepth) throw (CMMError)
 {
+    mm::TraceSpan span("CircularBuffer insert", "buffer");
+    // Before waiting for other insertions
+    const std::chrono::steady_clock::time_point received = std::chrono::steady_clock::now();
     MMThreadGuard insertGuard(g_insertLock);
  
-    mm::ImgBuffer* pImg;
+    if (numChannels == 0 || width == 0 || height == 0 || byteDepth == 0)
+       throw CMMError("Incompatible image dimensions in the circular buffer", MMERR_CircularBufferIncompatibleImage);
+
     unsigned long singleChannelSize = (unsigned long)width * height * byteDepth;
+    std::size_t bytes = (std::size_t)singleChannelSize * numChannels;
+    std::shared_ptr<Slot> slot;
+    // Gives back the memory reserved for the slot if filling it throws
+    // (the slot is moved into slots_ when published)
+    struct Reservation
+    {
+       CircularBuffer* buffer;
+       const std::shared_ptr<Slot>& slot;
+       ~Reservation()
+       {
+          if (slot)
+          {
+             MMThreadGuard guard(buffer->g_bufferLock);
+             buffer->bytesInUse_ -= slot->bytes;
+          }
+       }
+    } reservation = { this, slot };
+    long imageNumber;
+    std::chrono::steady_clock::time_point start;
+
+    // Compressed images take what they compress to; compress before
+    // reserving the memory
+    const bool compress = compress_;
+    const bool statistics = statisticsBins_ > 0 && nComponents == 1 &&
+          (byteDepth == 1 || byteDepth == 2);
+    double compressSeconds = 0.0;
+    if (compress)
+    {
+       mm::TraceSpan compressSpan("CircularBuffer compress", "buffer");
+       auto start = std::chrono::steady_clock::now();
+       packedScratch_.resize(numChannels);
+       bytes = 0;
+       for (unsigned i = 0; i < numChannels; ++i)
+       {
+          tasksCompress_->Compress(pixArray + i * singleChannelSize,
+                singleChannelSize, byteDepth, packedScratch_[i]);
+          bytes += packedScratch_[i].size();
+       }
+       compressSeconds = std::chrono::duration<double>(
+             std::chrono::steady_clock::now() - start).count();
+    }
  
     {
        MMThreadGuard guard(g_bufferLock);
- 
-       // check image dimensions
-       if (width != width_ || height != height_ || byteDepth != pixDepth_)
-          throw CMMError("Incompatible image dimensions in the circular buffer", MMERR_CircularBufferIncompatibleImage);
- 
-       bool overflowed = (insertIndex_ - saveIndex_) >= static_cast<long>(frameArray_.size());
-       if (overflowed) {
-          overflow_ = true;
+       slot = AcquireSlot(bytes, numChannels, width, height, byteDepth, compress);
+       if (!slot)
           return false;
+       slot->camera = camera;
+       slot->popped = false;
+       slot->bytes = bytes;
+       bytesInUse_ += bytes; // Reserved while being filled
+       if (compress)
+       {
+          slot->packed.swap(packedScratch_); // Old buffers are kept for reuse
+          slot->packed.resize(numChannels);
+          slot->metadata.resize(numChannels);
+          ++compressionStats_.framesCompressed;
+          compressionStats_.rawBytes += (std::size_t)singleChannelSize * numChannels;
+          compressionStats_.compressedBytes += bytes;
+          compressionStats_.compressSeconds += compressSeconds;
+       }
+
+       CameraQueue& queue = GetCameraQueue(camera);
+       imageNumber = queue.imageNumber++;
+       start = startTime_;
+    }
+
+    // Tags that are the same for all channels, formatted once
+    Metadata frameTags;
+    PutFrameTag(frameTags, MM::g_Keyword_Metadata_ImageNumber, (long long)imageNumber);
+    {
+       using namespace std::chrono;
+       const double receivedMs = duration<double, std::milli>(received - start).count();
+       if (!pMd || !pMd->HasTag(MM::g_Keyword_Elapsed_Time_ms))
+       {
+          // if time tag was not supplied by the camera insert current timestamp
+          PutFrameTag(frameTags, MM::g_Keyword_Elapsed_Time_ms,
+                (long long)duration_cast<milliseconds>(received - start).count());
        }
+
+       double deviceTime;
+       if (pMd && mm::GetDeviceTimestamp(*pMd, deviceTime))
+       {
+          // The models work in absolute host time, which survives Clear()
+          const double startMs = duration<double, std::milli>(start.time_since_epoch()).count();
+          double correctedMs, latencyMs;
+          timestamps_.AddFrame(camera, deviceTime, startMs + receivedMs,
+                correctedMs, latencyMs);
+          PutFrameTimeTag(frameTags, mm::g_Keyword_ReceivedTimeMs, receivedMs);
+          PutFrameTimeTag(frameTags, mm::g_Keyword_CorrectedTimeMs, correctedMs - startMs);
+          PutFrameTimeTag(frameTags, mm::g_Keyword_EstimatedLatencyMs, latencyMs);
+       }
+
+       // Note: It is not ideal to use local time. I think this tag is rarely
+       // used. Consider replacing with UTC (micro)seconds-since-epoch (with
+       // different tag key) after addressing current usage.
+       char localTime[32];
+       FormatLocalTime(system_clock::now(), localTime);
+       PutFrameTag(frameTags, MM::g_Keyword_Metadata_TimeInCore, localTime);
     }
+    PutFrameTag(frameTags, "Width", (long long)width);
+    PutFrameTag(frameTags, "Height", (long long)height);
+    const char* pixelType = "Unknown";
+    if (byteDepth == 1)
+       pixelType = "GRAY8";
+    else if (byteDepth == 2)
+       pixelType = "GRAY16";
+    else if (byteDepth == 4)
+       pixelType = nComponents == 1 ? "GRAY32" : "RGB32";
+    else if (byteDepth == 8)
+       pixelType = "RGB64";
+    PutFrameTag(frameTags, "PixelType", pixelType);
  
+    // The mailbox refers to the slot's pixels rather than copying them;
+    // until it lets go, the slot stays as it is (see AcquireSlot())
+    std::shared_ptr<const void> displayOwner;
+    if (latestFrames_)
+    {
+       latestFrames_->BeginFrame(numChannels, width, height, byteDepth,
+             nComponents, camera);
+       if (!compress)
+       {
+          slot->displayed = true;
+          std::shared_ptr<Slot> held = slot;
+          displayOwner = std::shared_ptr<const void>(slot.get(),
+                [held](const void*) { held->displayed = false; });
+       }
+    }
+
     for (unsigned i=0; i<numChannels; i++)
     {
        Metadata md;
+       if (pMd)
        {
-          MMThreadGuard guard(g_bufferLock);
-          // we assume that all buffers are pre-allocated
-          pImg = frameArray_[insertIndex_ % frameArray_.size()].FindImage(i);
-          if (!pImg)
-             return false;
- 
-          if (pMd)
-          {
-             // TODO: the same metadata is inserted for each channel ???
-             // Perhaps we need to add specific tags to each channel
-             md = *pMd;
-          }
+          // TODO: the same metadata is inserted for each channel ???
+          // Perhaps we need to add specific tags to each channel
+          md = *pMd;
+       }
 
-         std::string cameraName = md.GetSingleTag("Camera").GetValue();
-         if (imageNumbers_.end() == imageNumbers_.find(cameraName))
-         {
-            imageNumbers_[cameraName] = 0;
-         }
+      md.Merge(frameTags);
 
-         // insert image number. 
-         md.put(MM::g_Keyword_Metadata_ImageNumber, CDeviceUtils::ConvertToString(imageNumbers_[cameraName]));
-         ++imageNumbers_[cameraName];
+      mm::ImgBuffer* pImg = compress ? 0 : slot->frame.FindImage(i);
+      // TODO: In MMCore the ImgBuffer::GetPixels() returns const pointer.
+      //       It would be better to have something like ImgBuffer::GetPixelsRW() in MMDevice.
+      //       Or even better - pass tasksMemCopy_ to ImgBuffer constructor
+      //       and utilize parallel copy also in single snap acquisitions.
+      unsigned char* pixels = pImg ? (unsigned char*)pImg->GetPixels() : 0;
+      if (statistics)
+      {
+         // Fused with the copy, so that the pixels are read only once
+         mm::TraceSpan statsSpan("CircularBuffer statistics", "buffer");
+         tasksStatistics_->Compute(pixArray + i * singleChannelSize, pixels,
+               (std::size_t)width * height, byteDepth, bitDepth,
+               statisticsBins_, frameStats_);
+         frameStats_.AddToMetadata(md);
       }
-
-      if (!md.HasTag(MM::g_Keyword_Elapsed_Time_ms))
+      else if (pixels)
       {
-         // if time tag was not supplied by the camera insert current timestamp
-         using namespace std::chrono;
-         auto elapsed = steady_clock::now() - startTime_;
-         md.PutImageTag(MM::g_Keyword_Elapsed_Time_ms,
-            std::to_string(duration_cast<milliseconds>(elapsed).count()));
+         tasksMemCopy_->MemCopy(pixels, pixArray + i * singleChannelSize,
+               singleChannelSize);
       }
 
-      // Note: It is not ideal to use local time. I think this tag is rarely
-      // used. Consider replacing with UTC (micro)seconds-since-epoch (with
-      // different tag key) after addressing current usage.
-      auto now = std::chrono::system_clock::now();
-      md.PutImageTag(MM::g_Keyword_Metadata_TimeInCore, FormatLocalTime(now));
-
-      md.PutImageTag("Width",width);
-      md.PutImageTag("Height",height);
-      if (byteDepth == 1)
-         md.PutImageTag("PixelType","GRAY8");
-      else if (byteDepth == 2)
-         md.PutImageTag("PixelType","GRAY16");
-      else if (byteDepth == 4)
+      if (compress)
+         slot->metadata[i] = md;
+      else
+         pImg->SetMetadata(md);
+
+      if (sharedRing_)
+         sharedRing_->Publish(pixArray + i * singleChannelSize, width,
+               height, byteDepth, nComponents, md);
+      if (displayOwner)
+         latestFrames_->ShareChannel(i, pixels, md, displayOwner);
+      else if (latestFrames_)
+         latestFrames_->SetChannel(i, pixArray + i * singleChannelSize, md);
+   }
+
+   if (streamWriter_)
+   {
+      // The writer copies the image out on its own threads; until then the
+      // slot stays as it is (see AcquireSlot())
+      slot->streaming = true;
+      std::shared_ptr<Slot> held = slot;
+      std::shared_ptr<const void> owner(slot.get(),
+            [held](const void*) { held->streaming = false; });
+      for (unsigned i = 0; i < numChannels; ++i)
       {
-         if (nComponents == 1)
-            md.PutImageTag("PixelType","GRAY32");
+         mm::DiskStreamWriter::Frame frame;
+         frame.owner = owner;
+         if (compress)
+         {
+            frame.pixels = slot->packed[i].data();
+            frame.packedBytes = slot->packed[i].size();
+            frame.metadata = &slot->metadata[i];
+         }
          else
-            md.PutImageTag("PixelType","RGB32");
+         {
+            const mm::ImgBuffer* img = slot->frame.FindImage(i);
+            frame.pixels = img->GetPixels();
+            frame.metadata = &img->GetMetadata();
+         }
+         frame.width = width;
+         frame.height = height;
+         frame.byteDepth = byteDepth;
+         frame.nComponents = nComponents;
+         streamWriter_->Enqueue(frame);
       }
-      else if (byteDepth == 8)
-         md.PutImageTag("PixelType","RGB64");
-      else
-         md.PutImageTag("PixelType","Unknown"); 
-
-      pImg->SetMetadata(md);
-      //pImg->SetPixels(pixArray + i * singleChannelSize);
-      // TODO: In MMCore the ImgBuffer::GetPixels() returns const pointer.
-      //       It would be better to have something like ImgBuffer::GetPixelsRW() in MMDevice.
-      //       Or even better - pass tasksMemCopy_ to ImgBuffer constructor
-      //       and utilize parallel copy also in single snap acquisitions.
-      tasksMemCopy_->MemCopy((void*)pImg->GetPixels(),
-            pixArray + i * singleChannelSize, singleChannelSize);
    }
 
    {
+      // Publish the filled slot
       MMThreadGuard guard(g_bufferLock);
-
-      imageCounter_++;
-      insertIndex_++;
-      if ((insertIndex_ - (long)frameArray_.size()) > adjustThreshold && (saveIndex_- (long)frameArray_.size()) > adjustThreshold)
+      Slot* inserted = slot.get();
+      inserted->serial = ++insertSerial_;
+      slots_.push_back(std::move(slot));
+      if (streamOnly_)
+      {
+         // Only for the writer; reusable once written (see AcquireSlot())
+         inserted->popped = true;
+      }
+      else
       {
-         // adjust buffer indices to avoid overflowing integer size
-         insertIndex_ -= adjustThreshold;
-         saveIndex_ -= adjustThreshold;
+         GetCameraQueue(camera).unread.push_back(inserted);
+         ++unreadCount_;
+         unreadBytes_ += inserted->bytes;
       }
+      AdvanceFirstUnread();
+      imageCounter_++;
    }
 
+   if (latestFrames_)
+      latestFrames_->PublishFrame();
+
    return true;
 }
  
 
+void CircularBuffer::SetDiskStreamWriter(std::shared_ptr<mm::DiskStreamWriter> writer,
+      bool streamOnly)
+{
+   MMThreadGuard insertGuard(g_insertLock);
+   streamWriter_ = writer;
+   streamOnly_ = writer && streamOnly;
+}
+
+void CircularBuffer::SetSharedFrameRing(std::shared_ptr<mm::SharedFrameRingWriter> ring)
+{
+   MMThreadGuard insertGuard(g_insertLock);
+   sharedRing_ = ring;
+}
+
+void CircularBuffer::SetLatestFrameMailbox(std::shared_ptr<mm::LatestFrameMailbox> mailbox)
+{
+   MMThreadGuard insertGuard(g_insertLock);
+   latestFrames_ = mailbox;
+}
+
+void CircularBuffer::SetCompression(bool enable)
+{
+   MMThreadGuard insertGuard(g_insertLock);
+   MMThreadGuard guard(g_bufferLock);
+   if (enable == compress_)
+      return;
+   compress_ = enable;
+   compressionStats_ = CompressionStatistics();
+   if (enable)
+   {
+      // Free the preallocated (and other popped) uncompressed slots now
+      while (ReclaimOldest())
+         ;
+   }
+}
+
+bool CircularBuffer::IsCompressionEnabled() const
+{
+   MMThreadGuard guard(g_bufferLock);
+   return compress_;
+}
+
+void CircularBuffer::SetFrameStatistics(unsigned histogramBins)
+{
+   MMThreadGuard insertGuard(g_insertLock);
+   MMThreadGuard guard(g_bufferLock);
+   statisticsBins_ = histogramBins;
+}
+
+unsigned CircularBuffer::GetFrameStatisticsBins() const
+{
+   MMThreadGuard guard(g_bufferLock);
+   return statisticsBins_;
+}
+
+CircularBuffer::CompressionStatistics CircularBuffer::GetCompressionStatistics() const
+{
+   MMThreadGuard guard(g_bufferLock);
+   return compressionStats_;
+}
+
+std::string
+CircularBuffer::FormatCompressionStatistics(const CompressionStatistics& stats)
+{
+   std::ostringstream os;
+   os << "Statistic\tValue\n";
+   os << "FramesCompressed\t" << stats.framesCompressed << '\n';
+   os << "RawBytes\t" << stats.rawBytes << '\n';
+   os << "CompressedBytes\t" << stats.compressedBytes << '\n';
+   os << "CompressionRatio\t" << (stats.compressedBytes > 0 ?
+         (double)stats.rawBytes / stats.compressedBytes : 0.0) << '\n';
+   os << "CompressThroughput-MBps\t" << (stats.compressSeconds > 0.0 ?
+         stats.rawBytes / stats.compressSeconds / (1 << 20) : 0.0) << '\n';
+   os << "FramesDecompressed\t" << stats.framesDecompressed << '\n';
+   os << "DecompressThroughput-MBps\t" << (stats.decompressSeconds > 0.0 ?
+         stats.decompressedBytes / stats.decompressSeconds / (1 << 20) : 0.0) << '\n';
+   return os.str();
+}
+
+/**
+* Returns a channel of a slot; decompresses it into decoded if the slot is
+* compressed (unless already there). Requires g_bufferLock.
+*/
+const mm::ImgBuffer* CircularBuffer::GetImage(const Slot* slot,
+      unsigned channel, DecodedImage& decoded) const
+{
+   if (!slot->compressed)
+      return slot->frame.FindImage(channel);
+   if (channel >= slot->packed.size())
+      return 0;
+   if (decoded.image && decoded.serial == slot->serial && decoded.channel == channel)
+      return decoded.image.get();
+
+   mm::TraceSpan span("CircularBuffer decompress", "buffer");
+   auto start = std::chrono::steady_clock::now();
+   const unsigned w = slot->frame.Width();
+   const unsigned h = slot->frame.Height();
+   const unsigned d = slot->frame.Depth();
+   if (!decoded.image)
+      decoded.image.reset(new mm::ImgBuffer(w, h, d));
+   else
+      decoded.image->Resize(w, h, d); // Reallocates only to grow
+   decoded.serial = 0;
+
+   const std::vector<unsigned char>& packed = slot->packed[channel];
+   const std::size_t bytes = (std::size_t)w * h * d;
+   if (packed.empty() || !tasksDecompress_->Decompress(&packed[0], packed.size(),
+            const_cast<unsigned char*>(decoded.image->GetPixels()), bytes))
+      return 0;
+   decoded.image->SetMetadata(slot->metadata[channel]);
+   decoded.serial = slot->serial;
+   decoded.channel = channel;
+
+   ++compressionStats_.framesDecompressed;
+   compressionStats_.decompressedBytes += bytes;
+   compressionStats_.decompressSeconds += std::chrono::duration<double>(
+         std::chrono::steady_clock::now() - start).count();
+   return decoded.image.get();
+}
+
 const unsigned char* CircularBuffer::GetTopImage() const
 {
    const mm::ImgBuffer* img = GetNthFromTopImageBuffer(0, 0);
@@ -332,6 +841,16 @@ const mm::ImgBuffer* CircularBuffer::GetTopImageBuffer(unsigned channel) const
    return GetNthFromTopImageBuffer(0, channel);
 }
 
+const mm::ImgBuffer* CircularBuffer::GetTopImageBuffer(unsigned channel,
+      const void* camera) const
+{
+   MMThreadGuard guard(g_bufferLock);
+   const CameraQueue* queue = FindCameraQueue(camera);
+   if (!queue || queue->unread.empty())
+      return 0;
+   return GetImage(queue->unread.back(), channel, peeked_);
+}
+
 const mm::ImgBuffer* CircularBuffer::GetNthFromTopImageBuffer(unsigned long n) const
 {
    return GetNthFromTopImageBuffer(static_cast<long>(n), 0);
@@ -342,16 +861,18 @@ const mm::ImgBuffer* CircularBuffer::GetNthFromTopImageBuffer(long n,
 {
    MMThreadGuard guard(g_bufferLock);
 
-   long availableImages = insertIndex_ - saveIndex_;
-   if (n + 1 > availableImages)
+   if (n < 0 || static_cast<std::size_t>(n) >= unreadCount_)
       return 0;
 
-   long targetIndex = insertIndex_ - n - 1L;
-   while (targetIndex < 0)
-      targetIndex += (long) frameArray_.size();
-   targetIndex %= frameArray_.size();
-
-   return frameArray_[targetIndex].FindImage(channel);
+   // Newest first, skipping slots popped per camera (and, after
+   // Initialize(), the preallocated ones at the end)
+   for (std::size_t i = slots_.size(); i > firstUnread_; )
+   {
+      const Slot* slot = slots_[--i].get();
+      if (!slot->popped && n-- == 0)
+         return GetImage(slot, channel, peeked_);
+   }
+   return 0;
 }
 
 const unsigned char* CircularBuffer::GetNextImage()
@@ -362,15 +883,118 @@ const unsigned char* CircularBuffer::GetNextImage()
    return img->GetPixels();
 }
 
+/**
+* Marks a slot popped and returns its image. Requires g_bufferLock. The
+* image stays valid until its memory is needed for new images (or, if
+* compressed, until the next pop).
+*/
+const mm::ImgBuffer* CircularBuffer::PopSlot(Slot* slot, unsigned channel)
+{
+   slot->popped = true;
+   --unreadCount_;
+   unreadBytes_ -= slot->bytes;
+   AdvanceFirstUnread();
+   return GetImage(slot, channel, popped_);
+}
+
 const mm::ImgBuffer* CircularBuffer::GetNextImageBuffer(unsigned channel)
 {
+   mm::TraceSpan span("CircularBuffer pop", "buffer");
    MMThreadGuard guard(g_bufferLock);
 
-   long availableImages = insertIndex_ - saveIndex_;
-   if (availableImages < 1)
+   if (unreadCount_ == 0)
       return 0;
 
-   long targetIndex = saveIndex_ % frameArray_.size();
-   ++saveIndex_;
-   return frameArray_[targetIndex].FindImage(channel);
+   Slot* slot = slots_[firstUnread_].get();
+   GetCameraQueue(slot->camera).unread.pop_front();
+   return PopSlot(slot, channel);
+}
+
+const mm::ImgBuffer* CircularBuffer::GetNextImageBuffer(unsigned channel,
+      const void* camera)
+{
+   mm::TraceSpan span("CircularBuffer pop", "buffer");
+   MMThreadGuard guard(g_bufferLock);
+
+   CameraQueue* queue = const_cast<CameraQueue*>(FindCameraQueue(camera));
+   if (!queue || queue->unread.empty())
+      return 0;
+
+   Slot* slot = queue->unread.front();
+   queue->unread.pop_front();
+   return PopSlot(slot, channel);
+}
+
+std::size_t CircularBuffer::GetNextImageBufferSize() const
+{
+   MMThreadGuard guard(g_bufferLock);
+
+   if (unreadCount_ == 0)
+      return 0;
+
+   const mm::FrameBuffer& frame = slots_[firstUnread_]->frame;
+   return (std::size_t)frame.Width() * frame.Height() * frame.Depth();
+}
+
+/**
+* Pops a slot and pins its image: the slot stays in slots_ (and in the
+* budget) but is not reused until the pinned image is released. Requires
+* g_bufferLock.
+*/
+std::shared_ptr<PinnedImage> CircularBuffer::PinSlot(Slot* slot, unsigned channel)
+{
+   const mm::ImgBuffer* image = PopSlot(slot, channel);
+   if (!image)
+      return std::shared_ptr<PinnedImage>();
+
+   std::size_t index = 0;
+   while (slots_[index].get() != slot)
+      ++index;
+   std::shared_ptr<Slot> held = slots_[index];
+
+   // A compressed slot only holds compressed data; keep the decompressed
+   // image too (it is not counted in the budget beyond the slot's size)
+   std::shared_ptr<mm::ImgBuffer> decoded;
+   if (slot->compressed)
+   {
+      decoded.reset(popped_.image.release());
+      popped_.serial = 0;
+   }
+
+   // Released on any thread, possibly after the buffer is gone; the slot
+   // then becomes reusable in place (see AcquireSlot())
+   slot->pinned = true;
+   std::shared_ptr<PinnedImage> pinned(new PinnedImage());
+   pinned->image_ = image;
+   pinned->owner_ = std::shared_ptr<void>(slot,
+         [held, decoded](void*) { held->pinned = false; });
+   return pinned;
+}
+
+std::shared_ptr<PinnedImage> CircularBuffer::PopNextImagePinned(unsigned channel)
+{
+   mm::TraceSpan span("CircularBuffer pop", "buffer");
+   MMThreadGuard guard(g_bufferLock);
+
+   if (unreadCount_ == 0)
+      return std::shared_ptr<PinnedImage>();
+
+   Slot* slot = slots_[firstUnread_].get();
+   GetCameraQueue(slot->camera).unread.pop_front();
+   return PinSlot(slot, channel);
+}
+
+std::shared_ptr<PinnedImage> CircularBuffer::PopNextImagePinned(unsigned channel,
+      const void* camera)
+{
+   mm::TraceSpan span("CircularBuffer pop", "buffer");
+   MMThreadGuard guard(g_bufferLock);
+
+   CameraQueue* queue = const_cast<CameraQueue*>(FindCameraQueue(camera));
+   if (!queue || queue->unread.empty())
+      return std::shared_ptr<PinnedImage>();
+
+   Slot* slot = queue->unread.front();
+   queue->unread.pop_front();
+   return PinSlot(slot, channel);
 }
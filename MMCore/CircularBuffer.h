@@ -27,12 +27,19 @@
 #include "Error.h"
 #include "ErrorCodes.h"
 #include "FrameBuffer.h"
+#include "FrameStatistics.h"
+#include "FrameTimestamps.h"
 
 #include "../MMDevice/DeviceThreads.h"
 #include "../MMDevice/MMDevice.h"
 
+#include <atomic>
 #include <chrono>
+#include <cstddef>
+#include <ctime>
+#include <deque>
 #include <memory>
+#include <string>
 #include <vector>
 
 #ifdef _MSC_VER
@@ -42,19 +49,90 @@
 
 class ThreadPool;
 class TaskSet_CopyMemory;
+class TaskSet_FrameCompression;
+class TaskSet_FrameStatistics;
 
+namespace mm
+{
+   class DiskStreamWriter;
+   class LatestFrameMailbox;
+   class SharedFrameRingWriter;
+}
+
+// An image taken out of the circular buffer by
+// CircularBuffer::PopNextImagePinned(). Its memory is not reused by the
+// buffer for as long as this object exists, so the image stays valid (even
+// if the buffer is reinitialized or destroyed); meanwhile it counts against
+// the buffer's memory budget.
+class PinnedImage
+{
+public:
+   const mm::ImgBuffer& GetImage() const { return *image_; }
+
+private:
+   friend class CircularBuffer;
+   PinnedImage() : image_(0) {}
+
+   std::shared_ptr<void> owner_; // The slot, or the decompressed image
+   const mm::ImgBuffer* image_;
+};
+
+// Holds acquired images, in insertion order, within a fixed memory budget.
+//
+// Images of any size and pixel depth can be inserted; each is stored in a
+// slot allocated to fit it. Slots of popped images are kept for reuse by
+// later images of the same geometry, and freed only when their memory is
+// needed for other images, so a steady stream of equal images causes no
+// allocation. Each image is tagged with the camera it came from (an opaque
+// key, normally the camera's MM::Device pointer); images can be popped in
+// global insertion order or per camera.
+//
+// Optionally, images are held compressed (losslessly) so that more of them
+// fit in the budget; they are then decompressed when popped or peeked at,
+// into a buffer that stays valid until the next pop (or peek).
+//
+// Optionally, the statistics of each grayscale image (see FrameStatistics.h)
+// are computed while it is copied in, and added to its metadata.
+//
+// Images whose metadata has a device (hardware) timestamp also get their
+// time corrected by a model of the camera's clock (see FrameTimestamps.h).
+//
+// While streaming to disk, each image is also queued to the disk stream
+// writer without being copied; its slot is not reused until the writer has
+// copied it out (on the writer's threads) as well as it being popped.
 class CircularBuffer
 {
 public:
+   struct CompressionStatistics
+   {
+      unsigned long long framesCompressed;
+      unsigned long long rawBytes;
+      unsigned long long compressedBytes;
+      double compressSeconds;
+      unsigned long long framesDecompressed;
+      unsigned long long decompressedBytes;
+      double decompressSeconds;
+
+      CompressionStatistics() :
+         framesCompressed(0), rawBytes(0), compressedBytes(0),
+         compressSeconds(0.0), framesDecompressed(0), decompressedBytes(0),
+         decompressSeconds(0.0)
+      {}
+   };
+
    CircularBuffer(unsigned int memorySizeMB);
    ~CircularBuffer();
 
    unsigned GetMemorySizeMB() const { return memorySizeMB_; }
 
+   // Sets the nominal image geometry, used to report capacity, and
+   // preallocates as many slots of that geometry as fit in the memory
+   // budget. Images of other geometries can still be inserted.
    bool Initialize(unsigned channels, unsigned int xSize, unsigned int ySize, unsigned int pixDepth);
    unsigned long GetSize() const;
    unsigned long GetFreeSize() const;
    unsigned long GetRemainingImageCount() const;
+   unsigned long GetRemainingImageCount(const void* camera) const;
 
    unsigned int Width() const {MMThreadGuard guard(g_bufferLock); return width_;}
    unsigned int Height() const {MMThreadGuard guard(g_bufferLock); return height_;}
@@ -62,40 +140,151 @@ public:
 
    bool InsertImage(const unsigned char* pixArray, unsigned int width, unsigned int height, unsigned int byteDepth, const Metadata* pMd) throw (CMMError);
    bool InsertMultiChannel(const unsigned char* pixArray, unsigned int numChannels, unsigned int width, unsigned int height, unsigned int byteDepth, const Metadata* pMd) throw (CMMError);
-   bool InsertImage(const unsigned char* pixArray, unsigned int width, unsigned int height, unsigned int byteDepth, unsigned int nComponents, const Metadata* pMd) throw (CMMError);
-   bool InsertMultiChannel(const unsigned char* pixArray, unsigned int numChannels, unsigned int width, unsigned int height, unsigned int byteDepth, unsigned int nComponents, const Metadata* pMd) throw (CMMError);
+   bool InsertImage(const unsigned char* pixArray, unsigned int width, unsigned int height, unsigned int byteDepth, unsigned int nComponents, const Metadata* pMd, const void* camera = 0, unsigned int bitDepth = 0) throw (CMMError);
+   bool InsertMultiChannel(const unsigned char* pixArray, unsigned int numChannels, unsigned int width, unsigned int height, unsigned int byteDepth, unsigned int nComponents, const Metadata* pMd, const void* camera = 0, unsigned int bitDepth = 0) throw (CMMError);
    const unsigned char* GetTopImage() const;
    const unsigned char* GetNextImage();
    const mm::ImgBuffer* GetTopImageBuffer(unsigned channel) const;
+   const mm::ImgBuffer* GetTopImageBuffer(unsigned channel, const void* camera) const;
    const mm::ImgBuffer* GetNthFromTopImageBuffer(unsigned long n) const;
    const mm::ImgBuffer* GetNthFromTopImageBuffer(long n, unsigned channel) const;
    const mm::ImgBuffer* GetNextImageBuffer(unsigned channel);
+   const mm::ImgBuffer* GetNextImageBuffer(unsigned channel, const void* camera);
+   // Size in bytes of a channel of the image GetNextImageBuffer() would pop
+   // (0 if there is none), without popping or decompressing it
+   std::size_t GetNextImageBufferSize() const;
+   // Pop like GetNextImageBuffer(), but keep the image's slot from being
+   // reused until the caller releases the pinned image; it goes on counting
+   // against the memory budget until then (a compressed image at its
+   // compressed size). Return null if there is no image.
+   std::shared_ptr<PinnedImage> PopNextImagePinned(unsigned channel);
+   std::shared_ptr<PinnedImage> PopNextImagePinned(unsigned channel, const void* camera);
    void Clear(); 
 
    bool Overflow() {MMThreadGuard guard(g_bufferLock); return overflow_;}
 
+   // While a writer is attached, every inserted image is also queued to it;
+   // the buffer overflows as usual if images are neither popped nor written.
+   // With streamOnly, images are not queued for popping either: their
+   // memory is reused as soon as the writer is done with them.
+   void SetDiskStreamWriter(std::shared_ptr<mm::DiskStreamWriter> writer,
+         bool streamOnly = false);
+
+   // While a ring is attached, every inserted image is also published to it
+   void SetSharedFrameRing(std::shared_ptr<mm::SharedFrameRingWriter> ring);
+
+   // While a mailbox is attached, every inserted image is also published to
+   // it: by reference to its slot, which is not reused until the mailbox and
+   // its readers let go of the image, or as a copy if the image is
+   // compressed
+   void SetLatestFrameMailbox(std::shared_ptr<mm::LatestFrameMailbox> mailbox);
+
+   // Applies to images inserted from now on
+   void SetCompression(bool enable);
+   bool IsCompressionEnabled() const;
+   CompressionStatistics GetCompressionStatistics() const;
+   static std::string FormatCompressionStatistics(const CompressionStatistics& stats);
+
+   // Applies to images inserted from now on; 0 bins disables statistics
+   void SetFrameStatistics(unsigned histogramBins);
+   unsigned GetFrameStatisticsBins() const;
+
    mutable MMThreadLock g_bufferLock;
    mutable MMThreadLock g_insertLock;
 
 private:
+   struct Slot
+   {
+      mm::FrameBuffer frame; // No channel buffers if compressed
+      unsigned numChannels;
+      std::size_t bytes;
+      const void* camera;
+      bool popped;
+      bool compressed;
+      std::vector<std::vector<unsigned char> > packed; // Per channel, if compressed
+      std::vector<Metadata> metadata; // Per channel, if compressed
+      unsigned long long serial;
+      std::atomic<bool> streaming; // Queued to the disk stream, not yet copied
+      std::atomic<bool> pinned; // Popped by PinSlot(), not yet released
+      std::atomic<bool> displayed; // Shared with the latest-frame mailbox
+   };
+
+   // Decompressed image of a compressed slot
+   struct DecodedImage
+   {
+      std::unique_ptr<mm::ImgBuffer> image;
+      unsigned long long serial;
+      unsigned channel;
+      DecodedImage() : serial(0), channel(0) {}
+   };
+
+   struct CameraQueue
+   {
+      const void* camera;
+      long imageNumber;
+      std::deque<Slot*> unread; // Oldest first
+   };
+
+   CameraQueue& GetCameraQueue(const void* camera);
+   const CameraQueue* FindCameraQueue(const void* camera) const;
+   std::shared_ptr<Slot> AcquireSlot(std::size_t bytes, unsigned numChannels, unsigned width,
+         unsigned height, unsigned byteDepth, bool compressed) throw (CMMError);
+   bool ReclaimOldest();
+   const mm::ImgBuffer* PopSlot(Slot* slot, unsigned channel);
+   std::shared_ptr<PinnedImage> PinSlot(Slot* slot, unsigned channel);
+   void AdvanceFirstUnread();
+   const mm::ImgBuffer* GetImage(const Slot* slot, unsigned channel,
+         DecodedImage& decoded) const;
+   std::size_t NominalSlotBytes() const;
+   void FormatLocalTime(std::chrono::time_point<std::chrono::system_clock> tp, char (&buf)[32]);
+
    unsigned int width_;
    unsigned int height_;
    unsigned int pixDepth_;
+   unsigned int numChannels_;
    long imageCounter_;
    std::chrono::time_point<std::chrono::steady_clock> startTime_;
-   std::map<std::string, long> imageNumbers_;
 
-   // Invariants:
-   // 0 <= saveIndex_ <= insertIndex_
-   // insertIndex_ - saveIndex_ <= frameArray_.size()
-   long insertIndex_;
-   long saveIndex_;
+   // Invariants: slots_ from firstUnread_ on is in insertion order; all
+   // slots before firstUnread_ have been popped, and the slot at
+   // firstUnread_ (if any) has not; bytesInUse_ is the size of all slots
+   // and unreadBytes_ that of the slots not yet popped. Slots are shared
+   // only with the disk stream, with pinned images and with the
+   // latest-frame mailbox, which keep them from being reused; once a slot
+   // has left slots_ (on reinitialization) it no longer counts against the
+   // budget.
+   std::deque<std::shared_ptr<Slot> > slots_;
+   std::size_t firstUnread_;
+   std::size_t unreadCount_;
+   std::size_t bytesInUse_;
+   std::size_t unreadBytes_;
+   std::vector<CameraQueue> cameras_; // Few entries; searched linearly
+   unsigned long long insertSerial_;
 
    unsigned long memorySizeMB_;
-   unsigned int numChannels_;
    bool overflow_;
-   std::vector<mm::FrameBuffer> frameArray_;
 
    std::shared_ptr<ThreadPool> threadPool_;
    std::shared_ptr<TaskSet_CopyMemory> tasksMemCopy_;
+
+   bool compress_; // Guarded by both locks; either suffices for reading
+   std::shared_ptr<TaskSet_FrameCompression> tasksCompress_; // Under g_insertLock
+   std::shared_ptr<TaskSet_FrameCompression> tasksDecompress_; // Under g_bufferLock
+   std::vector<std::vector<unsigned char> > packedScratch_; // Under g_insertLock
+   mutable DecodedImage popped_; // Under g_bufferLock
+   mutable DecodedImage peeked_; // Under g_bufferLock
+   mutable CompressionStatistics compressionStats_; // Under g_bufferLock
+
+   unsigned statisticsBins_; // Guarded by both locks; either suffices for reading
+   std::shared_ptr<TaskSet_FrameStatistics> tasksStatistics_; // Under g_insertLock
+   mm::FrameStatistics frameStats_; // Under g_insertLock
+
+   std::shared_ptr<mm::DiskStreamWriter> streamWriter_; // Guarded by g_insertLock
+   bool streamOnly_; // Guarded by g_insertLock
+   std::shared_ptr<mm::SharedFrameRingWriter> sharedRing_; // Guarded by g_insertLock
+   std::shared_ptr<mm::LatestFrameMailbox> latestFrames_; // Guarded by g_insertLock
+
+   mm::FrameTimestamps timestamps_; // Under g_insertLock
+   std::time_t localTimeSecond_; // Under g_insertLock
+   char localTimePrefix_[24]; // Local time of localTimeSecond_, under g_insertLock
 };
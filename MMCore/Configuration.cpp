@@ -22,6 +22,7 @@
 #include "../MMDevice/MMDevice.h"
 #include "Error.h"
 #include <assert.h>
+#include <atomic>
 #include <sstream>
 #include <string>
 #include <cstring>
@@ -160,7 +161,11 @@ void Configuration::addSetting(const PropertySetting& setting)
    if (it != index_.end())
    {
       // replace
-      settings_[it->second] = setting;
+      PropertySetting& existing = settings_[it->second];
+      if (existing.isEqualTo(setting) &&
+            existing.getReadOnly() == setting.getReadOnly())
+         return;
+      existing = setting;
    }
    else
    {
@@ -168,6 +173,7 @@ void Configuration::addSetting(const PropertySetting& setting)
       index_[setting.getKey()] = (int)settings_.size();
       settings_.push_back(setting);
    }
+   bumpRevision();
 }
 
 /**
@@ -191,7 +197,15 @@ void Configuration::deleteSetting(const char* device, const char* prop)
    {
       index_[settings_[i].getKey()] = i;
    }
+   bumpRevision();
+}
 
+void Configuration::bumpRevision()
+{
+   // Revisions are drawn from a process-wide counter, so that no two
+   // different contents (of any Configuration) ever share a revision
+   static std::atomic<long long> lastRevision(0);
+   revision_ = ++lastRevision;
 }
 
 
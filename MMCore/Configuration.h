@@ -124,7 +124,7 @@ class Configuration
 {
 public:
 
-   Configuration() {}
+   Configuration() : revision_(0) {}
    ~Configuration() {}
 
    /**
@@ -145,10 +145,20 @@ public:
     */
    size_t size() const {return settings_.size();}
    std::string getVerbose() const;
+
+   /**
+    * Returns a number that changes whenever the contents change. Copies
+    * share the revision of the original until either is modified, so equal
+    * revisions imply equal contents.
+    */
+   long long getRevision() const {return revision_;}
  
 private:
+   void bumpRevision();
+
    std::vector<PropertySetting> settings_;
    std::map<std::string, int> index_;
+   long long revision_;
 };
 
 /**
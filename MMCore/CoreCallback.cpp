@@ -28,9 +28,11 @@
 #include "../MMDevice/DeviceThreads.h"
 #include "../MMDevice/DeviceUtils.h"
 #include "../MMDevice/ImgBuffer.h"
+#include "AcquisitionEngine.h"
 #include "CircularBuffer.h"
 #include "CoreCallback.h"
 #include "DeviceManager.h"
+#include "TraceRecorder.h"
 
 #include <cassert>
 #include <chrono>
@@ -223,6 +225,7 @@ CoreCallback::AddCameraMetadata(const MM::Device* caller, const Metadata* pMd)
 
    std::string label = camera->GetLabel();
    newMD.put("Camera", label);
+   core_->acqEngine_->TagInsertedImage(label, newMD);
 
    std::string serializedMD;
    try
@@ -241,6 +244,23 @@ CoreCallback::AddCameraMetadata(const MM::Device* caller, const Metadata* pMd)
    return newMD;
 }
 
+/**
+ * Returns the bit depth of the calling camera if image statistics are
+ * enabled (they are binned over its range), or 0 for the full byte depth.
+ * Called for each image, so only looks up the bit depth cached by the Core
+ * (see CMMCore::cacheStatisticsBitDepth()) instead of asking the camera.
+ */
+unsigned
+CoreCallback::GetStatisticsBitDepth(const MM::Device* caller)
+{
+   if (core_->cbuf_->GetFrameStatisticsBins() == 0)
+      return 0;
+   MMThreadGuard guard(core_->statisticsBitDepthsLock_);
+   std::map<const MM::Device*, unsigned>::const_iterator it =
+      core_->statisticsBitDepths_.find(caller);
+   return it == core_->statisticsBitDepths_.end() ? 0 : it->second;
+}
+
 int CoreCallback::InsertImage(const MM::Device* caller, const unsigned char* buf, unsigned width, unsigned height, unsigned byteDepth, const char* serializedMetadata, const bool doProcess)
 {
    Metadata md;
@@ -250,6 +270,7 @@ int CoreCallback::InsertImage(const MM::Device* caller, const unsigned char* buf
 
 int CoreCallback::InsertImage(const MM::Device* caller, const unsigned char* buf, unsigned width, unsigned height, unsigned byteDepth, const Metadata* pMd, bool doProcess)
 {
+   mm::TraceSpan span("InsertImage", "callback");
    try 
    {
       Metadata md = AddCameraMetadata(caller, pMd);
@@ -262,7 +283,8 @@ int CoreCallback::InsertImage(const MM::Device* caller, const unsigned char* buf
             ip->Process(const_cast<unsigned char*>(buf), width, height, byteDepth);
          }
       }
-      if (core_->cbuf_->InsertImage(buf, width, height, byteDepth, &md))
+      if (core_->cbuf_->InsertImage(buf, width, height, byteDepth, 1, &md, caller,
+               GetStatisticsBitDepth(caller)))
          return DEVICE_OK;
       else
          return DEVICE_BUFFER_OVERFLOW;
@@ -282,6 +304,7 @@ int CoreCallback::InsertImage(const MM::Device* caller, const unsigned char* buf
 
 int CoreCallback::InsertImage(const MM::Device* caller, const unsigned char* buf, unsigned width, unsigned height, unsigned byteDepth, unsigned nComponents, const Metadata* pMd, bool doProcess)
 {
+   mm::TraceSpan span("InsertImage", "callback");
    try 
    {
       Metadata md = AddCameraMetadata(caller, pMd);
@@ -294,7 +317,8 @@ int CoreCallback::InsertImage(const MM::Device* caller, const unsigned char* buf
             ip->Process(const_cast<unsigned char*>(buf), width, height, byteDepth);
          }
       }
-      if (core_->cbuf_->InsertImage(buf, width, height, byteDepth, nComponents, &md))
+      if (core_->cbuf_->InsertImage(buf, width, height, byteDepth, nComponents, &md, caller,
+               GetStatisticsBitDepth(caller)))
          return DEVICE_OK;
       else
          return DEVICE_BUFFER_OVERFLOW;
@@ -342,6 +366,7 @@ int CoreCallback::InsertMultiChannel(const MM::Device* caller,
                               unsigned byteDepth,
                               Metadata* pMd)
 {
+   mm::TraceSpan span("InsertMultiChannel", "callback");
    try
    {
       Metadata md = AddCameraMetadata(caller, pMd);
@@ -351,7 +376,8 @@ int CoreCallback::InsertMultiChannel(const MM::Device* caller,
       {
          ip->Process( const_cast<unsigned char*>(buf), width, height, byteDepth);
       }
-      if (core_->cbuf_->InsertMultiChannel(buf, numChannels, width, height, byteDepth, &md))
+      if (core_->cbuf_->InsertMultiChannel(buf, numChannels, width, height, byteDepth, 1, &md, caller,
+               GetStatisticsBitDepth(caller)))
          return DEVICE_OK;
       else
          return DEVICE_BUFFER_OVERFLOW;
@@ -365,6 +391,7 @@ int CoreCallback::InsertMultiChannel(const MM::Device* caller,
 
 int CoreCallback::AcqFinished(const MM::Device* caller, int /*statusCode*/)
 {
+   mm::TraceSpan span("AcqFinished", "callback");
    std::shared_ptr<DeviceInstance> camera;
    try
    {
@@ -380,24 +407,25 @@ int CoreCallback::AcqFinished(const MM::Device* caller, int /*statusCode*/)
    std::shared_ptr<DeviceInstance> currentCamera =
       core_->currentCameraDevice_.lock();
 
+   core_->acqEngine_->SequenceFinished(camera->GetLabel());
+
    if (core_->autoShutter_)
    {
       std::shared_ptr<ShutterInstance> shutter =
          core_->currentShutterDevice_.lock();
       if (shutter)
       {
-         // We need to lock the shutter's module for thread safety, but there's
-         // a case where deadlock would result.
-         if (camera->GetAdapterModule() == shutter->GetAdapterModule())
+         // We need to lock the shutter for thread safety, but there's a case
+         // where deadlock would result.
+         if (mm::DevicesShareLock(camera, shutter))
          {
             // This is a nasty hack to allow the case where the shutter and
-            // camera live in the same module. It is not safe, but this is how
+            // camera live in the same module (and share its lock). It is not safe, but this is how
             // _all_ cases used to be implemented, and I can't immediately
             // think of a fully safe fix that is reasonably simple.
             shutter->SetOpen(false);
          }
-         else if (currentCamera && currentCamera->GetAdapterModule() ==
-               shutter->GetAdapterModule())
+         else if (currentCamera && mm::DevicesShareLock(currentCamera, shutter))
          {
             // Likewise, we might be called as a result of a call to
             // StopSequenceAcquisition() on a virtual wrapper camera device
@@ -410,8 +438,9 @@ int CoreCallback::AcqFinished(const MM::Device* caller, int /*statusCode*/)
          }
          else
          {
-            // If the shutter is in a different device adapter, it is safe to
-            // lock that adapter.
+            // If the shutter is locked separately (in a different device
+            // adapter, or declared thread-safe by its adapter), it is safe to
+            // lock it.
             mm::DeviceModuleLockGuard g(shutter);
             shutter->SetOpen(false);
 
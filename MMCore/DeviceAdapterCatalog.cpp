@@ -0,0 +1,269 @@
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//
+// DESCRIPTION:   On-disk catalog of the devices offered by device adapter
+//                modules, so that they can be listed without loading them
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "DeviceAdapterCatalog.h"
+
+#include "CoreUtils.h"
+#include "Error.h"
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+namespace mm
+{
+
+namespace
+{
+
+const char* const catalogHeader = "# Micro-Manager device adapter catalog 1";
+
+// Fields are tab-separated and entries newline-terminated
+std::string Escape(const std::string& s)
+{
+   std::string out;
+   out.reserve(s.size());
+   for (char c : s)
+   {
+      switch (c)
+      {
+         case '\\': out += "\\\\"; break;
+         case '\t': out += "\\t"; break;
+         case '\n': out += "\\n"; break;
+         case '\r': out += "\\r"; break;
+         default: out += c;
+      }
+   }
+   return out;
+}
+
+std::string Unescape(const std::string& s)
+{
+   std::string out;
+   out.reserve(s.size());
+   for (std::size_t i = 0; i < s.size(); ++i)
+   {
+      if (s[i] != '\\' || i + 1 == s.size())
+      {
+         out += s[i];
+         continue;
+      }
+      switch (s[++i])
+      {
+         case 't': out += '\t'; break;
+         case 'n': out += '\n'; break;
+         case 'r': out += '\r'; break;
+         default: out += s[i];
+      }
+   }
+   return out;
+}
+
+std::vector<std::string> SplitFields(const std::string& line)
+{
+   std::vector<std::string> fields;
+   std::size_t start = 0;
+   for (;;)
+   {
+      std::size_t tab = line.find('\t', start);
+      fields.push_back(Unescape(line.substr(start, tab - start)));
+      if (tab == std::string::npos)
+         return fields;
+      start = tab + 1;
+   }
+}
+
+bool ParseInteger(const std::string& s, long long& value)
+{
+   if (s.empty())
+      return false;
+   char* end = 0;
+   value = std::strtoll(s.c_str(), &end, 10);
+   return *end == '\0';
+}
+
+// Parses the lines of one entry, starting with its "module" line
+bool ParseEntryLines(const std::vector<std::string>& lines,
+      std::string& moduleName, DeviceAdapterCatalogEntry& entry)
+{
+   if (lines.empty())
+      return false;
+   std::vector<std::string> fields = SplitFields(lines[0]);
+   long long size, mtime, moduleVersion, deviceVersion;
+   if (fields.size() != 8 || fields[0] != "module" || fields[1].empty() ||
+         !ParseInteger(fields[3], size) || !ParseInteger(fields[4], mtime) ||
+         !ParseInteger(fields[5], moduleVersion) ||
+         !ParseInteger(fields[6], deviceVersion))
+      return false;
+
+   moduleName = fields[1];
+   entry = DeviceAdapterCatalogEntry();
+   entry.signature.path = fields[2];
+   entry.signature.size = static_cast<unsigned long long>(size);
+   entry.signature.mtime = mtime;
+   entry.moduleInterfaceVersion = static_cast<long>(moduleVersion);
+   entry.deviceInterfaceVersion = static_cast<long>(deviceVersion);
+   entry.error = fields[7];
+
+   for (std::size_t i = 1; i < lines.size(); ++i)
+   {
+      fields = SplitFields(lines[i]);
+      long long type;
+      if (fields.size() != 4 || fields[0] != "device" ||
+            !ParseInteger(fields[2], type))
+         return false;
+      AdvertisedDevice device;
+      device.name = fields[1];
+      device.type = static_cast<int>(type);
+      device.description = fields[3];
+      entry.devices.push_back(device);
+   }
+   return true;
+}
+
+} // anonymous namespace
+
+bool GetModuleSignature(const std::string& path, ModuleSignature& signature)
+{
+#ifdef _WIN32
+   struct _stat64 st;
+   if (_stat64(path.c_str(), &st) != 0)
+      return false;
+#else
+   struct stat st;
+   if (stat(path.c_str(), &st) != 0)
+      return false;
+#endif
+   signature.path = path;
+   signature.size = static_cast<unsigned long long>(st.st_size);
+   signature.mtime = static_cast<long long>(st.st_mtime);
+   return true;
+}
+
+std::string SerializeCatalogEntry(const std::string& moduleName,
+      const DeviceAdapterCatalogEntry& entry)
+{
+   std::ostringstream os;
+   os << "module\t" << Escape(moduleName) << '\t' <<
+      Escape(entry.signature.path) << '\t' << entry.signature.size << '\t' <<
+      entry.signature.mtime << '\t' << entry.moduleInterfaceVersion << '\t' <<
+      entry.deviceInterfaceVersion << '\t' << Escape(entry.error) << '\n';
+   for (const AdvertisedDevice& device : entry.devices)
+   {
+      os << "device\t" << Escape(device.name) << '\t' << device.type << '\t' <<
+         Escape(device.description) << '\n';
+   }
+   return os.str();
+}
+
+bool ParseCatalogEntry(const std::string& text, std::string& moduleName,
+      DeviceAdapterCatalogEntry& entry)
+{
+   std::vector<std::string> lines;
+   std::istringstream is(text);
+   std::string line;
+   while (std::getline(is, line))
+      lines.push_back(line);
+   return ParseEntryLines(lines, moduleName, entry);
+}
+
+DeviceAdapterCatalog::DeviceAdapterCatalog(const std::string& filename) :
+   filename_(filename)
+{
+}
+
+void DeviceAdapterCatalog::Load()
+{
+   entries_.clear();
+   std::ifstream in(filename_.c_str());
+   std::string line;
+   if (!std::getline(in, line) || line != catalogHeader)
+      return;
+
+   std::vector<std::string> lines;
+   for (;;)
+   {
+      const bool more = static_cast<bool>(std::getline(in, line));
+      if (!lines.empty() && (!more || line.compare(0, 7, "module\t") == 0))
+      {
+         std::string moduleName;
+         DeviceAdapterCatalogEntry entry;
+         if (ParseEntryLines(lines, moduleName, entry))
+            entries_[moduleName] = entry;
+         lines.clear();
+      }
+      if (!more)
+         break;
+      lines.push_back(line);
+   }
+}
+
+void DeviceAdapterCatalog::Save() const
+{
+   // Replace the file only once it is complete, so that concurrent readers
+   // never see a partial catalog
+   const std::string tempFilename = filename_ + ".tmp";
+   {
+      std::ofstream out(tempFilename.c_str(), std::ios::binary | std::ios::trunc);
+      out << catalogHeader << '\n';
+      for (const auto& entry : entries_)
+         out << SerializeCatalogEntry(entry.first, entry.second);
+      out.close();
+      if (!out)
+      {
+         std::remove(tempFilename.c_str());
+         throw CMMError("Cannot write device adapter catalog " +
+               ToQuotedString(tempFilename));
+      }
+   }
+#ifdef _WIN32
+   std::remove(filename_.c_str()); // rename() does not replace on Windows
+#endif
+   if (std::rename(tempFilename.c_str(), filename_.c_str()) != 0)
+   {
+      std::remove(tempFilename.c_str());
+      throw CMMError("Cannot write device adapter catalog " +
+            ToQuotedString(filename_));
+   }
+}
+
+const DeviceAdapterCatalogEntry* DeviceAdapterCatalog::Find(
+      const std::string& moduleName, const ModuleSignature& signature,
+      long moduleInterfaceVersion, long deviceInterfaceVersion) const
+{
+   auto it = entries_.find(moduleName);
+   if (it == entries_.end())
+      return 0;
+   const DeviceAdapterCatalogEntry& entry = it->second;
+   if (entry.signature != signature ||
+         entry.moduleInterfaceVersion != moduleInterfaceVersion ||
+         entry.deviceInterfaceVersion != deviceInterfaceVersion)
+      return 0;
+   return &entry;
+}
+
+void DeviceAdapterCatalog::Put(const std::string& moduleName,
+      const DeviceAdapterCatalogEntry& entry)
+{
+   entries_[moduleName] = entry;
+}
+
+} // namespace mm
@@ -0,0 +1,114 @@
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//
+// DESCRIPTION:   On-disk catalog of the devices offered by device adapter
+//                modules, so that they can be listed without loading them
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace mm
+{
+
+// Identifies a version of a module file; an entry is only used while the
+// file still has the same path, size and modification time
+struct ModuleSignature
+{
+   std::string path;
+   unsigned long long size;
+   long long mtime; // Seconds since the epoch
+
+   ModuleSignature() : size(0), mtime(0) {}
+
+   bool operator==(const ModuleSignature& other) const
+   {
+      return path == other.path && size == other.size && mtime == other.mtime;
+   }
+   bool operator!=(const ModuleSignature& other) const
+   { return !(*this == other); }
+};
+
+// Returns false if the file does not exist
+bool GetModuleSignature(const std::string& path, ModuleSignature& signature);
+
+
+struct AdvertisedDevice
+{
+   std::string name;
+   std::string description;
+   int type; // MM::DeviceType
+
+   AdvertisedDevice() : type(0) {}
+};
+
+
+// What a module reported when it was queried, or why it could not be
+struct DeviceAdapterCatalogEntry
+{
+   ModuleSignature signature;
+   // Of the core that queried the module (and of the module, if it loaded)
+   long moduleInterfaceVersion;
+   long deviceInterfaceVersion;
+   std::vector<AdvertisedDevice> devices;
+   std::string error; // Nonempty if the module failed to load (not cataloged)
+
+   DeviceAdapterCatalogEntry() :
+      moduleInterfaceVersion(0), deviceInterfaceVersion(0)
+   {}
+};
+
+// Entries are written as tab-separated lines; the same format is used to
+// pass a single entry from a child process
+std::string SerializeCatalogEntry(const std::string& moduleName,
+      const DeviceAdapterCatalogEntry& entry);
+// Returns false if the text is not a complete entry
+bool ParseCatalogEntry(const std::string& text, std::string& moduleName,
+      DeviceAdapterCatalogEntry& entry);
+
+
+// Entries keyed by module name. Not thread-safe.
+class DeviceAdapterCatalog
+{
+public:
+   // Starts empty; use Load() to read an existing file
+   explicit DeviceAdapterCatalog(const std::string& filename);
+
+   const std::string& GetFilename() const { return filename_; }
+
+   // Unreadable or malformed files (or entries) are ignored, so that a
+   // damaged catalog is simply rebuilt
+   void Load();
+   // Throws CMMError if the file cannot be written
+   void Save() const;
+
+   // Returns null unless there is an entry for the module with the given
+   // signature, recorded by a core with the same interface versions
+   const DeviceAdapterCatalogEntry* Find(const std::string& moduleName,
+         const ModuleSignature& signature,
+         long moduleInterfaceVersion, long deviceInterfaceVersion) const;
+
+   void Put(const std::string& moduleName,
+         const DeviceAdapterCatalogEntry& entry);
+
+   std::size_t GetSize() const { return entries_.size(); }
+
+private:
+   std::string filename_;
+   std::map<std::string, DeviceAdapterCatalogEntry> entries_;
+};
+
+} // namespace mm
@@ -0,0 +1,74 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          DeviceHandle.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Opaque references to devices and device properties, for
+//                calling the Core without resolving labels every time
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include <string>
+
+class CMMCore;
+
+
+/**
+ * Reference to a loaded device, obtained from CMMCore::getDeviceHandle().
+ *
+ * Passing a handle to the Core avoids looking up the device label on every
+ * call. A handle stays valid until its device is unloaded; after that, calls
+ * taking the handle throw. Handles are never reused for another device, even
+ * if a new device is loaded under the same label.
+ */
+class DeviceHandle
+{
+public:
+   DeviceHandle() : id_(0) {}
+
+   bool isNull() const { return id_ == 0; }
+   long getId() const { return id_; }
+
+   bool operator==(const DeviceHandle& other) const { return id_ == other.id_; }
+   bool operator!=(const DeviceHandle& other) const { return id_ != other.id_; }
+
+private:
+   friend class CMMCore;
+   explicit DeviceHandle(long id) : id_(id) {}
+
+   long id_;
+};
+
+
+/**
+ * Reference to a property of a loaded device, obtained from
+ * CMMCore::getPropertyHandle(). Validity follows that of the device handle.
+ */
+class PropertyHandle
+{
+public:
+   PropertyHandle() {}
+
+   bool isNull() const { return device_.isNull(); }
+   DeviceHandle getDevice() const { return device_; }
+   std::string getPropertyName() const { return name_; }
+
+private:
+   friend class CMMCore;
+   PropertyHandle(DeviceHandle device, const std::string& name) :
+      device_(device), name_(name) {}
+
+   DeviceHandle device_;
+   std::string name_;
+};
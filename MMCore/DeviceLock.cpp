@@ -0,0 +1,107 @@
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//
+// DESCRIPTION:   Per-device lock, for devices whose module allows calls to
+//                different devices to run concurrently
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "DeviceLock.h"
+
+#include "Error.h"
+
+namespace mm
+{
+
+DeviceLock::DeviceLock() :
+   ownerDepth_(0),
+   waitingWriters_(0)
+{
+}
+
+void DeviceLock::Lock()
+{
+   const std::thread::id self = std::this_thread::get_id();
+   std::unique_lock<std::mutex> lock(mutex_);
+   if (ownerDepth_ > 0 && owner_ == self)
+   {
+      ++ownerDepth_;
+      return;
+   }
+   if (readers_.count(self))
+      throw CMMError("Cannot lock a device for modification while the same "
+            "thread is querying it");
+
+   ++waitingWriters_;
+   cv_.wait(lock, [&] { return ownerDepth_ == 0 && readers_.empty(); });
+   --waitingWriters_;
+   owner_ = self;
+   ownerDepth_ = 1;
+}
+
+void DeviceLock::Unlock()
+{
+   {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (--ownerDepth_ > 0)
+         return;
+      owner_ = std::thread::id();
+   }
+   cv_.notify_all();
+}
+
+void DeviceLock::LockShared()
+{
+   const std::thread::id self = std::this_thread::get_id();
+   std::unique_lock<std::mutex> lock(mutex_);
+   if (ownerDepth_ > 0 && owner_ == self)
+   {
+      ++ownerDepth_;
+      return;
+   }
+   std::map<std::thread::id, unsigned>::iterator it = readers_.find(self);
+   if (it != readers_.end())
+   {
+      ++it->second;
+      return;
+   }
+
+   cv_.wait(lock, [&] { return ownerDepth_ == 0 && waitingWriters_ == 0; });
+   readers_[self] = 1;
+}
+
+void DeviceLock::UnlockShared()
+{
+   const std::thread::id self = std::this_thread::get_id();
+   {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (ownerDepth_ > 0 && owner_ == self)
+      {
+         // Nested in the exclusive lock
+         if (--ownerDepth_ > 0)
+            return;
+         owner_ = std::thread::id();
+      }
+      else
+      {
+         std::map<std::thread::id, unsigned>::iterator it = readers_.find(self);
+         if (--it->second > 0)
+            return;
+         readers_.erase(it);
+         if (!readers_.empty())
+            return;
+      }
+   }
+   cv_.notify_all();
+}
+
+} // namespace mm
@@ -0,0 +1,71 @@
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//
+// DESCRIPTION:   Per-device lock, for devices whose module allows calls to
+//                different devices to run concurrently
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
+
+namespace mm
+{
+
+/**
+ * Recursive reader/writer lock.
+ *
+ * Like the module lock (MMThreadLock), the exclusive lock may be taken
+ * repeatedly by the thread that holds it; that thread may also take the
+ * shared lock, which then just nests in the exclusive lock. The shared lock
+ * may likewise be taken repeatedly by each thread.
+ *
+ * Waiting writers have priority over new readers (so that polling cannot
+ * starve them), except for readers that already hold the shared lock.
+ *
+ * A thread holding only the shared lock cannot take the exclusive lock (this
+ * would deadlock as soon as two threads tried); Lock() throws CMMError
+ * instead.
+ */
+class DeviceLock
+{
+public:
+   enum Access
+   {
+      Exclusive,
+      Shared,
+   };
+
+   DeviceLock();
+
+   DeviceLock(const DeviceLock&) = delete;
+   DeviceLock& operator=(const DeviceLock&) = delete;
+
+   void Lock();
+   void Unlock();
+   void LockShared();
+   void UnlockShared();
+
+private:
+   std::mutex mutex_;
+   std::condition_variable cv_;
+   std::thread::id owner_;
+   unsigned ownerDepth_; // 0 when not held exclusively
+   unsigned waitingWriters_;
+   std::map<std::thread::id, unsigned> readers_; // Depth for each reader
+};
+
+} // namespace mm
@@ -22,8 +22,8 @@
 #include "Devices/DeviceInstance.h"
 #include "Error.h"
 #include "LoadableModules/LoadedDeviceAdapter.h"
+#include "TraceRecorder.h"
 
-#include <algorithm>
 
 namespace mm
 {
@@ -41,13 +41,10 @@ DeviceManager::LoadDevice(std::shared_ptr<LoadedDeviceAdapter> module,
       mm::logging::Logger deviceLogger,
       mm::logging::Logger coreLogger)
 {
-   for (DeviceConstIterator it = devices_.begin(), end = devices_.end(); it != end; ++it)
+   if (labelIndex_.count(label))
    {
-      if (it->first == label)
-      {
-         throw CMMError("The specified device label " + ToQuotedString(label) +
-               " is already in use", MMERR_DuplicateLabel);
-      }
+      throw CMMError("The specified device label " + ToQuotedString(label) +
+            " is already in use", MMERR_DuplicateLabel);
    }
 
    std::shared_ptr<DeviceInstance> device = module->LoadDevice(core,
@@ -74,6 +71,9 @@ DeviceManager::LoadDevice(std::shared_ptr<LoadedDeviceAdapter> module,
 
    devices_.push_back(std::make_pair(label, device));
    deviceRawPtrIndex_.insert(std::make_pair(device->GetRawPtr(), device));
+   IndexEntry entry = { nextHandle_++, device };
+   labelIndex_.insert(std::make_pair(label, entry));
+   handleIndex_.insert(std::make_pair(entry.handle, device));
    return device;
 }
 
@@ -90,6 +90,13 @@ DeviceManager::UnloadDevice(std::shared_ptr<DeviceInstance> device)
       {
          device->Shutdown(); // TODO Should be automatic
          deviceRawPtrIndex_.erase(it->second->GetRawPtr());
+         std::unordered_map<std::string, IndexEntry>::iterator indexed =
+            labelIndex_.find(it->first);
+         if (indexed != labelIndex_.end())
+         {
+            handleIndex_.erase(indexed->second.handle);
+            labelIndex_.erase(indexed);
+         }
          devices_.erase(it);
          break;
       }
@@ -140,6 +147,8 @@ DeviceManager::UnloadAllDevices()
    }
 
    deviceRawPtrIndex_.clear();
+   labelIndex_.clear();
+   handleIndex_.clear();
    devices_.clear();
 
    // Now the only remaining references to the device objects should be in
@@ -155,31 +164,16 @@ DeviceManager::UnloadAllDevices()
 }
 
 
-namespace
-{
-   class DevicePairMatcheslabel
-   {
-      std::string s_;
-   public:
-      DevicePairMatcheslabel(const std::string& s) : s_(s) {}
-      bool operator()(const std::pair< std::string,
-            std::shared_ptr<DeviceInstance> >& p) const
-      { return p.first == s_; }
-   };
-} // anonymous namespace
-
-
 std::shared_ptr<DeviceInstance>
 DeviceManager::GetDevice(const std::string& label) const
 {
-   DeviceConstIterator found =
-      std::find_if(devices_.begin(), devices_.end(),
-            DevicePairMatcheslabel(label));
-   if (found == devices_.end())
+   std::unordered_map<std::string, IndexEntry>::const_iterator found =
+      labelIndex_.find(label);
+   if (found == labelIndex_.end())
    {
       throw CMMError("No device with label " + ToQuotedString(label));
    }
-   return found->second;
+   return found->second.device;
 }
 
 
@@ -194,6 +188,32 @@ DeviceManager::GetDevice(const char* label) const
 }
 
 
+long
+DeviceManager::GetDeviceHandle(const std::string& label) const
+{
+   std::unordered_map<std::string, IndexEntry>::const_iterator found =
+      labelIndex_.find(label);
+   if (found == labelIndex_.end())
+   {
+      throw CMMError("No device with label " + ToQuotedString(label));
+   }
+   return found->second.handle;
+}
+
+
+std::shared_ptr<DeviceInstance>
+DeviceManager::GetDeviceByHandle(long handle) const
+{
+   std::unordered_map<long, std::shared_ptr<DeviceInstance> >::const_iterator found =
+      handleIndex_.find(handle);
+   if (found == handleIndex_.end())
+   {
+      throw CMMError("Invalid device handle (the device may have been unloaded)");
+   }
+   return found->second;
+}
+
+
 std::shared_ptr<DeviceInstance>
 DeviceManager::GetDevice(const MM::Device* rawPtr) const
 {
@@ -292,9 +312,70 @@ DeviceManager::GetParentDevice(std::shared_ptr<DeviceInstance> device) const
 }
 
 
-DeviceModuleLockGuard::DeviceModuleLockGuard(std::shared_ptr<DeviceInstance> device) :
-   g_(device->GetAdapterModule()->GetLock())
-{}
+DeviceModuleLockGuard::DeviceModuleLockGuard(std::shared_ptr<DeviceInstance> device,
+      DeviceLock::Access access) :
+   device_(device),
+   moduleLock_(0),
+   shared_(false)
+{
+   const std::chrono::steady_clock::time_point start =
+      DeviceCallStatistics::IsEnabled() || TraceRecorder::IsEnabled() ?
+      std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+
+   switch (device->GetThreadSafety())
+   {
+      case MM::ThreadSafetyDeviceSharedReads:
+         if (access == DeviceLock::Shared)
+         {
+            device->GetDeviceLock().LockShared();
+            shared_ = true;
+            break;
+         }
+         device->GetDeviceLock().Lock();
+         break;
+      case MM::ThreadSafetyDevice:
+         device->GetDeviceLock().Lock();
+         break;
+      default:
+         moduleLock_ = device->GetAdapterModule()->GetLock();
+         moduleLock_->Lock();
+         break;
+   }
+
+   if (start != std::chrono::steady_clock::time_point())
+   {
+      std::chrono::steady_clock::time_point end =
+         std::chrono::steady_clock::now();
+      if (DeviceCallStatistics::IsEnabled())
+         device->GetCallStatistics().RecordLockWait(end - start);
+      if (TraceRecorder::IsEnabled())
+         TraceRecorder::RecordSpan(moduleLock_ ? "(module lock wait)" :
+               "(device lock wait)", "device",
+               device->GetTraceLabel(), start, end);
+   }
+}
+
+
+DeviceModuleLockGuard::~DeviceModuleLockGuard()
+{
+   if (moduleLock_)
+      moduleLock_->Unlock();
+   else if (shared_)
+      device_->GetDeviceLock().UnlockShared();
+   else
+      device_->GetDeviceLock().Unlock();
+}
+
+
+bool DevicesShareLock(const std::shared_ptr<DeviceInstance>& device1,
+      const std::shared_ptr<DeviceInstance>& device2)
+{
+   if (device1 == device2)
+      return true;
+   return device1->GetThreadSafety() == MM::ThreadSafetyModule &&
+      device2->GetThreadSafety() == MM::ThreadSafetyModule &&
+      device1->GetAdapterModule() == device2->GetAdapterModule();
+}
 
 
 } // namespace mm
@@ -24,9 +24,11 @@
 #include "Error.h"
 #include "Logging/Logger.h"
 
+#include <chrono>
 #include <map>
 #include <memory>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 class CMMCore;
@@ -39,9 +41,9 @@ namespace mm
 
 class DeviceManager /* final */
 {
-   // Store devices in an ordered container. We could use a map or hash map to
-   // retrieve by name, but the number of devices is so small that it is not
-   // known to be worth it.
+   // Store devices in an ordered container (load order matters for listing
+   // and unloading), with hash indices for lookup by label and by handle.
+   // Label lookup happens on nearly every Core call.
    std::vector< std::pair<std::string, std::shared_ptr<DeviceInstance> > > devices_;
    typedef std::vector< std::pair<std::string, std::shared_ptr<DeviceInstance> > >::const_iterator
       DeviceConstIterator;
@@ -52,7 +54,18 @@ class DeviceManager /* final */
    // where we need to retrieve device information from raw pointers.
    std::map< const MM::Device*, std::weak_ptr<DeviceInstance> > deviceRawPtrIndex_;
 
+   struct IndexEntry
+   {
+      long handle;
+      std::shared_ptr<DeviceInstance> device;
+   };
+   std::unordered_map<std::string, IndexEntry> labelIndex_;
+   std::unordered_map<long, std::shared_ptr<DeviceInstance> > handleIndex_;
+   long nextHandle_;
+
 public:
+   DeviceManager() : nextHandle_(1) {}
+
    ~DeviceManager();
 
    /**
@@ -105,6 +118,20 @@ public:
    { return GetDeviceOfType<TDeviceInstance>(GetDevice(label)); }
    ///@}
 
+   /**
+    * \brief Get the handle of a device.
+    *
+    * Handles are positive, assigned at load time, and never reused.
+    */
+   long GetDeviceHandle(const std::string& label) const;
+
+   /**
+    * \brief Get a device by handle.
+    *
+    * Throws if the device has been unloaded.
+    */
+   std::shared_ptr<DeviceInstance> GetDeviceByHandle(long handle) const;
+
    /**
     * \brief Get a device from a raw pointer to its MMDevice object.
     */
@@ -132,12 +159,33 @@ public:
 };
 
 
-// Scoped acquisition of a device's module's lock
+// Scoped acquisition of the lock that serializes calls to a device: its
+// module's lock, or, if the module declared the device thread-safe on its own
+// (MM::ThreadSafetyDevice or MM::ThreadSafetyDeviceSharedReads), the device's
+// own lock. Guards for calls that only query the device may request shared
+// access, which lets them run concurrently with each other for
+// ThreadSafetyDeviceSharedReads devices (and is exclusive otherwise).
+//
+// The time spent waiting for the lock is recorded in the device's call
+// statistics and in the trace.
 class DeviceModuleLockGuard
 {
-   MMThreadGuard g_;
+   std::shared_ptr<DeviceInstance> device_;
+   MMThreadLock* moduleLock_; // Null if the device lock is held
+   bool shared_;
 public:
-   explicit DeviceModuleLockGuard(std::shared_ptr<DeviceInstance> device);
+   DeviceModuleLockGuard(const DeviceModuleLockGuard&) = delete;
+   DeviceModuleLockGuard& operator=(const DeviceModuleLockGuard&) = delete;
+
+   explicit DeviceModuleLockGuard(std::shared_ptr<DeviceInstance> device,
+         DeviceLock::Access access = DeviceLock::Exclusive);
+   ~DeviceModuleLockGuard();
 };
 
+// Whether calls to the two devices are serialized by the same lock (in which
+// case a thread holding the lock for one may not wait for a thread that needs
+// it for the other)
+bool DevicesShareLock(const std::shared_ptr<DeviceInstance>& device1,
+      const std::shared_ptr<DeviceInstance>& device2);
+
 } // namespace mm
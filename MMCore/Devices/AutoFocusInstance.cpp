@@ -22,13 +22,13 @@
 #include "AutoFocusInstance.h"
 
 
-int AutoFocusInstance::SetContinuousFocusing(bool state) { return GetImpl()->SetContinuousFocusing(state); }
-int AutoFocusInstance::GetContinuousFocusing(bool& state) { return GetImpl()->GetContinuousFocusing(state); }
-bool AutoFocusInstance::IsContinuousFocusLocked() { return GetImpl()->IsContinuousFocusLocked(); }
-int AutoFocusInstance::FullFocus() { return GetImpl()->FullFocus(); }
-int AutoFocusInstance::IncrementalFocus() { return GetImpl()->IncrementalFocus(); }
-int AutoFocusInstance::GetLastFocusScore(double& score) { return GetImpl()->GetLastFocusScore(score); }
-int AutoFocusInstance::GetCurrentFocusScore(double& score) { return GetImpl()->GetCurrentFocusScore(score); }
-int AutoFocusInstance::AutoSetParameters() { return GetImpl()->AutoSetParameters(); }
-int AutoFocusInstance::GetOffset(double &offset) { return GetImpl()->GetOffset(offset); }
-int AutoFocusInstance::SetOffset(double offset) { return GetImpl()->SetOffset(offset); }
+int AutoFocusInstance::SetContinuousFocusing(bool state) { return MM_DEVICE_CALL(SetContinuousFocusing)->SetContinuousFocusing(state); }
+int AutoFocusInstance::GetContinuousFocusing(bool& state) { return MM_DEVICE_CALL(GetContinuousFocusing)->GetContinuousFocusing(state); }
+bool AutoFocusInstance::IsContinuousFocusLocked() { return MM_DEVICE_CALL(IsContinuousFocusLocked)->IsContinuousFocusLocked(); }
+int AutoFocusInstance::FullFocus() { return MM_DEVICE_CALL(FullFocus)->FullFocus(); }
+int AutoFocusInstance::IncrementalFocus() { return MM_DEVICE_CALL(IncrementalFocus)->IncrementalFocus(); }
+int AutoFocusInstance::GetLastFocusScore(double& score) { return MM_DEVICE_CALL(GetLastFocusScore)->GetLastFocusScore(score); }
+int AutoFocusInstance::GetCurrentFocusScore(double& score) { return MM_DEVICE_CALL(GetCurrentFocusScore)->GetCurrentFocusScore(score); }
+int AutoFocusInstance::AutoSetParameters() { return MM_DEVICE_CALL(AutoSetParameters)->AutoSetParameters(); }
+int AutoFocusInstance::GetOffset(double &offset) { return MM_DEVICE_CALL(GetOffset)->GetOffset(offset); }
+int AutoFocusInstance::SetOffset(double offset) { return MM_DEVICE_CALL(SetOffset)->SetOffset(offset); }
@@ -22,51 +22,51 @@
 #include "CameraInstance.h"
 
 
-int CameraInstance::SnapImage() { return GetImpl()->SnapImage(); }
-const unsigned char* CameraInstance::GetImageBuffer() { return GetImpl()->GetImageBuffer(); }
-const unsigned char* CameraInstance::GetImageBuffer(unsigned channelNr) { return GetImpl()->GetImageBuffer(channelNr); }
-const unsigned int* CameraInstance::GetImageBufferAsRGB32() { return GetImpl()->GetImageBufferAsRGB32(); }
-unsigned CameraInstance::GetNumberOfComponents() const { return GetImpl()->GetNumberOfComponents(); }
+int CameraInstance::SnapImage() { return MM_DEVICE_CALL(SnapImage)->SnapImage(); }
+const unsigned char* CameraInstance::GetImageBuffer() { return MM_DEVICE_CALL(GetImageBuffer)->GetImageBuffer(); }
+const unsigned char* CameraInstance::GetImageBuffer(unsigned channelNr) { return MM_DEVICE_CALL(GetImageBuffer)->GetImageBuffer(channelNr); }
+const unsigned int* CameraInstance::GetImageBufferAsRGB32() { return MM_DEVICE_CALL(GetImageBufferAsRGB32)->GetImageBufferAsRGB32(); }
+unsigned CameraInstance::GetNumberOfComponents() const { return MM_DEVICE_CALL(GetNumberOfComponents)->GetNumberOfComponents(); }
 
 std::string CameraInstance::GetComponentName(unsigned component)
 {
    DeviceStringBuffer nameBuf(this, "GetComponentName");
-   int err = GetImpl()->GetComponentName(component, nameBuf.GetBuffer());
+   int err = MM_DEVICE_CALL(GetComponentName)->GetComponentName(component, nameBuf.GetBuffer());
    ThrowIfError(err, "Cannot get component name at index " +
          ToString(component));
    return nameBuf.Get();
 }
 
-int unsigned CameraInstance::GetNumberOfChannels() const { return GetImpl()->GetNumberOfChannels(); }
+int unsigned CameraInstance::GetNumberOfChannels() const { return MM_DEVICE_CALL(GetNumberOfChannels)->GetNumberOfChannels(); }
 
 std::string CameraInstance::GetChannelName(unsigned channel)
 {
    DeviceStringBuffer nameBuf(this, "GetChannelName");
-   int err = GetImpl()->GetChannelName(channel, nameBuf.GetBuffer());
+   int err = MM_DEVICE_CALL(GetChannelName)->GetChannelName(channel, nameBuf.GetBuffer());
    ThrowIfError(err, "Cannot get channel name at index " + ToString(channel));
    return nameBuf.Get();
 }
 
-long CameraInstance::GetImageBufferSize()const { return GetImpl()->GetImageBufferSize(); }
-unsigned CameraInstance::GetImageWidth() const { return GetImpl()->GetImageWidth(); }
-unsigned CameraInstance::GetImageHeight() const { return GetImpl()->GetImageHeight(); }
-unsigned CameraInstance::GetImageBytesPerPixel() const { return GetImpl()->GetImageBytesPerPixel(); }
-unsigned CameraInstance::GetBitDepth() const { return GetImpl()->GetBitDepth(); }
-double CameraInstance::GetPixelSizeUm() const { return GetImpl()->GetPixelSizeUm(); }
-int CameraInstance::GetBinning() const { return GetImpl()->GetBinning(); }
-int CameraInstance::SetBinning(int binSize) { return GetImpl()->SetBinning(binSize); }
-void CameraInstance::SetExposure(double exp_ms) { return GetImpl()->SetExposure(exp_ms); }
-double CameraInstance::GetExposure() const { return GetImpl()->GetExposure(); }
-int CameraInstance::SetROI(unsigned x, unsigned y, unsigned xSize, unsigned ySize) { return GetImpl()->SetROI(x, y, xSize, ySize); }
-int CameraInstance::GetROI(unsigned& x, unsigned& y, unsigned& xSize, unsigned& ySize) { return GetImpl()->GetROI(x, y, xSize, ySize); }
-int CameraInstance::ClearROI() { return GetImpl()->ClearROI(); }
+long CameraInstance::GetImageBufferSize()const { return MM_DEVICE_CALL(GetImageBufferSize)->GetImageBufferSize(); }
+unsigned CameraInstance::GetImageWidth() const { return MM_DEVICE_CALL(GetImageWidth)->GetImageWidth(); }
+unsigned CameraInstance::GetImageHeight() const { return MM_DEVICE_CALL(GetImageHeight)->GetImageHeight(); }
+unsigned CameraInstance::GetImageBytesPerPixel() const { return MM_DEVICE_CALL(GetImageBytesPerPixel)->GetImageBytesPerPixel(); }
+unsigned CameraInstance::GetBitDepth() const { return MM_DEVICE_CALL(GetBitDepth)->GetBitDepth(); }
+double CameraInstance::GetPixelSizeUm() const { return MM_DEVICE_CALL(GetPixelSizeUm)->GetPixelSizeUm(); }
+int CameraInstance::GetBinning() const { return MM_DEVICE_CALL(GetBinning)->GetBinning(); }
+int CameraInstance::SetBinning(int binSize) { return MM_DEVICE_CALL(SetBinning)->SetBinning(binSize); }
+void CameraInstance::SetExposure(double exp_ms) { return MM_DEVICE_CALL(SetExposure)->SetExposure(exp_ms); }
+double CameraInstance::GetExposure() const { return MM_DEVICE_CALL(GetExposure)->GetExposure(); }
+int CameraInstance::SetROI(unsigned x, unsigned y, unsigned xSize, unsigned ySize) { return MM_DEVICE_CALL(SetROI)->SetROI(x, y, xSize, ySize); }
+int CameraInstance::GetROI(unsigned& x, unsigned& y, unsigned& xSize, unsigned& ySize) { return MM_DEVICE_CALL(GetROI)->GetROI(x, y, xSize, ySize); }
+int CameraInstance::ClearROI() { return MM_DEVICE_CALL(ClearROI)->ClearROI(); }
 
 /**
  * Queries if the camera supports multiple simultaneous ROIs.
  */
 bool CameraInstance::SupportsMultiROI()
 {
-   return GetImpl()->SupportsMultiROI();
+   return MM_DEVICE_CALL(SupportsMultiROI)->SupportsMultiROI();
 }
 
 /**
@@ -76,7 +76,7 @@ bool CameraInstance::SupportsMultiROI()
  */
 bool CameraInstance::IsMultiROISet()
 {
-   return GetImpl()->IsMultiROISet();
+   return MM_DEVICE_CALL(IsMultiROISet)->IsMultiROISet();
 }
 
 /**
@@ -85,7 +85,7 @@ bool CameraInstance::IsMultiROISet()
  */
 int CameraInstance::GetMultiROICount(unsigned int& count)
 {
-   return GetImpl()->GetMultiROICount(count);
+   return MM_DEVICE_CALL(GetMultiROICount)->GetMultiROICount(count);
 }
 
 /**
@@ -101,7 +101,7 @@ int CameraInstance::SetMultiROI(const unsigned int* xs, const unsigned int* ys,
       const unsigned* widths, const unsigned int* heights,
       unsigned numROIs)
 {
-   return GetImpl()->SetMultiROI(xs, ys, widths, heights, numROIs);
+   return MM_DEVICE_CALL(SetMultiROI)->SetMultiROI(xs, ys, widths, heights, numROIs);
 }
 
 /**
@@ -117,14 +117,14 @@ int CameraInstance::SetMultiROI(const unsigned int* xs, const unsigned int* ys,
 int CameraInstance::GetMultiROI(unsigned* xs, unsigned* ys, unsigned* widths,
       unsigned* heights, unsigned* length)
 {
-   return GetImpl()->GetMultiROI(xs, ys, widths, heights, length);
+   return MM_DEVICE_CALL(GetMultiROI)->GetMultiROI(xs, ys, widths, heights, length);
 }
 
-int CameraInstance::StartSequenceAcquisition(long numImages, double interval_ms, bool stopOnOverflow) { return GetImpl()->StartSequenceAcquisition(numImages, interval_ms, stopOnOverflow); }
-int CameraInstance::StartSequenceAcquisition(double interval_ms) { return GetImpl()->StartSequenceAcquisition(interval_ms); }
-int CameraInstance::StopSequenceAcquisition() { return GetImpl()->StopSequenceAcquisition(); }
-int CameraInstance::PrepareSequenceAcqusition() { return GetImpl()->PrepareSequenceAcqusition(); }
-bool CameraInstance::IsCapturing() { return GetImpl()->IsCapturing(); }
+int CameraInstance::StartSequenceAcquisition(long numImages, double interval_ms, bool stopOnOverflow) { return MM_DEVICE_CALL(StartSequenceAcquisition)->StartSequenceAcquisition(numImages, interval_ms, stopOnOverflow); }
+int CameraInstance::StartSequenceAcquisition(double interval_ms) { return MM_DEVICE_CALL(StartSequenceAcquisition)->StartSequenceAcquisition(interval_ms); }
+int CameraInstance::StopSequenceAcquisition() { return MM_DEVICE_CALL(StopSequenceAcquisition)->StopSequenceAcquisition(); }
+int CameraInstance::PrepareSequenceAcqusition() { return MM_DEVICE_CALL(PrepareSequenceAcqusition)->PrepareSequenceAcqusition(); }
+bool CameraInstance::IsCapturing() { return MM_DEVICE_CALL(IsCapturing)->IsCapturing(); }
 
 std::string CameraInstance::GetTags()
 {
@@ -133,16 +133,17 @@ std::string CameraInstance::GetTags()
    // (CCameraBase takes no precaution to limit string length; it is an
    // interface bug).
    DeviceStringBuffer serializedMetadataBuf(this, "GetTags");
-   GetImpl()->GetTags(serializedMetadataBuf.GetBuffer());
+   MM_DEVICE_CALL(GetTags)->GetTags(serializedMetadataBuf.GetBuffer());
    return serializedMetadataBuf.Get();
 }
 
-void CameraInstance::AddTag(const char* key, const char* deviceLabel, const char* value) { return GetImpl()->AddTag(key, deviceLabel, value); }
-void CameraInstance::RemoveTag(const char* key) { return GetImpl()->RemoveTag(key); }
-int CameraInstance::IsExposureSequenceable(bool& isSequenceable) const { return GetImpl()->IsExposureSequenceable(isSequenceable); }
-int CameraInstance::GetExposureSequenceMaxLength(long& nrEvents) const { return GetImpl()->GetExposureSequenceMaxLength(nrEvents); }
-int CameraInstance::StartExposureSequence() { return GetImpl()->StartExposureSequence(); }
-int CameraInstance::StopExposureSequence() { return GetImpl()->StopExposureSequence(); }
-int CameraInstance::ClearExposureSequence() { return GetImpl()->ClearExposureSequence(); }
-int CameraInstance::AddToExposureSequence(double exposureTime_ms) { return GetImpl()->AddToExposureSequence(exposureTime_ms); }
-int CameraInstance::SendExposureSequence() const { return GetImpl()->SendExposureSequence(); }
+void CameraInstance::AddTag(const char* key, const char* deviceLabel, const char* value) { return MM_DEVICE_CALL(AddTag)->AddTag(key, deviceLabel, value); }
+void CameraInstance::RemoveTag(const char* key) { return MM_DEVICE_CALL(RemoveTag)->RemoveTag(key); }
+int CameraInstance::IsExposureSequenceable(bool& isSequenceable) const { return MM_DEVICE_CALL(IsExposureSequenceable)->IsExposureSequenceable(isSequenceable); }
+int CameraInstance::GetExposureSequenceMaxLength(long& nrEvents) const { return MM_DEVICE_CALL(GetExposureSequenceMaxLength)->GetExposureSequenceMaxLength(nrEvents); }
+int CameraInstance::StartExposureSequence() { return MM_DEVICE_CALL(StartExposureSequence)->StartExposureSequence(); }
+int CameraInstance::StopExposureSequence() { return MM_DEVICE_CALL(StopExposureSequence)->StopExposureSequence(); }
+int CameraInstance::ClearExposureSequence() { return MM_DEVICE_CALL(ClearExposureSequence)->ClearExposureSequence(); }
+int CameraInstance::AddToExposureSequence(double exposureTime_ms) { return MM_DEVICE_CALL(AddToExposureSequence)->AddToExposureSequence(exposureTime_ms); }
+int CameraInstance::AddArrayToExposureSequence(const double* exposureTimes_ms, long count) { return MM_DEVICE_CALL(AddArrayToExposureSequence)->AddArrayToExposureSequence(exposureTimes_ms, count); }
+int CameraInstance::SendExposureSequence() const { return MM_DEVICE_CALL(SendExposureSequence)->SendExposureSequence(); }
@@ -81,5 +81,6 @@ public:
    int StopExposureSequence();
    int ClearExposureSequence();
    int AddToExposureSequence(double exposureTime_ms);
+   int AddArrayToExposureSequence(const double* exposureTimes_ms, long count);
    int SendExposureSequence() const;
 };
@@ -0,0 +1,217 @@
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//
+// DESCRIPTION:   Per-device timing of calls into device adapters
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "DeviceCallStatistics.h"
+
+#include <mutex>
+
+namespace mm
+{
+
+namespace
+{
+
+// Registry of call site names. Sites with the same name (e.g. the same method
+// in wrappers of different device types) share an index. When the registry is
+// full, further sites share the last index.
+class SiteRegistry
+{
+   std::mutex mutex_;
+   std::vector<std::string> names_;
+
+public:
+   static SiteRegistry& Instance()
+   {
+      static SiteRegistry instance;
+      return instance;
+   }
+
+   std::size_t Register(const char* name)
+   {
+      std::lock_guard<std::mutex> lock(mutex_);
+      for (std::size_t i = 0; i < names_.size(); ++i)
+      {
+         if (names_[i] == name)
+            return i;
+      }
+      if (names_.size() == DeviceCallSite::MaxSites - 1)
+      {
+         names_.push_back("(other)");
+         return names_.size() - 1;
+      }
+      if (names_.size() == DeviceCallSite::MaxSites)
+         return DeviceCallSite::MaxSites - 1;
+      names_.push_back(name);
+      return names_.size() - 1;
+   }
+
+   std::string GetName(std::size_t index)
+   {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (index < names_.size())
+         return names_[index];
+      return std::string();
+   }
+};
+
+std::size_t BucketOf(std::uint64_t ns)
+{
+   std::uint64_t us = ns / 1000;
+   std::size_t bucket = 0;
+   while (us > 0 && bucket < DeviceCallStatistics::NumHistogramBuckets - 1)
+   {
+      us >>= 1;
+      ++bucket;
+   }
+   return bucket;
+}
+
+const char* const g_LockWaitName = "(module lock wait)";
+
+} // anonymous namespace
+
+
+DeviceCallSite::DeviceCallSite(const char* name) :
+   name_(name),
+   index_(SiteRegistry::Instance().Register(name))
+{
+}
+
+std::string
+DeviceCallSite::GetName(std::size_t index)
+{
+   return SiteRegistry::Instance().GetName(index);
+}
+
+
+std::atomic<bool> DeviceCallStatistics::enabled_(false);
+
+
+DeviceCallStatistics::Entry::Entry()
+{
+   Clear();
+}
+
+void
+DeviceCallStatistics::Entry::Add(std::uint64_t ns)
+{
+   count.fetch_add(1, std::memory_order_relaxed);
+   totalNs.fetch_add(ns, std::memory_order_relaxed);
+   std::uint64_t prevMax = maxNs.load(std::memory_order_relaxed);
+   while (ns > prevMax &&
+         !maxNs.compare_exchange_weak(prevMax, ns, std::memory_order_relaxed))
+      ;
+   histogram[BucketOf(ns)].fetch_add(1, std::memory_order_relaxed);
+}
+
+void
+DeviceCallStatistics::Entry::Clear()
+{
+   count.store(0, std::memory_order_relaxed);
+   totalNs.store(0, std::memory_order_relaxed);
+   maxNs.store(0, std::memory_order_relaxed);
+   for (std::size_t i = 0; i < NumHistogramBuckets; ++i)
+      histogram[i].store(0, std::memory_order_relaxed);
+}
+
+
+DeviceCallStatistics::DeviceCallStatistics()
+{
+   for (std::size_t i = 0; i <= DeviceCallSite::MaxSites; ++i)
+      entries_[i].store(0, std::memory_order_relaxed);
+}
+
+DeviceCallStatistics::~DeviceCallStatistics()
+{
+   for (std::size_t i = 0; i <= DeviceCallSite::MaxSites; ++i)
+      delete entries_[i].load(std::memory_order_relaxed);
+}
+
+void
+DeviceCallStatistics::SetEnabled(bool enabled)
+{
+   enabled_.store(enabled, std::memory_order_relaxed);
+}
+
+DeviceCallStatistics::Entry*
+DeviceCallStatistics::GetEntry(std::size_t slot)
+{
+   Entry* entry = entries_[slot].load(std::memory_order_acquire);
+   if (entry)
+      return entry;
+
+   Entry* created = new Entry();
+   if (entries_[slot].compare_exchange_strong(entry, created,
+            std::memory_order_acq_rel))
+      return created;
+   delete created; // Another thread got there first
+   return entry;
+}
+
+void
+DeviceCallStatistics::Record(std::size_t siteIndex,
+      std::chrono::steady_clock::duration d)
+{
+   if (siteIndex >= DeviceCallSite::MaxSites)
+      return;
+   GetEntry(siteIndex)->Add(
+         std::chrono::duration_cast<std::chrono::nanoseconds>(d).count());
+}
+
+void
+DeviceCallStatistics::RecordLockWait(std::chrono::steady_clock::duration d)
+{
+   GetEntry(DeviceCallSite::MaxSites)->Add(
+         std::chrono::duration_cast<std::chrono::nanoseconds>(d).count());
+}
+
+void
+DeviceCallStatistics::Reset()
+{
+   for (std::size_t i = 0; i <= DeviceCallSite::MaxSites; ++i)
+   {
+      Entry* entry = entries_[i].load(std::memory_order_acquire);
+      if (entry)
+         entry->Clear();
+   }
+}
+
+std::vector<DeviceCallStatistics::Summary>
+DeviceCallStatistics::GetSummaries() const
+{
+   std::vector<Summary> result;
+   for (std::size_t i = 0; i <= DeviceCallSite::MaxSites; ++i)
+   {
+      const Entry* entry = entries_[i].load(std::memory_order_acquire);
+      if (!entry)
+         continue;
+      Summary summary;
+      summary.count = entry->count.load(std::memory_order_relaxed);
+      if (summary.count == 0)
+         continue;
+      summary.method = (i == DeviceCallSite::MaxSites) ?
+         std::string(g_LockWaitName) : DeviceCallSite::GetName(i);
+      summary.totalMs = entry->totalNs.load(std::memory_order_relaxed) / 1e6;
+      summary.maxMs = entry->maxNs.load(std::memory_order_relaxed) / 1e6;
+      for (std::size_t b = 0; b < NumHistogramBuckets; ++b)
+         summary.histogram.push_back(
+               entry->histogram[b].load(std::memory_order_relaxed));
+      result.push_back(summary);
+   }
+   return result;
+}
+
+} // namespace mm
@@ -0,0 +1,189 @@
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//
+// DESCRIPTION:   Per-device timing of calls into device adapters
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include "../TraceRecorder.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace mm
+{
+
+/**
+ * Identifies one instrumented DeviceInstance wrapper method. Instances are
+ * function-local statics (see MM_DEVICE_CALL), so each gets a small index
+ * once and lookups during calls are array accesses.
+ */
+class DeviceCallSite
+{
+public:
+   static const std::size_t MaxSites = 512;
+
+   // name must be a string literal
+   explicit DeviceCallSite(const char* name);
+
+   std::size_t GetIndex() const { return index_; }
+   const char* GetMethodName() const { return name_; }
+   static std::string GetName(std::size_t index);
+
+private:
+   const char* name_;
+   std::size_t index_;
+};
+
+
+/**
+ * Call counts and latencies of one device, per wrapper method, plus the time
+ * spent waiting for the device's module lock.
+ *
+ * Recording is lock-free (a handful of relaxed atomics per call) and is
+ * skipped entirely while statistics are disabled. The enabled flag is
+ * process-wide.
+ */
+class DeviceCallStatistics
+{
+public:
+   // Histogram bucket 0 counts calls under 1 us; bucket i (i > 0) counts
+   // calls of [2^(i-1), 2^i) us; the last bucket also takes everything
+   // longer.
+   static const std::size_t NumHistogramBuckets = 24;
+
+   struct Summary
+   {
+      std::string method;
+      std::uint64_t count;
+      double totalMs;
+      double maxMs;
+      std::vector<std::uint64_t> histogram;
+   };
+
+   DeviceCallStatistics();
+   ~DeviceCallStatistics();
+
+   DeviceCallStatistics(const DeviceCallStatistics&) = delete;
+   DeviceCallStatistics& operator=(const DeviceCallStatistics&) = delete;
+
+   static void SetEnabled(bool enabled);
+   static bool IsEnabled()
+   { return enabled_.load(std::memory_order_relaxed); }
+
+   void Record(std::size_t siteIndex, std::chrono::steady_clock::duration d);
+   void RecordLockWait(std::chrono::steady_clock::duration d);
+   void Reset();
+
+   // Methods with at least one recorded call; the lock wait appears as
+   // "(module lock wait)"
+   std::vector<Summary> GetSummaries() const;
+
+private:
+   struct Entry
+   {
+      std::atomic<std::uint64_t> count;
+      std::atomic<std::uint64_t> totalNs;
+      std::atomic<std::uint64_t> maxNs;
+      std::atomic<std::uint64_t> histogram[NumHistogramBuckets];
+
+      Entry();
+      void Add(std::uint64_t ns);
+      void Clear();
+   };
+
+   Entry* GetEntry(std::size_t slot);
+
+   static std::atomic<bool> enabled_;
+
+   // Slot MaxSites holds the module lock wait; entries are allocated on
+   // first use and live as long as the device
+   std::atomic<Entry*> entries_[DeviceCallSite::MaxSites + 1];
+};
+
+
+/**
+ * Times one call into a device adapter: the clock starts when the object is
+ * created and stops when it is destroyed at the end of the full expression
+ * containing the call. The call is recorded in the statistics and/or the
+ * trace, depending on which is enabled.
+ */
+template <typename TDevice>
+class TimedDeviceCall
+{
+public:
+   TimedDeviceCall(TDevice* device, DeviceCallStatistics* stats,
+         const DeviceCallSite& site, const char* traceLabel) :
+      device_(device),
+      stats_(DeviceCallStatistics::IsEnabled() ? stats : 0),
+      site_(&site),
+      traceLabel_(TraceRecorder::IsEnabled() ? traceLabel : 0)
+   {
+      if (stats_ || traceLabel_)
+         start_ = std::chrono::steady_clock::now();
+   }
+
+   TimedDeviceCall(TimedDeviceCall&& other) :
+      device_(other.device_),
+      stats_(other.stats_),
+      site_(other.site_),
+      traceLabel_(other.traceLabel_),
+      start_(other.start_)
+   {
+      other.stats_ = 0;
+      other.traceLabel_ = 0;
+   }
+
+   ~TimedDeviceCall()
+   {
+      if (!stats_ && !traceLabel_)
+         return;
+      std::chrono::steady_clock::time_point end =
+         std::chrono::steady_clock::now();
+      if (stats_)
+         stats_->Record(site_->GetIndex(), end - start_);
+      if (traceLabel_)
+         TraceRecorder::RecordSpan(site_->GetMethodName(), "device",
+               traceLabel_, start_, end);
+   }
+
+   TDevice* operator->() const { return device_; }
+
+private:
+   TimedDeviceCall(const TimedDeviceCall&) = delete;
+   TimedDeviceCall& operator=(const TimedDeviceCall&) = delete;
+
+   TDevice* device_;
+   DeviceCallStatistics* stats_;
+   const DeviceCallSite* site_;
+   const char* traceLabel_;
+   std::chrono::steady_clock::time_point start_;
+};
+
+} // namespace mm
+
+
+/**
+ * Use in DeviceInstance wrappers in place of GetImpl() (or pImpl_) to time
+ * the call into the device adapter:
+ *
+ *    return MM_DEVICE_CALL(SetPositionUm)->SetPositionUm(pos);
+ */
+#define MM_DEVICE_CALL(method) \
+   TimedImpl([]() -> const mm::DeviceCallSite& { \
+      static const mm::DeviceCallSite site(#method); \
+      return site; }())
@@ -52,7 +52,9 @@ DeviceInstance::DeviceInstance(CMMCore* core,
    label_(label),
    deleteFunction_(deleteFunction),
    deviceLogger_(deviceLogger),
-   coreLogger_(coreLogger)
+   coreLogger_(coreLogger),
+   traceLabel_(mm::TraceRecorder::Intern(label)),
+   threadSafety_(adapter->GetDeviceThreadSafety(name))
 {
    const std::string actualName = GetName();
    if (actualName != name)
@@ -65,7 +67,7 @@ DeviceInstance::DeviceInstance(CMMCore* core,
       // entirely and handle it solely in the Core.
    }
 
-   pImpl_->SetLabel(label_.c_str());
+   MM_DEVICE_CALL(SetLabel)->SetLabel(label_.c_str());
 }
 
 DeviceInstance::~DeviceInstance()
@@ -141,15 +143,30 @@ DeviceInstance::GetPropertyNames() const
    return result;
 }
 
+void
+DeviceInstance::OverridePropertyCachePolicy(const char* name,
+      MM::PropertyCachePolicy policy, long ttlMs)
+{
+   SetPropertyCachePolicy(name, policy, ttlMs);
+   cachePolicyOverrides_.insert(name);
+}
+
+std::vector<std::string>
+DeviceInstance::GetPropertyCachePolicyOverrides() const
+{
+   return std::vector<std::string>(cachePolicyOverrides_.begin(),
+         cachePolicyOverrides_.end());
+}
+
 unsigned
 DeviceInstance::GetNumberOfProperties() const
-{ return pImpl_->GetNumberOfProperties(); }
+{ return MM_DEVICE_CALL(GetNumberOfProperties)->GetNumberOfProperties(); }
 
 std::string
 DeviceInstance::GetProperty(const std::string& name) const
 {
    DeviceStringBuffer valueBuf(this, "GetProperty");
-   int err = pImpl_->GetProperty(name.c_str(), valueBuf.GetBuffer());
+   int err = MM_DEVICE_CALL(GetProperty)->GetProperty(name.c_str(), valueBuf.GetBuffer());
    ThrowIfError(err, "Cannot get value of property " +
          ToQuotedString(name));
    return valueBuf.Get();
@@ -162,7 +179,7 @@ DeviceInstance::SetProperty(const std::string& name,
    LOG_DEBUG(Logger()) << "Will set property \"" << name << "\" to \"" <<
       value << "\"";
 
-   int err = pImpl_->SetProperty(name.c_str(), value.c_str());
+   int err = MM_DEVICE_CALL(SetProperty)->SetProperty(name.c_str(), value.c_str());
 
    ThrowIfError(err, "Cannot set property " + ToQuotedString(name) +
          " to " + ToQuotedString(value));
@@ -173,13 +190,13 @@ DeviceInstance::SetProperty(const std::string& name,
 
 bool
 DeviceInstance::HasProperty(const std::string& name) const
-{ return pImpl_->HasProperty(name.c_str()); }
+{ return MM_DEVICE_CALL(HasProperty)->HasProperty(name.c_str()); }
 
 std::string
 DeviceInstance::GetPropertyName(size_t idx) const
 {
    DeviceStringBuffer nameBuf(this, "GetPropertyName");
-   bool ok = pImpl_->GetPropertyName(static_cast<unsigned>(idx), nameBuf.GetBuffer());
+   bool ok = MM_DEVICE_CALL(GetPropertyName)->GetPropertyName(static_cast<unsigned>(idx), nameBuf.GetBuffer());
    if (!ok)
       ThrowError("Cannot get property name at index " + ToString(idx));
    return nameBuf.Get();
@@ -189,7 +206,7 @@ bool
 DeviceInstance::GetPropertyReadOnly(const char* name) const
 {
    bool readOnly;
-   ThrowIfError(pImpl_->GetPropertyReadOnly(name, readOnly));
+   ThrowIfError(MM_DEVICE_CALL(GetPropertyReadOnly)->GetPropertyReadOnly(name, readOnly));
    return readOnly;
 }
 
@@ -197,7 +214,7 @@ bool
 DeviceInstance::GetPropertyInitStatus(const char* name) const
 {
    bool isPreInit;
-   ThrowIfError(pImpl_->GetPropertyInitStatus(name, isPreInit));
+   ThrowIfError(MM_DEVICE_CALL(GetPropertyInitStatus)->GetPropertyInitStatus(name, isPreInit));
    return isPreInit;
 }
 
@@ -205,7 +222,7 @@ bool
 DeviceInstance::HasPropertyLimits(const char* name) const
 {
    bool hasLimits;
-   ThrowIfError(pImpl_->HasPropertyLimits(name, hasLimits));
+   ThrowIfError(MM_DEVICE_CALL(HasPropertyLimits)->HasPropertyLimits(name, hasLimits));
    return hasLimits;
 }
 
@@ -213,7 +230,7 @@ double
 DeviceInstance::GetPropertyLowerLimit(const char* name) const
 {
    double lowLimit;
-   ThrowIfError(pImpl_->GetPropertyLowerLimit(name, lowLimit));
+   ThrowIfError(MM_DEVICE_CALL(GetPropertyLowerLimit)->GetPropertyLowerLimit(name, lowLimit));
    return lowLimit;
 }
 
@@ -221,7 +238,7 @@ double
 DeviceInstance::GetPropertyUpperLimit(const char* name) const
 {
    double highLimit;
-   ThrowIfError(pImpl_->GetPropertyUpperLimit(name, highLimit));
+   ThrowIfError(MM_DEVICE_CALL(GetPropertyUpperLimit)->GetPropertyUpperLimit(name, highLimit));
    return highLimit;
 }
 
@@ -229,19 +246,19 @@ MM::PropertyType
 DeviceInstance::GetPropertyType(const char* name) const
 {
    MM::PropertyType propType;
-   ThrowIfError(pImpl_->GetPropertyType(name, propType));
+   ThrowIfError(MM_DEVICE_CALL(GetPropertyType)->GetPropertyType(name, propType));
    return propType;
 }
 
 unsigned
 DeviceInstance::GetNumberOfPropertyValues(const char* propertyName) const
-{ return pImpl_->GetNumberOfPropertyValues(propertyName); }
+{ return MM_DEVICE_CALL(GetNumberOfPropertyValues)->GetNumberOfPropertyValues(propertyName); }
 
 std::string
 DeviceInstance::GetPropertyValueAt(const std::string& propertyName, unsigned index) const
 {
    DeviceStringBuffer valueBuf(this, "GetPropertyValueAt");
-   bool ok = pImpl_->GetPropertyValueAt(propertyName.c_str(), index,
+   bool ok = MM_DEVICE_CALL(GetPropertyValueAt)->GetPropertyValueAt(propertyName.c_str(), index,
          valueBuf.GetBuffer());
    if (!ok)
    {
@@ -257,7 +274,7 @@ bool
 DeviceInstance::IsPropertySequenceable(const char* name) const
 {
    bool isSequenceable;
-   ThrowIfError(pImpl_->IsPropertySequenceable(name, isSequenceable));
+   ThrowIfError(MM_DEVICE_CALL(IsPropertySequenceable)->IsPropertySequenceable(name, isSequenceable));
    return isSequenceable;
 }
 
@@ -265,45 +282,83 @@ long
 DeviceInstance::GetPropertySequenceMaxLength(const char* propertyName) const
 {
    long nrEvents;
-   ThrowIfError(pImpl_->GetPropertySequenceMaxLength(propertyName, nrEvents));
+   ThrowIfError(MM_DEVICE_CALL(GetPropertySequenceMaxLength)->GetPropertySequenceMaxLength(propertyName, nrEvents));
    return nrEvents;
 }
 
 void
 DeviceInstance::StartPropertySequence(const char* propertyName)
 {
-   ThrowIfError(pImpl_->StartPropertySequence(propertyName));
+   ThrowIfError(MM_DEVICE_CALL(StartPropertySequence)->StartPropertySequence(propertyName));
 }
 
 void
 DeviceInstance::StopPropertySequence(const char* propertyName)
 {
-   ThrowIfError(pImpl_->StopPropertySequence(propertyName));
+   ThrowIfError(MM_DEVICE_CALL(StopPropertySequence)->StopPropertySequence(propertyName));
 }
 
 void
 DeviceInstance::ClearPropertySequence(const char* propertyName)
 {
-   ThrowIfError(pImpl_->ClearPropertySequence(propertyName));
+   ThrowIfError(MM_DEVICE_CALL(ClearPropertySequence)->ClearPropertySequence(propertyName));
 }
 
 void
 DeviceInstance::AddToPropertySequence(const char* propertyName, const char* value)
 {
-   ThrowIfError(pImpl_->AddToPropertySequence(propertyName, value));
+   ThrowIfError(MM_DEVICE_CALL(AddToPropertySequence)->AddToPropertySequence(propertyName, value));
+}
+
+void
+DeviceInstance::AddFloatArrayToPropertySequence(const char* propertyName,
+      const double* values, long count)
+{
+   ThrowIfError(MM_DEVICE_CALL(AddFloatArrayToPropertySequence)->AddFloatArrayToPropertySequence(propertyName, values, count));
+}
+
+void
+DeviceInstance::AddIntegerArrayToPropertySequence(const char* propertyName,
+      const long* values, long count)
+{
+   ThrowIfError(MM_DEVICE_CALL(AddIntegerArrayToPropertySequence)->AddIntegerArrayToPropertySequence(propertyName, values, count));
 }
 
 void
 DeviceInstance::SendPropertySequence(const char* propertyName)
 {
-   ThrowIfError(pImpl_->SendPropertySequence(propertyName));
+   ThrowIfError(MM_DEVICE_CALL(SendPropertySequence)->SendPropertySequence(propertyName));
+}
+
+void
+DeviceInstance::SetPropertyCachePolicy(const char* name,
+      MM::PropertyCachePolicy policy, long ttlMs)
+{
+   ThrowIfError(MM_DEVICE_CALL(SetPropertyCachePolicy)->SetPropertyCachePolicy(name, policy, ttlMs),
+         "Cannot set cache policy of property " + ToQuotedString(name));
 }
 
+MM::PropertyCachePolicy
+DeviceInstance::GetPropertyCachePolicy(const char* name, long& ttlMs) const
+{
+   MM::PropertyCachePolicy policy;
+   ThrowIfError(MM_DEVICE_CALL(GetPropertyCachePolicy)->GetPropertyCachePolicy(name, policy, ttlMs));
+   return policy;
+}
+
+unsigned long
+DeviceInstance::GetPropertyChangeCounter() const
+{ return MM_DEVICE_CALL(GetPropertyChangeCounter)->GetPropertyChangeCounter(); }
+
+bool
+DeviceInstance::HasUncachedProperties() const
+{ return MM_DEVICE_CALL(HasUncachedProperties)->HasUncachedProperties(); }
+
 std::string
 DeviceInstance::GetErrorText(int code) const
 {
    DeviceStringBuffer msgBuf(this, "GetErrorText");
-   bool ok = pImpl_->GetErrorText(code, msgBuf.GetBuffer());
+   bool ok = MM_DEVICE_CALL(GetErrorText)->GetErrorText(code, msgBuf.GetBuffer());
    if (ok)
    {
       std::string msg = msgBuf.Get();
@@ -315,68 +370,68 @@ DeviceInstance::GetErrorText(int code) const
 
 bool
 DeviceInstance::Busy()
-{ return pImpl_->Busy(); }
+{ return MM_DEVICE_CALL(Busy)->Busy(); }
 
 double
 DeviceInstance::GetDelayMs() const
-{ return pImpl_->GetDelayMs(); }
+{ return MM_DEVICE_CALL(GetDelayMs)->GetDelayMs(); }
 
 void
 DeviceInstance::SetDelayMs(double delay)
-{ pImpl_->SetDelayMs(delay); }
+{ MM_DEVICE_CALL(SetDelayMs)->SetDelayMs(delay); }
 
 bool
 DeviceInstance::UsesDelay()
-{ return pImpl_->UsesDelay(); }
+{ return MM_DEVICE_CALL(UsesDelay)->UsesDelay(); }
 
 void
 DeviceInstance::Initialize()
 {
-   ThrowIfError(pImpl_->Initialize());
+   ThrowIfError(MM_DEVICE_CALL(Initialize)->Initialize());
 }
 
 void
 DeviceInstance::Shutdown()
 {
-   ThrowIfError(pImpl_->Shutdown());
+   ThrowIfError(MM_DEVICE_CALL(Shutdown)->Shutdown());
 }
 
 MM::DeviceType
 DeviceInstance::GetType() const
-{ return pImpl_->GetType(); }
+{ return MM_DEVICE_CALL(GetType)->GetType(); }
 
 std::string
 DeviceInstance::GetName() const
 {
    DeviceStringBuffer nameBuf(this, "GetName");
-   pImpl_->GetName(nameBuf.GetBuffer());
+   MM_DEVICE_CALL(GetName)->GetName(nameBuf.GetBuffer());
    return nameBuf.Get();
 }
 
 void
 DeviceInstance::SetCallback(MM::Core* callback) { 
-   pImpl_->SetCallback(callback); 
+   MM_DEVICE_CALL(SetCallback)->SetCallback(callback); 
 }
 
 
 bool
 DeviceInstance::SupportsDeviceDetection()
 {
-    return pImpl_->SupportsDeviceDetection();
+    return MM_DEVICE_CALL(SupportsDeviceDetection)->SupportsDeviceDetection();
 }
 
 MM::DeviceDetectionStatus
 DeviceInstance::DetectDevice()
-{ return pImpl_->DetectDevice(); }
+{ return MM_DEVICE_CALL(DetectDevice)->DetectDevice(); }
 
 void
 DeviceInstance::SetParentID(const char* parentId)
-{ pImpl_->SetParentID(parentId); }
+{ MM_DEVICE_CALL(SetParentID)->SetParentID(parentId); }
 
 std::string
 DeviceInstance::GetParentID() const
 {
    DeviceStringBuffer nameBuf(this, "GetParentID");
-   pImpl_->GetParentID(nameBuf.GetBuffer());
+   MM_DEVICE_CALL(GetParentID)->GetParentID(nameBuf.GetBuffer());
    return nameBuf.Get();
 }
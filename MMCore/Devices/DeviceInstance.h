@@ -20,12 +20,15 @@
 #pragma once
 
 #include "../../MMDevice/MMDeviceConstants.h"
+#include "../DeviceLock.h"
 #include "../Error.h"
+#include "DeviceCallStatistics.h"
 #include "../Logging/Logger.h"
 
 #include <cstring>
 #include <functional>
 #include <memory>
+#include <set>
 #include <string>
 #include <vector>
 
@@ -71,6 +74,11 @@ private:
    DeleteDeviceFunction deleteFunction_;
    mm::logging::Logger deviceLogger_;
    mm::logging::Logger coreLogger_;
+   std::set<std::string> cachePolicyOverrides_;
+   mutable mm::DeviceCallStatistics callStats_;
+   const char* traceLabel_; // Interned copy of label_, outlives the device
+   const MM::DeviceThreadSafety threadSafety_;
+   mutable mm::DeviceLock deviceLock_; // Unused with ThreadSafetyModule
 
 public:
    DeviceInstance(const DeviceInstance&) = delete;
@@ -85,6 +93,13 @@ public:
    // need it for the few CoreCallback methods that return a device pointer.
    MM::Device* GetRawPtr() const /* final */ { return pImpl_; }
 
+   mm::DeviceCallStatistics& GetCallStatistics() const /* final */ { return callStats_; }
+   const char* GetTraceLabel() const /* final */ { return traceLabel_; }
+
+   // Which lock serializes calls to the device (see DeviceModuleLockGuard)
+   MM::DeviceThreadSafety GetThreadSafety() const /* final */ { return threadSafety_; }
+   mm::DeviceLock& GetDeviceLock() const /* final */ { return deviceLock_; }
+
    // Callback API
    int LogMessage(const char* msg, bool debugOnly);
 
@@ -102,6 +117,11 @@ protected:
 
    virtual ~DeviceInstance();
 
+   // Raw device pointer for a single call that is timed in the call
+   // statistics and trace; use through MM_DEVICE_CALL
+   mm::TimedDeviceCall<MM::Device> TimedImpl(const mm::DeviceCallSite& site) const
+   { return mm::TimedDeviceCall<MM::Device>(pImpl_, &callStats_, site, traceLabel_); }
+
    CMMCore* GetCore() const /* final */ { return core_; }
 
    const mm::logging::Logger& Logger() const
@@ -154,6 +174,10 @@ public:
     * High-level interface to MM::Device methods.
     */
    std::vector<std::string> GetPropertyNames() const;
+   // Sets the cache policy and remembers it for saving to the config file
+   void OverridePropertyCachePolicy(const char* name,
+         MM::PropertyCachePolicy policy, long ttlMs);
+   std::vector<std::string> GetPropertyCachePolicyOverrides() const;
 
    /*
     * Wrappers for MM::Device member functions.
@@ -199,7 +223,16 @@ public:
    void StopPropertySequence(const char* propertyName);
    void ClearPropertySequence(const char* propertyName);
    void AddToPropertySequence(const char* propertyName, const char* value);
+   void AddFloatArrayToPropertySequence(const char* propertyName, const double* values, long count);
+   void AddIntegerArrayToPropertySequence(const char* propertyName, const long* values, long count);
    void SendPropertySequence(const char* propertyName);
+private:
+   // Exposed through OverridePropertyCachePolicy() only
+   void SetPropertyCachePolicy(const char* name, MM::PropertyCachePolicy policy, long ttlMs);
+public:
+   MM::PropertyCachePolicy GetPropertyCachePolicy(const char* name, long& ttlMs) const;
+   unsigned long GetPropertyChangeCounter() const;
+   bool HasUncachedProperties() const;
    std::string GetErrorText(int code) const;
    bool Busy();
    double GetDelayMs() const;
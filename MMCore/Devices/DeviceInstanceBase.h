@@ -60,4 +60,11 @@ protected:
 
 protected:
    RawDeviceClass* GetImpl() const /* final */ { return static_cast<RawDeviceClass*>(pImpl_); }
+
+   // Hides DeviceInstance::TimedImpl() to give wrappers the typed pointer
+   mm::TimedDeviceCall<RawDeviceClass> TimedImpl(const mm::DeviceCallSite& site) const
+   {
+      return mm::TimedDeviceCall<RawDeviceClass>(GetImpl(),
+            &GetCallStatistics(), site, GetTraceLabel());
+   }
 };
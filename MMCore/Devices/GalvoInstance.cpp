@@ -22,27 +22,27 @@
 #include "GalvoInstance.h"
 
 
-int GalvoInstance::PointAndFire(double x, double y, double time_us) { return GetImpl()->PointAndFire(x, y, time_us); }
-int GalvoInstance::SetSpotInterval(double pulseInterval_us) { return GetImpl()->SetSpotInterval(pulseInterval_us); }
-int GalvoInstance::SetPosition(double x, double y) { return GetImpl()->SetPosition(x, y); }
-int GalvoInstance::GetPosition(double& x, double& y) { return GetImpl()->GetPosition(x, y); }
-int GalvoInstance::SetIlluminationState(bool on) { return GetImpl()->SetIlluminationState(on); }
-double GalvoInstance::GetXRange() { return GetImpl()->GetXRange(); }
-double GalvoInstance::GetXMinimum() { return GetImpl()->GetXMinimum(); }
-double GalvoInstance::GetYRange() { return GetImpl()->GetYRange(); }
-double GalvoInstance::GetYMinimum() { return GetImpl()->GetYMinimum(); }
-int GalvoInstance::AddPolygonVertex(int polygonIndex, double x, double y) { return GetImpl()->AddPolygonVertex(polygonIndex, x, y); }
-int GalvoInstance::DeletePolygons() { return GetImpl()->DeletePolygons(); }
-int GalvoInstance::RunSequence() { return GetImpl()->RunSequence(); }
-int GalvoInstance::LoadPolygons() { return GetImpl()->LoadPolygons(); }
-int GalvoInstance::SetPolygonRepetitions(int repetitions) { return GetImpl()->SetPolygonRepetitions(repetitions); }
-int GalvoInstance::RunPolygons() { return GetImpl()->RunPolygons(); }
-int GalvoInstance::StopSequence() { return GetImpl()->StopSequence(); }
+int GalvoInstance::PointAndFire(double x, double y, double time_us) { return MM_DEVICE_CALL(PointAndFire)->PointAndFire(x, y, time_us); }
+int GalvoInstance::SetSpotInterval(double pulseInterval_us) { return MM_DEVICE_CALL(SetSpotInterval)->SetSpotInterval(pulseInterval_us); }
+int GalvoInstance::SetPosition(double x, double y) { return MM_DEVICE_CALL(SetPosition)->SetPosition(x, y); }
+int GalvoInstance::GetPosition(double& x, double& y) { return MM_DEVICE_CALL(GetPosition)->GetPosition(x, y); }
+int GalvoInstance::SetIlluminationState(bool on) { return MM_DEVICE_CALL(SetIlluminationState)->SetIlluminationState(on); }
+double GalvoInstance::GetXRange() { return MM_DEVICE_CALL(GetXRange)->GetXRange(); }
+double GalvoInstance::GetXMinimum() { return MM_DEVICE_CALL(GetXMinimum)->GetXMinimum(); }
+double GalvoInstance::GetYRange() { return MM_DEVICE_CALL(GetYRange)->GetYRange(); }
+double GalvoInstance::GetYMinimum() { return MM_DEVICE_CALL(GetYMinimum)->GetYMinimum(); }
+int GalvoInstance::AddPolygonVertex(int polygonIndex, double x, double y) { return MM_DEVICE_CALL(AddPolygonVertex)->AddPolygonVertex(polygonIndex, x, y); }
+int GalvoInstance::DeletePolygons() { return MM_DEVICE_CALL(DeletePolygons)->DeletePolygons(); }
+int GalvoInstance::RunSequence() { return MM_DEVICE_CALL(RunSequence)->RunSequence(); }
+int GalvoInstance::LoadPolygons() { return MM_DEVICE_CALL(LoadPolygons)->LoadPolygons(); }
+int GalvoInstance::SetPolygonRepetitions(int repetitions) { return MM_DEVICE_CALL(SetPolygonRepetitions)->SetPolygonRepetitions(repetitions); }
+int GalvoInstance::RunPolygons() { return MM_DEVICE_CALL(RunPolygons)->RunPolygons(); }
+int GalvoInstance::StopSequence() { return MM_DEVICE_CALL(StopSequence)->StopSequence(); }
 
 std::string GalvoInstance::GetChannel()
 {
    DeviceStringBuffer nameBuf(this, "GetChannel");
-   int err = GetImpl()->GetChannel(nameBuf.GetBuffer());
+   int err = MM_DEVICE_CALL(GetChannel)->GetChannel(nameBuf.GetBuffer());
    ThrowIfError(err, "Cannot get current channel name");
    return nameBuf.Get();
 }
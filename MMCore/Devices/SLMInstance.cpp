@@ -22,26 +22,26 @@
 #include "SLMInstance.h"
 
 
-int SLMInstance::SetImage(unsigned char* pixels) { return GetImpl()->SetImage(pixels); }
-int SLMInstance::SetImage(unsigned int* pixels) { return GetImpl()->SetImage(pixels); }
-int SLMInstance::DisplayImage() { return GetImpl()->DisplayImage(); }
-int SLMInstance::SetPixelsTo(unsigned char intensity) { return GetImpl()->SetPixelsTo(intensity); }
-int SLMInstance::SetPixelsTo(unsigned char red, unsigned char green, unsigned char blue) { return GetImpl()->SetPixelsTo(red, green, blue); }
-int SLMInstance::SetExposure(double interval_ms) { return GetImpl()->SetExposure(interval_ms); }
-double SLMInstance::GetExposure() { return GetImpl()->GetExposure(); }
-unsigned SLMInstance::GetWidth() { return GetImpl()->GetWidth(); }
-unsigned SLMInstance::GetHeight() { return GetImpl()->GetHeight(); }
-unsigned SLMInstance::GetNumberOfComponents() { return GetImpl()->GetNumberOfComponents(); }
-unsigned SLMInstance::GetBytesPerPixel() { return GetImpl()->GetBytesPerPixel(); }
+int SLMInstance::SetImage(unsigned char* pixels) { return MM_DEVICE_CALL(SetImage)->SetImage(pixels); }
+int SLMInstance::SetImage(unsigned int* pixels) { return MM_DEVICE_CALL(SetImage)->SetImage(pixels); }
+int SLMInstance::DisplayImage() { return MM_DEVICE_CALL(DisplayImage)->DisplayImage(); }
+int SLMInstance::SetPixelsTo(unsigned char intensity) { return MM_DEVICE_CALL(SetPixelsTo)->SetPixelsTo(intensity); }
+int SLMInstance::SetPixelsTo(unsigned char red, unsigned char green, unsigned char blue) { return MM_DEVICE_CALL(SetPixelsTo)->SetPixelsTo(red, green, blue); }
+int SLMInstance::SetExposure(double interval_ms) { return MM_DEVICE_CALL(SetExposure)->SetExposure(interval_ms); }
+double SLMInstance::GetExposure() { return MM_DEVICE_CALL(GetExposure)->GetExposure(); }
+unsigned SLMInstance::GetWidth() { return MM_DEVICE_CALL(GetWidth)->GetWidth(); }
+unsigned SLMInstance::GetHeight() { return MM_DEVICE_CALL(GetHeight)->GetHeight(); }
+unsigned SLMInstance::GetNumberOfComponents() { return MM_DEVICE_CALL(GetNumberOfComponents)->GetNumberOfComponents(); }
+unsigned SLMInstance::GetBytesPerPixel() { return MM_DEVICE_CALL(GetBytesPerPixel)->GetBytesPerPixel(); }
 int SLMInstance::IsSLMSequenceable(bool& isSequenceable)
-{ return GetImpl()->IsSLMSequenceable(isSequenceable); }
+{ return MM_DEVICE_CALL(IsSLMSequenceable)->IsSLMSequenceable(isSequenceable); }
 int SLMInstance::GetSLMSequenceMaxLength(long& nrEvents)
-{ return GetImpl()->GetSLMSequenceMaxLength(nrEvents); }
-int SLMInstance::StartSLMSequence() { return GetImpl()->StartSLMSequence(); }
-int SLMInstance::StopSLMSequence() { return GetImpl()->StopSLMSequence(); }
-int SLMInstance::ClearSLMSequence() { return GetImpl()->ClearSLMSequence(); }
+{ return MM_DEVICE_CALL(GetSLMSequenceMaxLength)->GetSLMSequenceMaxLength(nrEvents); }
+int SLMInstance::StartSLMSequence() { return MM_DEVICE_CALL(StartSLMSequence)->StartSLMSequence(); }
+int SLMInstance::StopSLMSequence() { return MM_DEVICE_CALL(StopSLMSequence)->StopSLMSequence(); }
+int SLMInstance::ClearSLMSequence() { return MM_DEVICE_CALL(ClearSLMSequence)->ClearSLMSequence(); }
 int SLMInstance::AddToSLMSequence(const unsigned char * pixels)
-{ return GetImpl()->AddToSLMSequence(pixels); }
+{ return MM_DEVICE_CALL(AddToSLMSequence)->AddToSLMSequence(pixels); }
 int SLMInstance::AddToSLMSequence(const unsigned int * pixels)
-{ return GetImpl()->AddToSLMSequence(pixels); }
-int SLMInstance::SendSLMSequence() { return GetImpl()->SendSLMSequence(); }
+{ return MM_DEVICE_CALL(AddToSLMSequence)->AddToSLMSequence(pixels); }
+int SLMInstance::SendSLMSequence() { return MM_DEVICE_CALL(SendSLMSequence)->SendSLMSequence(); }
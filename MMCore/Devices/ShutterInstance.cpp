@@ -22,6 +22,6 @@
 #include "ShutterInstance.h"
 
 
-int ShutterInstance::SetOpen(bool open) { return GetImpl()->SetOpen(open); }
-int ShutterInstance::GetOpen(bool& open) { return GetImpl()->GetOpen(open); }
-int ShutterInstance::Fire(double deltaT) { return GetImpl()->Fire(deltaT); }
+int ShutterInstance::SetOpen(bool open) { return MM_DEVICE_CALL(SetOpen)->SetOpen(open); }
+int ShutterInstance::GetOpen(bool& open) { return MM_DEVICE_CALL(GetOpen)->GetOpen(open); }
+int ShutterInstance::Fire(double deltaT) { return MM_DEVICE_CALL(Fire)->Fire(deltaT); }
@@ -22,15 +22,16 @@
 #include "SignalIOInstance.h"
 
 
-int SignalIOInstance::SetGateOpen(bool open) { return GetImpl()->SetGateOpen(open); }
-int SignalIOInstance::GetGateOpen(bool& open) { return GetImpl()->GetGateOpen(open); }
-int SignalIOInstance::SetSignal(double volts) { return GetImpl()->SetSignal(volts); }
-int SignalIOInstance::GetSignal(double& volts) { return GetImpl()->GetSignal(volts); }
-int SignalIOInstance::GetLimits(double& minVolts, double& maxVolts) { return GetImpl()->GetLimits(minVolts, maxVolts); }
-int SignalIOInstance::IsDASequenceable(bool& isSequenceable) const { return GetImpl()->IsDASequenceable(isSequenceable); }
-int SignalIOInstance::GetDASequenceMaxLength(long& nrEvents) const { return GetImpl()->GetDASequenceMaxLength(nrEvents); }
-int SignalIOInstance::StartDASequence() { return GetImpl()->StartDASequence(); }
-int SignalIOInstance::StopDASequence() { return GetImpl()->StopDASequence(); }
-int SignalIOInstance::ClearDASequence() { return GetImpl()->ClearDASequence(); }
-int SignalIOInstance::AddToDASequence(double voltage) { return GetImpl()->AddToDASequence(voltage); }
-int SignalIOInstance::SendDASequence() { return GetImpl()->SendDASequence(); }
+int SignalIOInstance::SetGateOpen(bool open) { return MM_DEVICE_CALL(SetGateOpen)->SetGateOpen(open); }
+int SignalIOInstance::GetGateOpen(bool& open) { return MM_DEVICE_CALL(GetGateOpen)->GetGateOpen(open); }
+int SignalIOInstance::SetSignal(double volts) { return MM_DEVICE_CALL(SetSignal)->SetSignal(volts); }
+int SignalIOInstance::GetSignal(double& volts) { return MM_DEVICE_CALL(GetSignal)->GetSignal(volts); }
+int SignalIOInstance::GetLimits(double& minVolts, double& maxVolts) { return MM_DEVICE_CALL(GetLimits)->GetLimits(minVolts, maxVolts); }
+int SignalIOInstance::IsDASequenceable(bool& isSequenceable) const { return MM_DEVICE_CALL(IsDASequenceable)->IsDASequenceable(isSequenceable); }
+int SignalIOInstance::GetDASequenceMaxLength(long& nrEvents) const { return MM_DEVICE_CALL(GetDASequenceMaxLength)->GetDASequenceMaxLength(nrEvents); }
+int SignalIOInstance::StartDASequence() { return MM_DEVICE_CALL(StartDASequence)->StartDASequence(); }
+int SignalIOInstance::StopDASequence() { return MM_DEVICE_CALL(StopDASequence)->StopDASequence(); }
+int SignalIOInstance::ClearDASequence() { return MM_DEVICE_CALL(ClearDASequence)->ClearDASequence(); }
+int SignalIOInstance::AddToDASequence(double voltage) { return MM_DEVICE_CALL(AddToDASequence)->AddToDASequence(voltage); }
+int SignalIOInstance::AddArrayToDASequence(const double* voltages, long count) { return MM_DEVICE_CALL(AddArrayToDASequence)->AddArrayToDASequence(voltages, count); }
+int SignalIOInstance::SendDASequence() { return MM_DEVICE_CALL(SendDASequence)->SendDASequence(); }
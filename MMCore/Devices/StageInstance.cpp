@@ -22,17 +22,17 @@
 #include "StageInstance.h"
 
 
-int StageInstance::SetPositionUm(double pos) { return GetImpl()->SetPositionUm(pos); }
-int StageInstance::SetRelativePositionUm(double d) { return GetImpl()->SetRelativePositionUm(d); }
-int StageInstance::Move(double velocity) { return GetImpl()->Move(velocity); }
-int StageInstance::Stop() { return GetImpl()->Stop(); }
-int StageInstance::Home() { return GetImpl()->Home(); }
-int StageInstance::SetAdapterOriginUm(double d) { return GetImpl()->SetAdapterOriginUm(d); }
-int StageInstance::GetPositionUm(double& pos) { return GetImpl()->GetPositionUm(pos); }
-int StageInstance::SetPositionSteps(long steps) { return GetImpl()->SetPositionSteps(steps); }
-int StageInstance::GetPositionSteps(long& steps) { return GetImpl()->GetPositionSteps(steps); }
-int StageInstance::SetOrigin() { return GetImpl()->SetOrigin(); }
-int StageInstance::GetLimits(double& lower, double& upper) { return GetImpl()->GetLimits(lower, upper); }
+int StageInstance::SetPositionUm(double pos) { return MM_DEVICE_CALL(SetPositionUm)->SetPositionUm(pos); }
+int StageInstance::SetRelativePositionUm(double d) { return MM_DEVICE_CALL(SetRelativePositionUm)->SetRelativePositionUm(d); }
+int StageInstance::Move(double velocity) { return MM_DEVICE_CALL(Move)->Move(velocity); }
+int StageInstance::Stop() { return MM_DEVICE_CALL(Stop)->Stop(); }
+int StageInstance::Home() { return MM_DEVICE_CALL(Home)->Home(); }
+int StageInstance::SetAdapterOriginUm(double d) { return MM_DEVICE_CALL(SetAdapterOriginUm)->SetAdapterOriginUm(d); }
+int StageInstance::GetPositionUm(double& pos) { return MM_DEVICE_CALL(GetPositionUm)->GetPositionUm(pos); }
+int StageInstance::SetPositionSteps(long steps) { return MM_DEVICE_CALL(SetPositionSteps)->SetPositionSteps(steps); }
+int StageInstance::GetPositionSteps(long& steps) { return MM_DEVICE_CALL(GetPositionSteps)->GetPositionSteps(steps); }
+int StageInstance::SetOrigin() { return MM_DEVICE_CALL(SetOrigin)->SetOrigin(); }
+int StageInstance::GetLimits(double& lower, double& upper) { return MM_DEVICE_CALL(GetLimits)->GetLimits(lower, upper); }
 
 MM::FocusDirection
 StageInstance::GetFocusDirection()
@@ -41,7 +41,7 @@ StageInstance::GetFocusDirection()
    if (!focusDirectionHasBeenSet_)
    {
       MM::FocusDirection direction;
-      int err = GetImpl()->GetFocusDirection(direction);
+      int err = MM_DEVICE_CALL(GetFocusDirection)->GetFocusDirection(direction);
       ThrowIfError(err, "Cannot get focus direction");
 
       focusDirection_ = direction;
@@ -57,14 +57,15 @@ StageInstance::SetFocusDirection(MM::FocusDirection direction)
    focusDirectionHasBeenSet_ = true;
 }
 
-int StageInstance::IsStageSequenceable(bool& isSequenceable) const { return GetImpl()->IsStageSequenceable(isSequenceable); }
-int StageInstance::IsStageLinearSequenceable(bool& isSequenceable) const { return GetImpl()->IsStageLinearSequenceable(isSequenceable); }
-bool StageInstance::IsContinuousFocusDrive() const { return GetImpl()->IsContinuousFocusDrive(); }
-int StageInstance::GetStageSequenceMaxLength(long& nrEvents) const { return GetImpl()->GetStageSequenceMaxLength(nrEvents); }
-int StageInstance::StartStageSequence() { return GetImpl()->StartStageSequence(); }
-int StageInstance::StopStageSequence() { return GetImpl()->StopStageSequence(); }
-int StageInstance::ClearStageSequence() { return GetImpl()->ClearStageSequence(); }
-int StageInstance::AddToStageSequence(double position) { return GetImpl()->AddToStageSequence(position); }
-int StageInstance::SendStageSequence() { return GetImpl()->SendStageSequence(); }
+int StageInstance::IsStageSequenceable(bool& isSequenceable) const { return MM_DEVICE_CALL(IsStageSequenceable)->IsStageSequenceable(isSequenceable); }
+int StageInstance::IsStageLinearSequenceable(bool& isSequenceable) const { return MM_DEVICE_CALL(IsStageLinearSequenceable)->IsStageLinearSequenceable(isSequenceable); }
+bool StageInstance::IsContinuousFocusDrive() const { return MM_DEVICE_CALL(IsContinuousFocusDrive)->IsContinuousFocusDrive(); }
+int StageInstance::GetStageSequenceMaxLength(long& nrEvents) const { return MM_DEVICE_CALL(GetStageSequenceMaxLength)->GetStageSequenceMaxLength(nrEvents); }
+int StageInstance::StartStageSequence() { return MM_DEVICE_CALL(StartStageSequence)->StartStageSequence(); }
+int StageInstance::StopStageSequence() { return MM_DEVICE_CALL(StopStageSequence)->StopStageSequence(); }
+int StageInstance::ClearStageSequence() { return MM_DEVICE_CALL(ClearStageSequence)->ClearStageSequence(); }
+int StageInstance::AddToStageSequence(double position) { return MM_DEVICE_CALL(AddToStageSequence)->AddToStageSequence(position); }
+int StageInstance::AddArrayToStageSequence(const double* positions, long count) { return MM_DEVICE_CALL(AddArrayToStageSequence)->AddArrayToStageSequence(positions, count); }
+int StageInstance::SendStageSequence() { return MM_DEVICE_CALL(SendStageSequence)->SendStageSequence(); }
 int StageInstance::SetStageLinearSequence(double dZ_um, long nSlices)
-{ return GetImpl()->SetStageLinearSequence(dZ_um, nSlices); }
\ No newline at end of file
+{ return MM_DEVICE_CALL(SetStageLinearSequence)->SetStageLinearSequence(dZ_um, nSlices); }
\ No newline at end of file
@@ -22,14 +22,14 @@
 #include "StateInstance.h"
 
 
-int StateInstance::SetPosition(long pos) { return GetImpl()->SetPosition(pos); }
-int StateInstance::SetPosition(const char* label) { return GetImpl()->SetPosition(label); }
-int StateInstance::GetPosition(long& pos) const { return GetImpl()->GetPosition(pos); }
+int StateInstance::SetPosition(long pos) { return MM_DEVICE_CALL(SetPosition)->SetPosition(pos); }
+int StateInstance::SetPosition(const char* label) { return MM_DEVICE_CALL(SetPosition)->SetPosition(label); }
+int StateInstance::GetPosition(long& pos) const { return MM_DEVICE_CALL(GetPosition)->GetPosition(pos); }
 
 std::string StateInstance::GetPositionLabel() const
 {
    DeviceStringBuffer labelBuf(this, "GetPosition");
-   int err = GetImpl()->GetPosition(labelBuf.GetBuffer());
+   int err = MM_DEVICE_CALL(GetPosition)->GetPosition(labelBuf.GetBuffer());
    ThrowIfError(err, "Cannot get current position label");
    return labelBuf.Get();
 }
@@ -37,13 +37,13 @@ std::string StateInstance::GetPositionLabel() const
 std::string StateInstance::GetPositionLabel(long pos) const
 {
    DeviceStringBuffer labelBuf(this, "GetPositionLabel");
-   int err = GetImpl()->GetPositionLabel(pos, labelBuf.GetBuffer());
+   int err = MM_DEVICE_CALL(GetPositionLabel)->GetPositionLabel(pos, labelBuf.GetBuffer());
    ThrowIfError(err, "Cannot get position label at index " + ToString(pos));
    return labelBuf.Get();
 }
 
-int StateInstance::GetLabelPosition(const char* label, long& pos) const { return GetImpl()->GetLabelPosition(label, pos); }
-int StateInstance::SetPositionLabel(long pos, const char* label) { return GetImpl()->SetPositionLabel(pos, label); }
-unsigned long StateInstance::GetNumberOfPositions() const { return GetImpl()->GetNumberOfPositions(); }
-int StateInstance::SetGateOpen(bool open) { return GetImpl()->SetGateOpen(open); }
-int StateInstance::GetGateOpen(bool& open) { return GetImpl()->GetGateOpen(open); }
+int StateInstance::GetLabelPosition(const char* label, long& pos) const { return MM_DEVICE_CALL(GetLabelPosition)->GetLabelPosition(label, pos); }
+int StateInstance::SetPositionLabel(long pos, const char* label) { return MM_DEVICE_CALL(SetPositionLabel)->SetPositionLabel(pos, label); }
+unsigned long StateInstance::GetNumberOfPositions() const { return MM_DEVICE_CALL(GetNumberOfPositions)->GetNumberOfPositions(); }
+int StateInstance::SetGateOpen(bool open) { return MM_DEVICE_CALL(SetGateOpen)->SetGateOpen(open); }
+int StateInstance::GetGateOpen(bool& open) { return MM_DEVICE_CALL(GetGateOpen)->GetGateOpen(open); }
@@ -22,27 +22,28 @@
 #include "XYStageInstance.h"
 
 
-int XYStageInstance::SetPositionUm(double x, double y) { return GetImpl()->SetPositionUm(x, y); }
-int XYStageInstance::SetRelativePositionUm(double dx, double dy) { return GetImpl()->SetRelativePositionUm(dx, dy); }
-int XYStageInstance::SetAdapterOriginUm(double x, double y) { return GetImpl()->SetAdapterOriginUm(x, y); }
-int XYStageInstance::GetPositionUm(double& x, double& y) { return GetImpl()->GetPositionUm(x, y); }
-int XYStageInstance::GetLimitsUm(double& xMin, double& xMax, double& yMin, double& yMax) { return GetImpl()->GetLimitsUm(xMin, xMax, yMin, yMax); }
-int XYStageInstance::Move(double vx, double vy) { return GetImpl()->Move(vx, vy); }
-int XYStageInstance::SetPositionSteps(long x, long y) { return GetImpl()->SetPositionSteps(x, y); }
-int XYStageInstance::GetPositionSteps(long& x, long& y) { return GetImpl()->GetPositionSteps(x, y); }
-int XYStageInstance::SetRelativePositionSteps(long x, long y) { return GetImpl()->SetRelativePositionSteps(x, y); }
-int XYStageInstance::Home() { return GetImpl()->Home(); }
-int XYStageInstance::Stop() { return GetImpl()->Stop(); }
-int XYStageInstance::SetOrigin() { return GetImpl()->SetOrigin(); }
-int XYStageInstance::SetXOrigin() { return GetImpl()->SetXOrigin(); }
-int XYStageInstance::SetYOrigin() { return GetImpl()->SetYOrigin(); }
-int XYStageInstance::GetStepLimits(long& xMin, long& xMax, long& yMin, long& yMax) { return GetImpl()->GetStepLimits(xMin, xMax, yMin, yMax); }
-double XYStageInstance::GetStepSizeXUm() { return GetImpl()->GetStepSizeXUm(); }
-double XYStageInstance::GetStepSizeYUm() { return GetImpl()->GetStepSizeYUm(); }
-int XYStageInstance::IsXYStageSequenceable(bool& isSequenceable) const { return GetImpl()->IsXYStageSequenceable(isSequenceable); }
-int XYStageInstance::GetXYStageSequenceMaxLength(long& nrEvents) const { return GetImpl()->GetXYStageSequenceMaxLength(nrEvents); }
-int XYStageInstance::StartXYStageSequence() { return GetImpl()->StartXYStageSequence(); }
-int XYStageInstance::StopXYStageSequence() { return GetImpl()->StopXYStageSequence(); }
-int XYStageInstance::ClearXYStageSequence() { return GetImpl()->ClearXYStageSequence(); }
-int XYStageInstance::AddToXYStageSequence(double positionX, double positionY) { return GetImpl()->AddToXYStageSequence(positionX, positionY); }
-int XYStageInstance::SendXYStageSequence() { return GetImpl()->SendXYStageSequence(); }
+int XYStageInstance::SetPositionUm(double x, double y) { return MM_DEVICE_CALL(SetPositionUm)->SetPositionUm(x, y); }
+int XYStageInstance::SetRelativePositionUm(double dx, double dy) { return MM_DEVICE_CALL(SetRelativePositionUm)->SetRelativePositionUm(dx, dy); }
+int XYStageInstance::SetAdapterOriginUm(double x, double y) { return MM_DEVICE_CALL(SetAdapterOriginUm)->SetAdapterOriginUm(x, y); }
+int XYStageInstance::GetPositionUm(double& x, double& y) { return MM_DEVICE_CALL(GetPositionUm)->GetPositionUm(x, y); }
+int XYStageInstance::GetLimitsUm(double& xMin, double& xMax, double& yMin, double& yMax) { return MM_DEVICE_CALL(GetLimitsUm)->GetLimitsUm(xMin, xMax, yMin, yMax); }
+int XYStageInstance::Move(double vx, double vy) { return MM_DEVICE_CALL(Move)->Move(vx, vy); }
+int XYStageInstance::SetPositionSteps(long x, long y) { return MM_DEVICE_CALL(SetPositionSteps)->SetPositionSteps(x, y); }
+int XYStageInstance::GetPositionSteps(long& x, long& y) { return MM_DEVICE_CALL(GetPositionSteps)->GetPositionSteps(x, y); }
+int XYStageInstance::SetRelativePositionSteps(long x, long y) { return MM_DEVICE_CALL(SetRelativePositionSteps)->SetRelativePositionSteps(x, y); }
+int XYStageInstance::Home() { return MM_DEVICE_CALL(Home)->Home(); }
+int XYStageInstance::Stop() { return MM_DEVICE_CALL(Stop)->Stop(); }
+int XYStageInstance::SetOrigin() { return MM_DEVICE_CALL(SetOrigin)->SetOrigin(); }
+int XYStageInstance::SetXOrigin() { return MM_DEVICE_CALL(SetXOrigin)->SetXOrigin(); }
+int XYStageInstance::SetYOrigin() { return MM_DEVICE_CALL(SetYOrigin)->SetYOrigin(); }
+int XYStageInstance::GetStepLimits(long& xMin, long& xMax, long& yMin, long& yMax) { return MM_DEVICE_CALL(GetStepLimits)->GetStepLimits(xMin, xMax, yMin, yMax); }
+double XYStageInstance::GetStepSizeXUm() { return MM_DEVICE_CALL(GetStepSizeXUm)->GetStepSizeXUm(); }
+double XYStageInstance::GetStepSizeYUm() { return MM_DEVICE_CALL(GetStepSizeYUm)->GetStepSizeYUm(); }
+int XYStageInstance::IsXYStageSequenceable(bool& isSequenceable) const { return MM_DEVICE_CALL(IsXYStageSequenceable)->IsXYStageSequenceable(isSequenceable); }
+int XYStageInstance::GetXYStageSequenceMaxLength(long& nrEvents) const { return MM_DEVICE_CALL(GetXYStageSequenceMaxLength)->GetXYStageSequenceMaxLength(nrEvents); }
+int XYStageInstance::StartXYStageSequence() { return MM_DEVICE_CALL(StartXYStageSequence)->StartXYStageSequence(); }
+int XYStageInstance::StopXYStageSequence() { return MM_DEVICE_CALL(StopXYStageSequence)->StopXYStageSequence(); }
+int XYStageInstance::ClearXYStageSequence() { return MM_DEVICE_CALL(ClearXYStageSequence)->ClearXYStageSequence(); }
+int XYStageInstance::AddToXYStageSequence(double positionX, double positionY) { return MM_DEVICE_CALL(AddToXYStageSequence)->AddToXYStageSequence(positionX, positionY); }
+int XYStageInstance::AddArrayToXYStageSequence(const double* positionsX, const double* positionsY, long count) { return MM_DEVICE_CALL(AddArrayToXYStageSequence)->AddArrayToXYStageSequence(positionsX, positionsY, count); }
+int XYStageInstance::SendXYStageSequence() { return MM_DEVICE_CALL(SendXYStageSequence)->SendXYStageSequence(); }
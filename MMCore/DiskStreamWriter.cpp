@@ -0,0 +1,489 @@
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//
+// DESCRIPTION:   Streaming of acquired frames to disk, read from the
+//                circular buffer on the writer's own threads
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "DiskStreamWriter.h"
+
+#include "CoreUtils.h"
+#include "TaskSet_FrameCompression.h"
+#include "ThreadPool.h"
+
+#include "../MMDevice/ImageMetadata.h"
+#include "../MMDevice/MMDeviceConstants.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <sstream>
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <direct.h>
+#include <malloc.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#endif
+
+namespace mm
+{
+
+namespace
+{
+
+// Unbuffered I/O needs buffers, offsets and sizes aligned to the sector
+// size; 4096 covers both 512-byte and 4K sector disks.
+const std::size_t g_Alignment = 4096;
+
+std::size_t AlignUp(std::size_t bytes)
+{
+   return (bytes + g_Alignment - 1) / g_Alignment * g_Alignment;
+}
+
+void* AllocateAligned(std::size_t bytes)
+{
+#ifdef _WIN32
+   return ::_aligned_malloc(bytes, g_Alignment);
+#else
+   void* p = 0;
+   if (::posix_memalign(&p, g_Alignment, bytes) != 0)
+      return 0;
+   return p;
+#endif
+}
+
+void FreeAligned(void* p)
+{
+#ifdef _WIN32
+   ::_aligned_free(p);
+#else
+   ::free(p);
+#endif
+}
+
+std::string TagValue(const Metadata& md, const char* key)
+{
+   try
+   {
+      return md.GetSingleTag(key).GetValue();
+   }
+   catch (const MetadataKeyError&)
+   {
+      return std::string();
+   }
+}
+
+// A page-aligned buffer, one per writer thread
+class AlignedBuffer
+{
+   void* buffer_;
+   std::size_t capacity_;
+
+public:
+   AlignedBuffer() : buffer_(0), capacity_(0) {}
+   ~AlignedBuffer() { FreeAligned(buffer_); }
+
+   AlignedBuffer(const AlignedBuffer&) = delete;
+   AlignedBuffer& operator=(const AlignedBuffer&) = delete;
+
+   void* Get() const { return buffer_; }
+
+   void Reserve(std::size_t size)
+   {
+      if (capacity_ >= size)
+         return;
+      FreeAligned(buffer_);
+      capacity_ = 0;
+      buffer_ = AllocateAligned(size);
+      if (!buffer_)
+         throw std::bad_alloc();
+      capacity_ = size;
+   }
+};
+
+} // anonymous namespace
+
+
+struct DiskStreamWriter::Pending
+{
+   Frame frame;
+   std::uint64_t number;
+   std::size_t bytes;
+   std::size_t alignedBytes;
+   std::size_t fileIndex;
+   std::uint64_t offset;
+};
+
+
+// A raw file written at explicit offsets, so that several threads can write
+// to it at once
+class DiskStreamWriter::File
+{
+#ifdef _WIN32
+   HANDLE handle_;
+#else
+   int fd_;
+#endif
+   std::string path_;
+   std::string error_;
+
+public:
+   explicit File(const std::string& path) :
+      path_(path)
+   {
+#ifdef _WIN32
+      handle_ = ::CreateFileA(path.c_str(), GENERIC_WRITE, 0, NULL,
+            CREATE_ALWAYS, FILE_FLAG_NO_BUFFERING, NULL);
+      if (handle_ == INVALID_HANDLE_VALUE)
+         error_ = "Cannot create " + ToQuotedString(path) + " (error " +
+            ToString(::GetLastError()) + ")";
+#else
+      const int flags = O_WRONLY | O_CREAT | O_TRUNC;
+      const mode_t mode = S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH;
+#ifdef O_DIRECT
+      fd_ = ::open(path.c_str(), flags | O_DIRECT, mode);
+      if (fd_ < 0 && errno == EINVAL) // File system without direct I/O
+#endif
+         fd_ = ::open(path.c_str(), flags, mode);
+      if (fd_ < 0)
+         error_ = "Cannot create " + ToQuotedString(path) + ": " +
+            std::strerror(errno);
+#endif
+   }
+
+   ~File()
+   {
+#ifdef _WIN32
+      if (handle_ != INVALID_HANDLE_VALUE)
+         ::CloseHandle(handle_);
+#else
+      if (fd_ >= 0)
+         ::close(fd_);
+#endif
+   }
+
+   // Returns an empty string on success
+   std::string Write(const void* data, std::size_t bytes, std::uint64_t offset)
+   {
+      if (!error_.empty())
+         return error_;
+#ifdef _WIN32
+      OVERLAPPED ov = OVERLAPPED();
+      ov.Offset = static_cast<DWORD>(offset & 0xffffffffu);
+      ov.OffsetHigh = static_cast<DWORD>(offset >> 32);
+      DWORD written = 0;
+      if (!::WriteFile(handle_, data, static_cast<DWORD>(bytes), &written, &ov) ||
+            written != bytes)
+         return "Write to " + ToQuotedString(path_) + " failed (error " +
+            ToString(::GetLastError()) + ")";
+#else
+      const char* p = static_cast<const char*>(data);
+      while (bytes > 0)
+      {
+         ssize_t n = ::pwrite(fd_, p, bytes, static_cast<off_t>(offset));
+         if (n < 0 && errno == EINTR)
+            continue;
+         if (n <= 0)
+            return "Write to " + ToQuotedString(path_) + " failed: " +
+               (n < 0 ? std::strerror(errno) : "no space");
+         p += n;
+         bytes -= static_cast<std::size_t>(n);
+         offset += static_cast<std::uint64_t>(n);
+      }
+#endif
+      return std::string();
+   }
+};
+
+
+DiskStreamWriter::DiskStreamWriter(const std::string& directory,
+      const std::string& prefix, const Options& options) throw (CMMError) :
+   directory_(directory),
+   prefix_(prefix),
+   options_(options),
+   startTime_(std::chrono::steady_clock::now()),
+   stopping_(false),
+   stopped_(false),
+   pendingBytes_(0),
+   fileIndex_(0),
+   fileBytes_(0),
+   stats_(),
+   threadPool_(std::make_shared<ThreadPool>()),
+   tasksDecompress_(std::make_shared<TaskSet_FrameCompression>(threadPool_))
+{
+   if (options_.writerThreads < 1)
+      throw CMMError("Disk streaming needs at least one writer thread");
+   if (options_.maxFileBytes < g_Alignment)
+      throw CMMError("Maximum stream file size is too small");
+
+#ifdef _WIN32
+   int err = ::_mkdir(directory_.c_str());
+#else
+   int err = ::mkdir(directory_.c_str(), S_IRWXU | S_IRGRP | S_IXGRP |
+         S_IROTH | S_IXOTH);
+#endif
+   if (err != 0 && errno != EEXIST)
+      throw CMMError("Cannot create directory " + ToQuotedString(directory_) +
+            ": " + std::strerror(errno));
+
+   std::string indexPath = directory_ + "/" + prefix_ + "_index.txt";
+   index_.open(indexPath.c_str(), std::ios_base::out | std::ios_base::trunc);
+   if (!index_)
+      throw CMMError("Cannot create " + ToQuotedString(indexPath));
+   index_ << "Frame\tFile\tOffset\tBytes\tWidth\tHeight\tBytesPerPixel\t"
+      "Components\tCamera\tImageNumber\tElapsedTime-ms\n";
+
+   for (unsigned i = 0; i < options_.writerThreads; ++i)
+      writers_.push_back(std::thread(&DiskStreamWriter::WriterLoop, this));
+}
+
+DiskStreamWriter::~DiskStreamWriter()
+{
+   Stop();
+}
+
+bool
+DiskStreamWriter::Enqueue(const Frame& frame)
+{
+   const std::size_t bytes = static_cast<std::size_t>(frame.width) *
+      frame.height * frame.byteDepth;
+   const std::size_t alignedBytes = AlignUp(bytes);
+   if (bytes == 0 || !frame.pixels)
+      return false;
+
+   {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (stopping_)
+         return false;
+      const std::uint64_t number = stats_.framesReceived++;
+
+      // The first frame is always taken, however large
+      if (!options_.blockWhenFull && !pending_.empty() &&
+            pendingBytes_ + bytes > options_.queueBytes)
+      {
+         ++stats_.framesDropped;
+         return false;
+      }
+
+      if (fileBytes_ > 0 && fileBytes_ + alignedBytes > options_.maxFileBytes)
+      {
+         ++fileIndex_;
+         fileBytes_ = 0;
+      }
+      Pending pending;
+      pending.frame = frame;
+      pending.number = number;
+      pending.bytes = bytes;
+      pending.alignedBytes = alignedBytes;
+      pending.fileIndex = fileIndex_;
+      pending.offset = fileBytes_;
+      fileBytes_ += alignedBytes;
+
+      pending_.push_back(pending);
+      pendingBytes_ += bytes;
+      stats_.queueHighWater = (std::max)(stats_.queueHighWater, pending_.size());
+      stats_.queueBytesHighWater =
+         (std::max)(stats_.queueBytesHighWater, pendingBytes_);
+   }
+   workAvailable_.notify_one();
+   return true;
+}
+
+/**
+* Copies the pixels of a frame, decompressing them if needed. Called by
+* writer threads.
+*/
+bool
+DiskStreamWriter::CopyOut(const Frame& frame, std::size_t bytes, void* dest)
+{
+   if (frame.packedBytes == 0)
+   {
+      std::memcpy(dest, frame.pixels, bytes);
+      return true;
+   }
+   std::lock_guard<std::mutex> lock(decompressMutex_);
+   return tasksDecompress_->Decompress(frame.pixels, frame.packedBytes,
+         static_cast<unsigned char*>(dest), bytes);
+}
+
+void
+DiskStreamWriter::WriterLoop()
+{
+   AlignedBuffer staging;
+   for (;;)
+   {
+      Pending pending;
+      {
+         std::unique_lock<std::mutex> lock(mutex_);
+         // When stopping, drain the queue
+         while (pending_.empty() && !stopping_)
+            workAvailable_.wait(lock);
+         if (pending_.empty())
+            return;
+         pending = std::move(pending_.front());
+         pending_.pop_front();
+      }
+
+      std::string error;
+      try
+      {
+         staging.Reserve(pending.alignedBytes);
+         if (!CopyOut(pending.frame, pending.bytes, staging.Get()))
+            error = "Cannot decompress image for disk streaming";
+      }
+      catch (const std::bad_alloc&)
+      {
+         error = "Out of memory for disk streaming staging buffer";
+      }
+
+      std::ostringstream line;
+      if (error.empty())
+      {
+         std::memset(static_cast<char*>(staging.Get()) + pending.bytes, 0,
+               pending.alignedBytes - pending.bytes);
+         const Frame& frame = pending.frame;
+         const Metadata empty;
+         const Metadata& md = frame.metadata ? *frame.metadata : empty;
+         line << pending.number << '\t' << pending.fileIndex << '\t' <<
+            pending.offset << '\t' << pending.bytes << '\t' << frame.width <<
+            '\t' << frame.height << '\t' << frame.byteDepth << '\t' <<
+            frame.nComponents << '\t' << TagValue(md, "Camera") << '\t' <<
+            TagValue(md, MM::g_Keyword_Metadata_ImageNumber) << '\t' <<
+            TagValue(md, MM::g_Keyword_Elapsed_Time_ms) << '\n';
+      }
+      // The producer may reuse the frame's memory from here on
+      pending.frame.owner.reset();
+
+      if (error.empty())
+      {
+         File* file = GetFile(pending.fileIndex);
+         error = file->Write(staging.Get(), pending.alignedBytes, pending.offset);
+      }
+
+      std::lock_guard<std::mutex> lock(mutex_);
+      pendingBytes_ -= pending.bytes;
+      if (error.empty())
+      {
+         ++stats_.framesWritten;
+         stats_.bytesWritten += pending.bytes;
+         index_ << line.str();
+      }
+      else
+      {
+         ++stats_.framesFailed;
+         stats_.lastError = error;
+      }
+   }
+}
+
+DiskStreamWriter::File*
+DiskStreamWriter::GetFile(std::size_t index)
+{
+   std::lock_guard<std::mutex> lock(filesMutex_);
+   while (files_.size() <= index)
+   {
+      char name[16];
+      std::snprintf(name, sizeof(name), "_%05u.raw",
+            static_cast<unsigned>(files_.size()));
+      files_.push_back(std::unique_ptr<File>(
+               new File(directory_ + "/" + prefix_ + name)));
+   }
+   return files_[index].get();
+}
+
+void
+DiskStreamWriter::Stop()
+{
+   {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (stopping_)
+         return;
+      stopping_ = true;
+   }
+   workAvailable_.notify_all();
+
+   for (std::size_t i = 0; i < writers_.size(); ++i)
+      writers_[i].join();
+   writers_.clear();
+
+   {
+      std::lock_guard<std::mutex> lock(filesMutex_);
+      files_.clear();
+   }
+
+   {
+      std::lock_guard<std::mutex> lock(mutex_);
+      index_.close();
+      stopTime_ = std::chrono::steady_clock::now();
+      stopped_ = true;
+   }
+   WriteSummary();
+}
+
+bool
+DiskStreamWriter::IsStopped() const
+{
+   std::lock_guard<std::mutex> lock(mutex_);
+   return stopped_;
+}
+
+DiskStreamWriter::Statistics
+DiskStreamWriter::GetStatistics() const
+{
+   std::lock_guard<std::mutex> lock(mutex_);
+   Statistics stats = stats_;
+   std::chrono::steady_clock::time_point end =
+      stopped_ ? stopTime_ : std::chrono::steady_clock::now();
+   stats.elapsedSeconds =
+      std::chrono::duration<double>(end - startTime_).count();
+   return stats;
+}
+
+std::string
+DiskStreamWriter::FormatStatistics(const Statistics& stats)
+{
+   std::ostringstream os;
+   os << "Statistic\tValue\n";
+   os << "FramesReceived\t" << stats.framesReceived << '\n';
+   os << "FramesWritten\t" << stats.framesWritten << '\n';
+   os << "FramesDropped\t" << stats.framesDropped << '\n';
+   os << "FramesFailed\t" << stats.framesFailed << '\n';
+   os << "BytesWritten\t" << stats.bytesWritten << '\n';
+   os << "QueueHighWater\t" << stats.queueHighWater << '\n';
+   os << "QueueHighWater-bytes\t" << stats.queueBytesHighWater << '\n';
+   os << "ElapsedTime-s\t" << stats.elapsedSeconds << '\n';
+   os << "Throughput-MBps\t" << (stats.elapsedSeconds > 0.0 ?
+         stats.bytesWritten / stats.elapsedSeconds / (1 << 20) : 0.0) << '\n';
+   os << "LastError\t" << stats.lastError << '\n';
+   return os.str();
+}
+
+void
+DiskStreamWriter::WriteSummary()
+{
+   std::string path = directory_ + "/" + prefix_ + "_summary.txt";
+   std::ofstream os(path.c_str(), std::ios_base::out | std::ios_base::trunc);
+   os << FormatStatistics(GetStatistics());
+}
+
+} // namespace mm
@@ -0,0 +1,174 @@
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//
+// DESCRIPTION:   Streaming of acquired frames to disk, read from the
+//                circular buffer on the writer's own threads
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include "Error.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class Metadata;
+class ThreadPool;
+class TaskSet_FrameCompression;
+
+namespace mm
+{
+
+/**
+ * Writes every frame it is given to raw files on disk, on its own threads.
+ *
+ * Frames are not copied when they are queued: each stays where its producer
+ * keeps it (a circular buffer slot) until a writer thread copies it into a
+ * page-aligned staging buffer, decompressing it if needed, and releases it.
+ * The staging buffer is written with unbuffered I/O (O_DIRECT on Linux,
+ * FILE_FLAG_NO_BUFFERING on Windows; buffered I/O where the file system does
+ * not support it). Each frame starts at a multiple of 4096 bytes in
+ * <prefix>_NNNNN.raw; a new file is started when the current one would
+ * exceed the maximum file size.
+ *
+ * <prefix>_index.txt gets one tab-separated line per frame written, giving
+ * the frame number, file number, byte offset, byte count, width, height,
+ * bytes per pixel, components per pixel, camera, image number and elapsed
+ * time. With more than one writer thread, lines may be out of frame order.
+ * <prefix>_summary.txt gets the final statistics when the writer is stopped.
+ *
+ * When the frames waiting to be written take up the queue size, further
+ * frames are either dropped (counted in the statistics) or queued anyway,
+ * depending on the options. Queueing never waits.
+ */
+class DiskStreamWriter
+{
+public:
+   struct Options
+   {
+      std::size_t queueBytes;
+      unsigned writerThreads;
+      bool blockWhenFull; // Never drop; the producer holds on to the frames
+      std::uint64_t maxFileBytes;
+
+      Options() :
+         queueBytes(std::size_t(256) << 20),
+         writerThreads(2),
+         blockWhenFull(false),
+         maxFileBytes(std::uint64_t(4) << 30)
+      {}
+   };
+
+   struct Statistics
+   {
+      std::uint64_t framesReceived;
+      std::uint64_t framesWritten;
+      std::uint64_t framesDropped;
+      std::uint64_t framesFailed;
+      std::uint64_t bytesWritten;
+      std::size_t queueHighWater; // Most frames waiting to be written
+      std::size_t queueBytesHighWater;
+      double elapsedSeconds;
+      std::string lastError;
+   };
+
+   // One frame (one channel). The pixels, raw or as packed by
+   // TaskSet_FrameCompression, and the metadata must stay valid and
+   // unchanged until the writer releases the owner, which it does as soon
+   // as it has copied them.
+   struct Frame
+   {
+      std::shared_ptr<const void> owner;
+      const unsigned char* pixels;
+      std::size_t packedBytes; // 0 if not compressed
+      unsigned width;
+      unsigned height;
+      unsigned byteDepth;
+      unsigned nComponents;
+      const Metadata* metadata;
+
+      Frame() : pixels(0), packedBytes(0), width(0), height(0), byteDepth(0),
+         nComponents(0), metadata(0)
+      {}
+   };
+
+   // Creates the directory if needed and starts the writer threads
+   DiskStreamWriter(const std::string& directory, const std::string& prefix,
+         const Options& options) throw (CMMError);
+   ~DiskStreamWriter();
+
+   DiskStreamWriter(const DiskStreamWriter&) = delete;
+   DiskStreamWriter& operator=(const DiskStreamWriter&) = delete;
+
+   // Queues a frame without copying it. Returns false (having released it)
+   // if the frame was dropped or the writer has been stopped.
+   bool Enqueue(const Frame& frame);
+
+   // Writes out all queued frames, closes the files and writes the summary.
+   // Frames enqueued afterwards are ignored.
+   void Stop();
+
+   bool IsStopped() const;
+   std::string GetDirectory() const { return directory_; }
+   std::string GetPrefix() const { return prefix_; }
+   Statistics GetStatistics() const;
+
+   // Tab-separated two-column table with a header line
+   static std::string FormatStatistics(const Statistics& stats);
+
+private:
+   struct Pending;
+   class File;
+
+   void WriterLoop();
+   bool CopyOut(const Frame& frame, std::size_t bytes, void* dest);
+   File* GetFile(std::size_t index);
+   void WriteSummary();
+
+   const std::string directory_;
+   const std::string prefix_;
+   const Options options_;
+   const std::chrono::steady_clock::time_point startTime_;
+
+   mutable std::mutex mutex_;
+   std::condition_variable workAvailable_;
+   bool stopping_;
+   bool stopped_;
+   std::deque<Pending> pending_;
+   std::size_t pendingBytes_;
+   std::size_t fileIndex_;
+   std::uint64_t fileBytes_;
+   Statistics stats_;
+   std::chrono::steady_clock::time_point stopTime_;
+   std::ofstream index_;
+
+   std::mutex filesMutex_;
+   std::vector<std::unique_ptr<File> > files_;
+
+   // Writer threads decompress in turn, each frame using the whole pool
+   std::mutex decompressMutex_;
+   std::shared_ptr<ThreadPool> threadPool_;
+   std::shared_ptr<TaskSet_FrameCompression> tasksDecompress_;
+
+   std::vector<std::thread> writers_;
+};
+
+} // namespace mm
@@ -0,0 +1,345 @@
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//
+// DESCRIPTION:   Lossless block codec for pixel data held in the circular
+//                buffer
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "FrameCompression.h"
+
+#include <cstdint>
+#include <cstring>
+
+namespace mm
+{
+
+namespace
+{
+
+enum
+{
+   ModeRaw = 0,
+   ModeShuffledRuns = 1,
+};
+
+const std::size_t minRun = 3;
+const std::size_t maxRun = 130;
+const std::size_t maxLiteral = 128;
+
+// Transposes an 8x8 bit matrix held with row i in byte i: afterwards, bit j
+// of byte i is what was bit i of byte j
+inline std::uint64_t Transpose8x8(std::uint64_t x)
+{
+   std::uint64_t t;
+   t = (x ^ (x >> 7)) & 0x00AA00AA00AA00AAULL;
+   x = x ^ t ^ (t << 7);
+   t = (x ^ (x >> 14)) & 0x0000CCCC0000CCCCULL;
+   x = x ^ t ^ (t << 14);
+   t = (x ^ (x >> 28)) & 0x00000000F0F0F0F0ULL;
+   x = x ^ t ^ (t << 28);
+   return x;
+}
+
+// Transposes 8 words as an 8x8 byte matrix: afterwards, byte j of word i is
+// what was byte i of word j
+inline void TransposeBytes8x8(std::uint64_t* w)
+{
+   // Swap off-diagonal blocks of 4x4, then 2x2, then 1x1 bytes
+   for (unsigned i = 0; i < 4; ++i)
+   {
+      std::uint64_t t = ((w[i] >> 32) ^ w[i + 4]) & 0x00000000FFFFFFFFULL;
+      w[i] ^= t << 32;
+      w[i + 4] ^= t;
+   }
+   static const unsigned pairs2[4] = { 0, 1, 4, 5 };
+   for (unsigned p = 0; p < 4; ++p)
+   {
+      const unsigned i = pairs2[p];
+      std::uint64_t t = ((w[i] >> 16) ^ w[i + 2]) & 0x0000FFFF0000FFFFULL;
+      w[i] ^= t << 16;
+      w[i + 2] ^= t;
+   }
+   for (unsigned i = 0; i < 8; i += 2)
+   {
+      std::uint64_t t = ((w[i] >> 8) ^ w[i + 1]) & 0x00FF00FF00FF00FFULL;
+      w[i] ^= t << 8;
+      w[i + 1] ^= t;
+   }
+}
+
+// Writes the bit planes of the first groups * 8 samples to dst: plane p
+// (bit p % 8 of sample byte p / 8) takes groups bytes, one bit per sample.
+// Groups are handled 8 at a time so that each plane gets whole words (plane
+// starts are often 4 KB apart, where byte stores would alias); the sample
+// size is a template parameter so that the gather loops unroll.
+template <unsigned SampleBytes>
+void BitShuffle(const unsigned char* src, std::size_t groups, unsigned char* dst)
+{
+   std::size_t g = 0;
+   for (; g + 8 <= groups; g += 8)
+   {
+      const unsigned char* in = src + g * 8 * SampleBytes;
+      for (unsigned j = 0; j < SampleBytes; ++j)
+      {
+         std::uint64_t w[8];
+         for (unsigned k = 0; k < 8; ++k)
+         {
+            std::uint64_t x = 0;
+            for (unsigned i = 0; i < 8; ++i)
+               x |= static_cast<std::uint64_t>(in[(8 * k + i) * SampleBytes + j]) << (8 * i);
+            w[k] = Transpose8x8(x);
+         }
+         TransposeBytes8x8(w);
+         unsigned char* out = dst + (j * 8) * groups + g;
+         for (unsigned b = 0; b < 8; ++b)
+            std::memcpy(out + b * groups, &w[b], 8);
+      }
+   }
+   for (; g < groups; ++g)
+   {
+      const unsigned char* in = src + g * 8 * SampleBytes;
+      for (unsigned j = 0; j < SampleBytes; ++j)
+      {
+         std::uint64_t x = 0;
+         for (unsigned i = 0; i < 8; ++i)
+            x |= static_cast<std::uint64_t>(in[i * SampleBytes + j]) << (8 * i);
+         x = Transpose8x8(x);
+         unsigned char* out = dst + (j * 8) * groups + g;
+         for (unsigned b = 0; b < 8; ++b)
+            out[b * groups] = static_cast<unsigned char>(x >> (8 * b));
+      }
+   }
+}
+
+template <unsigned SampleBytes>
+void BitUnshuffle(const unsigned char* src, std::size_t groups, unsigned char* dst)
+{
+   std::size_t g = 0;
+   for (; g + 8 <= groups; g += 8)
+   {
+      unsigned char* out = dst + g * 8 * SampleBytes;
+      for (unsigned j = 0; j < SampleBytes; ++j)
+      {
+         const unsigned char* in = src + (j * 8) * groups + g;
+         std::uint64_t w[8];
+         for (unsigned b = 0; b < 8; ++b)
+            std::memcpy(&w[b], in + b * groups, 8);
+         TransposeBytes8x8(w);
+         for (unsigned k = 0; k < 8; ++k)
+         {
+            std::uint64_t x = Transpose8x8(w[k]);
+            for (unsigned i = 0; i < 8; ++i)
+               out[(8 * k + i) * SampleBytes + j] = static_cast<unsigned char>(x >> (8 * i));
+         }
+      }
+   }
+   for (; g < groups; ++g)
+   {
+      unsigned char* out = dst + g * 8 * SampleBytes;
+      for (unsigned j = 0; j < SampleBytes; ++j)
+      {
+         const unsigned char* in = src + (j * 8) * groups + g;
+         std::uint64_t x = 0;
+         for (unsigned b = 0; b < 8; ++b)
+            x |= static_cast<std::uint64_t>(in[b * groups]) << (8 * b);
+         x = Transpose8x8(x);
+         for (unsigned i = 0; i < 8; ++i)
+            out[i * SampleBytes + j] = static_cast<unsigned char>(x >> (8 * i));
+      }
+   }
+}
+
+// Sample sizes other than 1, 2, 4 and 8 are treated as bytes; this is
+// lossless, only less effective
+void BitShuffle(const unsigned char* src, std::size_t bytes,
+      unsigned sampleBytes, unsigned char* dst)
+{
+   switch (sampleBytes)
+   {
+      case 2: BitShuffle<2>(src, bytes / 16, dst); break;
+      case 4: BitShuffle<4>(src, bytes / 32, dst); break;
+      case 8: BitShuffle<8>(src, bytes / 64, dst); break;
+      default: BitShuffle<1>(src, bytes / 8, dst); break;
+   }
+}
+
+void BitUnshuffle(const unsigned char* src, std::size_t bytes,
+      unsigned sampleBytes, unsigned char* dst)
+{
+   switch (sampleBytes)
+   {
+      case 2: BitUnshuffle<2>(src, bytes / 16, dst); break;
+      case 4: BitUnshuffle<4>(src, bytes / 32, dst); break;
+      case 8: BitUnshuffle<8>(src, bytes / 64, dst); break;
+      default: BitUnshuffle<1>(src, bytes / 8, dst); break;
+   }
+}
+
+// Bytes in whole groups of 8 samples
+std::size_t ShuffledBytes(std::size_t bytes, unsigned sampleBytes)
+{
+   if (sampleBytes != 2 && sampleBytes != 4 && sampleBytes != 8)
+      sampleBytes = 1;
+   return bytes / (8 * sampleBytes) * (8 * sampleBytes);
+}
+
+// Appends literal bytes in pieces of at most maxLiteral; returns false if
+// they would exceed capacity
+bool PutLiterals(const unsigned char* src, std::size_t count,
+      unsigned char* dst, std::size_t& out, std::size_t capacity)
+{
+   while (count > 0)
+   {
+      std::size_t n = count < maxLiteral ? count : maxLiteral;
+      if (out + 1 + n > capacity)
+         return false;
+      dst[out++] = static_cast<unsigned char>(n - 1);
+      std::memcpy(dst + out, src, n);
+      out += n;
+      src += n;
+      count -= n;
+   }
+   return true;
+}
+
+// Returns the encoded size, or 0 if it would exceed capacity
+std::size_t EncodeRuns(const unsigned char* src, std::size_t bytes,
+      unsigned char* dst, std::size_t capacity)
+{
+   std::size_t in = 0;
+   std::size_t out = 0;
+   std::size_t literalStart = 0;
+   while (in < bytes)
+   {
+      const unsigned char value = src[in];
+      std::size_t run = 1;
+      if (in + 1 < bytes && src[in + 1] != value)
+      {
+         ++in; // Most common case in noisy data
+         continue;
+      }
+      // Compare 8 bytes at a time within long runs
+      std::uint64_t pattern = value * 0x0101010101010101ULL;
+      while (in + run + 8 <= bytes && run + 8 <= maxRun)
+      {
+         std::uint64_t word;
+         std::memcpy(&word, src + in + run, 8);
+         if (word != pattern)
+            break;
+         run += 8;
+      }
+      while (in + run < bytes && run < maxRun && src[in + run] == value)
+         ++run;
+
+      if (run < minRun)
+      {
+         in += run;
+         continue;
+      }
+
+      if (!PutLiterals(src + literalStart, in - literalStart, dst, out, capacity))
+         return 0;
+      if (out + 2 > capacity)
+         return 0;
+      dst[out++] = static_cast<unsigned char>(128 + run - minRun);
+      dst[out++] = value;
+      in += run;
+      literalStart = in;
+   }
+
+   if (!PutLiterals(src + literalStart, in - literalStart, dst, out, capacity))
+      return 0;
+   return out;
+}
+
+bool DecodeRuns(const unsigned char* src, std::size_t srcBytes,
+      unsigned char* dst, std::size_t bytes)
+{
+   std::size_t in = 0;
+   std::size_t out = 0;
+   while (in < srcBytes)
+   {
+      unsigned c = src[in++];
+      if (c < 128)
+      {
+         std::size_t literals = c + 1;
+         if (in + literals > srcBytes || out + literals > bytes)
+            return false;
+         std::memcpy(dst + out, src + in, literals);
+         in += literals;
+         out += literals;
+      }
+      else
+      {
+         std::size_t run = c - 128 + minRun;
+         if (in >= srcBytes || out + run > bytes)
+            return false;
+         std::memset(dst + out, src[in++], run);
+         out += run;
+      }
+   }
+   return out == bytes;
+}
+
+} // anonymous namespace
+
+std::size_t CompressBlock(const unsigned char* src, std::size_t bytes,
+      unsigned sampleBytes, unsigned char* dst, unsigned char* scratch)
+{
+   if (bytes == 0)
+   {
+      dst[0] = ModeRaw;
+      return 1;
+   }
+
+   const std::size_t shuffled = ShuffledBytes(bytes, sampleBytes);
+   BitShuffle(src, shuffled, sampleBytes, scratch);
+   std::memcpy(scratch + shuffled, src + shuffled, bytes - shuffled);
+
+   std::size_t encoded = EncodeRuns(scratch, bytes, dst + 1, bytes - 1);
+   if (encoded > 0)
+   {
+      dst[0] = ModeShuffledRuns;
+      return 1 + encoded;
+   }
+
+   dst[0] = ModeRaw;
+   std::memcpy(dst + 1, src, bytes);
+   return 1 + bytes;
+}
+
+bool DecompressBlock(const unsigned char* src, std::size_t srcBytes,
+      unsigned sampleBytes, unsigned char* dst, std::size_t bytes,
+      unsigned char* scratch)
+{
+   if (srcBytes < 1)
+      return false;
+   if (src[0] == ModeRaw)
+   {
+      if (srcBytes != 1 + bytes)
+         return false;
+      std::memcpy(dst, src + 1, bytes);
+      return true;
+   }
+   if (src[0] != ModeShuffledRuns)
+      return false;
+
+   if (!DecodeRuns(src + 1, srcBytes - 1, scratch, bytes))
+      return false;
+   const std::size_t shuffled = ShuffledBytes(bytes, sampleBytes);
+   BitUnshuffle(scratch, shuffled, sampleBytes, dst);
+   std::memcpy(dst + shuffled, scratch + shuffled, bytes - shuffled);
+   return true;
+}
+
+} // namespace mm
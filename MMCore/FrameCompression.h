@@ -0,0 +1,53 @@
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//
+// DESCRIPTION:   Lossless block codec for pixel data held in the circular
+//                buffer
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include <cstddef>
+
+namespace mm
+{
+
+// The codec works on blocks of pixel data. Within a block, the bits of the
+// samples are transposed so that each bit plane is contiguous (bitshuffle);
+// the planes of bits that hardly vary across a sparse or dim image become
+// long runs of equal bytes, which are then run-length encoded. A block that
+// does not shrink is stored as is.
+//
+// A compressed block is a mode byte followed by the raw bytes (mode 0) or by
+// the encoded runs (mode 1): a control byte c < 128 introduces c + 1 literal
+// bytes, and c >= 128 introduces one byte repeated c - 125 times.
+
+// Raw size of the blocks a frame is divided into; a multiple of 8 samples
+// of any supported size
+const std::size_t g_CompressionBlockBytes = 64 * 1024;
+
+inline std::size_t CompressedBlockBound(std::size_t bytes) { return bytes + 1; }
+
+// Compresses bytes at src, made of samples of sampleBytes (1 to 8), into dst
+// (which must hold CompressedBlockBound(bytes)). scratch must hold bytes.
+// Returns the compressed size.
+std::size_t CompressBlock(const unsigned char* src, std::size_t bytes,
+      unsigned sampleBytes, unsigned char* dst, unsigned char* scratch);
+
+// Restores a block of bytes compressed with the same sampleBytes; scratch
+// must hold bytes. Returns false if the data is inconsistent.
+bool DecompressBlock(const unsigned char* src, std::size_t srcBytes,
+      unsigned sampleBytes, unsigned char* dst, std::size_t bytes,
+      unsigned char* scratch);
+
+} // namespace mm
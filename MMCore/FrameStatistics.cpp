@@ -0,0 +1,157 @@
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//
+// DESCRIPTION:   Per-image pixel statistics computed when images are inserted
+//                into the circular buffer
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "FrameStatistics.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <sstream>
+
+namespace mm
+{
+
+const char* const g_Keyword_StatsMin = "Statistics-Min";
+const char* const g_Keyword_StatsMax = "Statistics-Max";
+const char* const g_Keyword_StatsMean = "Statistics-Mean";
+const char* const g_Keyword_StatsSaturated = "Statistics-Saturated";
+const char* const g_Keyword_StatsHistogram = "Statistics-Histogram";
+
+namespace
+{
+
+// Small enough to stay in the L1 cache between the passes over a block;
+// sums of a block of 16-bit pixels fit in 32 bits
+const std::size_t blockPixels = 4096;
+
+template <typename T>
+void Accumulate(const T* src, T* dst, std::size_t count, unsigned bitDepth,
+      FrameStatistics& stats)
+{
+   const std::uint32_t saturation = (1u << bitDepth) - 1;
+   const std::uint32_t bins = static_cast<std::uint32_t>(stats.histogram.size());
+   unsigned long long* histogram = &stats.histogram[0];
+
+   T lo = stats.pixels > 0 ? static_cast<T>(stats.min) : static_cast<T>(~T(0));
+   T hi = stats.pixels > 0 ? static_cast<T>(stats.max) : T(0);
+   unsigned long long saturated = 0;
+   for (std::size_t start = 0; start < count; start += blockPixels)
+   {
+      const std::size_t n = std::min(blockPixels, count - start);
+      const T* in = src + start;
+      if (dst)
+         std::memcpy(dst + start, in, n * sizeof(T));
+
+      // Branch-free so that the compiler can vectorize it
+      T blockLo = lo;
+      T blockHi = hi;
+      std::uint32_t blockSum = 0;
+      for (std::size_t i = 0; i < n; ++i)
+      {
+         const T v = in[i];
+         blockLo = v < blockLo ? v : blockLo;
+         blockHi = v > blockHi ? v : blockHi;
+         blockSum += v;
+      }
+      lo = blockLo;
+      hi = blockHi;
+      stats.sum += blockSum;
+
+      std::uint32_t blockSaturated = 0;
+      for (std::size_t i = 0; i < n; ++i)
+      {
+         const std::uint32_t v = in[i];
+         const std::uint32_t clamped = v < saturation ? v : saturation;
+         ++histogram[(clamped * bins) >> bitDepth];
+         blockSaturated += (v >= saturation);
+      }
+      saturated += blockSaturated;
+   }
+
+   if (count > 0)
+   {
+      stats.min = lo;
+      stats.max = hi;
+   }
+   stats.pixels += count;
+   stats.saturated += saturated;
+}
+
+} // anonymous namespace
+
+void FrameStatistics::Reset(unsigned bins)
+{
+   min = max = 0;
+   sum = pixels = saturated = 0;
+   histogram.assign(bins, 0);
+}
+
+void FrameStatistics::Merge(const FrameStatistics& other)
+{
+   if (other.pixels == 0)
+      return;
+   if (pixels == 0)
+   {
+      min = other.min;
+      max = other.max;
+   }
+   else
+   {
+      min = std::min(min, other.min);
+      max = std::max(max, other.max);
+   }
+   sum += other.sum;
+   pixels += other.pixels;
+   saturated += other.saturated;
+   for (std::size_t i = 0; i < histogram.size() && i < other.histogram.size(); ++i)
+      histogram[i] += other.histogram[i];
+}
+
+void FrameStatistics::AddToMetadata(Metadata& md) const
+{
+   md.PutImageTag(g_Keyword_StatsMin, min);
+   md.PutImageTag(g_Keyword_StatsMax, max);
+   md.PutImageTag(g_Keyword_StatsMean, pixels > 0 ? (double)sum / pixels : 0.0);
+   md.PutImageTag(g_Keyword_StatsSaturated, saturated);
+
+   std::ostringstream os;
+   for (std::size_t i = 0; i < histogram.size(); ++i)
+   {
+      if (i > 0)
+         os << ' ';
+      os << histogram[i];
+   }
+   md.PutImageTag(g_Keyword_StatsHistogram, os.str());
+}
+
+void AccumulateFrameStatistics(const unsigned char* src, unsigned char* dst,
+      std::size_t count, unsigned byteDepth, unsigned bitDepth,
+      FrameStatistics& stats)
+{
+   if (bitDepth == 0 || bitDepth > 8 * byteDepth)
+      bitDepth = 8 * byteDepth;
+   if (stats.histogram.empty())
+      stats.histogram.assign(1, 0);
+
+   if (byteDepth == 1)
+      Accumulate<std::uint8_t>(src, dst, count, bitDepth, stats);
+   else if (byteDepth == 2)
+      Accumulate<std::uint16_t>(reinterpret_cast<const std::uint16_t*>(src),
+            reinterpret_cast<std::uint16_t*>(dst), count, bitDepth, stats);
+}
+
+} // namespace mm
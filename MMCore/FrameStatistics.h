@@ -0,0 +1,68 @@
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//
+// DESCRIPTION:   Per-image pixel statistics computed when images are inserted
+//                into the circular buffer
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include "../MMDevice/ImageMetadata.h"
+
+#include <cstddef>
+#include <vector>
+
+namespace mm
+{
+
+// Metadata tags added to images when statistics are enabled
+extern const char* const g_Keyword_StatsMin;
+extern const char* const g_Keyword_StatsMax;
+extern const char* const g_Keyword_StatsMean;
+extern const char* const g_Keyword_StatsSaturated;
+extern const char* const g_Keyword_StatsHistogram; // Space-separated counts
+
+
+// Statistics of the pixels of one image channel (8- or 16-bit grayscale)
+struct FrameStatistics
+{
+   unsigned min;
+   unsigned max;
+   unsigned long long sum;
+   unsigned long long pixels;
+   unsigned long long saturated; // Pixels at or above 2^bitDepth - 1
+
+   // Bin i counts values in [i, i + 1) * 2^bitDepth / bins; values beyond
+   // the bit depth count in the last bin
+   std::vector<unsigned long long> histogram;
+
+   FrameStatistics() : min(0), max(0), sum(0), pixels(0), saturated(0) {}
+
+   void Reset(unsigned bins);
+
+   // Accumulates the statistics of another part of the same image
+   void Merge(const FrameStatistics& other);
+
+   void AddToMetadata(Metadata& md) const;
+};
+
+
+// Accumulates the statistics of count pixels of byteDepth 1 or 2 at src
+// into stats (whose histogram must have been sized), copying them to dst if
+// it is not null. Pixels are processed in small blocks that are copied and
+// then binned while still in the L1 cache, so that memory is read once.
+void AccumulateFrameStatistics(const unsigned char* src, unsigned char* dst,
+      std::size_t count, unsigned byteDepth, unsigned bitDepth,
+      FrameStatistics& stats);
+
+} // namespace mm
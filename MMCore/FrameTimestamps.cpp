@@ -0,0 +1,172 @@
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//
+// DESCRIPTION:   Correlation of camera hardware timestamps with the host clock
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "FrameTimestamps.h"
+
+#include "../MMDevice/MMDeviceConstants.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <string>
+
+namespace mm
+{
+
+const char* const g_Keyword_ReceivedTimeMs = "TimeReceivedByCore-ms";
+const char* const g_Keyword_CorrectedTimeMs = "CorrectedTime-ms";
+const char* const g_Keyword_EstimatedLatencyMs = "EstimatedLatency-ms";
+
+namespace
+{
+
+// Frames needed before the model is used
+const unsigned long long minFitFrames = 4;
+
+// Disagreement between the model and the host clock that restarts the model
+const double maxDisagreementMs = 1000.0;
+
+// Rate (per host ms) at which the lower envelope rises when no frame
+// arrives as fast as before, so that it follows a lasting change in delay
+const double envelopeRise = 1e-3;
+
+} // anonymous namespace
+
+DeviceClockModel::DeviceClockModel(double windowFrames) :
+   decay_(windowFrames > 1.0 ? 1.0 - 1.0 / windowFrames : 0.0),
+   restarts_(0)
+{
+   Reset();
+}
+
+void DeviceClockModel::Reset()
+{
+   frames_ = 0;
+   deviceOrigin_ = hostOrigin_ = 0.0;
+   lastDevice_ = lastHost_ = 0.0;
+   weight_ = 0.0;
+   meanDevice_ = meanHost_ = 0.0;
+   coDeviceDevice_ = coDeviceHost_ = 0.0;
+   rate_ = 0.0;
+   offset_ = 0.0;
+}
+
+bool DeviceClockModel::IsFitted() const
+{
+   return frames_ >= minFitFrames && rate_ > 0.0;
+}
+
+double DeviceClockModel::ToHostMs(double deviceTime) const
+{
+   return hostOrigin_ + meanHost_ +
+      rate_ * (deviceTime - deviceOrigin_ - meanDevice_) + offset_;
+}
+
+bool DeviceClockModel::AddFrame(double deviceTime, double hostMs,
+      double& correctedMs, double& latencyMs)
+{
+   if (frames_ > 0 && (deviceTime < lastDevice_ || (IsFitted() &&
+         std::fabs(hostMs - ToHostMs(deviceTime)) > maxDisagreementMs)))
+   {
+      Reset();
+      ++restarts_;
+   }
+   const bool wasFitted = IsFitted();
+   if (frames_ == 0)
+   {
+      deviceOrigin_ = deviceTime;
+      hostOrigin_ = hostMs;
+      lastHost_ = hostMs;
+   }
+   ++frames_;
+
+   // Relative to the origins, to keep the precision of large timestamps
+   const double x = deviceTime - deviceOrigin_;
+   const double y = hostMs - hostOrigin_;
+   weight_ = decay_ * weight_ + 1.0;
+   const double dx = x - meanDevice_;
+   meanDevice_ += dx / weight_;
+   meanHost_ += (y - meanHost_) / weight_;
+   coDeviceDevice_ = decay_ * coDeviceDevice_ + dx * (x - meanDevice_);
+   coDeviceHost_ = decay_ * coDeviceHost_ + dx * (y - meanHost_);
+
+   rate_ = coDeviceDevice_ > 0.0 ? coDeviceHost_ / coDeviceDevice_ : 0.0;
+   if (IsFitted())
+   {
+      // The offset is kept relative to the weighted mean, which (unlike the
+      // origin) moves little when the rate is refined
+      const double residual = y - meanHost_ - rate_ * (x - meanDevice_);
+      if (wasFitted)
+         offset_ = std::min(residual, offset_ + envelopeRise * (hostMs - lastHost_));
+      else
+         offset_ = residual;
+   }
+
+   lastDevice_ = deviceTime;
+   lastHost_ = hostMs;
+
+   if (!IsFitted())
+   {
+      correctedMs = hostMs;
+      latencyMs = 0.0;
+      return false;
+   }
+   correctedMs = ToHostMs(deviceTime);
+   // Not below the envelope, but rounding can make it appear so
+   latencyMs = std::max(0.0, hostMs - correctedMs);
+   return true;
+}
+
+
+bool FrameTimestamps::AddFrame(const void* camera, double deviceTime,
+      double hostMs, double& correctedMs, double& latencyMs)
+{
+   for (std::size_t i = 0; i < models_.size(); ++i)
+   {
+      if (models_[i].first == camera)
+         return models_[i].second.AddFrame(deviceTime, hostMs, correctedMs, latencyMs);
+   }
+   models_.push_back(std::make_pair(camera, DeviceClockModel()));
+   return models_.back().second.AddFrame(deviceTime, hostMs, correctedMs, latencyMs);
+}
+
+const DeviceClockModel* FrameTimestamps::GetModel(const void* camera) const
+{
+   for (std::size_t i = 0; i < models_.size(); ++i)
+   {
+      if (models_[i].first == camera)
+         return &models_[i].second;
+   }
+   return 0;
+}
+
+
+bool GetDeviceTimestamp(const Metadata& md, double& deviceTime)
+{
+   // Checked first: most cameras do not supply the tag, and throwing for
+   // each of their frames would be costly
+   if (!md.HasTag(MM::g_Keyword_Metadata_DeviceTimestamp))
+      return false;
+   const std::string value = md.GetSingleTag(MM::g_Keyword_Metadata_DeviceTimestamp).GetValue();
+   char* end;
+   const double d = std::strtod(value.c_str(), &end);
+   if (end == value.c_str() || !std::isfinite(d))
+      return false;
+   deviceTime = d;
+   return true;
+}
+
+} // namespace mm
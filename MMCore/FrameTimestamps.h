@@ -0,0 +1,110 @@
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//
+// DESCRIPTION:   Correlation of camera hardware timestamps with the host clock
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include "../MMDevice/ImageMetadata.h"
+
+#include <utility>
+#include <vector>
+
+namespace mm
+{
+
+// Metadata tags added to images that carry MM::g_Keyword_Metadata_DeviceTimestamp
+// (all in ms, in the time base of the Core's ElapsedTime-ms)
+extern const char* const g_Keyword_ReceivedTimeMs;
+extern const char* const g_Keyword_CorrectedTimeMs;
+extern const char* const g_Keyword_EstimatedLatencyMs;
+
+
+// Online linear model of a device clock in terms of the host clock.
+//
+// Each frame contributes its device timestamp (in any unit, from any epoch,
+// but increasing) and the host time at which it was received. The rate of
+// the device clock is fitted by least squares, weighting recent frames more
+// (so that the fit follows drift); the offset is the lower envelope of the
+// receive times, i.e. that of the frames that arrived fastest, so that the
+// delays of slower frames do not bias it. The corrected time of a frame is
+// its device timestamp mapped through the model: when it would have been
+// received with the least delay seen. Its latency is how much later it
+// actually arrived.
+//
+// The model restarts when the device clock goes backwards or disagrees with
+// the host clock by more than a second (e.g. after the camera reset it).
+class DeviceClockModel
+{
+public:
+   // windowFrames: the number of recent frames that effectively make up the
+   // fit (their weights decay exponentially)
+   explicit DeviceClockModel(double windowFrames = 1000.0);
+
+   void Reset();
+
+   // Adds a frame; returns false (and sets correctedMs to hostMs and
+   // latencyMs to 0) until enough frames have been seen to fit the model
+   bool AddFrame(double deviceTime, double hostMs, double& correctedMs,
+         double& latencyMs);
+
+   bool IsFitted() const;
+   double GetRate() const { return rate_; } // Host ms per device unit
+   double ToHostMs(double deviceTime) const;
+   unsigned GetRestartCount() const { return restarts_; }
+
+private:
+   double decay_;
+
+   unsigned long long frames_;
+   double deviceOrigin_;
+   double hostOrigin_;
+   double lastDevice_;
+   double lastHost_;
+
+   // Exponentially weighted means and co-moments, relative to the origins
+   double weight_;
+   double meanDevice_;
+   double meanHost_;
+   double coDeviceDevice_;
+   double coDeviceHost_;
+
+   double rate_;
+   double offset_; // Lower envelope of host - rate * device
+   unsigned restarts_;
+};
+
+
+// Clock models of all cameras inserting images, keyed by an opaque camera
+// key (as in the circular buffer). Not thread-safe.
+class FrameTimestamps
+{
+public:
+   bool AddFrame(const void* camera, double deviceTime, double hostMs,
+         double& correctedMs, double& latencyMs);
+
+   // Null if the camera has not inserted frames with device timestamps
+   const DeviceClockModel* GetModel(const void* camera) const;
+
+   void Clear() { models_.clear(); }
+
+private:
+   std::vector<std::pair<const void*, DeviceClockModel> > models_; // Few entries
+};
+
+
+// The value of MM::g_Keyword_Metadata_DeviceTimestamp, if present and numeric
+bool GetDeviceTimestamp(const Metadata& md, double& deviceTime);
+
+} // namespace mm
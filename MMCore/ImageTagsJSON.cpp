@@ -0,0 +1,166 @@
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//
+// DESCRIPTION:   Serialization of image metadata and the system state cache
+//                to JSON, for creating tagged images in a single call
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "ImageTagsJSON.h"
+
+#include "Configuration.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace mm
+{
+
+void AppendJSONString(std::string& out, const std::string& s)
+{
+   out += '"';
+   for (char c : s)
+   {
+      unsigned char ch = static_cast<unsigned char>(c);
+      if (ch == '"' || ch == '\\')
+      {
+         out += '\\';
+         out += c;
+      }
+      else if (ch < 0x20)
+      {
+         char buf[8];
+         std::snprintf(buf, sizeof(buf), "\\u%04x", ch);
+         out += buf;
+      }
+      else
+         out += c;
+   }
+   out += '"';
+}
+
+std::string ToShortestString(double value)
+{
+   // snprintf and strtod use the C locale's '.' unless the program changed it
+   char buf[32];
+   for (int precision = 1; precision <= 17; ++precision)
+   {
+      std::snprintf(buf, sizeof(buf), "%.*g", precision, value);
+      if (std::strtod(buf, 0) == value)
+         break;
+   }
+   if (!std::strpbrk(buf, ".eEn"))
+      std::strcat(buf, ".0");
+   return buf;
+}
+
+std::shared_ptr<const JSONFragment>
+SerializeConfigurationJSON(const Configuration& config)
+{
+   std::shared_ptr<JSONFragment> fragment = std::make_shared<JSONFragment>();
+   for (size_t i = 0; i < config.size(); ++i)
+   {
+      PropertySetting setting = config.getSetting(i);
+      const std::string key = setting.getKey();
+      if (!fragment->keys.insert(key).second)
+         continue;
+      if (!fragment->members.empty())
+         fragment->members += ',';
+      AppendJSONString(fragment->members, key);
+      fragment->members += ':';
+      AppendJSONString(fragment->members, setting.getPropertyValue());
+   }
+   return fragment;
+}
+
+ImageTagsJSONWriter::ImageTagsJSONWriter() :
+   json_("{"),
+   fragment_(0)
+{
+}
+
+bool ImageTagsJSONWriter::BeginMember(const std::string& key)
+{
+   if (fragment_ && fragment_->keys.count(key))
+      return false;
+   if (!keys_.insert(key).second)
+      return false;
+   if (json_.size() > 1)
+      json_ += ',';
+   AppendJSONString(json_, key);
+   json_ += ':';
+   return true;
+}
+
+void ImageTagsJSONWriter::AddString(const std::string& key,
+      const std::string& value)
+{
+   if (BeginMember(key))
+      AppendJSONString(json_, value);
+}
+
+void ImageTagsJSONWriter::AddInteger(const std::string& key, long long value)
+{
+   if (!BeginMember(key))
+      return;
+   char buf[32];
+   std::snprintf(buf, sizeof(buf), "%lld", value);
+   json_ += buf;
+}
+
+void ImageTagsJSONWriter::AddDouble(const std::string& key, double value)
+{
+   if (!BeginMember(key))
+      return;
+   // JSON has no NaN or infinity
+   if (!std::isfinite(value))
+   {
+      json_ += "null";
+      return;
+   }
+   json_ += ToShortestString(value);
+}
+
+void ImageTagsJSONWriter::AddFragment(const JSONFragment& fragment)
+{
+   if (fragment.members.empty())
+      return;
+   if (json_.size() > 1)
+      json_ += ',';
+   json_ += fragment.members;
+   fragment_ = &fragment;
+}
+
+void ImageTagsJSONWriter::AddMetadata(const Metadata& md)
+{
+   for (Metadata::const_iterator it = md.begin(), end = md.end(); it != end; ++it)
+   {
+      const MetadataSingleTag* tag = it->second->ToSingleTag();
+      if (tag)
+         AddString(it->first, tag->GetValue());
+   }
+}
+
+std::string ImageTagsJSONWriter::Finish()
+{
+   json_ += '}';
+   std::string result;
+   result.swap(json_);
+   json_ = "{";
+   keys_.clear();
+   fragment_ = 0;
+   return result;
+}
+
+} // namespace mm
@@ -0,0 +1,84 @@
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//
+// DESCRIPTION:   Serialization of image metadata and the system state cache
+//                to JSON, for creating tagged images in a single call
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include "../MMDevice/ImageMetadata.h"
+
+#include <memory>
+#include <set>
+#include <string>
+
+class Configuration;
+
+namespace mm
+{
+
+// Appends s to out as a quoted JSON string
+void AppendJSONString(std::string& out, const std::string& s);
+
+// Shortest decimal form of a finite value that reads back exactly, always
+// with a decimal point or exponent (like Java's Double.toString())
+std::string ToShortestString(double value);
+
+
+// Members of a JSON object (without the enclosing braces), together with
+// their keys, so that the fragment can be spliced into other objects
+struct JSONFragment
+{
+   std::string members;
+   std::set<std::string> keys;
+};
+
+// Members "Device-Property": "value" for each setting of the configuration
+std::shared_ptr<const JSONFragment>
+SerializeConfigurationJSON(const Configuration& config);
+
+
+/**
+ * Builds the JSON object of tags for one image.
+ *
+ * Each key is written at most once; the first value given for a key wins,
+ * so callers add tags in order of decreasing precedence.
+ */
+class ImageTagsJSONWriter
+{
+public:
+   ImageTagsJSONWriter();
+
+   void AddString(const std::string& key, const std::string& value);
+   void AddInteger(const std::string& key, long long value);
+   void AddDouble(const std::string& key, double value);
+
+   // Adds the members of the fragment, whose keys must not have been added
+   // yet; fragment must outlive the writer
+   void AddFragment(const JSONFragment& fragment);
+
+   // Adds the single-valued tags (array tags are skipped)
+   void AddMetadata(const Metadata& md);
+
+   std::string Finish();
+
+private:
+   bool BeginMember(const std::string& key);
+
+   std::string json_;
+   std::set<std::string> keys_;
+   const JSONFragment* fragment_;
+};
+
+} // namespace mm
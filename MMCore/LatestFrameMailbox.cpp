@@ -0,0 +1,255 @@
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//
+// DESCRIPTION:   Triple-buffered reference to the newest image inserted into
+//                the circular buffer, for live display
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "LatestFrameMailbox.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace mm
+{
+
+namespace
+{
+
+// Copies the image row by row (unless dst is null), and averages each
+// binning x binning block of the rows just read (while they are in cache)
+// into one preview pixel
+template <typename T, unsigned Components>
+void CopyAndBin(const unsigned char* src, unsigned char* dst,
+      unsigned char* preview, unsigned width, unsigned height,
+      unsigned binning, std::vector<std::uint64_t>& sums)
+{
+   const std::size_t rowBytes = (std::size_t)width * Components * sizeof(T);
+   const unsigned previewWidth = (width + binning - 1) / binning;
+   sums.resize((std::size_t)previewWidth * Components);
+   T* out = reinterpret_cast<T*>(preview);
+
+   for (unsigned y0 = 0; y0 < height; y0 += binning)
+   {
+      const unsigned rows = std::min(binning, height - y0);
+      std::fill(sums.begin(), sums.end(), 0);
+      for (unsigned y = y0; y < y0 + rows; ++y)
+      {
+         const unsigned char* srcRow = src + y * rowBytes;
+         if (dst)
+            std::memcpy(dst + y * rowBytes, srcRow, rowBytes);
+         const T* p = reinterpret_cast<const T*>(srcRow);
+         std::uint64_t* sum = sums.data();
+         for (unsigned x = 0; x < width; sum += Components)
+         {
+            const unsigned end = std::min(x + binning, width);
+            for (; x < end; ++x, p += Components)
+               for (unsigned c = 0; c < Components; ++c)
+                  sum[c] += p[c];
+         }
+      }
+      for (unsigned px = 0; px < previewWidth; ++px)
+      {
+         const unsigned cols = std::min(binning, width - px * binning);
+         const std::uint64_t n = (std::uint64_t)cols * rows;
+         for (unsigned c = 0; c < Components; ++c)
+            *out++ = static_cast<T>((sums[px * Components + c] + n / 2) / n);
+      }
+   }
+}
+
+} // anonymous namespace
+
+LatestFrame::LatestFrame() :
+   serial(0),
+   camera(0),
+   width(0),
+   height(0),
+   byteDepth(0),
+   nComponents(0),
+   channelBytes(0),
+   previewBinning(1),
+   previewWidth(0),
+   previewHeight(0)
+{
+}
+
+const unsigned char* LatestFrame::GetPreview(unsigned channel) const
+{
+   return previewBinning > 1 ? preview_[channel].data() : pixels[channel];
+}
+
+std::size_t LatestFrame::GetPreviewBytes() const
+{
+   return previewBinning > 1 ?
+      (std::size_t)previewWidth * previewHeight * byteDepth : channelBytes;
+}
+
+Metadata LatestFrame::GetPreviewMetadata(unsigned channel) const
+{
+   Metadata md = metadata[channel];
+   if (previewBinning > 1)
+   {
+      md.RemoveTag("Width");
+      md.RemoveTag("Height");
+      md.PutImageTag("Width", previewWidth);
+      md.PutImageTag("Height", previewHeight);
+   }
+   md.RemoveTag("PreviewBinning");
+   md.PutImageTag("PreviewBinning", previewBinning);
+   return md;
+}
+
+LatestFrameMailbox::LatestFrameMailbox(unsigned previewMaxSize) :
+   previewMaxSize_(previewMaxSize),
+   publishedCount_(0)
+{
+   for (int i = 0; i < 3; ++i)
+      frames_.push_back(std::make_shared<LatestFrame>());
+}
+
+void LatestFrameMailbox::BeginFrame(unsigned numChannels, unsigned width,
+      unsigned height, unsigned byteDepth, unsigned nComponents,
+      const void* camera)
+{
+   // Fill a frame that is neither published nor held by any reader (only
+   // frames_ refers to it). Nobody can obtain a new reference to such a
+   // frame, so once we see it unreferenced it stays so; the pixels of all
+   // such frames are let go.
+   const LatestFrame* published = std::atomic_load(&latest_).get();
+   filling_.reset();
+   for (std::size_t i = 0; i < frames_.size(); ++i)
+   {
+      if (frames_[i].get() != published && frames_[i].use_count() == 1)
+      {
+         std::atomic_thread_fence(std::memory_order_acquire);
+         frames_[i]->owner_.reset();
+         if (!filling_)
+            filling_ = frames_[i];
+      }
+   }
+   if (!filling_)
+   {
+      // Readers are holding on to all the other frames; leave those to
+      // them and start a new one
+      for (std::size_t i = 0; i < frames_.size(); ++i)
+      {
+         if (frames_[i].get() != published)
+         {
+            frames_[i] = std::make_shared<LatestFrame>();
+            filling_ = frames_[i];
+            break;
+         }
+      }
+   }
+
+   LatestFrame& frame = *filling_;
+   frame.camera = camera;
+   frame.width = width;
+   frame.height = height;
+   frame.byteDepth = byteDepth;
+   frame.nComponents = nComponents;
+   frame.channelBytes = (std::size_t)width * height * byteDepth;
+   frame.pixels.assign(numChannels, 0);
+   frame.metadata.resize(numChannels);
+   frame.copies_.resize(numChannels);
+
+   const bool binnable = (nComponents == 1 && (byteDepth == 1 || byteDepth == 2)) ||
+      (nComponents == 4 && byteDepth == 4);
+   unsigned binning = 1;
+   if (previewMaxSize_ > 0 && binnable)
+   {
+      const unsigned largest = std::max(width, height);
+      binning = (largest + previewMaxSize_ - 1) / previewMaxSize_;
+   }
+   frame.previewBinning = std::max(binning, 1u);
+   frame.previewWidth = (width + frame.previewBinning - 1) / frame.previewBinning;
+   frame.previewHeight = (height + frame.previewBinning - 1) / frame.previewBinning;
+   frame.preview_.resize(frame.previewBinning > 1 ? numChannels : 0);
+}
+
+void LatestFrameMailbox::SetChannel(unsigned channel,
+      const unsigned char* pixels, const Metadata& md)
+{
+   LatestFrame& frame = *filling_;
+   std::vector<unsigned char>& copy = frame.copies_[channel];
+   copy.resize(frame.channelBytes);
+   frame.pixels[channel] = copy.data();
+   FillChannel(channel, pixels, copy.data(), md);
+}
+
+void LatestFrameMailbox::ShareChannel(unsigned channel,
+      const unsigned char* pixels, const Metadata& md,
+      std::shared_ptr<const void> owner)
+{
+   LatestFrame& frame = *filling_;
+   frame.owner_ = std::move(owner);
+   frame.pixels[channel] = pixels;
+   FillChannel(channel, pixels, 0, md);
+}
+
+void LatestFrameMailbox::FillChannel(unsigned channel,
+      const unsigned char* pixels, unsigned char* copy, const Metadata& md)
+{
+   LatestFrame& frame = *filling_;
+   frame.metadata[channel] = md;
+
+   if (frame.previewBinning == 1)
+   {
+      if (copy)
+         std::memcpy(copy, pixels, frame.channelBytes);
+      return;
+   }
+
+   std::vector<unsigned char>& preview = frame.preview_[channel];
+   preview.resize(frame.GetPreviewBytes());
+   if (frame.nComponents == 4)
+      CopyAndBin<std::uint8_t, 4>(pixels, copy, preview.data(),
+            frame.width, frame.height, frame.previewBinning, binSums_);
+   else if (frame.byteDepth == 2)
+      CopyAndBin<std::uint16_t, 1>(pixels, copy, preview.data(),
+            frame.width, frame.height, frame.previewBinning, binSums_);
+   else
+      CopyAndBin<std::uint8_t, 1>(pixels, copy, preview.data(),
+            frame.width, frame.height, frame.previewBinning, binSums_);
+}
+
+void LatestFrameMailbox::PublishFrame()
+{
+   if (!filling_)
+      return;
+   filling_->serial = ++publishedCount_;
+   std::shared_ptr<const LatestFrame> frame = filling_;
+   filling_.reset();
+   std::shared_ptr<const LatestFrame> previous =
+      std::atomic_exchange(&latest_, frame);
+
+   // Unless a reader holds the superseded frame (besides frames_ and
+   // previous), let go of its pixels now rather than at the next frame
+   if (previous && previous.use_count() == 2)
+   {
+      std::atomic_thread_fence(std::memory_order_acquire);
+      for (std::size_t i = 0; i < frames_.size(); ++i)
+      {
+         if (frames_[i] == previous)
+            frames_[i]->owner_.reset();
+      }
+   }
+}
+
+std::shared_ptr<const LatestFrame> LatestFrameMailbox::GetLatest() const
+{
+   return std::atomic_load(&latest_);
+}
+
+} // namespace mm
@@ -0,0 +1,127 @@
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//
+// DESCRIPTION:   Triple-buffered reference to the newest image inserted into
+//                the circular buffer, for live display
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include "../MMDevice/ImageMetadata.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace mm
+{
+
+// One published image, with all its channels. Never modified while readers
+// hold it; its pixels stay valid for as long as the frame is held.
+struct LatestFrame
+{
+   unsigned long long serial; // Counts published frames, from 1
+   const void* camera;
+   unsigned width;
+   unsigned height;
+   unsigned byteDepth;
+   unsigned nComponents;
+   std::size_t channelBytes; // Size of each channel's pixels
+   std::vector<const unsigned char*> pixels; // Per channel
+   std::vector<Metadata> metadata; // Per channel
+
+   // Downsampled (by averaging binning x binning blocks) copy of each
+   // channel. With binning 1 (no preview requested, image already small
+   // enough, or unsupported pixel type), the preview is the image itself.
+   unsigned previewBinning;
+   unsigned previewWidth;
+   unsigned previewHeight;
+
+   LatestFrame();
+
+   // The channel's preview, of GetPreviewBytes()
+   const unsigned char* GetPreview(unsigned channel) const;
+   std::size_t GetPreviewBytes() const;
+
+   // The channel's metadata, with the preview's Width and Height and its
+   // binning (PreviewBinning)
+   Metadata GetPreviewMetadata(unsigned channel) const;
+
+private:
+   friend class LatestFrameMailbox;
+   std::shared_ptr<const void> owner_; // Keeps shared pixels valid
+   std::vector<std::vector<unsigned char> > copies_; // Per copied channel
+   std::vector<std::vector<unsigned char> > preview_; // Per channel
+};
+
+
+/**
+ * Holds the newest image given to it, so that live display can read it
+ * without taking the circular buffer's locks or consuming images.
+ *
+ * Three (or, while readers hold on to old frames, more) frames are
+ * rotated: the writer fills one that no reader holds and publishes it with
+ * a pointer swap, so readers always see a complete frame and the writer
+ * never waits for them.
+ *
+ * Pixels are either copied into the frame or shared with their owner (a
+ * circular buffer slot), which the frame then keeps alive until it is
+ * superseded and no reader holds it any more.
+ *
+ * Optionally, a preview binned to at most previewMaxSize pixels in width
+ * and height is computed in one pass over the pixels (the same pass as the
+ * copy, if any), for 8- and 16-bit grayscale and 8-bit-per-component RGB
+ * images.
+ */
+class LatestFrameMailbox
+{
+public:
+   // previewMaxSize of 0 disables the preview
+   explicit LatestFrameMailbox(unsigned previewMaxSize);
+
+   LatestFrameMailbox(const LatestFrameMailbox&) = delete;
+   LatestFrameMailbox& operator=(const LatestFrameMailbox&) = delete;
+
+   unsigned GetPreviewMaxSize() const { return previewMaxSize_; }
+
+   // Writer side. Calls must not be concurrent: BeginFrame(), then
+   // SetChannel() or ShareChannel() for each channel, then PublishFrame().
+   void BeginFrame(unsigned numChannels, unsigned width, unsigned height,
+         unsigned byteDepth, unsigned nComponents, const void* camera);
+   // Copies the pixels
+   void SetChannel(unsigned channel, const unsigned char* pixels,
+         const Metadata& md);
+   // Refers to the pixels, which must not change while owner is held
+   void ShareChannel(unsigned channel, const unsigned char* pixels,
+         const Metadata& md, std::shared_ptr<const void> owner);
+   void PublishFrame();
+
+   // Reader side; any thread. Null until the first frame is published.
+   std::shared_ptr<const LatestFrame> GetLatest() const;
+   unsigned long long GetPublishedCount() const { return publishedCount_; }
+
+private:
+   void FillChannel(unsigned channel, const unsigned char* pixels,
+         unsigned char* copy, const Metadata& md);
+
+   const unsigned previewMaxSize_;
+   std::vector<std::shared_ptr<LatestFrame> > frames_; // Writer only
+   std::shared_ptr<LatestFrame> filling_; // Writer only
+   std::shared_ptr<const LatestFrame> latest_; // Accessed atomically
+   std::atomic<unsigned long long> publishedCount_;
+   std::vector<std::uint64_t> binSums_; // Writer only
+};
+
+} // namespace mm
@@ -39,7 +39,8 @@ LoadedDeviceAdapter::LoadedDeviceAdapter(const std::string& name, const std::str
    GetNumberOfDevices_(0),
    GetDeviceName_(0),
    GetDeviceType_(0),
-   GetDeviceDescription_(0)
+   GetDeviceDescription_(0),
+   GetDeviceThreadSafety_(0)
 {
    try
    {
@@ -125,6 +126,23 @@ LoadedDeviceAdapter::GetAdvertisedDeviceType(const std::string& deviceName) cons
 }
 
 
+MM::DeviceThreadSafety
+LoadedDeviceAdapter::GetDeviceThreadSafety(const std::string& deviceName) const
+{
+   int threadSafety = MM::ThreadSafetyModule;
+   if (!GetDeviceThreadSafety(deviceName.c_str(), &threadSafety))
+      return MM::ThreadSafetyModule;
+   switch (threadSafety)
+   {
+      case MM::ThreadSafetyDevice:
+      case MM::ThreadSafetyDeviceSharedReads:
+         return static_cast<MM::DeviceThreadSafety>(threadSafety);
+      default:
+         return MM::ThreadSafetyModule;
+   }
+}
+
+
 std::shared_ptr<DeviceInstance>
 LoadedDeviceAdapter::LoadDevice(CMMCore* core, const std::string& name,
       const std::string& label,
@@ -318,3 +336,13 @@ LoadedDeviceAdapter::GetDeviceDescription(const char* deviceName, char* buf, uns
          (module_->GetFunction("GetDeviceDescription"));
    return GetDeviceDescription_(deviceName, buf, bufLen);
 }
+
+
+bool
+LoadedDeviceAdapter::GetDeviceThreadSafety(const char* deviceName, int* threadSafety) const
+{
+   if (!GetDeviceThreadSafety_)
+      GetDeviceThreadSafety_ = reinterpret_cast<fnGetDeviceThreadSafety>
+         (module_->GetFunction("GetDeviceThreadSafety"));
+   return GetDeviceThreadSafety_(deviceName, threadSafety);
+}
@@ -58,6 +58,8 @@ public:
    std::vector<std::string> GetAvailableDeviceNames() const;
    std::string GetDeviceDescription(const std::string& deviceName) const;
    MM::DeviceType GetAdvertisedDeviceType(const std::string& deviceName) const;
+   // ThreadSafetyModule unless the module declared otherwise for the device
+   MM::DeviceThreadSafety GetDeviceThreadSafety(const std::string& deviceName) const;
 
    std::shared_ptr<DeviceInstance> LoadDevice(CMMCore* core,
          const std::string& name, const std::string& label,
@@ -105,6 +107,7 @@ private:
    bool GetDeviceDescription(const char* deviceName,
          char* buf, unsigned bufLen) const;
    bool GetDeviceType(const char* deviceName, int* type) const;
+   bool GetDeviceThreadSafety(const char* deviceName, int* threadSafety) const;
    MM::Device* CreateDevice(const char* deviceName);
    void DeleteDevice(MM::Device* device);
 
@@ -123,4 +126,5 @@ private:
    mutable fnGetDeviceName GetDeviceName_;
    mutable fnGetDeviceType GetDeviceType_;
    mutable fnGetDeviceDescription GetDeviceDescription_;
+   mutable fnGetDeviceThreadSafety GetDeviceThreadSafety_;
 };
@@ -42,6 +42,7 @@
 #include "../MMDevice/DeviceUtils.h"
 #include "../MMDevice/ImageMetadata.h"
 #include "../MMDevice/ModuleInterface.h"
+#include "AcquisitionEngine.h"
 #include "CircularBuffer.h"
 #include "ConfigGroup.h"
 #include "Configuration.h"
@@ -49,12 +50,17 @@
 #include "CoreProperty.h"
 #include "CoreUtils.h"
 #include "DeviceManager.h"
+#include "DiskStreamWriter.h"
 #include "Devices/DeviceInstances.h"
 #include "Host.h"
+#include "ImageTagsJSON.h"
+#include "LatestFrameMailbox.h"
 #include "LogManager.h"
 #include "MMCore.h"
 #include "MMEventCallback.h"
 #include "PluginManager.h"
+#include "SharedFrameRingWriter.h"
+#include "TraceRecorder.h"
 
 #include <algorithm>
 #include <cassert>
@@ -113,7 +119,16 @@ using namespace std;
  * (Keep the 3 numbers on one line to make it easier to look at diffs when
  * merging/rebasing.)
  */
-const int MMCore_versionMajor = 10, MMCore_versionMinor = 4, MMCore_versionPatch = 0;
+const int MMCore_versionMajor = 10, MMCore_versionMinor = 6, MMCore_versionPatch = 0;
+
+// Handle of the Core device, which has no DeviceInstance (device handles are
+// otherwise positive)
+const long g_CoreDeviceHandle = -1;
+
+// Policy names used by the PropertyCache configuration command (any other
+// value is taken as a time to live in milliseconds)
+const char* const g_PropertyCacheAlwaysQuery = "AlwaysQuery";
+const char* const g_PropertyCacheUntilSet = "UntilSet";
 
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -139,8 +154,13 @@ CMMCore::CMMCore() :
    externalCallback_(0),
    pixelSizeGroup_(0),
    cbuf_(0),
+   diskStreamQueueMB_(256),
+   diskStreamWriterThreads_(2),
+   diskStreamBlockWhenFull_(false),
+   lastPinId_(0),
    pluginManager_(new CPluginManager()),
    deviceManager_(new mm::DeviceManager()),
+   stateCacheJSONRevision_(-1),
    pPostedErrorsLock_(NULL)
 {
    configGroups_ = new ConfigGroupCollection();
@@ -153,6 +173,7 @@ CMMCore::CMMCore() :
 
    const unsigned seqBufMegabytes = (sizeof(void*) > 4) ? 250 : 25;
    cbuf_ = new CircularBuffer(seqBufMegabytes);
+   acqEngine_ = std::make_shared<mm::AcquisitionEngine>(this);
 
    nullAffine_ = new std::vector<double>(6);
    for (int i = 0; i < 6; i++) {
@@ -168,6 +189,8 @@ CMMCore::CMMCore() :
  */
 CMMCore::~CMMCore()
 {
+   acqEngine_->Stop();
+
    try
    {
       // TODO We should attempt to continue cleanup beyond the first device
@@ -182,6 +205,13 @@ CMMCore::~CMMCore()
    delete callback_;
    delete configGroups_;
    delete properties_;
+   if (diskStream_)
+   {
+      cbuf_->SetDiskStreamWriter(std::shared_ptr<mm::DiskStreamWriter>());
+      diskStream_->Stop();
+   }
+   cbuf_->SetSharedFrameRing(std::shared_ptr<mm::SharedFrameRingWriter>());
+   cbuf_->SetLatestFrameMailbox(std::shared_ptr<mm::LatestFrameMailbox>());
    delete cbuf_;
    delete pixelSizeGroup_;
    delete pPostedErrorsLock_;
@@ -310,6 +340,176 @@ void CMMCore::stopSecondaryLogFile(int handle) throw (CMMError)
 }
 
 
+namespace
+{
+   void FormatDeviceCallStatistics(std::ostream& os, const std::string& label,
+         const mm::DeviceCallStatistics& stats)
+   {
+      std::vector<mm::DeviceCallStatistics::Summary> summaries =
+         stats.GetSummaries();
+      for (std::vector<mm::DeviceCallStatistics::Summary>::const_iterator
+            it = summaries.begin(), end = summaries.end(); it != end; ++it)
+      {
+         os << label << '\t' << it->method << '\t' << it->count << '\t' <<
+            std::fixed << std::setprecision(3) << it->totalMs << '\t' <<
+            it->totalMs / it->count << '\t' << it->maxMs << '\t';
+         size_t last = it->histogram.size();
+         while (last > 1 && it->histogram[last - 1] == 0)
+            --last;
+         for (size_t i = 0; i < last; ++i)
+            os << (i > 0 ? "," : "") << it->histogram[i];
+         os << '\n';
+      }
+   }
+
+   const char* const g_DeviceCallStatisticsHeader =
+      "Device\tMethod\tCalls\tTotal (ms)\tMean (ms)\tMax (ms)\tHistogram\n";
+}
+
+
+/**
+ * Enables or disables timing of calls from the Core into device adapters.
+ *
+ * When enabled, every call through the Core's device wrappers is counted and
+ * timed per device and per method, and the time spent waiting for each
+ * device adapter's lock is recorded separately. The overhead is two clock
+ * reads and a few atomic increments per call. Statistics accumulate until
+ * resetDeviceCallStatistics() is called; disabling keeps them.
+ *
+ * The setting applies to all Core instances in the process.
+ *
+ * @param enable  whether to record call statistics
+ */
+void CMMCore::enableDeviceCallStatistics(bool enable)
+{
+   mm::DeviceCallStatistics::SetEnabled(enable);
+   LOG_INFO(coreLogger_) << "Device call statistics " <<
+      (enable ? "enabled" : "disabled");
+}
+
+/**
+ * Indicates whether device call statistics are being recorded.
+ */
+bool CMMCore::isDeviceCallStatisticsEnabled() const
+{
+   return mm::DeviceCallStatistics::IsEnabled();
+}
+
+/**
+ * Returns the device call statistics of all loaded devices, as a
+ * tab-separated table with a header line.
+ *
+ * Each row gives the device label, the method (or "(module lock wait)" for
+ * time spent waiting for the device adapter's lock), the number of calls, and
+ * the total, mean and maximum time in milliseconds. The last column is a
+ * comma-separated latency histogram: the first bucket counts calls shorter
+ * than 1 microsecond and bucket i counts calls of 2^(i-1) to 2^i
+ * microseconds. Trailing empty buckets are omitted.
+ */
+std::string CMMCore::getDeviceCallStatistics() throw (CMMError)
+{
+   std::ostringstream os;
+   os << g_DeviceCallStatisticsHeader;
+   std::vector<std::string> devices = deviceManager_->GetDeviceList();
+   for (std::vector<std::string>::const_iterator it = devices.begin(),
+         end = devices.end(); it != end; ++it)
+   {
+      std::shared_ptr<DeviceInstance> pDevice = deviceManager_->GetDevice(*it);
+      FormatDeviceCallStatistics(os, *it, pDevice->GetCallStatistics());
+   }
+   return os.str();
+}
+
+/**
+ * Returns the device call statistics of one device, in the format described
+ * for getDeviceCallStatistics().
+ *
+ * @param label   the device label
+ */
+std::string CMMCore::getDeviceCallStatistics(const char* label) throw (CMMError)
+{
+   CheckDeviceLabel(label);
+   std::shared_ptr<DeviceInstance> pDevice = deviceManager_->GetDevice(label);
+   std::ostringstream os;
+   os << g_DeviceCallStatisticsHeader;
+   FormatDeviceCallStatistics(os, label, pDevice->GetCallStatistics());
+   return os.str();
+}
+
+/**
+ * Clears the device call statistics of all loaded devices.
+ */
+void CMMCore::resetDeviceCallStatistics()
+{
+   std::vector<std::string> devices = deviceManager_->GetDeviceList();
+   for (std::vector<std::string>::const_iterator it = devices.begin(),
+         end = devices.end(); it != end; ++it)
+   {
+      deviceManager_->GetDevice(*it)->GetCallStatistics().Reset();
+   }
+}
+
+
+/**
+ * Enables or disables tracing.
+ *
+ * While enabled, the Core records a timestamped span for each snapImage(),
+ * setConfig(), waitForDevice() and startSequenceAcquisition() call, for
+ * every call into a device adapter, for waits on device adapter locks, and
+ * for image insertion into and retrieval from the circular buffer. Each
+ * thread's events are kept in a separate lane, which holds only its most
+ * recent 16383 events. Events accumulate until clearTrace() is called;
+ * disabling keeps them.
+ *
+ * The setting applies to all Core instances in the process.
+ *
+ * @param enable  whether to record trace events
+ */
+void CMMCore::enableTracing(bool enable)
+{
+   mm::TraceRecorder::SetEnabled(enable);
+   LOG_INFO(coreLogger_) << "Tracing " << (enable ? "enabled" : "disabled");
+}
+
+/**
+ * Indicates whether trace events are being recorded.
+ */
+bool CMMCore::isTracingEnabled() const
+{
+   return mm::TraceRecorder::IsEnabled();
+}
+
+/**
+ * Discards all recorded trace events.
+ */
+void CMMCore::clearTrace()
+{
+   mm::TraceRecorder::Clear();
+}
+
+/**
+ * Writes the recorded trace events to a file in the Chrome trace event
+ * (JSON) format, which can be opened in chrome://tracing or
+ * https://ui.perfetto.dev. Recording continues if enabled.
+ *
+ * @param filename   the file to write; an existing file is overwritten
+ */
+void CMMCore::saveTrace(const char* filename) throw (CMMError)
+{
+   if (!filename)
+      throw CMMError("Null filename");
+   std::ofstream os(filename);
+   if (!os)
+      throw CMMError(ToQuotedString(filename) + ": " +
+            getCoreErrorText(MMERR_FileOpenFailed), MMERR_FileOpenFailed);
+   mm::TraceRecorder::WriteChromeJSON(os);
+   os.close();
+   if (!os)
+      throw CMMError("Error writing trace to " + ToQuotedString(filename));
+   LOG_INFO(coreLogger_) << "Saved trace to " << filename;
+}
+
+
 /*!
  Displays current user name.
  */
@@ -359,13 +559,25 @@ string CMMCore::getVersionInfo() const
 
 /**
  * Get available devices from the specified device library.
+ *
+ * If a device adapter catalog is set (see setDeviceAdapterCatalogFile()),
+ * the library is only loaded if it is not in the catalog or has changed.
  */
 std::vector<std::string>
 CMMCore::getAvailableDevices(const char* moduleName) throw (CMMError)
 {
-   std::shared_ptr<LoadedDeviceAdapter> module =
-      pluginManager_->GetDeviceAdapter(moduleName);
-   return module->GetAvailableDeviceNames();
+   if (!moduleName)
+      throw CMMError("Null device adapter module name");
+   std::vector<mm::AdvertisedDevice> devices =
+      pluginManager_->GetAdvertisedDevices(moduleName);
+   std::vector<std::string> names;
+   names.reserve(devices.size());
+   for (std::vector<mm::AdvertisedDevice>::const_iterator
+         it = devices.begin(), end = devices.end(); it != end; ++it)
+   {
+      names.push_back(it->name);
+   }
+   return names;
 }
 
 /**
@@ -376,15 +588,16 @@ CMMCore::getAvailableDeviceDescriptions(const char* moduleName) throw (CMMError)
 {
    // XXX It is a little silly that we return the list of descriptions, rather
    // than provide access to the description of each device.
-   std::shared_ptr<LoadedDeviceAdapter> module =
-      pluginManager_->GetDeviceAdapter(moduleName);
-   std::vector<std::string> names = module->GetAvailableDeviceNames();
+   if (!moduleName)
+      throw CMMError("Null device adapter module name");
+   std::vector<mm::AdvertisedDevice> devices =
+      pluginManager_->GetAdvertisedDevices(moduleName);
    std::vector<std::string> descriptions;
-   descriptions.reserve(names.size());
-   for (std::vector<std::string>::const_iterator
-         it = names.begin(), end = names.end(); it != end; ++it)
+   descriptions.reserve(devices.size());
+   for (std::vector<mm::AdvertisedDevice>::const_iterator
+         it = devices.begin(), end = devices.end(); it != end; ++it)
    {
-      descriptions.push_back(module->GetDeviceDescription(*it));
+      descriptions.push_back(it->description);
    }
    return descriptions;
 }
@@ -397,20 +610,73 @@ CMMCore::getAvailableDeviceTypes(const char* moduleName) throw (CMMError)
 {
    // XXX It is a little silly that we return the list of types, rather than
    // provide access to the type of each device.
-   std::shared_ptr<LoadedDeviceAdapter> module =
-      pluginManager_->GetDeviceAdapter(moduleName);
-   std::vector<std::string> names = module->GetAvailableDeviceNames();
+   if (!moduleName)
+      throw CMMError("Null device adapter module name");
+   std::vector<mm::AdvertisedDevice> devices =
+      pluginManager_->GetAdvertisedDevices(moduleName);
    std::vector<long> types;
-   types.reserve(names.size());
-   for (std::vector<std::string>::const_iterator
-         it = names.begin(), end = names.end(); it != end; ++it)
+   types.reserve(devices.size());
+   for (std::vector<mm::AdvertisedDevice>::const_iterator
+         it = devices.begin(), end = devices.end(); it != end; ++it)
    {
-      MM::DeviceType devType = module->GetAdvertisedDeviceType(*it);
-      types.push_back(static_cast<long>(devType));
+      types.push_back(static_cast<long>(it->type));
    }
    return types;
 }
 
+/**
+ * Set the file in which to keep a catalog of the devices offered by each
+ * device adapter library, or disable the catalog (null or empty filename).
+ *
+ * Listing the devices of a library (getAvailableDevices() and related
+ * methods) normally requires loading it, which, for all libraries, can take
+ * a long time and have side effects (vendor libraries may start threads or
+ * probe hardware). With the catalog, each library is loaded only the first
+ * time it is listed and whenever its file changes (path, size or
+ * modification time). Libraries that fail to load (or, in a child process,
+ * crash or time out) are not cataloged, and are loaded again the next time
+ * they are listed. The file is created if it does not exist.
+ *
+ * @param filename              the catalog file
+ * @param queryInChildProcess   load uncataloged libraries in a short-lived
+ *                              child process (the mmcore-query-adapter
+ *                              program, installed next to the Core) rather
+ *                              than in this one, so that they do not stay
+ *                              loaded and cannot crash the application
+ *                              (ignored on Windows, or if the program is
+ *                              not found)
+ */
+void CMMCore::setDeviceAdapterCatalogFile(const char* filename,
+      bool queryInChildProcess) throw (CMMError)
+{
+   pluginManager_->SetCatalog(filename ? filename : "", queryInChildProcess);
+   if (filename && *filename)
+      LOG_INFO(coreLogger_) << "Using device adapter catalog " << filename;
+   else
+      LOG_INFO(coreLogger_) << "Device adapter catalog disabled";
+}
+
+/**
+ * Returns the device adapter catalog file, or an empty string if none is
+ * set.
+ */
+std::string CMMCore::getDeviceAdapterCatalogFile() const
+{
+   return pluginManager_->GetCatalogFilename();
+}
+
+/**
+ * Adds every device adapter library in the search paths that is not yet in
+ * the catalog, or has changed, to the catalog.
+ *
+ * Libraries that fail to load are cataloged with the error (which is then
+ * thrown by getAvailableDevices()), and do not cause this method to fail.
+ */
+void CMMCore::updateDeviceAdapterCatalog() throw (CMMError)
+{
+   pluginManager_->UpdateCatalog();
+}
+
 /**
  * Returns the module and device interface versions.
  */
@@ -438,33 +704,7 @@ Configuration CMMCore::getSystemState()
    {
       std::shared_ptr<DeviceInstance> pDev = deviceManager_->GetDevice(*i);
       mm::DeviceModuleLockGuard guard(pDev);
-      std::vector<std::string> propertyNames = pDev->GetPropertyNames();
-      for (std::vector<std::string>::const_iterator it = propertyNames.begin(), end = propertyNames.end();
-            it != end; ++it)
-      {
-         std::string val;
-         try
-         {
-            val = pDev->GetProperty(*it);
-         }
-         catch (const CMMError&)
-         {
-            // XXX BUG This should not be ignored, but the interface does not
-            // allow throwing from this function. Keeping old behavior for now.
-         }
-
-         bool readOnly = false;
-         try
-         {
-            readOnly = pDev->GetPropertyReadOnly(it->c_str());
-         }
-         catch (const CMMError&)
-         {
-            // XXX BUG This should not be ignored, but the interface does not
-            // allow throwing from this function. Keeping old behavior for now.
-         }
-         config.addSetting(PropertySetting(i->c_str(), it->c_str(), val.c_str(), readOnly));
-      }
+      addDeviceState(config, *i, pDev);
    }
 
    // add core properties
@@ -490,6 +730,42 @@ Configuration CMMCore::getSystemStateCache() const
    return stateCache_;
 }
 
+/**
+ * Returns the system state cache as a JSON object, with a member
+ * "Device-Property": "value" for each cached property.
+ *
+ * The JSON is only regenerated when the cache has changed, so repeated calls
+ * are cheap. Callers that keep the parsed result can use
+ * getSystemStateCacheRevision() to tell whether it is still current.
+ */
+std::string CMMCore::getSystemStateCacheJSON() const
+{
+   std::shared_ptr<const mm::JSONFragment> fragment =
+      getSystemStateCacheJSONFragment();
+   return "{" + fragment->members + "}";
+}
+
+/**
+ * Returns a number that changes whenever the system state cache changes.
+ */
+long long CMMCore::getSystemStateCacheRevision() const
+{
+   MMThreadGuard scg(stateCacheLock_);
+   return stateCache_.getRevision();
+}
+
+std::shared_ptr<const mm::JSONFragment>
+CMMCore::getSystemStateCacheJSONFragment() const
+{
+   MMThreadGuard scg(stateCacheLock_);
+   if (!stateCacheJSON_ || stateCacheJSONRevision_ != stateCache_.getRevision())
+   {
+      stateCacheJSON_ = mm::SerializeConfigurationJSON(stateCache_);
+      stateCacheJSONRevision_ = stateCache_.getRevision();
+   }
+   return stateCacheJSON_;
+}
+
 /**
  * Returns a partial state of the system, only for devices included in the
  * specified configuration.
@@ -791,6 +1067,10 @@ void CMMCore::unloadDevice(const char* label///< the name of the device to unloa
    try {
       mm::DeviceModuleLockGuard guard(pDevice);
       LOG_DEBUG(coreLogger_) << "Will unload device " << label;
+      {
+         MMThreadGuard bitDepthGuard(statisticsBitDepthsLock_);
+         statisticsBitDepths_.erase(pDevice->GetRawPtr());
+      }
       deviceManager_->UnloadDevice(pDevice);
       LOG_DEBUG(coreLogger_) << "Did unload device " << label;
    }
@@ -824,6 +1104,10 @@ void CMMCore::unloadAllDevices() throw (CMMError)
       }
 
       LOG_DEBUG(coreLogger_) << "Will unload all devices";
+      {
+         MMThreadGuard bitDepthGuard(statisticsBitDepthsLock_);
+         statisticsBitDepths_.clear();
+      }
       deviceManager_->UnloadAllDevices();
       LOG_INFO(coreLogger_) << "Did unload all devices";
 
@@ -970,12 +1254,110 @@ void CMMCore::initializeDevice(const char* label ///< the device to initialize
 void CMMCore::updateSystemStateCache()
 {
    LOG_DEBUG(coreLogger_) << "Will update system state cache";
-   Configuration wk = getSystemState();
+
+   Configuration previous;
+   std::map<std::string, std::pair<std::weak_ptr<DeviceInstance>, unsigned long> > counters;
+   {
+      MMThreadGuard scg(stateCacheLock_);
+      previous = stateCache_;
+      counters.swap(stateCacheCounters_);
+   }
+
+   // Index the previous cache by device, so that devices with unchanged
+   // property change counters can be carried over without querying them
+   std::map<std::string, std::vector<PropertySetting> > previousByDevice;
+   for (size_t i = 0; i < previous.size(); ++i)
+   {
+      PropertySetting setting = previous.getSetting(i);
+      previousByDevice[setting.getDeviceLabel()].push_back(setting);
+   }
+
+   Configuration wk;
+   size_t nrReused = 0;
+   vector<string> devices = deviceManager_->GetDeviceList();
+   for (vector<string>::const_iterator i = devices.begin(), dend = devices.end(); i != dend; ++i)
+   {
+      std::shared_ptr<DeviceInstance> pDev = deviceManager_->GetDevice(*i);
+      mm::DeviceModuleLockGuard guard(pDev);
+
+      bool reuse = false;
+      if (!pDev->HasUncachedProperties())
+      {
+         std::map<std::string, std::pair<std::weak_ptr<DeviceInstance>, unsigned long> >::const_iterator
+            prev = counters.find(*i);
+         std::map<std::string, std::vector<PropertySetting> >::const_iterator
+            prevSettings = previousByDevice.find(*i);
+         reuse = prev != counters.end() &&
+            prev->second.first.lock() == pDev &&
+            prev->second.second == pDev->GetPropertyChangeCounter() &&
+            prevSettings != previousByDevice.end() &&
+            prevSettings->second.size() == pDev->GetPropertyNames().size();
+         if (reuse)
+         {
+            for (std::vector<PropertySetting>::const_iterator it = prevSettings->second.begin(),
+                  end = prevSettings->second.end(); it != end; ++it)
+               wk.addSetting(*it);
+            ++nrReused;
+         }
+      }
+      if (!reuse)
+         addDeviceState(wk, *i, pDev);
+
+      counters[*i] = std::make_pair(std::weak_ptr<DeviceInstance>(pDev),
+            pDev->GetPropertyChangeCounter());
+   }
+
+   vector<string> coreProps = properties_->GetNames();
+   for (unsigned i=0; i < coreProps.size(); i++)
+   {
+      string name = coreProps[i];
+      string val = properties_->Get(name.c_str());
+      wk.addSetting(PropertySetting(MM::g_Keyword_CoreDevice, name.c_str(), val.c_str(), properties_->IsReadOnly(name.c_str())));
+   }
+
    {
       MMThreadGuard scg(stateCacheLock_);
       stateCache_ = wk;
+      stateCacheCounters_.swap(counters);
+   }
+   LOG_INFO(coreLogger_) << "Did update system state cache (" << nrReused <<
+      " of " << devices.size() << " devices unchanged)";
+}
+
+/**
+ * Appends the current values of all properties of a device to config. The
+ * caller must hold the device module lock.
+ */
+void CMMCore::addDeviceState(Configuration& config, const std::string& label,
+      std::shared_ptr<DeviceInstance> pDev)
+{
+   std::vector<std::string> propertyNames = pDev->GetPropertyNames();
+   for (std::vector<std::string>::const_iterator it = propertyNames.begin(), end = propertyNames.end();
+         it != end; ++it)
+   {
+      std::string val;
+      try
+      {
+         val = pDev->GetProperty(*it);
+      }
+      catch (const CMMError&)
+      {
+         // XXX BUG This should not be ignored, but the interface does not
+         // allow throwing from this function. Keeping old behavior for now.
+      }
+
+      bool readOnly = false;
+      try
+      {
+         readOnly = pDev->GetPropertyReadOnly(it->c_str());
+      }
+      catch (const CMMError&)
+      {
+         // XXX BUG This should not be ignored, but the interface does not
+         // allow throwing from this function. Keeping old behavior for now.
+      }
+      config.addSetting(PropertySetting(label.c_str(), it->c_str(), val.c_str(), readOnly));
    }
-   LOG_INFO(coreLogger_) << "Did update system state cache";
 }
 
 /**
@@ -1102,6 +1484,51 @@ std::string CMMCore::getDeviceDescription(const char* label) throw (CMMError)
    return pDevice->GetDescription();
 }
 
+/**
+ * Returns a handle to a loaded device.
+ *
+ * Functions taking a DeviceHandle behave like their label-taking
+ * counterparts, but skip the label lookup. Resolve the handle once and reuse
+ * it in code that calls the same device repeatedly.
+ *
+ * @param label    the device label
+ */
+DeviceHandle CMMCore::getDeviceHandle(const char* label) throw (CMMError)
+{
+   if (IsCoreDeviceLabel(label))
+      return DeviceHandle(g_CoreDeviceHandle);
+   CheckDeviceLabel(label);
+   return DeviceHandle(deviceManager_->GetDeviceHandle(label));
+}
+
+/**
+ * Returns a handle to a device property, for use with getProperty() and
+ * setProperty().
+ *
+ * @param label      the device label
+ * @param propName   the property name
+ */
+PropertyHandle CMMCore::getPropertyHandle(const char* label, const char* propName) throw (CMMError)
+{
+   DeviceHandle device = getDeviceHandle(label);
+   CheckPropertyName(propName);
+   if (!hasProperty(label, propName))
+      throw CMMError("Property " + ToQuotedString(propName) + " of device " +
+            ToQuotedString(label) + " does not exist");
+   return PropertyHandle(device, propName);
+}
+
+/**
+ * Returns the label of the device referred to by a handle.
+ * @param device   the device handle
+ */
+std::string CMMCore::getDeviceLabel(const DeviceHandle& device) throw (CMMError)
+{
+   if (device.getId() == g_CoreDeviceHandle)
+      return MM::g_Keyword_CoreDevice;
+   return getDevice(device)->GetLabel();
+}
+
 
 /**
  * Reports action delay in milliseconds for the specific device.
@@ -1169,7 +1596,22 @@ bool CMMCore::deviceBusy(const char* label) throw (CMMError)
       return false;
    std::shared_ptr<DeviceInstance> pDevice = deviceManager_->GetDevice(label);
 
-   mm::DeviceModuleLockGuard guard(pDevice);
+   mm::DeviceModuleLockGuard guard(pDevice, mm::DeviceLock::Shared);
+   return pDevice->Busy();
+}
+
+/**
+ * Checks the busy status of the specific device.
+ * @param device the device handle
+ * @return true if the device is busy
+ */
+bool CMMCore::deviceBusy(const DeviceHandle& device) throw (CMMError)
+{
+   if (device.getId() == g_CoreDeviceHandle)
+      return false;
+   std::shared_ptr<DeviceInstance> pDevice = getDevice(device);
+
+   mm::DeviceModuleLockGuard guard(pDevice, mm::DeviceLock::Shared);
    return pDevice->Busy();
 }
 
@@ -1205,6 +1647,7 @@ void CMMCore::waitForDevice(const char* label) throw (CMMError)
  */
 void CMMCore::waitForDevice(std::shared_ptr<DeviceInstance> pDev) throw (CMMError)
 {
+   mm::TraceSpan span("waitForDevice", "core", pDev->GetTraceLabel());
    LOG_DEBUG(coreLogger_) << "Waiting for device " << pDev->GetLabel() << "...";
 
    auto now = std::chrono::steady_clock::now();
@@ -1272,7 +1715,7 @@ bool CMMCore::deviceTypeBusy(MM::DeviceType devType) throw (CMMError)
       try {
          std::shared_ptr<DeviceInstance> pDevice =
             deviceManager_->GetDevice(devices[i]);
-         mm::DeviceModuleLockGuard guard(pDevice);
+         mm::DeviceModuleLockGuard guard(pDevice, mm::DeviceLock::Shared);
          if (pDevice->Busy())
             return true;
       }
@@ -1342,10 +1785,22 @@ void CMMCore::waitForImageSynchro() throw (CMMError)
  */
 void CMMCore::setPosition(const char* label, double position) throw (CMMError)
 {
-   std::shared_ptr<StageInstance> pStage =
-      deviceManager_->GetDeviceOfType<StageInstance>(label);
+   setPosition(deviceManager_->GetDeviceOfType<StageInstance>(label), position);
+}
 
-   LOG_DEBUG(coreLogger_) << "Will start absolute move of " << label <<
+/**
+ * Sets the position of the stage in microns.
+ * @param stage     the stage device handle
+ * @param position  the desired stage position, in microns
+ */
+void CMMCore::setPosition(const DeviceHandle& stage, double position) throw (CMMError)
+{
+   setPosition(deviceManager_->GetDeviceOfType<StageInstance>(getDevice(stage)), position);
+}
+
+void CMMCore::setPosition(std::shared_ptr<StageInstance> pStage, double position) throw (CMMError)
+{
+   LOG_DEBUG(coreLogger_) << "Will start absolute move of " << pStage->GetLabel() <<
       " to position " << std::fixed << std::setprecision(5) << position <<
       " um";
 
@@ -1407,10 +1862,22 @@ void CMMCore::setRelativePosition(double d) throw (CMMError)
  */
 double CMMCore::getPosition(const char* label) throw (CMMError)
 {
-   std::shared_ptr<StageInstance> pStage =
-      deviceManager_->GetDeviceOfType<StageInstance>(label);
+   return getPosition(deviceManager_->GetDeviceOfType<StageInstance>(label));
+}
 
-   mm::DeviceModuleLockGuard guard(pStage);
+/**
+ * Returns the current position of the stage in microns.
+ * @return the position in microns
+ * @param stage     the single-axis drive device handle
+ */
+double CMMCore::getPosition(const DeviceHandle& stage) throw (CMMError)
+{
+   return getPosition(deviceManager_->GetDeviceOfType<StageInstance>(getDevice(stage)));
+}
+
+double CMMCore::getPosition(std::shared_ptr<StageInstance> pStage) throw (CMMError)
+{
+   mm::DeviceModuleLockGuard guard(pStage, mm::DeviceLock::Shared);
    double pos;
    int ret = pStage->GetPositionUm(pos);
    if (ret != DEVICE_OK)
@@ -1439,11 +1906,24 @@ double CMMCore::getPosition() throw (CMMError)
  */
 void CMMCore::setXYPosition(const char* label, double x, double y) throw (CMMError)
 {
-   std::shared_ptr<XYStageInstance> pXYStage =
-      deviceManager_->GetDeviceOfType<XYStageInstance>(label);
+   setXYPosition(deviceManager_->GetDeviceOfType<XYStageInstance>(label), x, y);
+}
 
-   LOG_DEBUG(coreLogger_) << "Will start absolute move of " << label <<
-      " to position (" << std::fixed << std::setprecision(3) << x << ", " <<
+/**
+ * Sets the position of the XY stage in microns.
+ * @param xyStage  the XY stage device handle
+ * @param x        the X axis position in microns
+ * @param y        the Y axis position in microns
+ */
+void CMMCore::setXYPosition(const DeviceHandle& xyStage, double x, double y) throw (CMMError)
+{
+   setXYPosition(deviceManager_->GetDeviceOfType<XYStageInstance>(getDevice(xyStage)), x, y);
+}
+
+void CMMCore::setXYPosition(std::shared_ptr<XYStageInstance> pXYStage, double x, double y) throw (CMMError)
+{
+   LOG_DEBUG(coreLogger_) << "Will start absolute move of " << pXYStage->GetLabel() <<
+      " to position (" << std::fixed << std::setprecision(3) << x << ", " <<
       y << ") um";
 
    mm::DeviceModuleLockGuard guard(pXYStage);
@@ -1508,10 +1988,23 @@ void CMMCore::setRelativeXYPosition(double dx, double dy) throw (CMMError) {
  */
 void CMMCore::getXYPosition(const char* label, double& x, double& y) throw (CMMError)
 {
-   std::shared_ptr<XYStageInstance> pXYStage =
-      deviceManager_->GetDeviceOfType<XYStageInstance>(label);
+   getXYPosition(deviceManager_->GetDeviceOfType<XYStageInstance>(label), x, y);
+}
 
-   mm::DeviceModuleLockGuard guard(pXYStage);
+/**
+ * Obtains the current position of the XY stage in microns.
+ * @param xyStage      the stage device handle
+ * @param x            a return parameter yielding the X position in microns
+ * @param y            a return parameter yielding the Y position in microns
+ */
+void CMMCore::getXYPosition(const DeviceHandle& xyStage, double& x, double& y) throw (CMMError)
+{
+   getXYPosition(deviceManager_->GetDeviceOfType<XYStageInstance>(getDevice(xyStage)), x, y);
+}
+
+void CMMCore::getXYPosition(std::shared_ptr<XYStageInstance> pXYStage, double& x, double& y) throw (CMMError)
+{
+   mm::DeviceModuleLockGuard guard(pXYStage, mm::DeviceLock::Shared);
    int ret = pXYStage->GetPositionUm(x, y);
    if (ret != DEVICE_OK)
    {
@@ -1541,7 +2034,7 @@ double CMMCore::getXPosition(const char* label) throw (CMMError)
    std::shared_ptr<XYStageInstance> pXYStage =
       deviceManager_->GetDeviceOfType<XYStageInstance>(label);
 
-   mm::DeviceModuleLockGuard guard(pXYStage);
+   mm::DeviceModuleLockGuard guard(pXYStage, mm::DeviceLock::Shared);
    double x, y;
    int ret = pXYStage->GetPositionUm(x, y);
    if (ret != DEVICE_OK)
@@ -1574,7 +2067,7 @@ double CMMCore::getYPosition(const char* label) throw (CMMError)
    std::shared_ptr<XYStageInstance> pXYStage =
       deviceManager_->GetDeviceOfType<XYStageInstance>(label);
 
-   mm::DeviceModuleLockGuard guard(pXYStage);
+   mm::DeviceModuleLockGuard guard(pXYStage, mm::DeviceLock::Shared);
    double x, y;
    int ret = pXYStage->GetPositionUm(x, y);
    if (ret != DEVICE_OK)
@@ -2089,13 +2582,10 @@ void CMMCore::loadExposureSequence(const char* cameraLabel, std::vector<double>
    if (ret != DEVICE_OK)
       throw CMMError(getDeviceErrorText(ret, pCamera));
 
-   std::vector<double>::iterator it;
-   for ( it=exposureTime_ms.begin() ; it < exposureTime_ms.end(); it++ )
-   {
-      ret = pCamera->AddToExposureSequence(*it);
-      if (ret != DEVICE_OK)
-         throw CMMError(getDeviceErrorText(ret, pCamera));
-   }
+   ret = pCamera->AddArrayToExposureSequence(exposureTime_ms.data(),
+         static_cast<long>(exposureTime_ms.size()));
+   if (ret != DEVICE_OK)
+      throw CMMError(getDeviceErrorText(ret, pCamera));
 
    ret = pCamera->SendExposureSequence();
    if (ret != DEVICE_OK)
@@ -2216,13 +2706,10 @@ void CMMCore::loadStageSequence(const char* label, std::vector<double> positionS
    if (ret != DEVICE_OK)
       throw CMMError(getDeviceErrorText(ret, pStage));
 
-   std::vector<double>::iterator it;
-   for ( it=positionSequence.begin() ; it < positionSequence.end(); it++ )
-   {
-      ret = pStage->AddToStageSequence(*it);
-      if (ret != DEVICE_OK)
-         throw CMMError(getDeviceErrorText(ret, pStage));
-   }
+   ret = pStage->AddArrayToStageSequence(positionSequence.data(),
+         static_cast<long>(positionSequence.size()));
+   if (ret != DEVICE_OK)
+      throw CMMError(getDeviceErrorText(ret, pStage));
 
    ret = pStage->SendStageSequence();
    if (ret != DEVICE_OK)
@@ -2351,14 +2838,11 @@ void CMMCore::loadXYStageSequence(const char* label,
    if (ret != DEVICE_OK)
       throw CMMError(getDeviceErrorText(ret, pStage));
 
-   std::vector<double>::iterator itx, ity;
-   for ( itx=xSequence.begin(), ity=ySequence.begin() ;
-         (itx < xSequence.end()) && (ity < ySequence.end()); itx++, ity++)
-   {
-      ret = pStage->AddToXYStageSequence(*itx, *ity);
-      if (ret != DEVICE_OK)
-         throw CMMError(getDeviceErrorText(ret, pStage));
-   }
+   // Extra positions in the longer sequence are ignored
+   ret = pStage->AddArrayToXYStageSequence(xSequence.data(), ySequence.data(),
+         static_cast<long>(std::min(xSequence.size(), ySequence.size())));
+   if (ret != DEVICE_OK)
+      throw CMMError(getDeviceErrorText(ret, pStage));
 
    ret = pStage->SendXYStageSequence();
    if (ret != DEVICE_OK)
@@ -2372,6 +2856,7 @@ void CMMCore::loadXYStageSequence(const char* label,
  */
 void CMMCore::snapImage() throw (CMMError)
 {
+   mm::TraceSpan span("snapImage", "core");
    std::shared_ptr<CameraInstance> camera = currentCameraDevice_.lock();
    if (camera)
    {
@@ -2588,7 +3073,7 @@ bool CMMCore::getShutterOpen(const char* shutterLabel) throw (CMMError)
    bool state = true; // default open
    if (pShutter)
    {
-      mm::DeviceModuleLockGuard guard(pShutter);
+      mm::DeviceModuleLockGuard guard(pShutter, mm::DeviceLock::Shared);
       int ret = pShutter->GetOpen(state);
       if (ret != DEVICE_OK)
       {
@@ -2740,7 +3225,7 @@ long CMMCore::getImageBufferSize()
 {
    std::shared_ptr<CameraInstance> camera = currentCameraDevice_.lock();
    if (camera) {
-      mm::DeviceModuleLockGuard guard(camera);
+      mm::DeviceModuleLockGuard guard(camera, mm::DeviceLock::Shared);
       return camera->GetImageBufferSize();
    }
    else
@@ -2759,6 +3244,7 @@ long CMMCore::getImageBufferSize()
  */
 void CMMCore::startSequenceAcquisition(long numImages, double intervalMs, bool stopOnOverflow) throw (CMMError)
 {
+   mm::TraceSpan span("startSequenceAcquisition", "core");
    // scope for the thread guard
    {
       MMThreadGuard g(*pPostedErrorsLock_);
@@ -2784,6 +3270,7 @@ void CMMCore::startSequenceAcquisition(long numImages, double intervalMs, bool s
 			}
 			cbuf_->Clear();
          mm::DeviceModuleLockGuard guard(camera);
+         cacheStatisticsBitDepth(camera);
 
          LOG_DEBUG(coreLogger_) << "Will start sequence acquisition from default camera";
 			int nRet = camera->StartSequenceAcquisition(numImages, intervalMs, stopOnOverflow);
@@ -2813,6 +3300,7 @@ void CMMCore::startSequenceAcquisition(long numImages, double intervalMs, bool s
  */
 void CMMCore::startSequenceAcquisition(const char* label, long numImages, double intervalMs, bool stopOnOverflow) throw (CMMError)
 {
+   mm::TraceSpan span("startSequenceAcquisition", "core");
    std::shared_ptr<CameraInstance> pCam =
       deviceManager_->GetDeviceOfType<CameraInstance>(label);
 
@@ -2828,6 +3316,7 @@ void CMMCore::startSequenceAcquisition(const char* label, long numImages, double
    }
    cbuf_->Clear();
 	
+   cacheStatisticsBitDepth(pCam);
    LOG_DEBUG(coreLogger_) <<
       "Will start sequence acquisition from camera " << label;
    int nRet = pCam->StartSequenceAcquisition(numImages, intervalMs, stopOnOverflow);
@@ -2913,6 +3402,7 @@ void CMMCore::stopSequenceAcquisition(const char* label) throw (CMMError)
  */
 void CMMCore::startContinuousSequenceAcquisition(double intervalMs) throw (CMMError)
 {
+   mm::TraceSpan span("startContinuousSequenceAcquisition", "core");
    std::shared_ptr<CameraInstance> camera = currentCameraDevice_.lock();
    if (camera)
    {
@@ -2930,6 +3420,7 @@ void CMMCore::startContinuousSequenceAcquisition(double intervalMs) throw (CMMEr
          throw CMMError(getCoreErrorText(MMERR_CircularBufferFailedToInitialize).c_str(), MMERR_CircularBufferFailedToInitialize);
       }
       cbuf_->Clear();
+      cacheStatisticsBitDepth(camera);
       LOG_DEBUG(coreLogger_) << "Will start continuous sequence acquisition from current camera";
       int nRet = camera->StartSequenceAcquisition(intervalMs);
       if (nRet != DEVICE_OK)
@@ -2978,7 +3469,7 @@ bool CMMCore::isSequenceRunning() throw ()
    std::shared_ptr<CameraInstance> camera = currentCameraDevice_.lock();
    if (camera)
    {
-      mm::DeviceModuleLockGuard guard(camera);
+      mm::DeviceModuleLockGuard guard(camera, mm::DeviceLock::Shared);
 	    return camera->IsCapturing();
    }
    else
@@ -2996,7 +3487,7 @@ bool CMMCore::isSequenceRunning(const char* label) throw (CMMError)
    std::shared_ptr<CameraInstance> pCam =
       deviceManager_->GetDeviceOfType<CameraInstance>(label);
 
-   mm::DeviceModuleLockGuard guard(pCam);
+   mm::DeviceModuleLockGuard guard(pCam, mm::DeviceLock::Shared);
    return pCam->IsCapturing();
 };
 
@@ -3031,122 +3522,829 @@ void* CMMCore::getLastImage() throw (CMMError)
    }
 }
 
-void* CMMCore::getLastImageMD(unsigned channel, unsigned slice, Metadata& md) const throw (CMMError)
+void* CMMCore::getLastImageMD(unsigned channel, unsigned slice, Metadata& md) const throw (CMMError)
+{
+   // Slices have never been implemented on the device interface side
+   if (slice != 0)
+      throw CMMError("Slice must be 0");
+
+   const mm::ImgBuffer* pBuf = cbuf_->GetTopImageBuffer(channel);
+   if (pBuf != 0)
+   {
+      md = pBuf->GetMetadata();
+      return const_cast<unsigned char*>(pBuf->GetPixels());
+   }
+   else
+      throw CMMError(getCoreErrorText(MMERR_CircularBufferEmpty).c_str(), MMERR_CircularBufferEmpty);
+}
+
+/**
+ * Returns a pointer to the pixels of the image that was last inserted into the circular buffer
+ * Also provides all metadata associated with that image
+ *
+ * Supported data types are byte (8 bits per pixel, 1 component), short 
+ * (16 bits per pixel, 1 component), float (32 bits per pixel, 1 component, not
+ * supported by the UI yet), RGB_32 (8 bits per component, 4 components), RGB_64
+ * (16 bits per component, 4 components, not supported by UI yet).  
+ * RGB buffers are expected to be in big endian ARGB format (ARGB8888), which means that
+ * on little endian the format is BGRA888 
+ * (see: https://en.wikipedia.org/wiki/RGBA_color_model).
+ */
+void* CMMCore::getLastImageMD(Metadata& md) const throw (CMMError)
+{
+   return getLastImageMD(0, 0, md);
+}
+
+/**
+ * Returns a pointer to the pixels of the image that was inserted n images ago
+ * Also provides all metadata associated with that image
+ *
+ * Supported data types are byte (8 bits per pixel, 1 component), short 
+ * (16 bits per pixel, 1 component), float (32 bits per pixel, 1 component, not
+ * supported by the UI yet), RGB_32 (8 bits per component, 4 components), RGB_64
+ * (16 bits per component, 4 components, not supported by UI yet).  
+ * RGB buffers are expected to be in big endian ARGB format (ARGB8888), which means that
+ * on little endian the format is BGRA888 
+ * (see: https://en.wikipedia.org/wiki/RGBA_color_model).
+ */
+void* CMMCore::getNBeforeLastImageMD(unsigned long n, Metadata& md) const throw (CMMError)
+{
+   const mm::ImgBuffer* pBuf = cbuf_->GetNthFromTopImageBuffer(n);
+   if (pBuf != 0)
+   {
+      md = pBuf->GetMetadata();
+      return const_cast<unsigned char*>(pBuf->GetPixels());
+   }
+   else
+      throw CMMError(getCoreErrorText(MMERR_CircularBufferEmpty).c_str(), MMERR_CircularBufferEmpty);
+}
+
+/**
+ * Gets and removes the next image from the circular buffer.
+ * Returns 0 if the buffer is empty.
+ *
+ * Supported data types are byte (8 bits per pixel, 1 component), short 
+ * (16 bits per pixel, 1 component), float (32 bits per pixel, 1 component, not
+ * supported by the UI yet), RGB_32 (8 bits per component, 4 components), RGB_64
+ * (16 bits per component, 4 components, not supported by UI yet).  
+ * RGB buffers are expected to be in big endian ARGB format (ARGB8888), which means that
+ * on little endian the format is BGRA888 
+ * (see: https://en.wikipedia.org/wiki/RGBA_color_model).
+ */
+void* CMMCore::popNextImage() throw (CMMError)
+{
+   unsigned char* pBuf = const_cast<unsigned char*>(cbuf_->GetNextImage());
+   if (pBuf != 0)
+      return pBuf;
+   else
+      throw CMMError(getCoreErrorText(MMERR_CircularBufferEmpty).c_str(), MMERR_CircularBufferEmpty);
+}
+
+/**
+ * Gets and removes the next image (and metadata) from the circular buffer
+ * channel indicates which cameraChannel image should be retrieved.
+ * slice has not been implement and should always be 0
+ */
+void* CMMCore::popNextImageMD(unsigned channel, unsigned slice, Metadata& md) throw (CMMError)
+{
+   // Slices have never been implemented on the device interface side
+   if (slice != 0)
+      throw CMMError("Slice must be 0");
+
+   const mm::ImgBuffer* pBuf = cbuf_->GetNextImageBuffer(channel);
+   if (pBuf != 0)
+   {
+      md = pBuf->GetMetadata();
+      return const_cast<unsigned char*>(pBuf->GetPixels());
+   }
+   else
+      throw CMMError(getCoreErrorText(MMERR_CircularBufferEmpty).c_str(), MMERR_CircularBufferEmpty);
+}
+
+/**
+ * Gets and removes the next image (and metadata) from the circular buffer
+ */
+void* CMMCore::popNextImageMD(Metadata& md) throw (CMMError)
+{
+   return popNextImageMD(0, 0, md);
+}
+
+/**
+ * Returns the size in bytes of the image that popNextImage() would return,
+ * without removing it from the circular buffer.
+ *
+ * Images in the circular buffer may differ in size from the current camera's
+ * image (see getImageBufferSize()). With a single consumer popping images,
+ * this lets it check its destination before taking the image out.
+ */
+long CMMCore::getNextImageBufferSize() throw (CMMError)
+{
+   std::size_t size = cbuf_->GetNextImageBufferSize();
+   if (size == 0)
+      throw CMMError(getCoreErrorText(MMERR_CircularBufferEmpty).c_str(), MMERR_CircularBufferEmpty);
+   return static_cast<long>(size);
+}
+
+/**
+ * Returns the image that was last inserted into the circular buffer by the
+ * given camera, and its metadata, provided that it has not been popped yet.
+ *
+ * Images in the circular buffer may differ in size and pixel type; use the
+ * Width, Height and PixelType tags of the metadata to interpret the pixels.
+ *
+ * @param cameraLabel  the camera whose images are wanted (for a Multi Camera,
+ *                     one of its physical cameras)
+ */
+void* CMMCore::getLastImageMD(const char* cameraLabel, Metadata& md) const throw (CMMError)
+{
+   std::shared_ptr<DeviceInstance> camera =
+      deviceManager_->GetDevice(cameraLabel);
+   const mm::ImgBuffer* pBuf = cbuf_->GetTopImageBuffer(0, camera->GetRawPtr());
+   if (pBuf != 0)
+   {
+      md = pBuf->GetMetadata();
+      return const_cast<unsigned char*>(pBuf->GetPixels());
+   }
+   else
+      throw CMMError(getCoreErrorText(MMERR_CircularBufferEmpty).c_str(), MMERR_CircularBufferEmpty);
+}
+
+/**
+ * Gets and removes the oldest image inserted by the given camera (and its
+ * metadata) from the circular buffer. Images of other cameras are left in
+ * place; popNextImageMD(Metadata&) still returns images of all cameras in the
+ * order they were inserted.
+ *
+ * Images in the circular buffer may differ in size and pixel type; use the
+ * Width, Height and PixelType tags of the metadata to interpret the pixels.
+ *
+ * @param cameraLabel  the camera whose images are wanted (for a Multi Camera,
+ *                     one of its physical cameras)
+ */
+void* CMMCore::popNextImageMD(const char* cameraLabel, Metadata& md) throw (CMMError)
+{
+   std::shared_ptr<DeviceInstance> camera =
+      deviceManager_->GetDevice(cameraLabel);
+   const mm::ImgBuffer* pBuf = cbuf_->GetNextImageBuffer(0, camera->GetRawPtr());
+   if (pBuf != 0)
+   {
+      md = pBuf->GetMetadata();
+      return const_cast<unsigned char*>(pBuf->GetPixels());
+   }
+   else
+      throw CMMError(getCoreErrorText(MMERR_CircularBufferEmpty).c_str(), MMERR_CircularBufferEmpty);
+}
+
+/**
+ * Gets and removes the next image (and metadata) from the circular buffer,
+ * without copying it: the image's memory is not reused by the buffer, and
+ * stays valid, until it is released with releasePinnedImage().
+ *
+ * This allows a consumer (such as a Java wrapper that maps the pixels into
+ * a direct buffer) to use images without allocating or copying memory for
+ * each one. Pinned images count against the circular buffer's memory
+ * footprint until released, and the buffer reuses memory in insertion
+ * order, so images should be released promptly or the buffer overflows.
+ *
+ * Use the Width, Height and PixelType tags of the metadata to interpret the
+ * pixels.
+ *
+ * @return  the ID of the pinned image, for getPinnedImagePixels(),
+ *          getPinnedImageBufferSize() and releasePinnedImage()
+ */
+long CMMCore::popNextImagePinned(Metadata& md) throw (CMMError)
+{
+   return addPinnedImage(cbuf_->PopNextImagePinned(0), md);
+}
+
+/**
+ * Like popNextImagePinned(Metadata&), for the oldest image of the given
+ * camera.
+ *
+ * @param cameraLabel  the camera whose images are wanted (for a Multi Camera,
+ *                     one of its physical cameras)
+ */
+long CMMCore::popNextImagePinned(const char* cameraLabel, Metadata& md) throw (CMMError)
+{
+   std::shared_ptr<DeviceInstance> camera =
+      deviceManager_->GetDevice(cameraLabel);
+   return addPinnedImage(cbuf_->PopNextImagePinned(0, camera->GetRawPtr()), md);
+}
+
+/**
+ * Returns the pixels of a pinned image; they stay valid until the image is
+ * released.
+ */
+void* CMMCore::getPinnedImagePixels(long pinId) throw (CMMError)
+{
+   return const_cast<unsigned char*>(getPinnedImage(pinId)->GetImage().GetPixels());
+}
+
+/**
+ * Returns the size, in bytes, of the pixels of a pinned image.
+ */
+long CMMCore::getPinnedImageBufferSize(long pinId) throw (CMMError)
+{
+   const mm::ImgBuffer& image = getPinnedImage(pinId)->GetImage();
+   return static_cast<long>(image.Width() * image.Height() * image.Depth());
+}
+
+/**
+ * Releases a pinned image; its pixels must no longer be used.
+ */
+void CMMCore::releasePinnedImage(long pinId) throw (CMMError)
+{
+   std::shared_ptr<PinnedImage> image;
+   {
+      MMThreadGuard guard(pinnedImagesLock_);
+      std::map<long, std::shared_ptr<PinnedImage> >::iterator it =
+         pinnedImages_.find(pinId);
+      if (it == pinnedImages_.end())
+         throw CMMError("No pinned image with ID " + ToString(pinId));
+      image = it->second;
+      pinnedImages_.erase(it);
+   }
+   // Freed here, outside of the lock
+}
+
+/**
+ * Returns the number of pinned images that have not been released.
+ */
+long CMMCore::getPinnedImageCount()
+{
+   MMThreadGuard guard(pinnedImagesLock_);
+   return static_cast<long>(pinnedImages_.size());
+}
+
+/**
+ * Returns the complete tags of an image as a JSON object, in a single call.
+ *
+ * The tags are (optionally) those of the system state cache, then those of
+ * the metadata, then, for keys that neither has, the current camera's image
+ * format (BitDepth, Width, Height, PixelType, ROI, Binning), the pixel size
+ * (PixelSizeUm, PixelSizeAffine), the current channel (Channel), and default
+ * indices (Frame, Position, Slice, ChannelIndex and their variants). Where
+ * the same key appears more than once, the earlier value wins, so that the
+ * indices and format recorded with an image (e.g. by an acquisition, or for
+ * an image of another camera) are kept.
+ *
+ * This is what the Java wrapper uses to create TaggedImages.
+ *
+ * @param md                       metadata of the image
+ * @param includeSystemStateCache  whether to include the system state cache
+ */
+std::string CMMCore::getImageTagsJSON(const Metadata& md,
+      bool includeSystemStateCache) throw (CMMError)
+{
+   // The writer keeps the first value of each key, so add the tags in
+   // order of precedence
+   mm::ImageTagsJSONWriter tags;
+   std::shared_ptr<const mm::JSONFragment> stateCache;
+   if (includeSystemStateCache)
+   {
+      stateCache = getSystemStateCacheJSONFragment();
+      tags.AddFragment(*stateCache);
+   }
+   tags.AddMetadata(md);
+
+   // Defaults for the keys that the image does not have
+   tags.AddInteger("BitDepth", getImageBitDepth());
+   tags.AddDouble("PixelSizeUm", getPixelSizeUm(true));
+
+   std::string affine;
+   std::vector<double> aff = getPixelSizeAffine(true);
+   if (aff.size() == 6)
+   {
+      for (size_t i = 0; i < aff.size(); ++i)
+      {
+         if (i > 0)
+            affine += ';';
+         affine += mm::ToShortestString(aff[i]);
+      }
+   }
+   tags.AddString("PixelSizeAffine", affine);
+
+   int x, y, xSize, ySize;
+   getROI(x, y, xSize, ySize);
+   tags.AddString("ROI", ToString(x) + "-" + ToString(y) + "-" +
+         ToString(xSize) + "-" + ToString(ySize));
+   tags.AddInteger("Width", getImageWidth());
+   tags.AddInteger("Height", getImageHeight());
+
+   const char* pixelType = "";
+   switch (getBytesPerPixel())
+   {
+      case 1: pixelType = "GRAY8"; break;
+      case 2: pixelType = "GRAY16"; break;
+      case 4: pixelType = getNumberOfComponents() == 1 ? "GRAY32" : "RGB32"; break;
+      case 8: pixelType = "RGB64"; break;
+   }
+   tags.AddString("PixelType", pixelType);
+
+   tags.AddInteger("Frame", 0);
+   tags.AddInteger("FrameIndex", 0);
+   tags.AddString("Position", "Default");
+   tags.AddInteger("PositionIndex", 0);
+   tags.AddInteger("Slice", 0);
+   tags.AddInteger("SliceIndex", 0);
+   std::string channel = getCurrentConfigFromCache(
+         getPropertyFromCache(MM::g_Keyword_CoreDevice,
+            MM::g_Keyword_CoreChannelGroup).c_str());
+   if (channel.empty())
+      channel = "Default";
+   tags.AddString("Channel", channel);
+   tags.AddInteger("ChannelIndex", 0);
+
+   try
+   {
+      std::string camera = getCameraDevice();
+      tags.AddString("Binning",
+            getProperty(camera.c_str(), MM::g_Keyword_Binning));
+   }
+   catch (const CMMError&)
+   {
+      // No camera, or no binning
+   }
+
+   return tags.Finish();
+}
+
+long CMMCore::addPinnedImage(std::shared_ptr<PinnedImage> image, Metadata& md) throw (CMMError)
+{
+   if (!image)
+      throw CMMError(getCoreErrorText(MMERR_CircularBufferEmpty).c_str(), MMERR_CircularBufferEmpty);
+   md = image->GetImage().GetMetadata();
+
+   MMThreadGuard guard(pinnedImagesLock_);
+   do
+   {
+      if (++lastPinId_ <= 0)
+         lastPinId_ = 1;
+   } while (pinnedImages_.count(lastPinId_) > 0);
+   pinnedImages_[lastPinId_] = image;
+   return lastPinId_;
+}
+
+std::shared_ptr<PinnedImage> CMMCore::getPinnedImage(long pinId) throw (CMMError)
+{
+   MMThreadGuard guard(pinnedImagesLock_);
+   std::map<long, std::shared_ptr<PinnedImage> >::const_iterator it =
+      pinnedImages_.find(pinId);
+   if (it == pinnedImages_.end())
+      throw CMMError("No pinned image with ID " + ToString(pinId));
+   return it->second;
+}
+
+/**
+ * Removes all images from the circular buffer.
+ *
+ * It is rarely necessary to call this directly since starting a sequence
+ * acquisition or changing the ROI will always clear the buffer.
+ */
+void CMMCore::clearCircularBuffer() throw (CMMError)
+{
+   cbuf_->Clear();
+}
+
+/**
+ * Enables or disables lossless compression of the images held in the
+ * circular buffer.
+ *
+ * While enabled, images are compressed (in parallel) as they are inserted,
+ * and take only their compressed size out of the buffer's memory footprint,
+ * so that sparse or dim images allow longer sequences before the buffer
+ * overflows. Images are decompressed when they are retrieved. The setting
+ * applies to images inserted from now on, and is kept when the memory
+ * footprint is changed.
+ *
+ * Compression costs CPU time on the camera's insert thread; use
+ * getCircularBufferCompressionStatistics() to check that it keeps up.
+ */
+void CMMCore::setCircularBufferCompression(bool enable) throw (CMMError)
+{
+   cbuf_->SetCompression(enable);
+   LOG_DEBUG(coreLogger_) << "Circular buffer compression " <<
+      (enable ? "enabled" : "disabled");
+}
+
+bool CMMCore::isCircularBufferCompressionEnabled() const
+{
+   return cbuf_ && cbuf_->IsCompressionEnabled();
+}
+
+/**
+ * Returns the compression statistics since compression was enabled, as a
+ * tab-separated table with the header "Statistic\tValue": the numbers of
+ * images compressed and decompressed, the raw and compressed byte counts,
+ * the compression ratio, and the compression and decompression throughput
+ * in MB of raw pixels per second of processing.
+ */
+std::string CMMCore::getCircularBufferCompressionStatistics() const
+{
+   if (!cbuf_)
+      return std::string();
+   return CircularBuffer::FormatCompressionStatistics(
+         cbuf_->GetCompressionStatistics());
+}
+
+/**
+ * Enables or disables per-image statistics.
+ *
+ * While enabled, the statistics of each 8- or 16-bit grayscale image are
+ * computed as it is inserted into the circular buffer (in the same pass as
+ * the copy into the buffer) and added to its metadata, as returned by
+ * getLastImageMD(), popNextImageMD() and their variants: the minimum
+ * (Statistics-Min), maximum (Statistics-Max) and mean (Statistics-Mean)
+ * pixel values, the number of saturated pixels (Statistics-Saturated; those
+ * at the maximum value for the camera's bit depth) and a histogram of
+ * histogramBins equal bins spanning that bit depth (Statistics-Histogram;
+ * space-separated counts). The setting applies to images inserted from now
+ * on, and is kept when the memory footprint is changed.
+ *
+ * @param enable            whether to compute statistics
+ * @param histogramBins     number of histogram bins, 1 to 65536 (ignored
+ *                          when disabling)
+ */
+void CMMCore::enableImageStatistics(bool enable, unsigned histogramBins) throw (CMMError)
+{
+   if (enable && (histogramBins < 1 || histogramBins > 65536))
+      throw CMMError("Histogram bin count must be between 1 and 65536");
+   cbuf_->SetFrameStatistics(enable ? histogramBins : 0);
+   std::shared_ptr<CameraInstance> camera = currentCameraDevice_.lock();
+   if (enable && camera)
+   {
+      mm::DeviceModuleLockGuard guard(camera, mm::DeviceLock::Shared);
+      cacheStatisticsBitDepth(camera);
+   }
+   LOG_DEBUG(coreLogger_) << "Image statistics " <<
+      (enable ? "enabled" : "disabled");
+}
+
+/**
+ * Caches the bit depth of a camera for the statistics of the images it
+ * inserts, so that it is not queried (without the camera's module lock) for
+ * each image. Called, with the module lock held, when statistics are
+ * enabled, when the camera is made the default camera and when a sequence
+ * acquisition is started; the images of cameras for which it has not been
+ * called (such as the physical cameras of a Multi Camera) get statistics
+ * over their full byte depth.
+ */
+void CMMCore::cacheStatisticsBitDepth(std::shared_ptr<CameraInstance> camera)
+{
+   if (!isImageStatisticsEnabled())
+      return;
+   unsigned bitDepth = camera->GetBitDepth();
+   MMThreadGuard guard(statisticsBitDepthsLock_);
+   statisticsBitDepths_[camera->GetRawPtr()] = bitDepth;
+}
+
+bool CMMCore::isImageStatisticsEnabled() const
+{
+   return cbuf_ && cbuf_->GetFrameStatisticsBins() > 0;
+}
+
+/**
+ * Starts writing every image inserted into the circular buffer to disk.
+ *
+ * Images are written on dedicated threads, as raw files with an index, in
+ * the given directory (which is created if it does not exist):
+ * <prefix>_00000.raw, <prefix>_00001.raw, ... hold the pixels, each image
+ * starting at a multiple of 4096 bytes; <prefix>_index.txt lists, for each
+ * image, the file, offset and size together with the image dimensions,
+ * camera, image number and elapsed time; <prefix>_summary.txt receives the
+ * statistics when streaming is stopped.
+ *
+ * Images are not copied when they are inserted: the writer threads copy
+ * them out of the circular buffer, whose memory for an image is reused only
+ * once the image has been both written and popped. The circular buffer thus
+ * remains available for display and for popping images, and overflows as
+ * usual if images are not popped (but see the overload with streamOnly).
+ * Whether images are dropped from the disk stream when the writer cannot
+ * keep up is set with setDiskStreamingOptions().
+ *
+ * @param directory  the directory to write to
+ * @param prefix     the prefix for the names of the files written
+ */
+void CMMCore::startDiskStreaming(const char* directory, const char* prefix) throw (CMMError)
+{
+   startDiskStreaming(directory, prefix, false);
+}
+
+/**
+ * Starts writing every image inserted into the circular buffer to disk,
+ * optionally without queueing the images for popping.
+ *
+ * With streamOnly, images go to disk only: they are not returned by
+ * popNextImage() and the like, and the memory of each is reused as soon as
+ * it has been written, so that an acquisition can be streamed without any
+ * consumer popping images. The circular buffer then only overflows if the
+ * disk does not keep up. Use the latest-frame mailbox (see
+ * enableLatestFrameMailbox()) to display images meanwhile.
+ *
+ * @param directory   the directory to write to
+ * @param prefix      the prefix for the names of the files written
+ * @param streamOnly  whether to write images to disk only
+ */
+void CMMCore::startDiskStreaming(const char* directory, const char* prefix,
+      bool streamOnly) throw (CMMError)
+{
+   if (!directory || !*directory)
+      throw CMMError("Null or empty directory");
+   if (!prefix || !*prefix)
+      throw CMMError("Null or empty prefix");
+   if (isDiskStreaming())
+      throw CMMError("Disk streaming is already running");
+
+   mm::DiskStreamWriter::Options options;
+   options.queueBytes = static_cast<size_t>(diskStreamQueueMB_) << 20;
+   options.writerThreads = diskStreamWriterThreads_;
+   options.blockWhenFull = diskStreamBlockWhenFull_;
+   diskStream_ = std::make_shared<mm::DiskStreamWriter>(directory, prefix,
+         options);
+   cbuf_->SetDiskStreamWriter(diskStream_, streamOnly);
+
+   LOG_INFO(coreLogger_) << "Started disk streaming to " << directory <<
+      " with prefix " << prefix << (streamOnly ? " (stream only)" : "");
+}
+
+/**
+ * Stops writing images to disk, after writing out all images already
+ * received. Does nothing if disk streaming is not running.
+ */
+void CMMCore::stopDiskStreaming() throw (CMMError)
+{
+   if (!isDiskStreaming())
+      return;
+
+   cbuf_->SetDiskStreamWriter(std::shared_ptr<mm::DiskStreamWriter>());
+   diskStream_->Stop();
+
+   mm::DiskStreamWriter::Statistics stats = diskStream_->GetStatistics();
+   LOG_INFO(coreLogger_) << "Stopped disk streaming: " <<
+      stats.framesWritten << " images written, " <<
+      stats.framesDropped << " dropped, " << stats.framesFailed << " failed";
+   if (!stats.lastError.empty())
+      LOG_ERROR(coreLogger_) << "Disk streaming error: " << stats.lastError;
+}
+
+/**
+ * Indicates whether images are being written to disk.
+ */
+bool CMMCore::isDiskStreaming() const
+{
+   return diskStream_ && !diskStream_->IsStopped();
+}
+
+/**
+ * Sets the options used by the next startDiskStreaming().
+ *
+ * @param queueMB        circular buffer memory that images waiting to be
+ *                       written may hold
+ * @param writerThreads  number of threads writing to disk
+ * @param blockWhenFull  when the queue is full, whether to keep queueing
+ *                       images, so that the circular buffer overflows if
+ *                       the disk does not keep up (true), or drop them from
+ *                       the disk stream (false)
+ */
+void CMMCore::setDiskStreamingOptions(unsigned queueMB,
+      unsigned writerThreads, bool blockWhenFull) throw (CMMError)
+{
+   if (queueMB < 1)
+      throw CMMError("Disk streaming queue must be at least 1 MB");
+   if (writerThreads < 1)
+      throw CMMError("Disk streaming needs at least one writer thread");
+   diskStreamQueueMB_ = queueMB;
+   diskStreamWriterThreads_ = writerThreads;
+   diskStreamBlockWhenFull_ = blockWhenFull;
+}
+
+/**
+ * Returns the statistics of the current (or last) disk streaming session,
+ * as a tab-separated table with a header line: images received, written,
+ * dropped (queue full) and failed (write error), bytes written, the longest
+ * write queue in images and in bytes, the elapsed time, the throughput and
+ * the last error. Empty if disk streaming has never been started.
+ */
+std::string CMMCore::getDiskStreamingStatistics() const
+{
+   if (!diskStream_)
+      return std::string();
+   return mm::DiskStreamWriter::FormatStatistics(diskStream_->GetStatistics());
+}
+
+/**
+ * Publishes every image inserted into the circular buffer to a POSIX
+ * shared-memory ring, so that other processes on this machine can read the
+ * images without copies or calls into the Core.
+ *
+ * The layout of the ring, and a reference reader in C, are given in
+ * SharedFrameRingFormat.h. The ring holds the most recent images, each with
+ * its size, pixel format, camera, image number and elapsed time; readers
+ * that fall behind detect lost images through sequence numbers, and are
+ * never waited for. Slots are sized for the current camera's images; larger
+ * images are skipped (and counted in the ring header).
+ *
+ * Not available on Windows.
+ *
+ * @param name       the shared-memory object name, such as "/mmcore-frames";
+ *                   an existing object of the same name is replaced
+ * @param slotCount  the number of images the ring holds
+ */
+void CMMCore::startSharedFrameRing(const char* name, unsigned slotCount) throw (CMMError)
+{
+   if (!name)
+      throw CMMError("Null shared memory name");
+   if (sharedRing_)
+      throw CMMError("A shared frame ring is already active");
+
+   std::size_t maxPixelBytes = 0;
+   std::shared_ptr<CameraInstance> camera = currentCameraDevice_.lock();
+   if (camera)
+   {
+      mm::DeviceModuleLockGuard guard(camera);
+      maxPixelBytes = static_cast<std::size_t>(camera->GetImageWidth()) *
+         camera->GetImageHeight() * camera->GetImageBytesPerPixel();
+   }
+   if (maxPixelBytes == 0)
+      throw CMMError(getCoreErrorText(MMERR_CameraNotAvailable).c_str(),
+            MMERR_CameraNotAvailable);
+
+   sharedRing_ = std::make_shared<mm::SharedFrameRingWriter>(name, slotCount,
+         maxPixelBytes);
+   cbuf_->SetSharedFrameRing(sharedRing_);
+   LOG_INFO(coreLogger_) << "Publishing images to shared memory " << name <<
+      " (" << slotCount << " slots of " << maxPixelBytes << " bytes)";
+}
+
+/**
+ * Stops publishing images to shared memory and removes the ring. Readers
+ * that still have it mapped see it marked closed.
+ */
+void CMMCore::stopSharedFrameRing()
+{
+   if (!sharedRing_)
+      return;
+   cbuf_->SetSharedFrameRing(std::shared_ptr<mm::SharedFrameRingWriter>());
+   LOG_INFO(coreLogger_) << "Stopped publishing images to shared memory " <<
+      sharedRing_->GetName() << ": " << sharedRing_->GetPublishedCount() <<
+      " published, " << sharedRing_->GetSkippedCount() << " skipped";
+   sharedRing_.reset();
+}
+
+/**
+ * Indicates whether images are being published to a shared-memory ring.
+ */
+bool CMMCore::isSharedFrameRingActive() const
+{
+   return static_cast<bool>(sharedRing_);
+}
+
+/**
+ * Enables or disables the latest-frame mailbox, from which live display can
+ * read the newest image without consuming images from the circular buffer
+ * or contending for its locks.
+ *
+ * While enabled, every image inserted into the circular buffer is also
+ * published to the mailbox, replacing the previous one. Images are not
+ * copied (unless the buffer compresses them): the mailbox refers to their
+ * memory in the circular buffer, which is therefore not reused for new
+ * images until the mailbox and its readers have let go of it.
+ *
+ * Readers get the newest complete image (all its channels, with their
+ * metadata) through getLatestFrame(), or, from Java, getLatestImageInto()
+ * and getLatestPreviewInto(); they never wait for the camera thread, nor it
+ * for them.
+ *
+ * Optionally, a preview of each image, binned (by averaging) so that its
+ * width and height are at most previewMaxSize, is computed on the camera
+ * thread in one pass over the pixels. Previews are made of 8- and 16-bit
+ * grayscale and 32-bit RGB images; other images are their own preview.
+ *
+ * Re-enabling replaces the mailbox (and its contents).
+ *
+ * @param enable          whether to keep the newest image in the mailbox
+ * @param previewMaxSize  largest preview width and height, or 0 for no
+ *                        preview (ignored when disabling)
+ */
+void CMMCore::enableLatestFrameMailbox(bool enable, unsigned previewMaxSize)
+{
+   std::shared_ptr<mm::LatestFrameMailbox> mailbox;
+   if (enable)
+      mailbox = std::make_shared<mm::LatestFrameMailbox>(previewMaxSize);
+   cbuf_->SetLatestFrameMailbox(mailbox);
+   std::atomic_store(&latestFrames_, mailbox);
+   LOG_DEBUG(coreLogger_) << "Latest-frame mailbox " <<
+      (enable ? "enabled" : "disabled");
+}
+
+bool CMMCore::isLatestFrameMailboxEnabled() const
+{
+   return static_cast<bool>(std::atomic_load(&latestFrames_));
+}
+
+/**
+ * Returns the number of images that have passed through the latest-frame
+ * mailbox since it was enabled (0 if it is disabled). Live display can
+ * compare this with the count it last displayed to tell whether there is a
+ * new image.
+ */
+long long CMMCore::getLatestFrameCount() const
 {
-   // Slices have never been implemented on the device interface side
-   if (slice != 0)
-      throw CMMError("Slice must be 0");
-
-   const mm::ImgBuffer* pBuf = cbuf_->GetTopImageBuffer(channel);
-   if (pBuf != 0)
-   {
-      md = pBuf->GetMetadata();
-      return const_cast<unsigned char*>(pBuf->GetPixels());
-   }
-   else
-      throw CMMError(getCoreErrorText(MMERR_CircularBufferEmpty).c_str(), MMERR_CircularBufferEmpty);
+   std::shared_ptr<mm::LatestFrameMailbox> mailbox =
+      std::atomic_load(&latestFrames_);
+   return mailbox ? static_cast<long long>(mailbox->GetPublishedCount()) : 0;
 }
 
 /**
- * Returns a pointer to the pixels of the image that was last inserted into the circular buffer
- * Also provides all metadata associated with that image
+ * Returns the newest image in the latest-frame mailbox. The returned frame
+ * is never modified, and stays valid for as long as the caller holds it;
+ * meanwhile its memory in the circular buffer is not reused, so callers
+ * should not hold on to frames for long.
  *
- * Supported data types are byte (8 bits per pixel, 1 component), short 
- * (16 bits per pixel, 1 component), float (32 bits per pixel, 1 component, not
- * supported by the UI yet), RGB_32 (8 bits per component, 4 components), RGB_64
- * (16 bits per component, 4 components, not supported by UI yet).  
- * RGB buffers are expected to be in big endian ARGB format (ARGB8888), which means that
- * on little endian the format is BGRA888 
- * (see: https://en.wikipedia.org/wiki/RGBA_color_model).
+ * Not available from Java; use getLatestImageInto() and
+ * getLatestPreviewInto() there.
  */
-void* CMMCore::getLastImageMD(Metadata& md) const throw (CMMError)
+std::shared_ptr<const mm::LatestFrame> CMMCore::getLatestFrame() const throw (CMMError)
 {
-   return getLastImageMD(0, 0, md);
+   std::shared_ptr<mm::LatestFrameMailbox> mailbox =
+      std::atomic_load(&latestFrames_);
+   if (!mailbox)
+      throw CMMError("The latest-frame mailbox is not enabled");
+   std::shared_ptr<const mm::LatestFrame> frame = mailbox->GetLatest();
+   if (!frame)
+      throw CMMError(getCoreErrorText(MMERR_CircularBufferEmpty).c_str(),
+            MMERR_CircularBufferEmpty);
+   return frame;
 }
 
 /**
- * Returns a pointer to the pixels of the image that was inserted n images ago
- * Also provides all metadata associated with that image
+ * Runs a multi-dimensional acquisition on a Core thread, taking images with
+ * the current camera into the circular buffer. Returns as soon as the
+ * acquisition has started; images are retrieved with popNextImage() and
+ * related functions as for sequence acquisitions.
  *
- * Supported data types are byte (8 bits per pixel, 1 component), short 
- * (16 bits per pixel, 1 component), float (32 bits per pixel, 1 component, not
- * supported by the UI yet), RGB_32 (8 bits per component, 4 components), RGB_64
- * (16 bits per component, 4 components, not supported by UI yet).  
- * RGB buffers are expected to be in big endian ARGB format (ARGB8888), which means that
- * on little endian the format is BGRA888 
- * (see: https://en.wikipedia.org/wiki/RGBA_color_model).
+ * The images of each time point and XY position are taken as one hardware
+ * sequence when the devices allow it: Z slices through a stage sequence,
+ * and channels through property and exposure sequences, with the camera
+ * running a sequence acquisition of all the images. Otherwise the images are
+ * taken in hardware sequences along the inner axis (for example, one Z stack
+ * per channel), or else one at a time by setting the devices and snapping.
+ * A time series of single images becomes one camera sequence acquisition at
+ * the plan's interval. describeAcquisition() shows how a plan will be run.
+ *
+ * Each image is tagged with FrameIndex, PositionIndex, ChannelIndex and
+ * SliceIndex (0 for axes the plan does not have), and with Channel and
+ * ZPositionUm where the plan has channels or Z slices.
+ *
+ * The circular buffer is initialized and cleared when the acquisition
+ * starts.
+ *
+ * @param plan  the acquisition to run
  */
-void* CMMCore::getNBeforeLastImageMD(unsigned long n, Metadata& md) const throw (CMMError)
+void CMMCore::startAcquisition(const AcquisitionPlan& plan) throw (CMMError)
 {
-   const mm::ImgBuffer* pBuf = cbuf_->GetNthFromTopImageBuffer(n);
-   if (pBuf != 0)
-   {
-      md = pBuf->GetMetadata();
-      return const_cast<unsigned char*>(pBuf->GetPixels());
-   }
-   else
-      throw CMMError(getCoreErrorText(MMERR_CircularBufferEmpty).c_str(), MMERR_CircularBufferEmpty);
+   acqEngine_->Start(plan);
 }
 
 /**
- * Gets and removes the next image from the circular buffer.
- * Returns 0 if the buffer is empty.
- *
- * Supported data types are byte (8 bits per pixel, 1 component), short 
- * (16 bits per pixel, 1 component), float (32 bits per pixel, 1 component, not
- * supported by the UI yet), RGB_32 (8 bits per component, 4 components), RGB_64
- * (16 bits per component, 4 components, not supported by UI yet).  
- * RGB buffers are expected to be in big endian ARGB format (ARGB8888), which means that
- * on little endian the format is BGRA888 
- * (see: https://en.wikipedia.org/wiki/RGBA_color_model).
+ * Stops the running acquisition and waits for it to end. Does nothing if no
+ * acquisition is running.
  */
-void* CMMCore::popNextImage() throw (CMMError)
+void CMMCore::stopAcquisition() throw (CMMError)
 {
-   unsigned char* pBuf = const_cast<unsigned char*>(cbuf_->GetNextImage());
-   if (pBuf != 0)
-      return pBuf;
-   else
-      throw CMMError(getCoreErrorText(MMERR_CircularBufferEmpty).c_str(), MMERR_CircularBufferEmpty);
+   acqEngine_->Stop();
 }
 
 /**
- * Gets and removes the next image (and metadata) from the circular buffer
- * channel indicates which cameraChannel image should be retrieved.
- * slice has not been implement and should always be 0
+ * Indicates whether an acquisition started with startAcquisition() is still
+ * running.
  */
-void* CMMCore::popNextImageMD(unsigned channel, unsigned slice, Metadata& md) throw (CMMError)
+bool CMMCore::isAcquisitionRunning()
 {
-   // Slices have never been implemented on the device interface side
-   if (slice != 0)
-      throw CMMError("Slice must be 0");
-
-   const mm::ImgBuffer* pBuf = cbuf_->GetNextImageBuffer(channel);
-   if (pBuf != 0)
-   {
-      md = pBuf->GetMetadata();
-      return const_cast<unsigned char*>(pBuf->GetPixels());
-   }
-   else
-      throw CMMError(getCoreErrorText(MMERR_CircularBufferEmpty).c_str(), MMERR_CircularBufferEmpty);
+   return acqEngine_->IsRunning();
 }
 
 /**
- * Gets and removes the next image (and metadata) from the circular buffer
+ * Waits for the acquisition started with startAcquisition() to end.
+ * Throws if the acquisition failed.
  */
-void* CMMCore::popNextImageMD(Metadata& md) throw (CMMError)
+void CMMCore::waitForAcquisition() throw (CMMError)
 {
-   return popNextImageMD(0, 0, md);
+   acqEngine_->Wait();
 }
 
 /**
- * Removes all images from the circular buffer.
+ * Returns how startAcquisition() would run the plan with the current
+ * devices and settings, one line for each hardware sequence or group of
+ * software-timed images.
  *
- * It is rarely necessary to call this directly since starting a sequence
- * acquisition or changing the ROI will always clear the buffer.
+ * @param plan  the acquisition to describe
  */
-void CMMCore::clearCircularBuffer() throw (CMMError)
+std::string CMMCore::describeAcquisition(const AcquisitionPlan& plan) throw (CMMError)
 {
-   cbuf_->Clear();
+   mm::SequencingLimits limits = acqEngine_->GetLimits(plan);
+   return mm::AcquisitionEngine::Describe(
+         mm::AcquisitionEngine::Compile(plan, limits));
 }
 
 /**
@@ -3155,12 +4353,20 @@ void CMMCore::clearCircularBuffer() throw (CMMError)
 void CMMCore::setCircularBufferMemoryFootprint(unsigned sizeMB ///< n megabytes
                                                ) throw (CMMError)
 {
+   bool compress = cbuf_ && cbuf_->IsCompressionEnabled();
+   unsigned statisticsBins = cbuf_ ? cbuf_->GetFrameStatisticsBins() : 0;
    delete cbuf_; // discard old buffer
    LOG_DEBUG(coreLogger_) << "Will set circular buffer size to " <<
       sizeMB << " MB";
 	try
 	{
 		cbuf_ = new CircularBuffer(sizeMB);
+      cbuf_->SetCompression(compress);
+      cbuf_->SetFrameStatistics(statisticsBins);
+      if (isDiskStreaming())
+         cbuf_->SetDiskStreamWriter(diskStream_);
+      cbuf_->SetSharedFrameRing(sharedRing_);
+      cbuf_->SetLatestFrameMailbox(std::atomic_load(&latestFrames_));
 	}
 	catch(bad_alloc& ex)
 	{
@@ -3221,6 +4427,21 @@ long CMMCore::getRemainingImageCount()
    return 0;
 }
 
+/**
+ * Returns the number of images from the given camera available in the
+ * Circular Buffer
+ */
+long CMMCore::getRemainingImageCount(const char* cameraLabel) throw (CMMError)
+{
+   std::shared_ptr<DeviceInstance> camera =
+      deviceManager_->GetDevice(cameraLabel);
+   if (cbuf_)
+   {
+      return cbuf_->GetRemainingImageCount(camera->GetRawPtr());
+   }
+   return 0;
+}
+
 /**
  * Returns the total number of images that can be stored in the buffer
  */
@@ -3623,8 +4844,13 @@ void CMMCore::setCameraDevice(const char* cameraLabel) throw (CMMError)
 
    if (cameraLabel && strlen(cameraLabel) > 0)
    {
-      currentCameraDevice_ =
+      std::shared_ptr<CameraInstance> camera =
          deviceManager_->GetDeviceOfType<CameraInstance>(cameraLabel);
+      currentCameraDevice_ = camera;
+      {
+         mm::DeviceModuleLockGuard guard(camera, mm::DeviceLock::Shared);
+         cacheStatisticsBitDepth(camera);
+      }
       LOG_INFO(coreLogger_) << "Default camera set to " << cameraLabel;
    }
    else
@@ -3732,12 +4958,31 @@ string CMMCore::getProperty(const char* label, const char* propName) throw (CMME
    std::shared_ptr<DeviceInstance> pDevice = deviceManager_->GetDevice(label);
    CheckPropertyName(propName);
 
+   return getProperty(pDevice, propName);
+}
+
+/**
+ * Returns the property value for the specified device.
+ *
+ * @return the property value
+ * @param property   the property handle
+ */
+string CMMCore::getProperty(const PropertyHandle& property) throw (CMMError)
+{
+   if (property.getDevice().getId() == g_CoreDeviceHandle)
+      return properties_->Get(property.getPropertyName().c_str());
+   return getProperty(getDevice(property.getDevice()), property.getPropertyName());
+}
+
+string CMMCore::getProperty(std::shared_ptr<DeviceInstance> pDevice,
+      const std::string& propName) throw (CMMError)
+{
    mm::DeviceModuleLockGuard guard(pDevice);
    std::string value = pDevice->GetProperty(propName);
 
    // use the opportunity to update the cache
    // Note, stateCache is mutable so that we can update it from this const function
-   PropertySetting s(label, propName, value.c_str());
+   PropertySetting s(pDevice->GetLabel().c_str(), propName.c_str(), value.c_str());
    {
       MMThreadGuard scg(stateCacheLock_);
       stateCache_.addSetting(s);
@@ -3801,16 +5046,39 @@ void CMMCore::setProperty(const char* label, const char* propName,
    }
    else
    {
-      std::shared_ptr<DeviceInstance> pDevice = deviceManager_->GetDevice(label);
+      setProperty(deviceManager_->GetDevice(label), propName, propValue);
+   }
+}
 
-      mm::DeviceModuleLockGuard guard(pDevice);
+/**
+ * Changes the value of the device property.
+ *
+ * @param property    the property handle
+ * @param propValue   the new property value
+ */
+void CMMCore::setProperty(const PropertyHandle& property,
+                          const char* propValue) throw (CMMError)
+{
+   if (property.getDevice().getId() == g_CoreDeviceHandle)
+   {
+      setProperty(MM::g_Keyword_CoreDevice, property.getPropertyName().c_str(), propValue);
+      return;
+   }
+   CheckPropertyValue(propValue);
+   setProperty(getDevice(property.getDevice()), property.getPropertyName(), propValue);
+}
 
-      pDevice->SetProperty(propName, propValue);
+void CMMCore::setProperty(std::shared_ptr<DeviceInstance> pDevice,
+      const std::string& propName, const char* propValue) throw (CMMError)
+{
+   mm::DeviceModuleLockGuard guard(pDevice);
 
-      {
-         MMThreadGuard scg(stateCacheLock_);
-         stateCache_.addSetting(PropertySetting(label, propName, propValue));
-      }
+   pDevice->SetProperty(propName, propValue);
+
+   {
+      MMThreadGuard scg(stateCacheLock_);
+      stateCache_.addSetting(PropertySetting(pDevice->GetLabel().c_str(),
+               propName.c_str(), propValue));
    }
 }
 
@@ -3962,6 +5230,74 @@ bool CMMCore::hasPropertyLimits(const char* label, const char* propName) throw (
    return pDevice->HasPropertyLimits(propName);
 }
 
+/**
+ * Sets when a device property queries the hardware on a read.
+ *
+ * With MM::CacheAlwaysQuery (the default for most properties) every read runs
+ * the device adapter's query. MM::CacheUntilSet reuses the value obtained by
+ * the first read until the property is set again; MM::CacheTimeToLive reuses
+ * it for ttlMs milliseconds. Properties whose value cannot change behind the
+ * core's back are good candidates for caching, which also lets
+ * updateSystemStateCache() skip unchanged devices. The setting is saved with
+ * the system configuration.
+ *
+ * @param label      the device label
+ * @param propName   the property name
+ * @param policy     the cache policy
+ * @param ttlMs      the time to live in milliseconds, for MM::CacheTimeToLive
+ */
+void CMMCore::setPropertyCachePolicy(const char* label, const char* propName,
+      MM::PropertyCachePolicy policy, long ttlMs) throw (CMMError)
+{
+   if (IsCoreDeviceLabel(label))
+      throw CMMError("Cannot set the cache policy of Core properties");
+   std::shared_ptr<DeviceInstance> pDevice = deviceManager_->GetDevice(label);
+   CheckPropertyName(propName);
+   if (policy == MM::CacheTimeToLive && ttlMs <= 0)
+      throw CMMError("Property cache time to live must be positive");
+
+   mm::DeviceModuleLockGuard guard(pDevice);
+   pDevice->OverridePropertyCachePolicy(propName, policy, ttlMs);
+   LOG_DEBUG(coreLogger_) << "Set cache policy of property " << label << "-" <<
+      propName << " to " << policy << " (time to live " << ttlMs << " ms)";
+}
+
+/**
+ * Returns the cache policy of a device property.
+ * @param label      the device label
+ * @param propName   the property name
+ */
+MM::PropertyCachePolicy CMMCore::getPropertyCachePolicy(const char* label, const char* propName) throw (CMMError)
+{
+   if (IsCoreDeviceLabel(label))
+      return MM::CacheAlwaysQuery;
+   std::shared_ptr<DeviceInstance> pDevice = deviceManager_->GetDevice(label);
+   CheckPropertyName(propName);
+
+   mm::DeviceModuleLockGuard guard(pDevice);
+   long ttlMs;
+   return pDevice->GetPropertyCachePolicy(propName, ttlMs);
+}
+
+/**
+ * Returns the cache time to live of a device property, in milliseconds. Only
+ * meaningful when the cache policy is MM::CacheTimeToLive.
+ * @param label      the device label
+ * @param propName   the property name
+ */
+long CMMCore::getPropertyCacheTimeToLiveMs(const char* label, const char* propName) throw (CMMError)
+{
+   if (IsCoreDeviceLabel(label))
+      return 0;
+   std::shared_ptr<DeviceInstance> pDevice = deviceManager_->GetDevice(label);
+   CheckPropertyName(propName);
+
+   mm::DeviceModuleLockGuard guard(pDevice);
+   long ttlMs;
+   pDevice->GetPropertyCachePolicy(propName, ttlMs);
+   return ttlMs;
+}
+
 /**
  * Queries device if the specified property can be used in a sequence
  * @param label      the device name
@@ -4061,6 +5397,52 @@ void CMMCore::loadPropertySequence(const char* label, const char* propName, std:
    pDevice->SendPropertySequence(propName);
 }
 
+/**
+ * Transfer a sequence of numeric values to a Float or Integer property of
+ * the device, in a single call to the device adapter
+ * This should only be called for device-properties that are sequenceable
+ * @param label           the device name
+ * @param propName        the property label
+ * @param eventSequence   the sequence of values that the device will execute in response to external triggers
+ */
+void CMMCore::loadPropertySequence(const char* label, const char* propName, const std::vector<double>& eventSequence) throw (CMMError)
+{
+   if (IsCoreDeviceLabel(label))
+      // XXX Should be a throw
+      return;
+   std::shared_ptr<DeviceInstance> pDevice = deviceManager_->GetDevice(label);
+   CheckPropertyName(propName);
+
+   mm::DeviceModuleLockGuard guard(pDevice);
+   pDevice->ClearPropertySequence(propName);
+   pDevice->AddFloatArrayToPropertySequence(propName, eventSequence.data(),
+         static_cast<long>(eventSequence.size()));
+   pDevice->SendPropertySequence(propName);
+}
+
+/**
+ * Transfer a sequence of integer values to a property of the device, in a
+ * single call to the device adapter
+ * This should only be called for device-properties that are sequenceable
+ * @param label           the device name
+ * @param propName        the property label
+ * @param eventSequence   the sequence of values that the device will execute in response to external triggers
+ */
+void CMMCore::loadPropertySequence(const char* label, const char* propName, const std::vector<long>& eventSequence) throw (CMMError)
+{
+   if (IsCoreDeviceLabel(label))
+      // XXX Should be a throw
+      return;
+   std::shared_ptr<DeviceInstance> pDevice = deviceManager_->GetDevice(label);
+   CheckPropertyName(propName);
+
+   mm::DeviceModuleLockGuard guard(pDevice);
+   pDevice->ClearPropertySequence(propName);
+   pDevice->AddIntegerArrayToPropertySequence(propName, eventSequence.data(),
+         static_cast<long>(eventSequence.size()));
+   pDevice->SendPropertySequence(propName);
+}
+
 /**
  * Returns the intrinsic property type.
  */
@@ -4089,7 +5471,7 @@ unsigned CMMCore::getImageWidth()
       return 0;
    }
 
-   mm::DeviceModuleLockGuard guard(camera);
+   mm::DeviceModuleLockGuard guard(camera, mm::DeviceLock::Shared);
    return camera->GetImageWidth();
 }
 
@@ -4105,7 +5487,7 @@ unsigned CMMCore::getImageHeight()
       return 0;
    }
 
-   mm::DeviceModuleLockGuard guard(camera);
+   mm::DeviceModuleLockGuard guard(camera, mm::DeviceLock::Shared);
    return camera->GetImageHeight();
 }
 
@@ -4122,7 +5504,7 @@ unsigned CMMCore::getBytesPerPixel()
       return 0;
    }
 
-   mm::DeviceModuleLockGuard guard(camera);
+   mm::DeviceModuleLockGuard guard(camera, mm::DeviceLock::Shared);
    return camera->GetImageBytesPerPixel();
 }
 
@@ -4141,7 +5523,7 @@ unsigned CMMCore::getImageBitDepth()
       return 0;
    }
 
-   mm::DeviceModuleLockGuard guard(camera);
+   mm::DeviceModuleLockGuard guard(camera, mm::DeviceLock::Shared);
    return camera->GetBitDepth();
 }
 
@@ -4156,7 +5538,7 @@ unsigned CMMCore::getNumberOfComponents()
    {
       return 0;
    }
-   mm::DeviceModuleLockGuard guard(camera);
+   mm::DeviceModuleLockGuard guard(camera, mm::DeviceLock::Shared);
    return camera->GetNumberOfComponents();
 }
 
@@ -4171,7 +5553,7 @@ unsigned CMMCore::getNumberOfCameraChannels()
       return 0;
    }
 
-   mm::DeviceModuleLockGuard guard(camera);
+   mm::DeviceModuleLockGuard guard(camera, mm::DeviceLock::Shared);
    return camera->GetNumberOfChannels();
 }
 
@@ -4186,7 +5568,7 @@ string CMMCore::getCameraChannelName(unsigned int channelNr)
       return std::string();
    }
 
-   mm::DeviceModuleLockGuard guard(camera);
+   mm::DeviceModuleLockGuard guard(camera, mm::DeviceLock::Shared);
    return camera->GetChannelName(channelNr);
 }
 
@@ -4252,7 +5634,7 @@ double CMMCore::getExposure() throw (CMMError)
    std::shared_ptr<CameraInstance> camera = currentCameraDevice_.lock();
    if (camera)
    {
-      mm::DeviceModuleLockGuard guard(camera);
+      mm::DeviceModuleLockGuard guard(camera, mm::DeviceLock::Shared);
       return camera->GetExposure();
    }
    else
@@ -4271,7 +5653,7 @@ double CMMCore::getExposure(const char* label) throw (CMMError)
         deviceManager_->GetDeviceOfType<CameraInstance>(label);
   if (pCamera)
   {
-     mm::DeviceModuleLockGuard guard(pCamera);
+     mm::DeviceModuleLockGuard guard(pCamera, mm::DeviceLock::Shared);
      return pCamera->GetExposure();
   }
   else
@@ -4341,7 +5723,7 @@ void CMMCore::getROI(int& x, int& y, int& xSize, int& ySize) throw (CMMError)
    std::shared_ptr<CameraInstance> camera = currentCameraDevice_.lock();
    if (camera)
    {
-      mm::DeviceModuleLockGuard guard(camera);
+      mm::DeviceModuleLockGuard guard(camera, mm::DeviceLock::Shared);
       int nRet = camera->GetROI(uX, uY, uXSize, uYSize);
       if (nRet != DEVICE_OK)
          throw CMMError(getDeviceErrorText(nRet, camera).c_str(), MMERR_DEVICE_GENERIC);
@@ -4418,7 +5800,7 @@ void CMMCore::getROI(const char* label, int& x, int& y, int& xSize, int& ySize)
       deviceManager_->GetDeviceOfType<CameraInstance>(label);
 
    unsigned uX(0), uY(0), uXSize(0), uYSize(0);
-   mm::DeviceModuleLockGuard guard(pCam);
+   mm::DeviceModuleLockGuard guard(pCam, mm::DeviceLock::Shared);
    int nRet = pCam->GetROI(uX, uY, uXSize, uYSize);
    if (nRet != DEVICE_OK)
       throw CMMError(getDeviceErrorText(nRet, pCam).c_str(), MMERR_DEVICE_GENERIC);
@@ -4603,9 +5985,24 @@ void CMMCore::getMultiROI(std::vector<unsigned>& xs, std::vector<unsigned>& ys,
  */
 void CMMCore::setState(const char* deviceLabel, long state) throw (CMMError)
 {
-   std::shared_ptr<StateInstance> pStateDev =
-      deviceManager_->GetDeviceOfType<StateInstance>(deviceLabel);
+   setState(deviceManager_->GetDeviceOfType<StateInstance>(deviceLabel), state);
+}
+
+/**
+ * Sets the state (position) on the specific device.
+ * @param stateDevice     the state device handle
+ * @param state           the new state
+ */
+void CMMCore::setState(const DeviceHandle& stateDevice, long state) throw (CMMError)
+{
+   setState(deviceManager_->GetDeviceOfType<StateInstance>(getDevice(stateDevice)), state);
+}
+
+void CMMCore::setState(std::shared_ptr<StateInstance> pStateDev, long state) throw (CMMError)
+{
    mm::DeviceModuleLockGuard guard(pStateDev);
+   const std::string label = pStateDev->GetLabel();
+   const char* deviceLabel = label.c_str();
 
    LOG_DEBUG(coreLogger_) << "Will set " << deviceLabel << " to state " << state;
    int nRet = pStateDev->SetPosition(state);
@@ -4641,8 +6038,21 @@ void CMMCore::setState(const char* deviceLabel, long state) throw (CMMError)
  */
 long CMMCore::getState(const char* deviceLabel) throw (CMMError)
 {
-   std::shared_ptr<StateInstance> pStateDev =
-      deviceManager_->GetDeviceOfType<StateInstance>(deviceLabel);
+   return getState(deviceManager_->GetDeviceOfType<StateInstance>(deviceLabel));
+}
+
+/**
+ * Returns the current state (position) on the specific device.
+ * @return                the current state
+ * @param stateDevice     the state device handle
+ */
+long CMMCore::getState(const DeviceHandle& stateDevice) throw (CMMError)
+{
+   return getState(deviceManager_->GetDeviceOfType<StateInstance>(getDevice(stateDevice)));
+}
+
+long CMMCore::getState(std::shared_ptr<StateInstance> pStateDev) throw (CMMError)
+{
    mm::DeviceModuleLockGuard guard(pStateDev);
 
    long state;
@@ -5079,6 +6489,7 @@ void CMMCore::setPixelSizeConfig(const char* resolutionID) throw (CMMError)
  */
 void CMMCore::setConfig(const char* groupName, const char* configName) throw (CMMError)
 {
+   mm::TraceSpan span("setConfig", "core");
    CheckConfigGroupName(groupName);
    CheckConfigPresetName(configName);
 
@@ -5610,7 +7021,7 @@ double CMMCore::getMagnificationFactor() const
          std::shared_ptr<MagnifierInstance> magnifier =
             deviceManager_->GetDeviceOfType<MagnifierInstance>(magnifiers[i]);
 
-         mm::DeviceModuleLockGuard guard(magnifier);
+         mm::DeviceModuleLockGuard guard(magnifier, mm::DeviceLock::Shared);
          magnification *= magnifier->GetMagnification();
       }
       catch (const CMMError&)
@@ -6207,7 +7618,7 @@ void CMMCore::getGalvoPosition(const char* deviceLabel, double &x, double &y) th
    std::shared_ptr<GalvoInstance> pGalvo =
       deviceManager_->GetDeviceOfType<GalvoInstance>(deviceLabel);
 
-   mm::DeviceModuleLockGuard guard(pGalvo);
+   mm::DeviceModuleLockGuard guard(pGalvo, mm::DeviceLock::Shared);
 
    int ret = pGalvo->GetPosition(x, y);
 
@@ -6639,6 +8050,29 @@ void CMMCore::saveSystemConfiguration(const char* fileName) throw (CMMError)
          << *stageIt << ',' << direction << '\n';
    }
 
+   // save property cache policies set through the core
+   os << "# Property cache policies\n";
+   for (it=devices.begin(); it != devices.end(); it++)
+   {
+      std::shared_ptr<DeviceInstance> pDev = deviceManager_->GetDevice(*it);
+      mm::DeviceModuleLockGuard guard(pDev);
+      std::vector<std::string> overrides = pDev->GetPropertyCachePolicyOverrides();
+      for (std::vector<std::string>::const_iterator propIt = overrides.begin(),
+            end = overrides.end(); propIt != end; ++propIt)
+      {
+         long ttlMs;
+         MM::PropertyCachePolicy policy =
+            pDev->GetPropertyCachePolicy(propIt->c_str(), ttlMs);
+         os << MM::g_CFGCommand_PropertyCache << ',' << *it << ',' << *propIt << ',';
+         if (policy == MM::CacheTimeToLive)
+            os << ttlMs << '\n';
+         else if (policy == MM::CacheUntilSet)
+            os << g_PropertyCacheUntilSet << '\n';
+         else
+            os << g_PropertyCacheAlwaysQuery << '\n';
+      }
+   }
+
    // save labels
    os << "# Labels" << endl;
    vector<string> deviceLabels = deviceManager_->GetDeviceList(MM::StateDevice);
@@ -6856,6 +8290,23 @@ void CMMCore::loadSystemConfigurationImpl(const char* fileName) throw (CMMError)
                         MMERR_InvalidCFGEntry);
                setFocusDirection(tokens[1].c_str(), atol(tokens[2].c_str()));
             }
+            else if(tokens[0].compare(MM::g_CFGCommand_PropertyCache) == 0)
+            {
+               // set property cache policy command: the policy is either
+               // a keyword or a time to live in milliseconds
+               // ----------------------------------------------------------
+               if (tokens.size() != 4)
+                  throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
+                        ToQuotedString(line) + ")",
+                        MMERR_InvalidCFGEntry);
+               if (tokens[3] == g_PropertyCacheAlwaysQuery)
+                  setPropertyCachePolicy(tokens[1].c_str(), tokens[2].c_str(), MM::CacheAlwaysQuery);
+               else if (tokens[3] == g_PropertyCacheUntilSet)
+                  setPropertyCachePolicy(tokens[1].c_str(), tokens[2].c_str(), MM::CacheUntilSet);
+               else
+                  setPropertyCachePolicy(tokens[1].c_str(), tokens[2].c_str(),
+                        MM::CacheTimeToLive, atol(tokens[3].c_str()));
+            }
             else if(tokens[0].compare(MM::g_CFGCommand_Label) == 0)
             {
                // define label command
@@ -7447,6 +8898,15 @@ bool CMMCore::IsCoreDeviceLabel(const char* label) const throw (CMMError)
    return (strcmp(label, MM::g_Keyword_CoreDevice) == 0);
 }
 
+std::shared_ptr<DeviceInstance> CMMCore::getDevice(const DeviceHandle& device) const throw (CMMError)
+{
+   if (device.isNull())
+      throw CMMError("Null device handle", MMERR_NullPointerException);
+   if (device.getId() == g_CoreDeviceHandle)
+      throw CMMError("This operation is not supported by the Core device");
+   return deviceManager_->GetDeviceByHandle(device.getId());
+}
+
 /**
  * Set all properties in a configuration
  * Upon error, don't stop, but try to set all failed properties again
@@ -56,8 +56,10 @@
 #include "../MMDevice/DeviceThreads.h"
 #include "../MMDevice/MMDevice.h"
 #include "../MMDevice/MMDeviceConstants.h"
+#include "AcquisitionPlan.h"
 #include "Configuration.h"
 #include "CoreUtils.h"
+#include "DeviceHandle.h"
 #include "Error.h"
 #include "ErrorCodes.h"
 #include "Logging/Logger.h"
@@ -90,6 +92,7 @@ class CoreCallback;
 class CorePropertyCollection;
 class MMEventCallback;
 class Metadata;
+class PinnedImage;
 class PixelSizeConfigGroup;
 class PropertyBlock;
 
@@ -101,12 +104,19 @@ class ImageProcessorInstance;
 class SLMInstance;
 class ShutterInstance;
 class StageInstance;
+class StateInstance;
 class XYStageInstance;
 
 class CMMCore;
 
 namespace mm {
+   class AcquisitionEngine;
    class DeviceManager;
+   class DiskStreamWriter;
+   struct JSONFragment;
+   struct LatestFrame;
+   class LatestFrameMailbox;
+   class SharedFrameRingWriter;
    class LogManager;
 } // namespace mm
 
@@ -125,6 +135,7 @@ typedef unsigned int* imgRGB32;
 class CMMCore
 {
    friend class CoreCallback;
+   friend class mm::AcquisitionEngine;
    friend class CorePropertyCollection;
 
 public:
@@ -186,6 +197,30 @@ public:
 
    ///@}
 
+   /** \name Device call statistics.
+    *
+    * Counts and latencies of calls from the Core into device adapters.
+    */
+   ///@{
+   void enableDeviceCallStatistics(bool enable);
+   bool isDeviceCallStatisticsEnabled() const;
+   std::string getDeviceCallStatistics() throw (CMMError);
+   std::string getDeviceCallStatistics(const char* label) throw (CMMError);
+   void resetDeviceCallStatistics();
+   ///@}
+
+   /** \name Tracing.
+    *
+    * Timeline of Core API calls, device calls and image buffer activity,
+    * viewable in chrome://tracing or Perfetto.
+    */
+   ///@{
+   void enableTracing(bool enable);
+   bool isTracingEnabled() const;
+   void clearTrace();
+   void saveTrace(const char* filename) throw (CMMError);
+   ///@}
+
    /** \name Device listing. */
    ///@{
    std::vector<std::string> getDeviceAdapterSearchPaths();
@@ -198,6 +233,11 @@ public:
    std::vector<std::string> getAvailableDevices(const char* library) throw (CMMError);
    std::vector<std::string> getAvailableDeviceDescriptions(const char* library) throw (CMMError);
    std::vector<long> getAvailableDeviceTypes(const char* library) throw (CMMError);
+
+   void setDeviceAdapterCatalogFile(const char* filename,
+         bool queryInChildProcess) throw (CMMError);
+   std::string getDeviceAdapterCatalogFile() const;
+   void updateDeviceAdapterCatalog() throw (CMMError);
    ///@}
 
    /** \name Generic device control.
@@ -212,14 +252,20 @@ public:
    std::string getDeviceName(const char* label) throw (CMMError);
    std::string getDeviceDescription(const char* label) throw (CMMError);
 
+   DeviceHandle getDeviceHandle(const char* label) throw (CMMError);
+   PropertyHandle getPropertyHandle(const char* label, const char* propName) throw (CMMError);
+   std::string getDeviceLabel(const DeviceHandle& device) throw (CMMError);
+
    std::vector<std::string> getDevicePropertyNames(const char* label) throw (CMMError);
    bool hasProperty(const char* label, const char* propName) throw (CMMError);
    std::string getProperty(const char* label, const char* propName) throw (CMMError);
+   std::string getProperty(const PropertyHandle& property) throw (CMMError);
    void setProperty(const char* label, const char* propName, const char* propValue) throw (CMMError);
    void setProperty(const char* label, const char* propName, const bool propValue) throw (CMMError);
    void setProperty(const char* label, const char* propName, const long propValue) throw (CMMError);
    void setProperty(const char* label, const char* propName, const float propValue) throw (CMMError);
    void setProperty(const char* label, const char* propName, const double propValue) throw (CMMError);
+   void setProperty(const PropertyHandle& property, const char* propValue) throw (CMMError);
 
    std::vector<std::string> getAllowedPropertyValues(const char* label, const char* propName) throw (CMMError);
    bool isPropertyReadOnly(const char* label, const char* propName) throw (CMMError);
@@ -229,13 +275,22 @@ public:
    double getPropertyLowerLimit(const char* label, const char* propName) throw (CMMError);
    double getPropertyUpperLimit(const char* label, const char* propName) throw (CMMError);
    MM::PropertyType getPropertyType(const char* label, const char* propName) throw (CMMError);
+   void setPropertyCachePolicy(const char* label, const char* propName,
+         MM::PropertyCachePolicy policy, long ttlMs = 0) throw (CMMError);
+   MM::PropertyCachePolicy getPropertyCachePolicy(const char* label, const char* propName) throw (CMMError);
+   long getPropertyCacheTimeToLiveMs(const char* label, const char* propName) throw (CMMError);
 
    void startPropertySequence(const char* label, const char* propName) throw (CMMError);
    void stopPropertySequence(const char* label, const char* propName) throw (CMMError);
    long getPropertySequenceMaxLength(const char* label, const char* propName) throw (CMMError);
    void loadPropertySequence(const char* label, const char* propName, std::vector<std::string> eventSequence) throw (CMMError);
+   void loadPropertySequence(const char* label, const char* propName,
+         const std::vector<double>& eventSequence) throw (CMMError);
+   void loadPropertySequence(const char* label, const char* propName,
+         const std::vector<long>& eventSequence) throw (CMMError);
 
    bool deviceBusy(const char* label) throw (CMMError);
+   bool deviceBusy(const DeviceHandle& device) throw (CMMError);
    void waitForDevice(const char* label) throw (CMMError);
    void waitForConfig(const char* group, const char* configName) throw (CMMError);
    bool systemBusy() throw (CMMError);
@@ -283,6 +338,8 @@ public:
     */
    ///@{
    Configuration getSystemStateCache() const;
+   std::string getSystemStateCacheJSON() const;
+   long long getSystemStateCacheRevision() const;
    void updateSystemStateCache();
    std::string getPropertyFromCache(const char* deviceLabel,
          const char* propName) const throw (CMMError);
@@ -416,8 +473,23 @@ public:
    void* getNBeforeLastImageMD(unsigned long n, Metadata& md)
       const throw (CMMError);
    void* popNextImageMD(Metadata& md) throw (CMMError);
+   long getNextImageBufferSize() throw (CMMError);
+   void* getLastImageMD(const char* cameraLabel, Metadata& md)
+      const throw (CMMError);
+   void* popNextImageMD(const char* cameraLabel, Metadata& md)
+      throw (CMMError);
+   long popNextImagePinned(Metadata& md) throw (CMMError);
+   long popNextImagePinned(const char* cameraLabel, Metadata& md)
+      throw (CMMError);
+   void* getPinnedImagePixels(long pinId) throw (CMMError);
+   long getPinnedImageBufferSize(long pinId) throw (CMMError);
+   void releasePinnedImage(long pinId) throw (CMMError);
+   long getPinnedImageCount();
+   std::string getImageTagsJSON(const Metadata& md,
+         bool includeSystemStateCache) throw (CMMError);
 
    long getRemainingImageCount();
+   long getRemainingImageCount(const char* cameraLabel) throw (CMMError);
    long getBufferTotalCapacity();
    long getBufferFreeCapacity();
    bool isBufferOverflowed() const;
@@ -425,6 +497,35 @@ public:
    unsigned getCircularBufferMemoryFootprint();
    void initializeCircularBuffer() throw (CMMError);
    void clearCircularBuffer() throw (CMMError);
+   void setCircularBufferCompression(bool enable) throw (CMMError);
+   bool isCircularBufferCompressionEnabled() const;
+   std::string getCircularBufferCompressionStatistics() const;
+   void enableImageStatistics(bool enable, unsigned histogramBins) throw (CMMError);
+   bool isImageStatisticsEnabled() const;
+
+   void startDiskStreaming(const char* directory, const char* prefix) throw (CMMError);
+   void startDiskStreaming(const char* directory, const char* prefix,
+         bool streamOnly) throw (CMMError);
+   void stopDiskStreaming() throw (CMMError);
+   bool isDiskStreaming() const;
+   void setDiskStreamingOptions(unsigned queueMB,
+         unsigned writerThreads, bool blockWhenFull) throw (CMMError);
+   std::string getDiskStreamingStatistics() const;
+
+   void startSharedFrameRing(const char* name, unsigned slotCount) throw (CMMError);
+   void stopSharedFrameRing();
+   bool isSharedFrameRingActive() const;
+
+   void enableLatestFrameMailbox(bool enable, unsigned previewMaxSize);
+   bool isLatestFrameMailboxEnabled() const;
+   long long getLatestFrameCount() const;
+   std::shared_ptr<const mm::LatestFrame> getLatestFrame() const throw (CMMError);
+
+   void startAcquisition(const AcquisitionPlan& plan) throw (CMMError);
+   void stopAcquisition() throw (CMMError);
+   bool isAcquisitionRunning();
+   void waitForAcquisition() throw (CMMError);
+   std::string describeAcquisition(const AcquisitionPlan& plan) throw (CMMError);
 
    bool isExposureSequenceable(const char* cameraLabel) throw (CMMError);
    void startExposureSequence(const char* cameraLabel) throw (CMMError);
@@ -451,7 +552,9 @@ public:
    /** \name State device control. */
    ///@{
    void setState(const char* stateDeviceLabel, long state) throw (CMMError);
+   void setState(const DeviceHandle& stateDevice, long state) throw (CMMError);
    long getState(const char* stateDeviceLabel) throw (CMMError);
+   long getState(const DeviceHandle& stateDevice) throw (CMMError);
    long getNumberOfStates(const char* stateDeviceLabel);
    void setStateLabel(const char* stateDeviceLabel,
          const char* stateLabel) throw (CMMError);
@@ -470,8 +573,10 @@ public:
    /** \name Focus (Z) stage control. */
    ///@{
    void setPosition(const char* stageLabel, double position) throw (CMMError);
+   void setPosition(const DeviceHandle& stage, double position) throw (CMMError);
    void setPosition(double position) throw (CMMError);
    double getPosition(const char* stageLabel) throw (CMMError);
+   double getPosition(const DeviceHandle& stage) throw (CMMError);
    double getPosition() throw (CMMError);
    void setRelativePosition(const char* stageLabel, double d) throw (CMMError);
    void setRelativePosition(double d) throw (CMMError);
@@ -497,12 +602,16 @@ public:
    ///@{
    void setXYPosition(const char* xyStageLabel,
          double x, double y) throw (CMMError);
+   void setXYPosition(const DeviceHandle& xyStage,
+         double x, double y) throw (CMMError);
    void setXYPosition(double x, double y) throw (CMMError);
    void setRelativeXYPosition(const char* xyStageLabel,
          double dx, double dy) throw (CMMError);
    void setRelativeXYPosition(double dx, double dy) throw (CMMError);
    void getXYPosition(const char* xyStageLabel,
          double &x_stage, double &y_stage) throw (CMMError);
+   void getXYPosition(const DeviceHandle& xyStage,
+         double &x_stage, double &y_stage) throw (CMMError);
    void getXYPosition(double &x_stage, double &y_stage) throw (CMMError);
    double getXPosition(const char* xyStageLabel) throw (CMMError);
    double getYPosition(const char* xyStageLabel) throw (CMMError);
@@ -670,6 +779,22 @@ private:
    MMEventCallback* externalCallback_;  // notification hook to the higher layer (e.g. GUI)
    PixelSizeConfigGroup* pixelSizeGroup_;
    CircularBuffer* cbuf_;
+   std::shared_ptr<mm::DiskStreamWriter> diskStream_; // Kept after stopping, for statistics
+   unsigned diskStreamQueueMB_;
+   unsigned diskStreamWriterThreads_;
+   bool diskStreamBlockWhenFull_;
+   std::shared_ptr<mm::SharedFrameRingWriter> sharedRing_;
+   std::shared_ptr<mm::LatestFrameMailbox> latestFrames_; // Accessed atomically
+   std::shared_ptr<mm::AcquisitionEngine> acqEngine_;
+
+   MMThreadLock pinnedImagesLock_;
+   std::map<long, std::shared_ptr<PinnedImage> > pinnedImages_; // Synchronized by pinnedImagesLock_
+   long lastPinId_; // Synchronized by pinnedImagesLock_
+
+   MMThreadLock statisticsBitDepthsLock_;
+   // Bit depth of each camera for image statistics (see
+   // cacheStatisticsBitDepth()); synchronized by statisticsBitDepthsLock_
+   std::map<const MM::Device*, unsigned> statisticsBitDepths_;
 
    std::vector< std::weak_ptr<DeviceInstance> > imageSynchroDevices_;
    std::shared_ptr<CPluginManager> pluginManager_;
@@ -681,6 +806,14 @@ private:
    // or acquiring a module lock
    mutable MMThreadLock stateCacheLock_;
    mutable Configuration stateCache_; // Synchronized by stateCacheLock_
+   // Device property change counters as of the last state cache update,
+   // used to skip devices whose properties cannot have changed since.
+   // Synchronized by stateCacheLock_
+   std::map<std::string, std::pair<std::weak_ptr<DeviceInstance>, unsigned long> > stateCacheCounters_;
+   // JSON of stateCache_ as of revision stateCacheJSONRevision_
+   // Synchronized by stateCacheLock_
+   mutable std::shared_ptr<const mm::JSONFragment> stateCacheJSON_;
+   mutable long long stateCacheJSONRevision_;
 
    MMThreadLock* pPostedErrorsLock_;
    mutable std::deque<std::pair< int, std::string> > postedErrors_;
@@ -702,6 +835,20 @@ private:
    void applyConfiguration(const Configuration& config) throw (CMMError);
    int applyProperties(std::vector<PropertySetting>& props, std::string& lastError);
    void waitForDevice(std::shared_ptr<DeviceInstance> pDev) throw (CMMError);
+   std::shared_ptr<DeviceInstance> getDevice(const DeviceHandle& device) const throw (CMMError);
+   std::string getProperty(std::shared_ptr<DeviceInstance> pDevice, const std::string& propName) throw (CMMError);
+   long addPinnedImage(std::shared_ptr<PinnedImage> image, Metadata& md) throw (CMMError);
+   std::shared_ptr<PinnedImage> getPinnedImage(long pinId) throw (CMMError);
+   void cacheStatisticsBitDepth(std::shared_ptr<CameraInstance> camera);
+   std::shared_ptr<const mm::JSONFragment> getSystemStateCacheJSONFragment() const;
+   void setProperty(std::shared_ptr<DeviceInstance> pDevice, const std::string& propName,
+         const char* propValue) throw (CMMError);
+   void setState(std::shared_ptr<StateInstance> pStateDev, long state) throw (CMMError);
+   long getState(std::shared_ptr<StateInstance> pStateDev) throw (CMMError);
+   void setPosition(std::shared_ptr<StageInstance> pStage, double position) throw (CMMError);
+   double getPosition(std::shared_ptr<StageInstance> pStage) throw (CMMError);
+   void setXYPosition(std::shared_ptr<XYStageInstance> pXYStage, double x, double y) throw (CMMError);
+   void getXYPosition(std::shared_ptr<XYStageInstance> pXYStage, double& x, double& y) throw (CMMError);
    Configuration getConfigGroupState(const char* group, bool fromCache) throw (CMMError);
    std::string getDeviceErrorText(int deviceCode, std::shared_ptr<DeviceInstance> pDevice);
    std::string getDeviceName(std::shared_ptr<DeviceInstance> pDev);
@@ -709,6 +856,8 @@ private:
    void updateAllowedChannelGroups();
    void assignDefaultRole(std::shared_ptr<DeviceInstance> pDev);
    void updateCoreProperty(const char* propName, MM::DeviceType devType) throw (CMMError);
+   void addDeviceState(Configuration& config, const std::string& label,
+         std::shared_ptr<DeviceInstance> pDev);
    void loadSystemConfigurationImpl(const char* fileName) throw (CMMError);
 };
 
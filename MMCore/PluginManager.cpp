@@ -26,7 +26,16 @@
    #include <io.h>
 #else
    #include <sys/types.h>
+   #include <sys/wait.h>
    #include <dirent.h>
+   #include <fcntl.h>
+   #include <poll.h>
+   #include <signal.h>
+   #include <spawn.h>
+   #include <unistd.h>
+   #ifdef __APPLE__
+      #include <crt_externs.h>
+   #endif
 #endif // WIN32
 
 #include "../MMDevice/ModuleInterface.h"
@@ -39,6 +48,8 @@
 #include "PluginManager.h"
 
 #include <algorithm>
+#include <cerrno>
+#include <chrono>
 #include <cstring>
 #include <fstream>
 #include <memory>
@@ -65,7 +76,8 @@ const char* const LIB_NAME_SUFFIX = "";
 
 std::vector<std::string> CPluginManager::fallbackSearchPaths_;
 
-CPluginManager::CPluginManager()
+CPluginManager::CPluginManager() :
+   queryInChildProcess_(false)
 {
    const std::vector<std::string> paths = GetDefaultSearchPaths();
    SetSearchPaths(paths.begin(), paths.end());
@@ -145,13 +157,9 @@ CPluginManager::GetDeviceAdapter(const std::string& moduleName)
       return it->second;
    }
 
-   std::string filename(LIB_NAME_PREFIX);
-   filename += moduleName;
-   filename += LIB_NAME_SUFFIX;
-   filename = FindInSearchPath(filename);
-
    std::shared_ptr<LoadedDeviceAdapter> module =
-      std::make_shared<LoadedDeviceAdapter>(moduleName, filename);
+      std::make_shared<LoadedDeviceAdapter>(moduleName,
+            GetModuleFilename(moduleName));
    moduleMap_[moduleName] = module;
    return module;
 }
@@ -166,6 +174,15 @@ CPluginManager::GetDeviceAdapter(const char* moduleName)
    return GetDeviceAdapter(std::string(moduleName));
 }
 
+std::string
+CPluginManager::GetModuleFilename(const std::string& moduleName)
+{
+   std::string filename(LIB_NAME_PREFIX);
+   filename += moduleName;
+   filename += LIB_NAME_SUFFIX;
+   return FindInSearchPath(filename);
+}
+
 /** 
  * Unload a module.
  */
@@ -384,3 +401,345 @@ CPluginManager::GetModulesInLegacyFallbackSearchPaths()
 
    return modules;
 }
+
+
+namespace
+{
+
+void DescribeModule(const LoadedDeviceAdapter& module,
+      mm::DeviceAdapterCatalogEntry& entry)
+{
+   std::vector<std::string> names = module.GetAvailableDeviceNames();
+   for (std::vector<std::string>::const_iterator it = names.begin(),
+         end = names.end(); it != end; ++it)
+   {
+      mm::AdvertisedDevice device;
+      device.name = *it;
+      device.description = module.GetDeviceDescription(*it);
+      device.type = static_cast<int>(module.GetAdvertisedDeviceType(*it));
+      entry.devices.push_back(device);
+   }
+}
+
+#ifndef WIN32
+const char* const QUERY_HELPER_NAME = "mmcore-query-adapter";
+
+// The helper program is installed next to the binary containing the Core;
+// returns an empty string if it is not there
+std::string GetQueryHelperPath()
+{
+   std::string path;
+   try
+   {
+      path = MMCorePrivate::GetPathOfThisModule();
+   }
+   catch (const CMMError&)
+   {
+      return std::string();
+   }
+   const std::string::size_type slash = path.rfind('/');
+   if (slash == std::string::npos)
+      return std::string();
+   path = path.substr(0, slash + 1) + QUERY_HELPER_NAME;
+   if (access(path.c_str(), X_OK) != 0)
+      return std::string();
+   return path;
+}
+
+// Queries the module in a separate process running the helper program, so
+// that whatever the module does when loaded (starting threads, probing
+// hardware, crashing) does not affect this process. The helper is started
+// with posix_spawn() (not fork() alone, which is unsafe in a process with
+// other threads running).
+void QueryModuleInChildProcess(const std::string& helperPath,
+      const std::string& moduleName, const std::string& filename,
+      mm::DeviceAdapterCatalogEntry& entry)
+{
+   const int timeoutMs = 10000;
+
+   int fds[2];
+   if (pipe(fds) != 0)
+   {
+      entry.error = "Cannot create pipe to query device adapter " +
+         ToQuotedString(moduleName);
+      return;
+   }
+   // Not inherited by processes that other threads start
+   fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+   fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+
+   posix_spawn_file_actions_t actions;
+   posix_spawn_file_actions_init(&actions);
+   posix_spawn_file_actions_adddup2(&actions, fds[1], STDOUT_FILENO);
+   std::vector<char*> argv;
+   argv.push_back(const_cast<char*>(helperPath.c_str()));
+   argv.push_back(const_cast<char*>(moduleName.c_str()));
+   argv.push_back(const_cast<char*>(filename.c_str()));
+   argv.push_back(0);
+#ifdef __APPLE__
+   char** env = *_NSGetEnviron();
+#else
+   char** env = environ;
+#endif
+   pid_t pid;
+   int err = posix_spawn(&pid, helperPath.c_str(), &actions, 0,
+         &argv[0], env);
+   posix_spawn_file_actions_destroy(&actions);
+   close(fds[1]);
+   if (err != 0)
+   {
+      close(fds[0]);
+      entry.error = "Cannot start process to query device adapter " +
+         ToQuotedString(moduleName);
+      return;
+   }
+
+   std::string reply;
+   bool timedOut = false;
+   bool endOfReply = false;
+   const std::chrono::steady_clock::time_point deadline =
+      std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+   for (;;)
+   {
+      const long long remainingMs =
+         std::chrono::duration_cast<std::chrono::milliseconds>(
+               deadline - std::chrono::steady_clock::now()).count();
+      struct pollfd pfd;
+      pfd.fd = fds[0];
+      pfd.events = POLLIN;
+      int ready = remainingMs > 0 ?
+         poll(&pfd, 1, static_cast<int>(remainingMs)) : 0;
+      if (ready == 0)
+      {
+         timedOut = true;
+         break;
+      }
+      if (ready < 0)
+      {
+         if (errno == EINTR)
+            continue;
+         break;
+      }
+      char buf[4096];
+      ssize_t n = read(fds[0], buf, sizeof(buf));
+      if (n < 0 && errno == EINTR)
+         continue;
+      if (n == 0)
+         endOfReply = true;
+      if (n <= 0)
+         break;
+      reply.append(buf, static_cast<std::size_t>(n));
+   }
+   close(fds[0]);
+
+   const mm::ModuleSignature signature = entry.signature;
+   std::string repliedName;
+   const bool succeeded = endOfReply &&
+      mm::ParseCatalogEntry(reply, repliedName, entry) &&
+      repliedName == moduleName &&
+      entry.moduleInterfaceVersion == MODULE_INTERFACE_VERSION &&
+      entry.deviceInterfaceVersion == DEVICE_INTERFACE_VERSION;
+
+   // Otherwise the helper may be stuck (or still running after an error
+   // here), and waitpid() must not wait for it
+   if (!succeeded)
+      kill(pid, SIGKILL);
+   int status = 0;
+   while (waitpid(pid, &status, 0) < 0 && errno == EINTR)
+      ;
+
+   if (succeeded)
+   {
+      entry.signature = signature;
+      return;
+   }
+   entry = mm::DeviceAdapterCatalogEntry();
+   entry.signature = signature;
+   entry.moduleInterfaceVersion = MODULE_INTERFACE_VERSION;
+   entry.deviceInterfaceVersion = DEVICE_INTERFACE_VERSION;
+   if (timedOut)
+      entry.error = "Device adapter " + ToQuotedString(moduleName) +
+         " did not respond within " + ToString(timeoutMs / 1000) + " s";
+   else if (WIFSIGNALED(status) && WTERMSIG(status) != SIGKILL)
+      entry.error = "Device adapter " + ToQuotedString(moduleName) +
+         " crashed when loaded (signal " + ToString(WTERMSIG(status)) + ")";
+   else
+      entry.error = "Device adapter " + ToQuotedString(moduleName) +
+         " could not be queried";
+}
+#endif // !WIN32
+
+} // anonymous namespace
+
+
+/**
+ * Enable the catalog, reading the existing file if any, or disable it.
+ */
+void
+CPluginManager::SetCatalog(const std::string& filename, bool queryInChildProcess)
+{
+   if (filename.empty())
+   {
+      catalog_.reset();
+      queryInChildProcess_ = false;
+      return;
+   }
+   queryInChildProcess_ = queryInChildProcess;
+   catalog_.reset(new mm::DeviceAdapterCatalog(filename));
+   catalog_->Load();
+}
+
+
+std::string
+CPluginManager::GetCatalogFilename() const
+{
+   return catalog_ ? catalog_->GetFilename() : std::string();
+}
+
+
+/**
+ * Load and query a module that is not (or no longer) in the catalog.
+ */
+mm::DeviceAdapterCatalogEntry
+CPluginManager::QueryModule(const std::string& moduleName,
+      const std::string& filename)
+{
+   mm::DeviceAdapterCatalogEntry entry;
+   entry.moduleInterfaceVersion = MODULE_INTERFACE_VERSION;
+   entry.deviceInterfaceVersion = DEVICE_INTERFACE_VERSION;
+   mm::GetModuleSignature(filename, entry.signature);
+
+#ifndef WIN32
+   // Modules that are already loaded are cheap to query in this process
+   if (queryInChildProcess_ && !moduleMap_.count(moduleName))
+   {
+      const std::string helperPath = GetQueryHelperPath();
+      if (!helperPath.empty())
+      {
+         QueryModuleInChildProcess(helperPath, moduleName, filename, entry);
+         return entry;
+      }
+   }
+#endif
+
+   try
+   {
+      DescribeModule(*GetDeviceAdapter(moduleName), entry);
+   }
+   catch (const CMMError& e)
+   {
+      entry.devices.clear();
+      entry.error = e.getFullMsg();
+   }
+   return entry;
+}
+
+
+/**
+ * Load a module on its own (outside of any plugin manager) and list its
+ * devices. This is what the mmcore-query-adapter helper program runs.
+ */
+mm::DeviceAdapterCatalogEntry
+CPluginManager::DescribeModuleFile(const std::string& moduleName,
+      const std::string& filename)
+{
+   mm::DeviceAdapterCatalogEntry entry;
+   entry.moduleInterfaceVersion = MODULE_INTERFACE_VERSION;
+   entry.deviceInterfaceVersion = DEVICE_INTERFACE_VERSION;
+   try
+   {
+      LoadedDeviceAdapter module(moduleName, filename);
+      DescribeModule(module, entry);
+   }
+   catch (const CMMError& e)
+   {
+      entry.devices.clear();
+      entry.error = e.getFullMsg();
+   }
+   return entry;
+}
+
+
+mm::DeviceAdapterCatalogEntry
+CPluginManager::GetCatalogEntry(const std::string& moduleName, bool& changed)
+{
+   changed = false;
+   if (!catalog_)
+   {
+      // As without the catalog feature; errors are thrown as they occur
+      mm::DeviceAdapterCatalogEntry entry;
+      DescribeModule(*GetDeviceAdapter(moduleName), entry);
+      return entry;
+   }
+
+   // Modules that cannot be found are loaded (to report the error) but not
+   // cataloged
+   const std::string filename = GetModuleFilename(moduleName);
+   mm::ModuleSignature signature;
+   if (!mm::GetModuleSignature(filename, signature))
+      return QueryModule(moduleName, filename);
+
+   const mm::DeviceAdapterCatalogEntry* cached = catalog_->Find(moduleName,
+         signature, MODULE_INTERFACE_VERSION, DEVICE_INTERFACE_VERSION);
+   if (cached)
+      return *cached;
+
+   // Failures are not cataloged: they may be transient (a timeout, or a
+   // library that was missing at the time), so the module is queried again
+   // next time
+   mm::DeviceAdapterCatalogEntry entry = QueryModule(moduleName, filename);
+   if (entry.error.empty())
+   {
+      catalog_->Put(moduleName, entry);
+      changed = true;
+   }
+   return entry;
+}
+
+
+std::vector<mm::AdvertisedDevice>
+CPluginManager::GetAdvertisedDevices(const std::string& moduleName)
+{
+   if (moduleName.empty())
+   {
+      throw CMMError("Empty device adapter module name");
+   }
+
+   bool changed;
+   mm::DeviceAdapterCatalogEntry entry = GetCatalogEntry(moduleName, changed);
+   if (changed)
+   {
+      // The catalog is only an optimization; a write failure will show up
+      // as slow enumeration, not as an error
+      try
+      {
+         catalog_->Save();
+      }
+      catch (const CMMError&)
+      {
+      }
+   }
+   if (!entry.error.empty())
+      throw CMMError(entry.error);
+   return entry.devices;
+}
+
+
+void
+CPluginManager::UpdateCatalog()
+{
+   if (!catalog_)
+      throw CMMError("No device adapter catalog file has been set");
+
+   bool anyChanged = false;
+   std::vector<std::string> modules = GetAvailableDeviceAdapters();
+   for (std::vector<std::string>::const_iterator it = modules.begin(),
+         end = modules.end(); it != end; ++it)
+   {
+      bool changed;
+      GetCatalogEntry(*it, changed); // Errors are reported when listed
+      anyChanged = anyChanged || changed;
+   }
+   if (anyChanged)
+      catalog_->Save();
+}
@@ -25,6 +25,7 @@
 
 
 #include "../MMDevice/DeviceThreads.h"
+#include "DeviceAdapterCatalog.h"
 
 #include <map>
 #include <memory>
@@ -62,7 +63,37 @@ public:
    std::shared_ptr<LoadedDeviceAdapter>
    GetDeviceAdapter(const char* moduleName);
 
+   // Optional on-disk catalog of the devices in each module (empty filename
+   // to disable). With the catalog, modules are only loaded to list their
+   // devices if they are new or have changed since they were cataloged,
+   // and then optionally in a child process running the
+   // mmcore-query-adapter helper (Unix only, if the helper is installed
+   // next to the Core), so that they do not stay loaded (or crash the
+   // application). Modules that fail are not cataloged.
+   void SetCatalog(const std::string& filename, bool queryInChildProcess);
+   std::string GetCatalogFilename() const;
+
+   /**
+    * Return the devices of a module, from the catalog if possible
+    */
+   std::vector<mm::AdvertisedDevice>
+   GetAdvertisedDevices(const std::string& moduleName);
+   // Catalogs all modules in the search paths that are not yet cataloged
+   void UpdateCatalog();
+
+   // Loads a module on its own and lists its devices; errors are recorded
+   // in the entry (used by the mmcore-query-adapter helper program)
+   static mm::DeviceAdapterCatalogEntry
+   DescribeModuleFile(const std::string& moduleName,
+         const std::string& filename);
+
 private:
+   mm::DeviceAdapterCatalogEntry
+   GetCatalogEntry(const std::string& moduleName, bool& changed);
+   mm::DeviceAdapterCatalogEntry
+   QueryModule(const std::string& moduleName, const std::string& filename);
+   std::string GetModuleFilename(const std::string& moduleName);
+
    static std::vector<std::string> GetDefaultSearchPaths();
    std::vector<std::string> GetActualSearchPaths() const;
    static void GetModules(std::vector<std::string> &modules, const char *path);
@@ -72,6 +103,9 @@ private:
    static std::vector<std::string> fallbackSearchPaths_;
 
    std::map< std::string, std::shared_ptr<LoadedDeviceAdapter> > moduleMap_;
+
+   std::unique_ptr<mm::DeviceAdapterCatalog> catalog_;
+   bool queryInChildProcess_;
 };
 
 #endif //_PLUGIN_MANAGER_H_
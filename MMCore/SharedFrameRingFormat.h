@@ -0,0 +1,224 @@
+/*
+ * PROJECT:       Micro-Manager
+ * SUBSYSTEM:     MMCore
+ *
+ * DESCRIPTION:   Layout of the shared-memory frame ring published by
+ *                CMMCore::startSharedFrameRing(), and a reference reader.
+ *                This header is plain C99 and has no other dependencies, so
+ *                that other programs can include it as is.
+ *
+ * LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+ *                License text is included with the source distribution.
+ *
+ *                This file is distributed in the hope that it will be useful,
+ *                but WITHOUT ANY WARRANTY; without even the implied warranty
+ *                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ *                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ *                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+ */
+
+/*
+ * Layout
+ * ------
+ * The shared-memory object starts with an MMSFRHeader. Slot i starts at
+ * byte headerBytes + i * slotBytes and holds an MMSFRSlotHeader followed,
+ * at byte slotHeaderBytes of the slot, by the pixels of one image (rows top
+ * to bottom, no padding). All offsets are multiples of 64. Integers are in
+ * the byte order of the machine; there is one writer and any number of
+ * readers on the same machine.
+ *
+ * Frames are numbered from 0 in the order they are published; frame n goes
+ * to slot n % slotCount. The header's writeCount is the number of frames
+ * published so far. Each slot carries two copies of its frame number plus 1:
+ * beginSequence is set before the writer touches the slot and endSequence
+ * after it has finished. A reader checks endSequence before using a frame
+ * and beginSequence afterwards; if either differs from the frame number
+ * plus 1, the frame was overwritten (the reader fell behind by a whole ring)
+ * and whatever was read must be discarded. No locks are involved, and the
+ * reader never writes to the shared memory.
+ *
+ * magic is set last when the ring is created; closed becomes nonzero when
+ * the writer detaches (the object is then unlinked, but existing mappings
+ * stay valid).
+ *
+ * Reading
+ * -------
+ *    size_t size;
+ *    const MMSFRHeader* ring = mmsfr_attach("/mmcore-frames", &size);
+ *    uint64_t next = mmsfr_write_count(ring); // Start from new frames
+ *    for (;;) {
+ *       const MMSFRSlotHeader* slot;
+ *       int status = mmsfr_begin_read(ring, next, &slot);
+ *       if (status == MMSFR_NOT_YET) { wait a little; continue; }
+ *       if (status == MMSFR_OK) {
+ *          use mmsfr_pixels(ring, slot) and the slot's fields in place;
+ *          status = mmsfr_end_read(ring, next, slot);
+ *       }
+ *       if (status == MMSFR_OVERWRITTEN) { discard; skip to a newer frame }
+ *       ++next;
+ *    }
+ *    mmsfr_detach(ring, size);
+ */
+
+#ifndef MM_SHARED_FRAME_RING_FORMAT_H
+#define MM_SHARED_FRAME_RING_FORMAT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MMSFR_MAGIC UINT64_C(0x474E495246534D4D) /* "MMSFRING" */
+#define MMSFR_VERSION 1
+#define MMSFR_ALIGNMENT 64
+#define MMSFR_CAMERA_BYTES 64
+
+typedef struct MMSFRHeader
+{
+   uint64_t magic;
+   uint32_t version;
+   uint32_t headerBytes;
+   uint64_t slotBytes;
+   uint64_t maxPixelBytes;   /* Largest image a slot can hold */
+   uint32_t slotCount;
+   uint32_t slotHeaderBytes;
+   uint64_t writeCount;      /* Atomic */
+   uint64_t skippedCount;    /* Atomic; images too large for a slot */
+   uint32_t closed;          /* Atomic */
+   uint32_t writerPid;
+} MMSFRHeader;
+
+typedef struct MMSFRSlotHeader
+{
+   uint64_t beginSequence;   /* Atomic */
+   uint64_t endSequence;     /* Atomic */
+   uint32_t width;
+   uint32_t height;
+   uint32_t bytesPerPixel;
+   uint32_t nComponents;
+   uint64_t pixelBytes;
+   int64_t imageNumber;      /* Per camera, from the image metadata; -1 if none */
+   double elapsedTimeMs;     /* From the image metadata; -1 if none */
+   char camera[MMSFR_CAMERA_BYTES]; /* Camera label, null-terminated */
+} MMSFRSlotHeader;
+
+enum
+{
+   MMSFR_OK = 0,
+   MMSFR_NOT_YET = 1,        /* Frame not yet published */
+   MMSFR_OVERWRITTEN = 2     /* Frame lost to newer frames */
+};
+
+
+#if defined(__GNUC__) || defined(__clang__)
+
+#define MMSFR_LOAD_ACQUIRE(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define MMSFR_LOAD_RELAXED(p) __atomic_load_n((p), __ATOMIC_RELAXED)
+#define MMSFR_FENCE_ACQUIRE() __atomic_thread_fence(__ATOMIC_ACQUIRE)
+
+static inline uint64_t
+mmsfr_write_count(const MMSFRHeader* ring)
+{
+   return MMSFR_LOAD_ACQUIRE(&ring->writeCount);
+}
+
+static inline int
+mmsfr_is_closed(const MMSFRHeader* ring)
+{
+   return MMSFR_LOAD_ACQUIRE(&ring->closed) != 0;
+}
+
+static inline const MMSFRSlotHeader*
+mmsfr_slot(const MMSFRHeader* ring, uint64_t frame)
+{
+   return (const MMSFRSlotHeader*)((const unsigned char*)ring +
+         ring->headerBytes + (frame % ring->slotCount) * ring->slotBytes);
+}
+
+static inline const unsigned char*
+mmsfr_pixels(const MMSFRHeader* ring, const MMSFRSlotHeader* slot)
+{
+   return (const unsigned char*)slot + ring->slotHeaderBytes;
+}
+
+/* Finds a frame; on MMSFR_OK its slot may be used until mmsfr_end_read() */
+static inline int
+mmsfr_begin_read(const MMSFRHeader* ring, uint64_t frame,
+      const MMSFRSlotHeader** slot)
+{
+   uint64_t written = mmsfr_write_count(ring);
+   if (frame >= written)
+      return MMSFR_NOT_YET;
+   if (written - frame > ring->slotCount)
+      return MMSFR_OVERWRITTEN;
+   *slot = mmsfr_slot(ring, frame);
+   if (MMSFR_LOAD_ACQUIRE(&(*slot)->endSequence) != frame + 1)
+      return MMSFR_OVERWRITTEN;
+   return MMSFR_OK;
+}
+
+/* Whether the frame stayed intact while it was being used */
+static inline int
+mmsfr_end_read(const MMSFRHeader* ring, uint64_t frame,
+      const MMSFRSlotHeader* slot)
+{
+   (void)ring;
+   MMSFR_FENCE_ACQUIRE();
+   if (MMSFR_LOAD_RELAXED(&slot->beginSequence) != frame + 1)
+      return MMSFR_OVERWRITTEN;
+   return MMSFR_OK;
+}
+
+#endif /* __GNUC__ || __clang__ */
+
+
+#if !defined(_WIN32) && (defined(__GNUC__) || defined(__clang__))
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Maps the ring read-only; returns NULL if it does not exist or is not a
+   ready ring of this version */
+static inline const MMSFRHeader*
+mmsfr_attach(const char* name, size_t* size)
+{
+   struct stat st;
+   void* region;
+   const MMSFRHeader* ring;
+   int fd = shm_open(name, O_RDONLY, 0);
+   if (fd < 0)
+      return NULL;
+   if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(MMSFRHeader))
+   {
+      close(fd);
+      return NULL;
+   }
+   region = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+   close(fd);
+   if (region == MAP_FAILED)
+      return NULL;
+
+   ring = (const MMSFRHeader*)region;
+   if (MMSFR_LOAD_ACQUIRE(&ring->magic) != MMSFR_MAGIC ||
+         ring->version != MMSFR_VERSION ||
+         ring->headerBytes + (uint64_t)ring->slotCount * ring->slotBytes >
+         (uint64_t)st.st_size)
+   {
+      munmap(region, (size_t)st.st_size);
+      return NULL;
+   }
+   *size = (size_t)st.st_size;
+   return ring;
+}
+
+static inline void
+mmsfr_detach(const MMSFRHeader* ring, size_t size)
+{
+   munmap((void*)ring, size);
+}
+
+#endif /* POSIX */
+
+#endif /* MM_SHARED_FRAME_RING_FORMAT_H */
@@ -0,0 +1,218 @@
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//
+// DESCRIPTION:   Publishes acquired frames to a POSIX shared-memory ring for
+//                other processes; see SharedFrameRingFormat.h for the layout
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "SharedFrameRingWriter.h"
+
+#include "CoreUtils.h"
+#include "SharedFrameRingFormat.h"
+#include "TaskSet_CopyMemory.h"
+#include "ThreadPool.h"
+
+#include "../MMDevice/ImageMetadata.h"
+#include "../MMDevice/MMDeviceConstants.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace mm
+{
+
+namespace
+{
+
+std::size_t AlignUp(std::size_t n)
+{
+   return (n + MMSFR_ALIGNMENT - 1) / MMSFR_ALIGNMENT * MMSFR_ALIGNMENT;
+}
+
+// Numeric tag value, or the fallback if absent or not a number
+template <typename T>
+T NumericTag(const Metadata& md, const char* key, T fallback)
+{
+   try
+   {
+      std::string value = md.GetSingleTag(key).GetValue();
+      char* end;
+      double d = std::strtod(value.c_str(), &end);
+      if (end == value.c_str())
+         return fallback;
+      return static_cast<T>(d);
+   }
+   catch (const MetadataKeyError&)
+   {
+      return fallback;
+   }
+}
+
+} // anonymous namespace
+
+
+#ifdef _WIN32
+
+SharedFrameRingWriter::SharedFrameRingWriter(const std::string& name,
+      unsigned, std::size_t) throw (CMMError) :
+   name_(name),
+   header_(0),
+   size_(0),
+   published_(0),
+   skipped_(0)
+{
+   throw CMMError("Shared-memory frame rings are not supported on this platform");
+}
+
+SharedFrameRingWriter::~SharedFrameRingWriter()
+{
+}
+
+bool
+SharedFrameRingWriter::Publish(const unsigned char*, unsigned, unsigned,
+      unsigned, unsigned, const Metadata&)
+{
+   return false;
+}
+
+#else // _WIN32
+
+SharedFrameRingWriter::SharedFrameRingWriter(const std::string& name,
+      unsigned slotCount, std::size_t maxPixelBytes) throw (CMMError) :
+   name_(name),
+   threadPool_(std::make_shared<ThreadPool>()),
+   tasksMemCopy_(std::make_shared<TaskSet_CopyMemory>(threadPool_)),
+   header_(0),
+   size_(0),
+   published_(0),
+   skipped_(0)
+{
+   if (name_.size() < 2 || name_[0] != '/' ||
+         name_.find('/', 1) != std::string::npos)
+      throw CMMError("Shared memory name must be a slash followed by a name: " +
+            ToQuotedString(name_));
+   if (slotCount < 2)
+      throw CMMError("Shared frame ring needs at least 2 slots");
+   if (maxPixelBytes == 0)
+      throw CMMError("Shared frame ring slot size must not be zero");
+
+   const std::size_t headerBytes = AlignUp(sizeof(MMSFRHeader));
+   const std::size_t slotHeaderBytes = AlignUp(sizeof(MMSFRSlotHeader));
+   const std::size_t slotBytes = slotHeaderBytes + AlignUp(maxPixelBytes);
+   size_ = headerBytes + slotCount * slotBytes;
+
+   ::shm_unlink(name_.c_str()); // Stale ring from a previous session
+   int fd = ::shm_open(name_.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+   if (fd < 0)
+      throw CMMError("Cannot create shared memory " + ToQuotedString(name_) +
+            ": " + std::strerror(errno));
+   if (::ftruncate(fd, static_cast<off_t>(size_)) != 0)
+   {
+      int err = errno;
+      ::close(fd);
+      ::shm_unlink(name_.c_str());
+      throw CMMError("Cannot size shared memory " + ToQuotedString(name_) +
+            ": " + std::strerror(err));
+   }
+   void* region = ::mmap(0, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+   int err = errno;
+   ::close(fd);
+   if (region == MAP_FAILED)
+   {
+      ::shm_unlink(name_.c_str());
+      throw CMMError("Cannot map shared memory " + ToQuotedString(name_) +
+            ": " + std::strerror(err));
+   }
+
+   // The object is zero-filled, so every slot starts out empty
+   header_ = static_cast<MMSFRHeader*>(region);
+   header_->version = MMSFR_VERSION;
+   header_->headerBytes = static_cast<std::uint32_t>(headerBytes);
+   header_->slotBytes = slotBytes;
+   header_->maxPixelBytes = maxPixelBytes;
+   header_->slotCount = slotCount;
+   header_->slotHeaderBytes = static_cast<std::uint32_t>(slotHeaderBytes);
+   header_->writerPid = static_cast<std::uint32_t>(::getpid());
+   __atomic_store_n(&header_->magic, MMSFR_MAGIC, __ATOMIC_RELEASE);
+}
+
+SharedFrameRingWriter::~SharedFrameRingWriter()
+{
+   if (!header_)
+      return;
+   __atomic_store_n(&header_->closed, 1u, __ATOMIC_RELEASE);
+   ::munmap(header_, size_);
+   ::shm_unlink(name_.c_str());
+}
+
+bool
+SharedFrameRingWriter::Publish(const unsigned char* pixels, unsigned width,
+      unsigned height, unsigned byteDepth, unsigned nComponents,
+      const Metadata& md)
+{
+   const std::size_t bytes = static_cast<std::size_t>(width) * height * byteDepth;
+   if (bytes > header_->maxPixelBytes)
+   {
+      __atomic_store_n(&header_->skippedCount, ++skipped_, __ATOMIC_RELEASE);
+      return false;
+   }
+
+   const std::uint64_t frame = published_;
+   MMSFRSlotHeader* slot = reinterpret_cast<MMSFRSlotHeader*>(
+         reinterpret_cast<unsigned char*>(header_) + header_->headerBytes +
+         (frame % header_->slotCount) * header_->slotBytes);
+
+   // Seqlock write: readers that saw any of the new contents will see the
+   // new beginSequence
+   __atomic_store_n(&slot->beginSequence, frame + 1, __ATOMIC_RELAXED);
+   __atomic_thread_fence(__ATOMIC_RELEASE);
+
+   slot->width = width;
+   slot->height = height;
+   slot->bytesPerPixel = byteDepth;
+   slot->nComponents = nComponents;
+   slot->pixelBytes = bytes;
+   slot->imageNumber = NumericTag<std::int64_t>(md,
+         MM::g_Keyword_Metadata_ImageNumber, -1);
+   slot->elapsedTimeMs = NumericTag<double>(md, MM::g_Keyword_Elapsed_Time_ms,
+         -1.0);
+   std::string camera;
+   try
+   {
+      camera = md.GetSingleTag("Camera").GetValue();
+   }
+   catch (const MetadataKeyError&)
+   {
+   }
+   std::memset(slot->camera, 0, sizeof(slot->camera));
+   std::strncpy(slot->camera, camera.c_str(), sizeof(slot->camera) - 1);
+   tasksMemCopy_->MemCopy(reinterpret_cast<unsigned char*>(slot) +
+         header_->slotHeaderBytes, pixels, bytes);
+
+   __atomic_store_n(&slot->endSequence, frame + 1, __ATOMIC_RELEASE);
+   published_ = frame + 1;
+   __atomic_store_n(&header_->writeCount, published_, __ATOMIC_RELEASE);
+   return true;
+}
+
+#endif // _WIN32
+
+} // namespace mm
@@ -0,0 +1,76 @@
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//
+// DESCRIPTION:   Publishes acquired frames to a POSIX shared-memory ring for
+//                other processes; see SharedFrameRingFormat.h for the layout
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include "Error.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+class Metadata;
+class ThreadPool;
+class TaskSet_CopyMemory;
+
+struct MMSFRHeader;
+
+namespace mm
+{
+
+/**
+ * Creates a shared-memory frame ring and copies each frame it is given into
+ * the next slot, overwriting the oldest. Readers are never waited for.
+ *
+ * Only supported where POSIX shared memory is available; elsewhere the
+ * constructor throws.
+ */
+class SharedFrameRingWriter
+{
+public:
+   // Replaces any existing shared-memory object of the same name. The name
+   // should start with a slash and contain no other.
+   SharedFrameRingWriter(const std::string& name, unsigned slotCount,
+         std::size_t maxPixelBytes) throw (CMMError);
+
+   // Marks the ring closed and unlinks it
+   ~SharedFrameRingWriter();
+
+   SharedFrameRingWriter(const SharedFrameRingWriter&) = delete;
+   SharedFrameRingWriter& operator=(const SharedFrameRingWriter&) = delete;
+
+   // Returns false if the frame does not fit in a slot (it is counted in the
+   // ring's skippedCount). Must not be called concurrently.
+   bool Publish(const unsigned char* pixels, unsigned width, unsigned height,
+         unsigned byteDepth, unsigned nComponents, const Metadata& md);
+
+   std::string GetName() const { return name_; }
+   std::uint64_t GetPublishedCount() const { return published_; }
+   std::uint64_t GetSkippedCount() const { return skipped_; }
+
+private:
+   const std::string name_;
+   const std::shared_ptr<ThreadPool> threadPool_;
+   const std::shared_ptr<TaskSet_CopyMemory> tasksMemCopy_;
+   MMSFRHeader* header_;
+   std::size_t size_;
+   std::uint64_t published_;
+   std::uint64_t skipped_;
+};
+
+} // namespace mm
@@ -0,0 +1,228 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          TaskSet_FrameCompression.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Task set for parallelized lossless compression of frames.
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "TaskSet_FrameCompression.h"
+
+#include "FrameCompression.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+namespace
+{
+    // Header: raw bytes (8), sample bytes (4), block bytes (4), block count (4)
+    const size_t headerBytes = 20;
+
+    size_t BlockBytesFor(unsigned sampleBytes)
+    {
+        // A multiple of 8 samples, so that only the last block has a tail
+        return mm::g_CompressionBlockBytes / (8 * sampleBytes) * (8 * sampleBytes);
+    }
+}
+
+TaskSet_FrameCompression::ATask::ATask(std::shared_ptr<Semaphore> semDone, size_t taskIndex, size_t totalTaskCount)
+    : Task(semDone, taskIndex, totalTaskCount)
+{
+}
+
+void TaskSet_FrameCompression::ATask::SetUpCompress(const unsigned char* src, size_t bytes,
+    unsigned sampleBytes, size_t firstBlock, size_t endBlock, size_t usedTaskCount)
+{
+    compress_ = true;
+    src_ = src;
+    bytes_ = bytes;
+    sampleBytes_ = sampleBytes;
+    firstBlock_ = firstBlock;
+    endBlock_ = endBlock;
+    usedTaskCount_ = usedTaskCount;
+}
+
+void TaskSet_FrameCompression::ATask::SetUpDecompress(const unsigned char* packed,
+    const size_t* blockOffsets, unsigned char* dst, size_t bytes, unsigned sampleBytes,
+    size_t firstBlock, size_t endBlock, size_t usedTaskCount)
+{
+    compress_ = false;
+    src_ = packed;
+    blockOffsets_ = blockOffsets;
+    dst_ = dst;
+    bytes_ = bytes;
+    sampleBytes_ = sampleBytes;
+    firstBlock_ = firstBlock;
+    endBlock_ = endBlock;
+    usedTaskCount_ = usedTaskCount;
+}
+
+void TaskSet_FrameCompression::ATask::Execute()
+{
+    if (taskIndex_ >= usedTaskCount_)
+        return;
+
+    const size_t blockBytes = BlockBytesFor(sampleBytes_);
+    scratch_.resize(blockBytes);
+    ok_ = true;
+
+    if (compress_)
+    {
+        blockSizes_.clear();
+        output_.resize((endBlock_ - firstBlock_) * mm::CompressedBlockBound(blockBytes));
+        size_t out = 0;
+        for (size_t b = firstBlock_; b < endBlock_; ++b)
+        {
+            const size_t offset = b * blockBytes;
+            const size_t n = std::min(blockBytes, bytes_ - offset);
+            const size_t packed = mm::CompressBlock(src_ + offset, n, sampleBytes_,
+                &output_[out], &scratch_[0]);
+            blockSizes_.push_back(static_cast<uint32_t>(packed));
+            out += packed;
+        }
+        output_.resize(out);
+    }
+    else
+    {
+        for (size_t b = firstBlock_; b < endBlock_ && ok_; ++b)
+        {
+            const size_t offset = b * blockBytes;
+            const size_t n = std::min(blockBytes, bytes_ - offset);
+            ok_ = mm::DecompressBlock(src_ + blockOffsets_[b],
+                blockOffsets_[b + 1] - blockOffsets_[b], sampleBytes_,
+                dst_ + offset, n, &scratch_[0]);
+        }
+    }
+}
+
+TaskSet_FrameCompression::TaskSet_FrameCompression(std::shared_ptr<ThreadPool> pool)
+    : TaskSet(pool)
+{
+    CreateTasks<ATask>();
+}
+
+void TaskSet_FrameCompression::Run()
+{
+    // Small frames are handled on the calling thread
+    if (usedTaskCount_ == 1)
+    {
+        tasks_[0]->Execute();
+        return;
+    }
+    Execute();
+    Wait();
+}
+
+void TaskSet_FrameCompression::Compress(const unsigned char* src, size_t bytes,
+    unsigned sampleBytes, std::vector<unsigned char>& out)
+{
+    assert(src || bytes == 0);
+    assert(!tasks_.empty());
+    if (sampleBytes < 1 || sampleBytes > 8)
+        sampleBytes = 1;
+
+    const size_t blockBytes = BlockBytesFor(sampleBytes);
+    const size_t blockCount = (bytes + blockBytes - 1) / blockBytes;
+
+    // One task for each 1MB, as for memory copy
+    usedTaskCount_ = std::max<size_t>(1,
+        std::min<size_t>({ 1 + bytes / 1000000, tasks_.size(), blockCount }));
+    const size_t blocksPerTask = (blockCount + usedTaskCount_ - 1) / usedTaskCount_;
+    for (size_t i = 0; i < tasks_.size(); ++i)
+    {
+        const size_t first = std::min(blockCount, i * blocksPerTask);
+        const size_t end = std::min(blockCount, first + blocksPerTask);
+        static_cast<ATask*>(tasks_[i])->SetUpCompress(src, bytes, sampleBytes,
+            first, end, usedTaskCount_);
+    }
+    Run();
+
+    size_t packedBytes = headerBytes + 4 * blockCount;
+    for (size_t i = 0; i < usedTaskCount_; ++i)
+        packedBytes += static_cast<ATask*>(tasks_[i])->GetOutput().size();
+    out.resize(packedBytes);
+
+    const uint64_t rawBytes = bytes;
+    const uint32_t header[3] = { sampleBytes, static_cast<uint32_t>(blockBytes),
+        static_cast<uint32_t>(blockCount) };
+    std::memcpy(&out[0], &rawBytes, 8);
+    std::memcpy(&out[8], header, 12);
+    size_t sizePos = headerBytes;
+    size_t dataPos = headerBytes + 4 * blockCount;
+    for (size_t i = 0; i < usedTaskCount_; ++i)
+    {
+        const ATask* task = static_cast<ATask*>(tasks_[i]);
+        const std::vector<uint32_t>& sizes = task->GetBlockSizes();
+        if (!sizes.empty())
+            std::memcpy(&out[sizePos], &sizes[0], 4 * sizes.size());
+        sizePos += 4 * sizes.size();
+        const std::vector<unsigned char>& data = task->GetOutput();
+        if (!data.empty())
+            std::memcpy(&out[dataPos], &data[0], data.size());
+        dataPos += data.size();
+    }
+}
+
+bool TaskSet_FrameCompression::Decompress(const unsigned char* packed, size_t packedBytes,
+    unsigned char* dst, size_t bytes)
+{
+    assert(!tasks_.empty());
+    if (packedBytes < headerBytes)
+        return false;
+
+    uint64_t rawBytes;
+    uint32_t header[3];
+    std::memcpy(&rawBytes, packed, 8);
+    std::memcpy(header, packed + 8, 12);
+    const unsigned sampleBytes = header[0];
+    const size_t blockBytes = header[1];
+    const size_t blockCount = header[2];
+    if (rawBytes != bytes || sampleBytes < 1 || sampleBytes > 8 ||
+        blockBytes != BlockBytesFor(sampleBytes) ||
+        blockCount != (bytes + blockBytes - 1) / blockBytes ||
+        packedBytes < headerBytes + 4 * blockCount)
+        return false;
+
+    blockOffsets_.resize(blockCount + 1);
+    size_t offset = headerBytes + 4 * blockCount;
+    for (size_t b = 0; b < blockCount; ++b)
+    {
+        uint32_t size;
+        std::memcpy(&size, packed + headerBytes + 4 * b, 4);
+        blockOffsets_[b] = offset;
+        offset += size;
+    }
+    blockOffsets_[blockCount] = offset;
+    if (offset != packedBytes)
+        return false;
+
+    usedTaskCount_ = std::max<size_t>(1,
+        std::min<size_t>({ 1 + bytes / 1000000, tasks_.size(), blockCount }));
+    const size_t blocksPerTask = (blockCount + usedTaskCount_ - 1) / usedTaskCount_;
+    for (size_t i = 0; i < tasks_.size(); ++i)
+    {
+        const size_t first = std::min(blockCount, i * blocksPerTask);
+        const size_t end = std::min(blockCount, first + blocksPerTask);
+        static_cast<ATask*>(tasks_[i])->SetUpDecompress(packed, &blockOffsets_[0],
+            dst, bytes, sampleBytes, first, end, usedTaskCount_);
+    }
+    Run();
+
+    for (size_t i = 0; i < usedTaskCount_; ++i)
+    {
+        if (!static_cast<ATask*>(tasks_[i])->Succeeded())
+            return false;
+    }
+    return true;
+}
@@ -0,0 +1,85 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          TaskSet_FrameCompression.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Task set for parallelized lossless compression of frames.
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include "TaskSet.h"
+
+#include <cstdint>
+#include <vector>
+
+// Compresses a frame as independent blocks (see FrameCompression.h), the
+// blocks being divided among the tasks. A compressed frame starts with a
+// header (raw size, sample size, block size and count, then the compressed
+// size of each block) followed by the blocks.
+//
+// One operation at a time; use separate instances for concurrent callers.
+class TaskSet_FrameCompression : public TaskSet
+{
+private:
+    class ATask : public Task
+    {
+    public:
+        explicit ATask(std::shared_ptr<Semaphore> semDone, size_t taskIndex, size_t totalTaskCount);
+
+        void SetUpCompress(const unsigned char* src, size_t bytes, unsigned sampleBytes,
+            size_t firstBlock, size_t endBlock, size_t usedTaskCount);
+        void SetUpDecompress(const unsigned char* packed, const size_t* blockOffsets,
+            unsigned char* dst, size_t bytes, unsigned sampleBytes,
+            size_t firstBlock, size_t endBlock, size_t usedTaskCount);
+
+        virtual void Execute() override;
+
+        const std::vector<unsigned char>& GetOutput() const { return output_; }
+        const std::vector<uint32_t>& GetBlockSizes() const { return blockSizes_; }
+        bool Succeeded() const { return ok_; }
+
+    private:
+        bool compress_{ true };
+        const unsigned char* src_{ nullptr };
+        const size_t* blockOffsets_{ nullptr };
+        unsigned char* dst_{ nullptr };
+        size_t bytes_{ 0 };
+        unsigned sampleBytes_{ 1 };
+        size_t firstBlock_{ 0 };
+        size_t endBlock_{ 0 };
+        bool ok_{ true };
+
+        std::vector<unsigned char> output_{};
+        std::vector<uint32_t> blockSizes_{};
+        std::vector<unsigned char> scratch_{};
+    };
+
+public:
+    explicit TaskSet_FrameCompression(std::shared_ptr<ThreadPool> pool);
+
+    // Compresses bytes at src, made of samples of sampleBytes, replacing the
+    // contents of out
+    void Compress(const unsigned char* src, size_t bytes, unsigned sampleBytes,
+        std::vector<unsigned char>& out);
+
+    // Restores a compressed frame of the given raw size into dst; returns
+    // false if the data is inconsistent
+    bool Decompress(const unsigned char* packed, size_t packedBytes,
+        unsigned char* dst, size_t bytes);
+
+private:
+    void Run();
+
+    std::vector<size_t> blockOffsets_{};
+};
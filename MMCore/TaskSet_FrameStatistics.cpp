@@ -0,0 +1,90 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          TaskSet_FrameStatistics.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Task set for parallelized computation of image statistics,
+//                optionally fused with the image copy.
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "TaskSet_FrameStatistics.h"
+
+#include <algorithm>
+#include <cassert>
+
+TaskSet_FrameStatistics::ATask::ATask(std::shared_ptr<Semaphore> semDone, size_t taskIndex, size_t totalTaskCount)
+    : Task(semDone, taskIndex, totalTaskCount)
+{
+}
+
+void TaskSet_FrameStatistics::ATask::SetUp(const unsigned char* src, unsigned char* dst,
+    size_t pixels, unsigned byteDepth, unsigned bitDepth, unsigned bins, size_t usedTaskCount)
+{
+    src_ = src;
+    dst_ = dst;
+    pixels_ = pixels;
+    byteDepth_ = byteDepth;
+    bitDepth_ = bitDepth;
+    usedTaskCount_ = usedTaskCount;
+    stats_.Reset(bins);
+}
+
+void TaskSet_FrameStatistics::ATask::Execute()
+{
+    if (taskIndex_ >= usedTaskCount_)
+        return;
+
+    // Each task gets a contiguous range of whole pixels
+    const size_t chunk = pixels_ / usedTaskCount_;
+    const size_t begin = taskIndex_ * chunk;
+    const size_t count = (taskIndex_ == usedTaskCount_ - 1) ? pixels_ - begin : chunk;
+    const size_t offset = begin * byteDepth_;
+    mm::AccumulateFrameStatistics(src_ + offset, dst_ ? dst_ + offset : nullptr,
+        count, byteDepth_, bitDepth_, stats_);
+}
+
+TaskSet_FrameStatistics::TaskSet_FrameStatistics(std::shared_ptr<ThreadPool> pool)
+    : TaskSet(pool)
+{
+    CreateTasks<ATask>();
+}
+
+void TaskSet_FrameStatistics::Compute(const unsigned char* src, unsigned char* dst,
+    size_t pixels, unsigned byteDepth, unsigned bitDepth, unsigned bins,
+    mm::FrameStatistics& stats)
+{
+    assert(src || pixels == 0);
+    assert(!tasks_.empty());
+
+    // One task for each 1MB, as for memory copy
+    const size_t bytes = pixels * byteDepth;
+    usedTaskCount_ = std::min<size_t>(1 + bytes / 1000000, tasks_.size());
+    for (Task* task : tasks_)
+        static_cast<ATask*>(task)->SetUp(src, dst, pixels, byteDepth, bitDepth,
+            bins, usedTaskCount_);
+
+    // Small frames are handled on the calling thread
+    if (usedTaskCount_ == 1)
+    {
+        tasks_[0]->Execute();
+    }
+    else
+    {
+        Execute();
+        Wait();
+    }
+
+    stats.Reset(bins);
+    for (size_t i = 0; i < usedTaskCount_; ++i)
+        stats.Merge(static_cast<ATask*>(tasks_[i])->GetStatistics());
+}
@@ -0,0 +1,62 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          TaskSet_FrameStatistics.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Task set for parallelized computation of image statistics,
+//                optionally fused with the image copy.
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include "FrameStatistics.h"
+#include "TaskSet.h"
+
+// Each task accumulates the statistics of a contiguous range of pixels into
+// its own partial result; the partial results are merged after the wait.
+//
+// One operation at a time; use separate instances for concurrent callers.
+class TaskSet_FrameStatistics : public TaskSet
+{
+private:
+    class ATask : public Task
+    {
+    public:
+        explicit ATask(std::shared_ptr<Semaphore> semDone, size_t taskIndex, size_t totalTaskCount);
+
+        void SetUp(const unsigned char* src, unsigned char* dst, size_t pixels,
+            unsigned byteDepth, unsigned bitDepth, unsigned bins, size_t usedTaskCount);
+
+        virtual void Execute() override;
+
+        const mm::FrameStatistics& GetStatistics() const { return stats_; }
+
+    private:
+        const unsigned char* src_{ nullptr };
+        unsigned char* dst_{ nullptr };
+        size_t pixels_{ 0 };
+        unsigned byteDepth_{ 1 };
+        unsigned bitDepth_{ 8 };
+        mm::FrameStatistics stats_{};
+    };
+
+public:
+    explicit TaskSet_FrameStatistics(std::shared_ptr<ThreadPool> pool);
+
+    // Computes the statistics of pixels of byteDepth 1 or 2 at src into stats,
+    // with a histogram of the given number of bins, copying the pixels to dst
+    // if it is not null
+    void Compute(const unsigned char* src, unsigned char* dst, size_t pixels,
+        unsigned byteDepth, unsigned bitDepth, unsigned bins,
+        mm::FrameStatistics& stats);
+};
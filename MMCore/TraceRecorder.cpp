@@ -0,0 +1,361 @@
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//
+// DESCRIPTION:   Timeline tracing of Core, device and buffer activity, for
+//                viewing in chrome://tracing or Perfetto
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "TraceRecorder.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <vector>
+
+namespace mm
+{
+
+namespace
+{
+
+struct TraceEvent
+{
+   const char* name;
+   const char* category;
+   const char* device;
+   std::int64_t startNs; // Since the recorder's origin
+   std::int64_t durationNs; // Negative for instant events
+};
+
+
+// Single-producer ring of one thread's events. The owning thread writes
+// without locking; readers copy the slots and then discard any that the
+// owner may have overwritten meanwhile.
+class ThreadRing
+{
+   static const std::uint64_t Mask = TraceRecorder::EventsPerThread - 1;
+
+   std::vector<TraceEvent> events_;
+   std::atomic<std::uint64_t> written_;
+   std::atomic<std::uint64_t> cleared_;
+   std::atomic<bool> exited_;
+   const int tid_;
+
+public:
+   std::string name; // Guarded by the registry mutex
+
+   explicit ThreadRing(int tid) :
+      events_(TraceRecorder::EventsPerThread),
+      written_(0),
+      cleared_(0),
+      exited_(false),
+      tid_(tid)
+   {}
+
+   int GetTid() const { return tid_; }
+   bool HasExited() const { return exited_.load(std::memory_order_acquire); }
+   void MarkExited() { exited_.store(true, std::memory_order_release); }
+
+   void Push(const TraceEvent& e)
+   {
+      std::uint64_t i = written_.load(std::memory_order_relaxed);
+      events_[i & Mask] = e;
+      written_.store(i + 1, std::memory_order_release);
+   }
+
+   void Clear()
+   {
+      cleared_.store(written_.load(std::memory_order_acquire),
+            std::memory_order_relaxed);
+   }
+
+   void Snapshot(std::vector<TraceEvent>& out) const
+   {
+      const std::uint64_t capacity = TraceRecorder::EventsPerThread;
+      std::uint64_t end = written_.load(std::memory_order_acquire);
+      std::uint64_t begin = end > capacity ? end - capacity : 0;
+      std::uint64_t cleared = cleared_.load(std::memory_order_relaxed);
+      if (cleared > begin)
+         begin = cleared;
+
+      std::size_t first = out.size();
+      for (std::uint64_t i = begin; i < end; ++i)
+         out.push_back(events_[i & Mask]);
+
+      // The owner may be writing event number 'after' right now, into the
+      // slot of event number 'after - capacity'
+      std::uint64_t after = written_.load(std::memory_order_acquire);
+      if (after + 1 > capacity + begin)
+      {
+         std::uint64_t stale = after + 1 - capacity - begin;
+         if (stale > end - begin)
+            stale = end - begin;
+         out.erase(out.begin() + first, out.begin() + first + stale);
+      }
+   }
+};
+
+
+class Registry
+{
+   std::mutex mutex_;
+   std::vector<std::shared_ptr<ThreadRing>> rings_;
+   int nextTid_;
+   std::set<std::string> interned_; // Set nodes never move
+   const TraceRecorder::TimePoint origin_;
+
+public:
+   static Registry& Instance()
+   {
+      static Registry instance;
+      return instance;
+   }
+
+   Registry() :
+      nextTid_(1),
+      origin_(std::chrono::steady_clock::now())
+   {}
+
+   std::int64_t SinceOrigin(TraceRecorder::TimePoint t) const
+   {
+      return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            t - origin_).count();
+   }
+
+   std::shared_ptr<ThreadRing> NewRing()
+   {
+      std::lock_guard<std::mutex> lock(mutex_);
+      std::shared_ptr<ThreadRing> ring =
+         std::make_shared<ThreadRing>(nextTid_++);
+      rings_.push_back(ring);
+      return ring;
+   }
+
+   void SetName(ThreadRing& ring, const std::string& name)
+   {
+      std::lock_guard<std::mutex> lock(mutex_);
+      ring.name = name;
+   }
+
+   const char* Intern(const std::string& str)
+   {
+      std::lock_guard<std::mutex> lock(mutex_);
+      return interned_.insert(str).first->c_str();
+   }
+
+   void Clear()
+   {
+      std::lock_guard<std::mutex> lock(mutex_);
+      std::vector<std::shared_ptr<ThreadRing>> live;
+      for (std::size_t i = 0; i < rings_.size(); ++i)
+      {
+         rings_[i]->Clear();
+         if (!rings_[i]->HasExited())
+            live.push_back(rings_[i]);
+      }
+      rings_.swap(live);
+   }
+
+   struct Lane
+   {
+      int tid;
+      std::string name;
+      std::vector<TraceEvent> events;
+   };
+
+   std::vector<Lane> Snapshot()
+   {
+      std::lock_guard<std::mutex> lock(mutex_);
+      std::vector<Lane> lanes(rings_.size());
+      for (std::size_t i = 0; i < rings_.size(); ++i)
+      {
+         lanes[i].tid = rings_[i]->GetTid();
+         lanes[i].name = rings_[i]->name;
+         rings_[i]->Snapshot(lanes[i].events);
+      }
+      return lanes;
+   }
+};
+
+
+// Marks the thread's ring as orphaned when the thread exits, so that Clear()
+// can drop it once its events are no longer wanted
+struct ThreadSlot
+{
+   std::shared_ptr<ThreadRing> ring;
+   ~ThreadSlot() { if (ring) ring->MarkExited(); }
+};
+
+thread_local ThreadSlot t_slot;
+
+ThreadRing& CurrentRing()
+{
+   if (!t_slot.ring)
+      t_slot.ring = Registry::Instance().NewRing();
+   return *t_slot.ring;
+}
+
+
+void WriteJSONString(std::ostream& out, const char* s)
+{
+   out << '"';
+   for (; *s; ++s)
+   {
+      unsigned char ch = static_cast<unsigned char>(*s);
+      if (ch == '"' || ch == '\\')
+         out << '\\' << *s;
+      else if (ch < 0x20)
+      {
+         char buf[8];
+         std::snprintf(buf, sizeof(buf), "\\u%04x", ch);
+         out << buf;
+      }
+      else
+         out << *s;
+   }
+   out << '"';
+}
+
+// Microseconds with nanosecond digits, independent of stream locale
+void WriteMicroseconds(std::ostream& out, std::int64_t ns)
+{
+   if (ns < 0)
+   {
+      out << '-';
+      ns = -ns;
+   }
+   char buf[32];
+   std::snprintf(buf, sizeof(buf), "%lld.%03d",
+         static_cast<long long>(ns / 1000), static_cast<int>(ns % 1000));
+   out << buf;
+}
+
+} // anonymous namespace
+
+
+const std::size_t TraceRecorder::EventsPerThread;
+std::atomic<bool> TraceRecorder::enabled_(false);
+
+
+void
+TraceRecorder::SetEnabled(bool enabled)
+{
+   if (enabled)
+      Registry::Instance(); // Fix the time origin before the first event
+   enabled_.store(enabled, std::memory_order_relaxed);
+}
+
+void
+TraceRecorder::RecordSpan(const char* name, const char* category,
+      const char* device, TimePoint start, TimePoint end)
+{
+   Registry& registry = Registry::Instance();
+   TraceEvent e;
+   e.name = name;
+   e.category = category;
+   e.device = device;
+   e.startNs = registry.SinceOrigin(start);
+   e.durationNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+         end - start).count();
+   if (e.durationNs < 0)
+      e.durationNs = 0;
+   CurrentRing().Push(e);
+}
+
+void
+TraceRecorder::RecordInstant(const char* name, const char* category,
+      const char* device)
+{
+   if (!IsEnabled())
+      return;
+   TraceEvent e;
+   e.name = name;
+   e.category = category;
+   e.device = device;
+   e.startNs = Registry::Instance().SinceOrigin(
+         std::chrono::steady_clock::now());
+   e.durationNs = -1;
+   CurrentRing().Push(e);
+}
+
+const char*
+TraceRecorder::Intern(const std::string& str)
+{
+   return Registry::Instance().Intern(str);
+}
+
+void
+TraceRecorder::SetCurrentThreadName(const std::string& name)
+{
+   Registry::Instance().SetName(CurrentRing(), name);
+}
+
+void
+TraceRecorder::Clear()
+{
+   Registry::Instance().Clear();
+}
+
+void
+TraceRecorder::WriteChromeJSON(std::ostream& out)
+{
+   std::vector<Registry::Lane> lanes = Registry::Instance().Snapshot();
+
+   out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+   out << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,"
+      "\"args\":{\"name\":\"MMCore\"}}";
+   for (std::size_t i = 0; i < lanes.size(); ++i)
+   {
+      const Registry::Lane& lane = lanes[i];
+      if (lane.events.empty())
+         continue;
+
+      std::string name = lane.name.empty() ?
+         "Thread " + std::to_string(lane.tid) : lane.name;
+      out << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" <<
+         lane.tid << ",\"args\":{\"name\":";
+      WriteJSONString(out, name.c_str());
+      out << "}}";
+
+      for (std::size_t j = 0; j < lane.events.size(); ++j)
+      {
+         const TraceEvent& e = lane.events[j];
+         out << ",\n{\"name\":";
+         WriteJSONString(out, e.name);
+         out << ",\"cat\":";
+         WriteJSONString(out, e.category);
+         if (e.durationNs < 0)
+            out << ",\"ph\":\"i\",\"s\":\"t\"";
+         else
+         {
+            out << ",\"ph\":\"X\",\"dur\":";
+            WriteMicroseconds(out, e.durationNs);
+         }
+         out << ",\"ts\":";
+         WriteMicroseconds(out, e.startNs);
+         out << ",\"pid\":1,\"tid\":" << lane.tid;
+         if (e.device)
+         {
+            out << ",\"args\":{\"device\":";
+            WriteJSONString(out, e.device);
+            out << "}";
+         }
+         out << "}";
+      }
+   }
+   out << "\n]}\n";
+}
+
+} // namespace mm
@@ -0,0 +1,110 @@
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//
+// DESCRIPTION:   Timeline tracing of Core, device and buffer activity, for
+//                viewing in chrome://tracing or Perfetto
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <ostream>
+#include <string>
+
+namespace mm
+{
+
+/**
+ * Process-wide recorder of timed spans and instant events.
+ *
+ * Each thread that records an event gets its own fixed-size ring (the oldest
+ * events are overwritten when it is full), so recording takes no locks and
+ * does not allocate after the thread's first event. Nothing is recorded while
+ * tracing is disabled; the check is a single relaxed atomic load.
+ *
+ * Event names, categories and device labels (which may be null) are stored
+ * as pointers and must stay valid for the life of the process: use string
+ * literals, or Intern().
+ */
+class TraceRecorder
+{
+public:
+   // Ring size; must be a power of 2. Up to EventsPerThread - 1 of the most
+   // recent events of each thread can be written out.
+   static const std::size_t EventsPerThread = 16384;
+
+   typedef std::chrono::steady_clock::time_point TimePoint;
+
+   static void SetEnabled(bool enabled);
+   static bool IsEnabled()
+   { return enabled_.load(std::memory_order_relaxed); }
+
+   static void RecordSpan(const char* name, const char* category,
+         const char* device, TimePoint start, TimePoint end);
+   static void RecordInstant(const char* name, const char* category,
+         const char* device);
+
+   // Returns a pointer to a permanent copy of str (one per distinct string)
+   static const char* Intern(const std::string& str);
+
+   // Name shown for the calling thread's lane
+   static void SetCurrentThreadName(const std::string& name);
+
+   // Discards recorded events (and the rings of threads that have exited)
+   static void Clear();
+
+   // Writes the recorded events in the Chrome trace event JSON format.
+   // Events recorded concurrently may or may not be included.
+   static void WriteChromeJSON(std::ostream& out);
+
+private:
+   static std::atomic<bool> enabled_;
+};
+
+
+/**
+ * Records the lifetime of the object as a span, if tracing was enabled when
+ * it was created.
+ */
+class TraceSpan
+{
+public:
+   TraceSpan(const char* name, const char* category, const char* device = 0) :
+      name_(TraceRecorder::IsEnabled() ? name : 0),
+      category_(category),
+      device_(device)
+   {
+      if (name_)
+         start_ = std::chrono::steady_clock::now();
+   }
+
+   ~TraceSpan()
+   {
+      if (name_)
+         TraceRecorder::RecordSpan(name_, category_, device_, start_,
+               std::chrono::steady_clock::now());
+   }
+
+private:
+   TraceSpan(const TraceSpan&) = delete;
+   TraceSpan& operator=(const TraceSpan&) = delete;
+
+   const char* name_;
+   const char* category_;
+   const char* device_;
+   TraceRecorder::TimePoint start_;
+};
+
+} // namespace mm
@@ -1,6 +1,7 @@
 #include <gtest/gtest.h>
 
 #include "MMCore.h"
+#include "../MMDevice/ImageMetadata.h"
 
 TEST(APIErrorTests, SetFocusDirectionWithInvalidDevice)
 {
@@ -86,6 +87,18 @@ TEST(APIErrorTests, DetectDeviceWithInvalidDevice)
    EXPECT_EQ(MM::Unimplemented, c.detectDevice("Core"));
 }
 
+TEST(APIErrorTests, PinnedImagesWithInvalidID)
+{
+   CMMCore c;
+   Metadata md;
+   EXPECT_THROW(c.popNextImagePinned(md), CMMError);
+   EXPECT_THROW(c.popNextImagePinned("Blah", md), CMMError);
+   EXPECT_THROW(c.getPinnedImagePixels(1), CMMError);
+   EXPECT_THROW(c.getPinnedImageBufferSize(0), CMMError);
+   EXPECT_THROW(c.releasePinnedImage(-1), CMMError);
+   EXPECT_EQ(0, c.getPinnedImageCount());
+}
+
 int main(int argc, char **argv)
 {
    ::testing::InitGoogleTest(&argc, argv);
@@ -0,0 +1,209 @@
+#include <gtest/gtest.h>
+
+#include "AcquisitionEngine.h"
+#include "MMCore.h"
+
+#include <string>
+#include <vector>
+
+using namespace mm;
+
+namespace
+{
+   // Two channels differing in a filter position and an LED intensity
+   SequencingLimits TwoChannelLimits(long filterMax, long ledMax)
+   {
+      SequencingLimits limits;
+      limits.cameraBurst = true;
+      const char* filters[] = { "1", "2" };
+      const char* leds[] = { "10", "80" };
+      for (int c = 0; c < 2; ++c)
+      {
+         Configuration config;
+         config.addSetting(PropertySetting("Wheel", "State", filters[c]));
+         config.addSetting(PropertySetting("LED", "Intensity", leds[c]));
+         config.addSetting(PropertySetting("Shutter", "State", "1"));
+         limits.channelSettings.push_back(config);
+      }
+      limits.properties[PropertySetting::generateKey("Wheel", "State")] = filterMax;
+      limits.properties[PropertySetting::generateKey("LED", "Intensity")] = ledMax;
+      limits.properties[PropertySetting::generateKey("Shutter", "State")] = 0;
+      return limits;
+   }
+
+   AcquisitionPlan ZStackTwoChannels(bool channelsFirst)
+   {
+      AcquisitionPlan plan;
+      plan.setChannelGroup("Channel");
+      plan.addChannel("DAPI", 10.0);
+      plan.addChannel("GFP", 10.0);
+      for (int z = 0; z < 5; ++z)
+         plan.addZPosition(z * 0.5);
+      plan.setChannelsFirst(channelsFirst);
+      return plan;
+   }
+}
+
+TEST(AcquisitionEngineTests, EmptyPlanIsOneSoftwareImage)
+{
+   std::vector<AcquisitionRun> runs =
+      AcquisitionEngine::Compile(AcquisitionPlan(), SequencingLimits());
+   ASSERT_EQ(1u, runs.size());
+   EXPECT_EQ(AcquisitionRun::Software, runs[0].kind);
+   ASSERT_EQ(1u, runs[0].events.size());
+}
+
+TEST(AcquisitionEngineTests, TimeSeriesBecomesCameraBurst)
+{
+   AcquisitionPlan plan;
+   plan.setTimepoints(100, 50.0);
+   SequencingLimits limits;
+   limits.cameraBurst = true;
+   limits.cameraExposureMs = 50.0;
+   std::vector<AcquisitionRun> runs = AcquisitionEngine::Compile(plan, limits);
+   ASSERT_EQ(1u, runs.size());
+   EXPECT_EQ(AcquisitionRun::TimeSequence, runs[0].kind);
+   ASSERT_EQ(100u, runs[0].events.size());
+   EXPECT_EQ(99, runs[0].events.back().frame);
+
+   limits.cameraBurst = false;
+   runs = AcquisitionEngine::Compile(plan, limits);
+   ASSERT_EQ(100u, runs.size());
+   EXPECT_EQ(AcquisitionRun::Software, runs[0].kind);
+}
+
+TEST(AcquisitionEngineTests, LongIntervalTimedInSoftware)
+{
+   AcquisitionPlan plan;
+   plan.setTimepoints(10, 100.0);
+   SequencingLimits limits;
+   limits.cameraBurst = true;
+   limits.cameraExposureMs = 10.0;
+   std::vector<AcquisitionRun> runs = AcquisitionEngine::Compile(plan, limits);
+   ASSERT_EQ(10u, runs.size());
+   for (std::size_t i = 0; i < runs.size(); ++i)
+   {
+      EXPECT_EQ(AcquisitionRun::Software, runs[i].kind);
+      ASSERT_EQ(1u, runs[i].events.size());
+      EXPECT_EQ(static_cast<long>(i), runs[i].events[0].frame);
+   }
+
+   // As fast as possible
+   plan.setTimepoints(10, 0.0);
+   runs = AcquisitionEngine::Compile(plan, limits);
+   ASSERT_EQ(1u, runs.size());
+   EXPECT_EQ(AcquisitionRun::TimeSequence, runs[0].kind);
+
+   // The exposure of the plan's channel counts
+   plan.setTimepoints(10, 100.0);
+   plan.setChannelGroup("Channel");
+   plan.addChannel("DAPI", 200.0);
+   runs = AcquisitionEngine::Compile(plan, limits);
+   ASSERT_EQ(1u, runs.size());
+   EXPECT_EQ(AcquisitionRun::TimeSequence, runs[0].kind);
+}
+
+TEST(AcquisitionEngineTests, WholeBlockSequencedWhenEverythingIs)
+{
+   AcquisitionPlan plan = ZStackTwoChannels(true);
+   plan.setTimepoints(3, 1000.0);
+   plan.addXYPosition(0.0, 0.0);
+   plan.addXYPosition(100.0, 0.0);
+   SequencingLimits limits = TwoChannelLimits(100, 100);
+   limits.zStage = 100;
+
+   std::vector<AcquisitionRun> runs = AcquisitionEngine::Compile(plan, limits);
+   ASSERT_EQ(6u, runs.size()); // One per time point and position
+   for (std::size_t i = 0; i < runs.size(); ++i)
+   {
+      EXPECT_EQ(AcquisitionRun::DeviceSequence, runs[i].kind);
+      EXPECT_EQ(10u, runs[i].events.size());
+      EXPECT_TRUE(runs[i].sequenceZ);
+      EXPECT_FALSE(runs[i].sequenceExposure);
+      EXPECT_EQ(2u, runs[i].sequencedProperties.size()); // Not the shutter
+   }
+   EXPECT_EQ(1, runs[1].events[0].position);
+   EXPECT_EQ(1, runs[2].events[0].frame);
+
+   // Channels innermost
+   const AcquisitionEvent& second = runs[0].events[1];
+   EXPECT_EQ(1, second.channel);
+   EXPECT_EQ(0, second.slice);
+}
+
+TEST(AcquisitionEngineTests, FallsBackToZStackPerChannel)
+{
+   // The filter wheel cannot be sequenced: channels are set in software,
+   // with a Z sequence in each
+   AcquisitionPlan plan = ZStackTwoChannels(false);
+   SequencingLimits limits = TwoChannelLimits(0, 100);
+   limits.zStage = 100;
+
+   std::vector<AcquisitionRun> runs = AcquisitionEngine::Compile(plan, limits);
+   ASSERT_EQ(2u, runs.size());
+   for (std::size_t c = 0; c < runs.size(); ++c)
+   {
+      EXPECT_EQ(AcquisitionRun::DeviceSequence, runs[c].kind);
+      EXPECT_TRUE(runs[c].sequenceZ);
+      EXPECT_TRUE(runs[c].sequencedProperties.empty());
+      ASSERT_EQ(5u, runs[c].events.size());
+      EXPECT_EQ(long(c), runs[c].events[0].channel);
+   }
+}
+
+TEST(AcquisitionEngineTests, SoftwareWhenSequencesTooShort)
+{
+   AcquisitionPlan plan = ZStackTwoChannels(true);
+   SequencingLimits limits = TwoChannelLimits(100, 100);
+   limits.zStage = 4; // Fewer than the 10 events of the block
+
+   std::vector<AcquisitionRun> runs = AcquisitionEngine::Compile(plan, limits);
+   // Channels first: one channel sequence per slice
+   ASSERT_EQ(5u, runs.size());
+   EXPECT_EQ(AcquisitionRun::DeviceSequence, runs[0].kind);
+   EXPECT_FALSE(runs[0].sequenceZ);
+   EXPECT_EQ(2u, runs[0].events.size());
+
+   limits = TwoChannelLimits(1, 100);
+   runs = AcquisitionEngine::Compile(plan, limits);
+   ASSERT_EQ(5u, runs.size());
+   EXPECT_EQ(AcquisitionRun::Software, runs[0].kind);
+   EXPECT_EQ(2u, runs[0].events.size());
+}
+
+TEST(AcquisitionEngineTests, DifferingExposuresNeedExposureSequence)
+{
+   AcquisitionPlan plan;
+   plan.setChannelGroup("Channel");
+   plan.addChannel("DAPI", 10.0);
+   plan.addChannel("GFP", 50.0);
+   SequencingLimits limits = TwoChannelLimits(100, 100);
+
+   std::vector<AcquisitionRun> runs = AcquisitionEngine::Compile(plan, limits);
+   ASSERT_EQ(1u, runs.size());
+   EXPECT_EQ(AcquisitionRun::Software, runs[0].kind);
+
+   limits.exposure = 2;
+   runs = AcquisitionEngine::Compile(plan, limits);
+   ASSERT_EQ(1u, runs.size());
+   EXPECT_EQ(AcquisitionRun::DeviceSequence, runs[0].kind);
+   EXPECT_TRUE(runs[0].sequenceExposure);
+   EXPECT_EQ("Frame 0, position 0: hardware sequence of 2 images "
+         "(exposure, Wheel-State, LED-Intensity)\n",
+         AcquisitionEngine::Describe(runs));
+}
+
+TEST(AcquisitionEngineTests, CoreRejectsPlanWithoutCamera)
+{
+   CMMCore c;
+   EXPECT_THROW(c.startAcquisition(AcquisitionPlan()), CMMError);
+   EXPECT_FALSE(c.isAcquisitionRunning());
+   c.stopAcquisition(); // No-op
+   c.waitForAcquisition();
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
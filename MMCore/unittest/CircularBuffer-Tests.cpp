@@ -0,0 +1,351 @@
+#include <gtest/gtest.h>
+
+#include "CircularBuffer.h"
+#include "../MMDevice/ImageMetadata.h"
+#include "../MMDevice/MMDeviceConstants.h"
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace
+{
+   // Opaque camera keys
+   int cameraA;
+   int cameraB;
+
+   std::vector<unsigned char> Pixels(unsigned w, unsigned h, unsigned depth,
+         unsigned char value)
+   {
+      return std::vector<unsigned char>((std::size_t)w * h * depth, value);
+   }
+
+   bool Insert(CircularBuffer& cb, unsigned w, unsigned h, unsigned depth,
+         unsigned char value, const void* camera)
+   {
+      std::vector<unsigned char> pixels = Pixels(w, h, depth, value);
+      Metadata md;
+      return cb.InsertImage(&pixels[0], w, h, depth, 1, &md, camera);
+   }
+
+   std::string Tag(const mm::ImgBuffer* img, const char* key)
+   {
+      return img->GetMetadata().GetSingleTag(key).GetValue();
+   }
+}
+
+TEST(CircularBufferTests, AcceptsImagesOfAnyGeometry)
+{
+   CircularBuffer cb(1);
+   ASSERT_TRUE(cb.Initialize(1, 64, 64, 1));
+   ASSERT_TRUE(Insert(cb, 64, 64, 1, 1, &cameraA));
+   ASSERT_TRUE(Insert(cb, 32, 16, 2, 2, &cameraA));
+   ASSERT_TRUE(Insert(cb, 100, 3, 4, 3, &cameraA));
+   EXPECT_EQ(3u, cb.GetRemainingImageCount());
+
+   EXPECT_EQ(64u * 64u, cb.GetNextImageBufferSize());
+   const mm::ImgBuffer* img = cb.GetNextImageBuffer(0);
+   ASSERT_TRUE(img != 0);
+   EXPECT_EQ(64u, img->Width());
+   EXPECT_EQ(1, img->GetPixels()[0]);
+   EXPECT_EQ(32u * 16u * 2u, cb.GetNextImageBufferSize());
+   img = cb.GetNextImageBuffer(0);
+   ASSERT_TRUE(img != 0);
+   EXPECT_EQ(32u, img->Width());
+   EXPECT_EQ(16u, img->Height());
+   EXPECT_EQ(2u, img->Depth());
+   EXPECT_EQ("GRAY16", Tag(img, "PixelType"));
+   EXPECT_EQ(2, img->GetPixels()[32 * 16 * 2 - 1]);
+   img = cb.GetNextImageBuffer(0);
+   ASSERT_TRUE(img != 0);
+   EXPECT_EQ(100u, img->Width());
+   EXPECT_EQ(3, img->GetPixels()[0]);
+   EXPECT_EQ(0u, cb.GetNextImageBufferSize());
+   EXPECT_TRUE(cb.GetNextImageBuffer(0) == 0);
+}
+
+TEST(CircularBufferTests, ImageTooLargeForBudgetThrows)
+{
+   CircularBuffer cb(1);
+   ASSERT_TRUE(cb.Initialize(1, 64, 64, 1));
+   std::vector<unsigned char> pixels = Pixels(1024, 1024, 2, 0);
+   EXPECT_THROW(cb.InsertImage(&pixels[0], 1024, 1024, 2, 1, 0, &cameraA),
+         CMMError);
+}
+
+TEST(CircularBufferTests, PerCameraAndGlobalPops)
+{
+   CircularBuffer cb(1);
+   ASSERT_TRUE(cb.Initialize(1, 16, 16, 1));
+   ASSERT_TRUE(Insert(cb, 16, 16, 1, 10, &cameraA));
+   ASSERT_TRUE(Insert(cb, 8, 8, 2, 20, &cameraB));
+   ASSERT_TRUE(Insert(cb, 16, 16, 1, 11, &cameraA));
+   ASSERT_TRUE(Insert(cb, 8, 8, 2, 21, &cameraB));
+   EXPECT_EQ(2u, cb.GetRemainingImageCount(&cameraA));
+   EXPECT_EQ(2u, cb.GetRemainingImageCount(&cameraB));
+
+   // Latest per camera, and overall
+   EXPECT_EQ(11, cb.GetTopImageBuffer(0, &cameraA)->GetPixels()[0]);
+   EXPECT_EQ(21, cb.GetTopImageBuffer(0, &cameraB)->GetPixels()[0]);
+   EXPECT_EQ(21, cb.GetTopImage()[0]);
+   EXPECT_EQ(11, cb.GetNthFromTopImageBuffer(1)->GetPixels()[0]);
+
+   // Per-camera image numbers
+   const mm::ImgBuffer* img = cb.GetNextImageBuffer(0, &cameraB);
+   ASSERT_TRUE(img != 0);
+   EXPECT_EQ(20, img->GetPixels()[0]);
+   EXPECT_EQ("0", Tag(img, MM::g_Keyword_Metadata_ImageNumber));
+   EXPECT_EQ(3u, cb.GetRemainingImageCount());
+
+   // Global pops skip images already popped per camera
+   img = cb.GetNextImageBuffer(0);
+   EXPECT_EQ(10, img->GetPixels()[0]);
+   img = cb.GetNextImageBuffer(0);
+   EXPECT_EQ(11, img->GetPixels()[0]);
+   EXPECT_EQ("1", Tag(img, MM::g_Keyword_Metadata_ImageNumber));
+   EXPECT_EQ(0u, cb.GetRemainingImageCount(&cameraA));
+   EXPECT_TRUE(cb.GetNextImageBuffer(0, &cameraA) == 0);
+   img = cb.GetNextImageBuffer(0);
+   EXPECT_EQ(21, img->GetPixels()[0]);
+   EXPECT_EQ("1", Tag(img, MM::g_Keyword_Metadata_ImageNumber));
+   EXPECT_EQ(0u, cb.GetRemainingImageCount());
+   EXPECT_TRUE(cb.GetTopImage() == 0);
+}
+
+TEST(CircularBufferTests, NthFromTopSkipsPoppedImages)
+{
+   CircularBuffer cb(1);
+   ASSERT_TRUE(cb.Initialize(1, 16, 16, 1)); // Preallocates popped slots
+   ASSERT_TRUE(Insert(cb, 16, 16, 1, 10, &cameraA));
+   ASSERT_TRUE(Insert(cb, 16, 16, 1, 20, &cameraB));
+   ASSERT_TRUE(Insert(cb, 16, 16, 1, 11, &cameraA));
+   ASSERT_TRUE(Insert(cb, 16, 16, 1, 21, &cameraB));
+   EXPECT_EQ(21, cb.GetTopImage()[0]);
+
+   // Pop both of camera B's images, leaving gaps among the unread ones
+   ASSERT_TRUE(cb.GetNextImageBuffer(0, &cameraB) != 0);
+   ASSERT_TRUE(cb.GetNextImageBuffer(0, &cameraB) != 0);
+   EXPECT_EQ(11, cb.GetTopImage()[0]);
+   EXPECT_EQ(11, cb.GetNthFromTopImageBuffer(0)->GetPixels()[0]);
+   EXPECT_EQ(10, cb.GetNthFromTopImageBuffer(1)->GetPixels()[0]);
+   EXPECT_TRUE(cb.GetNthFromTopImageBuffer(2) == 0);
+}
+
+TEST(CircularBufferTests, OverflowsWhenBudgetIsUsedByUnreadImages)
+{
+   const unsigned w = 512, h = 512; // 4 images per MB
+   CircularBuffer cb(1);
+   ASSERT_TRUE(cb.Initialize(1, w, h, 1));
+   EXPECT_EQ(4u, cb.GetSize());
+   EXPECT_EQ(4u, cb.GetFreeSize());
+   for (unsigned char i = 0; i < 4; ++i)
+      ASSERT_TRUE(Insert(cb, w, h, 1, i, &cameraA));
+   EXPECT_EQ(0u, cb.GetFreeSize());
+   EXPECT_FALSE(cb.Overflow());
+   EXPECT_FALSE(Insert(cb, w, h, 1, 4, &cameraA));
+   EXPECT_TRUE(cb.Overflow());
+
+   // Popping makes room; the memory of popped images is reused
+   EXPECT_EQ(0, cb.GetNextImage()[0]);
+   EXPECT_EQ(1u, cb.GetFreeSize());
+   EXPECT_TRUE(Insert(cb, w, h, 1, 5, &cameraA));
+   EXPECT_EQ(1, cb.GetNextImage()[0]);
+
+   // Popped images of another geometry are freed when memory is needed
+   EXPECT_TRUE(Insert(cb, w / 2, h / 2, 1, 6, &cameraB));
+   EXPECT_EQ(2, cb.GetNextImage()[0]);
+   EXPECT_EQ(3, cb.GetNextImage()[0]);
+   EXPECT_EQ(5, cb.GetNextImage()[0]);
+   EXPECT_EQ(6, cb.GetNextImage()[0]);
+
+   cb.Clear();
+   EXPECT_FALSE(cb.Overflow());
+   for (unsigned char i = 0; i < 4; ++i)
+      ASSERT_TRUE(Insert(cb, w, h, 1, i, &cameraA));
+   EXPECT_EQ(4u, cb.GetRemainingImageCount());
+}
+
+TEST(CircularBufferTests, CompressedImagesRoundTrip)
+{
+   const unsigned w = 256, h = 256;
+   CircularBuffer cb(1);
+   ASSERT_TRUE(cb.Initialize(1, w, h, 2));
+   cb.SetCompression(true);
+   EXPECT_TRUE(cb.IsCompressionEnabled());
+
+   std::vector<unsigned char> pixels = Pixels(w, h, 2, 0);
+   for (unsigned i = 0; i < w * h; i += 101)
+      pixels[2 * i] = static_cast<unsigned char>(i);
+   Metadata md;
+   ASSERT_TRUE(cb.InsertImage(&pixels[0], w, h, 2, 1, &md, &cameraA));
+   ASSERT_TRUE(Insert(cb, 16, 8, 1, 9, &cameraB));
+
+   const mm::ImgBuffer* top = cb.GetTopImageBuffer(0, &cameraA);
+   ASSERT_TRUE(top != 0);
+   EXPECT_EQ(0, std::memcmp(top->GetPixels(), &pixels[0], pixels.size()));
+
+   EXPECT_EQ(pixels.size(), cb.GetNextImageBufferSize()); // Uncompressed size
+   const mm::ImgBuffer* img = cb.GetNextImageBuffer(0);
+   ASSERT_TRUE(img != 0);
+   EXPECT_EQ(w, img->Width());
+   EXPECT_EQ("GRAY16", Tag(img, "PixelType"));
+   EXPECT_EQ(0, std::memcmp(img->GetPixels(), &pixels[0], pixels.size()));
+   img = cb.GetNextImageBuffer(0);
+   ASSERT_TRUE(img != 0);
+   EXPECT_EQ(16u, img->Width());
+   EXPECT_EQ(9, img->GetPixels()[16 * 8 - 1]);
+
+   CircularBuffer::CompressionStatistics stats = cb.GetCompressionStatistics();
+   EXPECT_EQ(2u, stats.framesCompressed);
+   EXPECT_EQ(w * h * 2 + 16 * 8, stats.rawBytes);
+   EXPECT_LT(stats.compressedBytes, stats.rawBytes / 4);
+   EXPECT_EQ(3u, stats.framesDecompressed);
+   EXPECT_EQ(0u, CircularBuffer::FormatCompressionStatistics(stats).find(
+            "Statistic\tValue\n"));
+}
+
+TEST(CircularBufferTests, CompressedImagesTakeTheirCompressedSize)
+{
+   const unsigned w = 512, h = 512; // 4 raw images per MB
+   CircularBuffer cb(1);
+   ASSERT_TRUE(cb.Initialize(1, w, h, 1));
+   cb.SetCompression(true);
+   for (unsigned i = 0; i < 40; ++i)
+      ASSERT_TRUE(Insert(cb, w, h, 1, static_cast<unsigned char>(i), &cameraA));
+   EXPECT_EQ(40u, cb.GetRemainingImageCount());
+   EXPECT_FALSE(cb.Overflow());
+   EXPECT_GT(cb.GetSize(), 40u);
+   for (unsigned i = 0; i < 40; ++i)
+      EXPECT_EQ(i, cb.GetNextImage()[w * h - 1]);
+}
+
+TEST(CircularBufferTests, StatisticsAreAddedToMetadata)
+{
+   const unsigned w = 16, h = 8;
+   CircularBuffer cb(1);
+   ASSERT_TRUE(cb.Initialize(1, w, h, 2));
+   cb.SetFrameStatistics(4);
+   EXPECT_EQ(4u, cb.GetFrameStatisticsBins());
+
+   // 12-bit pixels: half at 100, half saturated
+   std::vector<unsigned char> pixels(w * h * 2);
+   for (unsigned i = 0; i < w * h; ++i)
+   {
+      const uint16_t v = i < w * h / 2 ? 100 : 4095;
+      std::memcpy(&pixels[2 * i], &v, 2);
+   }
+   Metadata md;
+   ASSERT_TRUE(cb.InsertImage(&pixels[0], w, h, 2, 1, &md, &cameraA, 12));
+
+   const mm::ImgBuffer* img = cb.GetTopImageBuffer(0, &cameraA);
+   ASSERT_TRUE(img != 0);
+   EXPECT_EQ(0, std::memcmp(img->GetPixels(), &pixels[0], pixels.size()));
+   EXPECT_EQ("100", Tag(img, "Statistics-Min"));
+   EXPECT_EQ("4095", Tag(img, "Statistics-Max"));
+   EXPECT_EQ("2097.5", Tag(img, "Statistics-Mean"));
+   EXPECT_EQ("64", Tag(img, "Statistics-Saturated"));
+   EXPECT_EQ("64 0 0 64", Tag(img, "Statistics-Histogram"));
+
+   // Also for compressed images; not for RGB
+   cb.SetCompression(true);
+   ASSERT_TRUE(cb.InsertImage(&pixels[0], w, h, 2, 1, &md, &cameraB, 12));
+   img = cb.GetTopImageBuffer(0, &cameraB);
+   ASSERT_TRUE(img != 0);
+   EXPECT_EQ("64 0 0 64", Tag(img, "Statistics-Histogram"));
+
+   cb.SetCompression(false);
+   std::vector<unsigned char> rgb = Pixels(w, h, 4, 1);
+   ASSERT_TRUE(cb.InsertImage(&rgb[0], w, h, 4, 4, &md, &cameraA));
+   img = cb.GetTopImageBuffer(0, &cameraA);
+   ASSERT_TRUE(img != 0);
+   Metadata rgbMd = img->GetMetadata();
+   EXPECT_FALSE(rgbMd.HasTag("Statistics-Min"));
+}
+
+TEST(CircularBufferTests, PinnedImagesOutliveTheirSlots)
+{
+   const unsigned w = 512, h = 512; // 4 images per MB
+   std::shared_ptr<PinnedImage> first, second;
+   {
+      CircularBuffer cb(1);
+      ASSERT_TRUE(cb.Initialize(1, w, h, 1));
+      for (unsigned char i = 0; i < 4; ++i)
+         ASSERT_TRUE(Insert(cb, w, h, 1, i, i % 2 ? &cameraB : &cameraA));
+      first = cb.PopNextImagePinned(0);
+      ASSERT_TRUE(first != 0);
+      second = cb.PopNextImagePinned(0, &cameraA);
+      ASSERT_TRUE(second != 0);
+      EXPECT_EQ(2u, cb.GetRemainingImageCount());
+
+      // Pinned memory is not reused, and counts against the budget
+      EXPECT_FALSE(Insert(cb, w, h, 1, 10, &cameraA));
+      EXPECT_TRUE(cb.Overflow());
+      cb.Clear();
+      EXPECT_FALSE(Insert(cb, w, h, 1, 10, &cameraA));
+      EXPECT_EQ(0, first->GetImage().GetPixels()[w * h - 1]);
+      EXPECT_EQ(2, second->GetImage().GetPixels()[w * h - 1]);
+      cb.Clear();
+      EXPECT_TRUE(cb.PopNextImagePinned(0) == 0);
+      ASSERT_TRUE(cb.Initialize(1, w / 2, h / 2, 1));
+   }
+   EXPECT_EQ(w, first->GetImage().Width());
+   EXPECT_EQ(0, first->GetImage().GetPixels()[0]);
+   EXPECT_EQ(2, second->GetImage().GetPixels()[0]);
+}
+
+TEST(CircularBufferTests, ReleasedPinnedSlotsAreReused)
+{
+   const unsigned w = 512, h = 512; // 4 images per MB
+   CircularBuffer cb(1);
+   ASSERT_TRUE(cb.Initialize(1, w, h, 1));
+   for (unsigned char i = 0; i < 4; ++i)
+      ASSERT_TRUE(Insert(cb, w, h, 1, i, &cameraA));
+
+   // With every slot pinned, the buffer is full
+   std::vector<std::shared_ptr<PinnedImage> > pinned;
+   for (unsigned i = 0; i < 4; ++i)
+   {
+      pinned.push_back(cb.PopNextImagePinned(0));
+      ASSERT_TRUE(pinned.back() != 0);
+   }
+   EXPECT_FALSE(Insert(cb, w, h, 1, 10, &cameraA));
+   cb.Clear();
+
+   // Released slots are reused in place, without allocating
+   const unsigned char* firstPixels = pinned[0]->GetImage().GetPixels();
+   pinned[0].reset();
+   ASSERT_TRUE(Insert(cb, w, h, 1, 10, &cameraA));
+   const mm::ImgBuffer* img = cb.GetTopImageBuffer(0);
+   ASSERT_TRUE(img != 0);
+   EXPECT_EQ(firstPixels, img->GetPixels());
+   EXPECT_FALSE(Insert(cb, w, h, 1, 11, &cameraA));
+   cb.Clear();
+
+   pinned.clear();
+   for (unsigned char i = 20; i < 24; ++i)
+      ASSERT_TRUE(Insert(cb, w, h, 1, i, &cameraA));
+   EXPECT_FALSE(cb.Overflow());
+   EXPECT_EQ(4u, cb.GetRemainingImageCount());
+}
+
+TEST(CircularBufferTests, CompressedImagesCanBePinned)
+{
+   const unsigned w = 64, h = 64;
+   CircularBuffer cb(1);
+   ASSERT_TRUE(cb.Initialize(1, w, h, 1));
+   cb.SetCompression(true);
+   ASSERT_TRUE(Insert(cb, w, h, 1, 7, &cameraA));
+   ASSERT_TRUE(Insert(cb, w, h, 1, 8, &cameraA));
+   std::shared_ptr<PinnedImage> pinned = cb.PopNextImagePinned(0);
+   ASSERT_TRUE(pinned != 0);
+   EXPECT_EQ(8, cb.GetNextImage()[0]);
+   EXPECT_EQ(7, pinned->GetImage().GetPixels()[w * h - 1]);
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
@@ -0,0 +1,211 @@
+#include <gtest/gtest.h>
+
+#include "DeviceAdapterCatalog.h"
+#include "MMCore.h"
+#include "../MMDevice/ModuleInterface.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+
+#include <unistd.h>
+
+using namespace mm;
+
+namespace
+{
+   class TempDir
+   {
+   public:
+      TempDir()
+      {
+         char name[] = "/tmp/mmcore-catalog-XXXXXX";
+         const char* dir = mkdtemp(name);
+         path_ = dir ? dir : "";
+      }
+      ~TempDir()
+      {
+         if (!path_.empty())
+            std::system(("rm -rf '" + path_ + "'").c_str());
+      }
+      const std::string& Path() const { return path_; }
+
+   private:
+      std::string path_;
+   };
+
+   DeviceAdapterCatalogEntry Entry(const std::string& path)
+   {
+      DeviceAdapterCatalogEntry entry;
+      entry.signature.path = path;
+      entry.signature.size = 12345;
+      entry.signature.mtime = 1700000000;
+      entry.moduleInterfaceVersion = 10;
+      entry.deviceInterfaceVersion = 70;
+      AdvertisedDevice camera;
+      camera.name = "DCam";
+      camera.description = "Demo camera\twith\\odd\ncharacters";
+      camera.type = 2;
+      entry.devices.push_back(camera);
+      AdvertisedDevice stage;
+      stage.name = "DStage";
+      stage.type = 5;
+      entry.devices.push_back(stage);
+      return entry;
+   }
+
+   void ExpectSameEntry(const DeviceAdapterCatalogEntry& expected,
+         const DeviceAdapterCatalogEntry& actual)
+   {
+      EXPECT_TRUE(expected.signature == actual.signature);
+      EXPECT_EQ(expected.moduleInterfaceVersion, actual.moduleInterfaceVersion);
+      EXPECT_EQ(expected.deviceInterfaceVersion, actual.deviceInterfaceVersion);
+      EXPECT_EQ(expected.error, actual.error);
+      ASSERT_EQ(expected.devices.size(), actual.devices.size());
+      for (std::size_t i = 0; i < expected.devices.size(); ++i)
+      {
+         EXPECT_EQ(expected.devices[i].name, actual.devices[i].name);
+         EXPECT_EQ(expected.devices[i].description, actual.devices[i].description);
+         EXPECT_EQ(expected.devices[i].type, actual.devices[i].type);
+      }
+   }
+}
+
+TEST(DeviceAdapterCatalogTests, EntryRoundTrip)
+{
+   DeviceAdapterCatalogEntry entry = Entry("/opt/mm/libmmgr_dal_Demo.so.0");
+   std::string name;
+   DeviceAdapterCatalogEntry parsed;
+   ASSERT_TRUE(ParseCatalogEntry(SerializeCatalogEntry("Demo", entry), name,
+            parsed));
+   EXPECT_EQ("Demo", name);
+   ExpectSameEntry(entry, parsed);
+
+   EXPECT_FALSE(ParseCatalogEntry("", name, parsed));
+   EXPECT_FALSE(ParseCatalogEntry("module\tDemo\t/x\tnot-a-size\t0\t10\t70\t\n",
+            name, parsed));
+}
+
+TEST(DeviceAdapterCatalogTests, SaveAndLoad)
+{
+   TempDir dir;
+   ASSERT_FALSE(dir.Path().empty());
+   const std::string filename = dir.Path() + "/catalog.txt";
+
+   DeviceAdapterCatalogEntry good = Entry(dir.Path() + "/libmmgr_dal_Demo.so.0");
+   DeviceAdapterCatalogEntry bad;
+   bad.signature.path = dir.Path() + "/libmmgr_dal_Broken.so.0";
+   bad.moduleInterfaceVersion = 10;
+   bad.deviceInterfaceVersion = 70;
+   bad.error = "Failed to load device adapter \"Broken\"";
+   {
+      DeviceAdapterCatalog catalog(filename);
+      catalog.Load(); // No file yet
+      EXPECT_EQ(0u, catalog.GetSize());
+      catalog.Put("Demo", good);
+      catalog.Put("Broken", bad);
+      catalog.Save();
+   }
+
+   DeviceAdapterCatalog catalog(filename);
+   catalog.Load();
+   EXPECT_EQ(2u, catalog.GetSize());
+   const DeviceAdapterCatalogEntry* found =
+      catalog.Find("Demo", good.signature, 10, 70);
+   ASSERT_TRUE(found != 0);
+   ExpectSameEntry(good, *found);
+   found = catalog.Find("Broken", bad.signature, 10, 70);
+   ASSERT_TRUE(found != 0);
+   EXPECT_EQ(bad.error, found->error);
+   EXPECT_TRUE(found->devices.empty());
+}
+
+TEST(DeviceAdapterCatalogTests, ChangedModulesAreNotFound)
+{
+   DeviceAdapterCatalog catalog("unused");
+   DeviceAdapterCatalogEntry entry = Entry("/opt/mm/libmmgr_dal_Demo.so.0");
+   catalog.Put("Demo", entry);
+
+   ModuleSignature signature = entry.signature;
+   EXPECT_TRUE(catalog.Find("Demo", signature, 10, 70) != 0);
+   EXPECT_TRUE(catalog.Find("Other", signature, 10, 70) == 0);
+   EXPECT_TRUE(catalog.Find("Demo", signature, 11, 70) == 0);
+   EXPECT_TRUE(catalog.Find("Demo", signature, 10, 71) == 0);
+   signature.mtime += 1;
+   EXPECT_TRUE(catalog.Find("Demo", signature, 10, 70) == 0);
+   signature = entry.signature;
+   signature.size += 1;
+   EXPECT_TRUE(catalog.Find("Demo", signature, 10, 70) == 0);
+   signature = entry.signature;
+   signature.path = "/elsewhere/libmmgr_dal_Demo.so.0";
+   EXPECT_TRUE(catalog.Find("Demo", signature, 10, 70) == 0);
+}
+
+TEST(DeviceAdapterCatalogTests, DamagedFileIsIgnored)
+{
+   TempDir dir;
+   ASSERT_FALSE(dir.Path().empty());
+   const std::string filename = dir.Path() + "/catalog.txt";
+   {
+      std::ofstream out(filename.c_str());
+      out << "not a catalog\n";
+   }
+   DeviceAdapterCatalog catalog(filename);
+   catalog.Load();
+   EXPECT_EQ(0u, catalog.GetSize());
+}
+
+TEST(DeviceAdapterCatalogTests, SignatureOfFile)
+{
+   TempDir dir;
+   ASSERT_FALSE(dir.Path().empty());
+   const std::string filename = dir.Path() + "/libmmgr_dal_Fake.so.0";
+   {
+      std::ofstream out(filename.c_str());
+      out << "0123456789";
+   }
+   ModuleSignature signature;
+   ASSERT_TRUE(GetModuleSignature(filename, signature));
+   EXPECT_EQ(filename, signature.path);
+   EXPECT_EQ(10u, signature.size);
+   EXPECT_GT(signature.mtime, 0);
+   EXPECT_FALSE(GetModuleSignature(dir.Path() + "/missing", signature));
+}
+
+TEST(DeviceAdapterCatalogTests, BrokenModuleErrorIsNotCataloged)
+{
+   TempDir dir;
+   ASSERT_FALSE(dir.Path().empty());
+   const std::string module = dir.Path() + "/libmmgr_dal_Fake.so.0";
+   {
+      std::ofstream out(module.c_str());
+      out << "not a shared library";
+   }
+   const std::string catalogFile = dir.Path() + "/catalog.txt";
+
+   CMMCore core;
+   core.setDeviceAdapterSearchPaths(std::vector<std::string>(1, dir.Path()));
+   core.setDeviceAdapterCatalogFile(catalogFile.c_str(), false);
+   EXPECT_EQ(catalogFile, core.getDeviceAdapterCatalogFile());
+   EXPECT_THROW(core.getAvailableDevices("Fake"), CMMError);
+
+   DeviceAdapterCatalog catalog(catalogFile);
+   catalog.Load();
+   ModuleSignature signature;
+   ASSERT_TRUE(GetModuleSignature(module, signature));
+   EXPECT_TRUE(catalog.Find("Fake", signature,
+         MODULE_INTERFACE_VERSION, DEVICE_INTERFACE_VERSION) == 0);
+
+   // Queried again, with the same error
+   EXPECT_THROW(core.getAvailableDeviceTypes("Fake"), CMMError);
+
+   core.setDeviceAdapterCatalogFile(0, false);
+   EXPECT_EQ("", core.getDeviceAdapterCatalogFile());
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
@@ -0,0 +1,81 @@
+#include <gtest/gtest.h>
+
+#include "Devices/DeviceCallStatistics.h"
+
+#include <chrono>
+
+using namespace mm;
+
+namespace
+{
+   struct FakeDevice
+   {
+      int Answer() { return 42; }
+   };
+
+   class EnableStatistics
+   {
+   public:
+      EnableStatistics() { DeviceCallStatistics::SetEnabled(true); }
+      ~EnableStatistics() { DeviceCallStatistics::SetEnabled(false); }
+   };
+}
+
+TEST(DeviceCallStatisticsTests, SitesWithSameNameShareIndex)
+{
+   DeviceCallSite a("TestSiteA");
+   DeviceCallSite b("TestSiteB");
+   DeviceCallSite a2("TestSiteA");
+   ASSERT_NE(a.GetIndex(), b.GetIndex());
+   ASSERT_EQ(a.GetIndex(), a2.GetIndex());
+   ASSERT_EQ("TestSiteB", DeviceCallSite::GetName(b.GetIndex()));
+}
+
+TEST(DeviceCallStatisticsTests, RecordsCountsMaxAndHistogram)
+{
+   DeviceCallSite site("TestRecord");
+   DeviceCallStatistics stats;
+   ASSERT_TRUE(stats.GetSummaries().empty());
+
+   stats.Record(site.GetIndex(), std::chrono::nanoseconds(500));
+   stats.Record(site.GetIndex(), std::chrono::microseconds(3));
+   stats.Record(site.GetIndex(), std::chrono::milliseconds(2));
+   stats.RecordLockWait(std::chrono::microseconds(1));
+
+   std::vector<DeviceCallStatistics::Summary> summaries = stats.GetSummaries();
+   ASSERT_EQ(2u, summaries.size());
+   const DeviceCallStatistics::Summary& s = summaries[0];
+   ASSERT_EQ("TestRecord", s.method);
+   ASSERT_EQ(3u, s.count);
+   ASSERT_NEAR(2.0035, s.totalMs, 1e-9);
+   ASSERT_NEAR(2.0, s.maxMs, 1e-9);
+   ASSERT_EQ(1u, s.histogram[0]); // < 1 us
+   ASSERT_EQ(1u, s.histogram[2]); // 2-4 us
+   ASSERT_EQ(1u, s.histogram[11]); // 1024-2048 us
+   ASSERT_EQ("(module lock wait)", summaries[1].method);
+
+   stats.Reset();
+   ASSERT_TRUE(stats.GetSummaries().empty());
+}
+
+TEST(DeviceCallStatisticsTests, TimedCallRecordsOnlyWhenEnabled)
+{
+   DeviceCallSite site("TestTimedCall");
+   DeviceCallStatistics stats;
+   FakeDevice device;
+
+   ASSERT_FALSE(DeviceCallStatistics::IsEnabled());
+   ASSERT_EQ(42, TimedDeviceCall<FakeDevice>(&device, &stats, site, 0)->Answer());
+   ASSERT_TRUE(stats.GetSummaries().empty());
+
+   EnableStatistics enable;
+   ASSERT_EQ(42, TimedDeviceCall<FakeDevice>(&device, &stats, site, 0)->Answer());
+   ASSERT_EQ(1u, stats.GetSummaries().size());
+   ASSERT_EQ(1u, stats.GetSummaries()[0].count);
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
@@ -0,0 +1,49 @@
+#include <gtest/gtest.h>
+
+#include "MMCore.h"
+
+TEST(DeviceHandleTests, DefaultHandlesAreNull)
+{
+   DeviceHandle device;
+   PropertyHandle property;
+   ASSERT_TRUE(device.isNull());
+   ASSERT_TRUE(property.isNull());
+}
+
+TEST(DeviceHandleTests, CoreDeviceHasHandle)
+{
+   CMMCore c;
+   DeviceHandle core = c.getDeviceHandle("Core");
+   ASSERT_FALSE(core.isNull());
+   ASSERT_EQ(core, c.getDeviceHandle("Core"));
+   ASSERT_EQ("Core", c.getDeviceLabel(core));
+   ASSERT_FALSE(c.deviceBusy(core));
+}
+
+TEST(DeviceHandleTests, CorePropertyThroughHandle)
+{
+   CMMCore c;
+   PropertyHandle autoShutter = c.getPropertyHandle("Core", "AutoShutter");
+   ASSERT_EQ("AutoShutter", autoShutter.getPropertyName());
+   c.setProperty(autoShutter, "0");
+   ASSERT_EQ("0", c.getProperty(autoShutter));
+   ASSERT_EQ("0", c.getProperty("Core", "AutoShutter"));
+   c.setProperty(autoShutter, "1");
+   ASSERT_EQ("1", c.getProperty(autoShutter));
+}
+
+TEST(DeviceHandleTests, InvalidHandlesThrow)
+{
+   CMMCore c;
+   ASSERT_THROW(c.getDeviceHandle("NoSuchDevice"), CMMError);
+   ASSERT_THROW(c.getPropertyHandle("Core", "NoSuchProperty"), CMMError);
+   ASSERT_THROW(c.getPosition(DeviceHandle()), CMMError);
+   ASSERT_THROW(c.getPosition(c.getDeviceHandle("Core")), CMMError);
+   ASSERT_THROW(c.getProperty(PropertyHandle()), CMMError);
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
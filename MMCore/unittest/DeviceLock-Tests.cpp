@@ -0,0 +1,135 @@
+#include <gtest/gtest.h>
+
+#include "DeviceLock.h"
+#include "Error.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+using namespace mm;
+
+namespace
+{
+   void Pause()
+   {
+      std::this_thread::sleep_for(std::chrono::milliseconds(50));
+   }
+}
+
+TEST(DeviceLockTests, ExclusiveIsRecursive)
+{
+   DeviceLock lock;
+   lock.Lock();
+   lock.Lock();
+   lock.LockShared(); // Nests in the exclusive lock
+   lock.UnlockShared();
+   lock.Unlock();
+
+   std::atomic<bool> locked(false);
+   std::thread other([&]
+   {
+      lock.Lock();
+      locked = true;
+      lock.Unlock();
+   });
+   Pause();
+   EXPECT_FALSE(locked);
+   lock.Unlock();
+   other.join();
+   EXPECT_TRUE(locked);
+}
+
+TEST(DeviceLockTests, ReadersRunConcurrently)
+{
+   DeviceLock lock;
+   std::atomic<int> inside(0);
+   std::atomic<int> sawBoth(0);
+   auto reader = [&]
+   {
+      lock.LockShared();
+      ++inside;
+      for (int i = 0; i < 200 && inside < 2; ++i)
+         std::this_thread::sleep_for(std::chrono::milliseconds(5));
+      if (inside == 2)
+         ++sawBoth;
+      lock.UnlockShared();
+   };
+   std::thread r1(reader);
+   std::thread r2(reader);
+   r1.join();
+   r2.join();
+   EXPECT_LT(0, sawBoth.load());
+}
+
+TEST(DeviceLockTests, WriterExcludesReaders)
+{
+   DeviceLock lock;
+   lock.Lock();
+   std::atomic<bool> read(false);
+   std::thread reader([&]
+   {
+      lock.LockShared();
+      read = true;
+      lock.UnlockShared();
+   });
+   Pause();
+   EXPECT_FALSE(read);
+   lock.Unlock();
+   reader.join();
+   EXPECT_TRUE(read);
+}
+
+TEST(DeviceLockTests, WaitingWriterHasPriorityOverNewReaders)
+{
+   DeviceLock lock;
+   lock.LockShared();
+
+   std::atomic<bool> written(false);
+   std::thread writer([&]
+   {
+      lock.Lock();
+      written = true;
+      lock.Unlock();
+   });
+   Pause();
+   EXPECT_FALSE(written);
+
+   std::atomic<bool> read(false);
+   std::thread reader([&]
+   {
+      lock.LockShared();
+      EXPECT_TRUE(written);
+      read = true;
+      lock.UnlockShared();
+   });
+   Pause();
+   EXPECT_FALSE(read);
+
+   // A thread already reading may read again despite the waiting writer
+   lock.LockShared();
+   lock.UnlockShared();
+
+   lock.UnlockShared();
+   writer.join();
+   reader.join();
+   EXPECT_TRUE(written);
+   EXPECT_TRUE(read);
+}
+
+TEST(DeviceLockTests, UpgradeThrows)
+{
+   DeviceLock lock;
+   lock.LockShared();
+   EXPECT_THROW(lock.Lock(), CMMError);
+   lock.UnlockShared();
+
+   lock.Lock();
+   lock.Unlock();
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
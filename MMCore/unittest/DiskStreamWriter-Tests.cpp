@@ -0,0 +1,309 @@
+#include <gtest/gtest.h>
+
+#include "CircularBuffer.h"
+#include "DiskStreamWriter.h"
+#include "MMCore.h"
+#include "../MMDevice/ImageMetadata.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+using namespace mm;
+
+namespace
+{
+   class TempDir
+   {
+   public:
+      TempDir()
+      {
+         char name[] = "/tmp/mmcore-diskstream-XXXXXX";
+         const char* dir = mkdtemp(name);
+         path_ = dir ? dir : "";
+      }
+      ~TempDir()
+      {
+         if (!path_.empty())
+            std::system(("rm -rf '" + path_ + "'").c_str());
+      }
+      const std::string& Path() const { return path_; }
+
+   private:
+      std::string path_;
+   };
+
+   std::string ReadFile(const std::string& path)
+   {
+      std::ifstream in(path.c_str(), std::ios_base::binary);
+      return std::string(std::istreambuf_iterator<char>(in),
+            std::istreambuf_iterator<char>());
+   }
+
+   // Hashed, so that compression does not shrink it
+   std::vector<unsigned char> Frame(unsigned n, std::size_t bytes)
+   {
+      std::vector<unsigned char> pixels(bytes);
+      for (std::size_t i = 0; i < bytes; ++i)
+      {
+         std::uint32_t x = n * 2654435761u ^ static_cast<std::uint32_t>(i) * 40503u;
+         x ^= x >> 15;
+         x *= 2246822519u;
+         x ^= x >> 13;
+         pixels[i] = static_cast<unsigned char>(x);
+      }
+      return pixels;
+   }
+
+   // A frame owning its pixels and metadata
+   DiskStreamWriter::Frame OwnedFrame(unsigned n, unsigned width,
+         unsigned height)
+   {
+      struct Data
+      {
+         std::vector<unsigned char> pixels;
+         Metadata md;
+      };
+      std::shared_ptr<Data> data = std::make_shared<Data>();
+      data->pixels = Frame(n, width * height);
+      data->md.PutImageTag<std::string>(MM::g_Keyword_Metadata_ImageNumber,
+            std::to_string(n));
+      DiskStreamWriter::Frame frame;
+      frame.owner = data;
+      frame.pixels = &data->pixels[0];
+      frame.width = width;
+      frame.height = height;
+      frame.byteDepth = 1;
+      frame.nComponents = 1;
+      frame.metadata = &data->md;
+      return frame;
+   }
+
+   // Checks each image in the index against Frame(image number)
+   void CheckWrittenFrames(const std::string& dir, const std::string& prefix,
+         unsigned nFrames, std::size_t frameBytes)
+   {
+      std::istringstream index(ReadFile(dir + "/" + prefix + "_index.txt"));
+      std::string line;
+      ASSERT_TRUE(std::getline(index, line));
+      ASSERT_EQ(0u, line.find("Frame\tFile\tOffset\tBytes"));
+      std::vector<bool> seen(nFrames);
+      unsigned lines = 0;
+      while (std::getline(index, line))
+      {
+         std::istringstream fields(line);
+         unsigned frame, file, w, h, bpp, comp;
+         std::size_t offset, bytes;
+         fields >> frame >> file >> offset >> bytes >> w >> h >> bpp >> comp;
+         ASSERT_TRUE(fields);
+         std::string camera, imageNumber;
+         std::getline(fields, camera, '\t'); // Rest of the separator
+         std::getline(fields, camera, '\t');
+         std::getline(fields, imageNumber, '\t');
+         ASSERT_LT(frame, nFrames);
+         EXPECT_FALSE(seen[frame]);
+         seen[frame] = true;
+         ++lines;
+         EXPECT_EQ(std::to_string(frame), imageNumber);
+         EXPECT_EQ(0u, offset % 4096);
+         EXPECT_EQ(frameBytes, bytes);
+
+         char name[16];
+         std::snprintf(name, sizeof(name), "_%05u.raw", file);
+         std::string raw = ReadFile(dir + "/" + prefix + name);
+         ASSERT_LE(offset + bytes, raw.size());
+         std::vector<unsigned char> expected = Frame(frame, bytes);
+         EXPECT_EQ(0, std::memcmp(&expected[0], raw.data() + offset, bytes));
+      }
+      EXPECT_EQ(nFrames, lines);
+   }
+}
+
+TEST(DiskStreamWriterTests, FramesWrittenAtIndexedOffsets)
+{
+   TempDir dir;
+   ASSERT_FALSE(dir.Path().empty());
+
+   const unsigned width = 100, height = 30, nFrames = 20;
+   DiskStreamWriter::Options options;
+   options.blockWhenFull = true;
+   options.queueBytes = 4 * 4096;
+   options.maxFileBytes = 8 * 4096; // Forces several files
+   DiskStreamWriter writer(dir.Path(), "test", options);
+   std::weak_ptr<const void> last;
+   for (unsigned n = 0; n < nFrames; ++n)
+   {
+      DiskStreamWriter::Frame frame = OwnedFrame(n, width, height);
+      last = frame.owner;
+      ASSERT_TRUE(writer.Enqueue(frame));
+   }
+   writer.Stop();
+   ASSERT_TRUE(writer.IsStopped());
+   EXPECT_TRUE(last.expired());
+
+   DiskStreamWriter::Statistics stats = writer.GetStatistics();
+   EXPECT_EQ(nFrames, stats.framesReceived);
+   EXPECT_EQ(nFrames, stats.framesWritten);
+   EXPECT_EQ(0u, stats.framesDropped);
+   EXPECT_EQ(0u, stats.framesFailed);
+   EXPECT_EQ(std::uint64_t(nFrames) * width * height, stats.bytesWritten);
+   EXPECT_TRUE(stats.lastError.empty());
+
+   CheckWrittenFrames(dir.Path(), "test", nFrames, width * height);
+
+   std::string summary = ReadFile(dir.Path() + "/test_summary.txt");
+   EXPECT_NE(std::string::npos, summary.find("FramesWritten\t20\n"));
+}
+
+TEST(DiskStreamWriterTests, EnqueueAfterStopIsIgnored)
+{
+   TempDir dir;
+   DiskStreamWriter writer(dir.Path(), "late", DiskStreamWriter::Options());
+   writer.Stop();
+   DiskStreamWriter::Frame frame = OwnedFrame(0, 8, 8);
+   std::weak_ptr<const void> owner = frame.owner;
+   EXPECT_FALSE(writer.Enqueue(frame));
+   frame = DiskStreamWriter::Frame();
+   EXPECT_TRUE(owner.expired());
+   EXPECT_EQ(0u, writer.GetStatistics().framesWritten);
+}
+
+TEST(DiskStreamWriterTests, CircularBufferOverflowsWhenNotPopped)
+{
+   TempDir dir;
+   const unsigned width = 512, height = 512, nSlots = 4; // 1 MB
+   for (int compress = 0; compress < 2; ++compress)
+   {
+      CircularBuffer cbuf(1);
+      ASSERT_TRUE(cbuf.Initialize(1, width, height, 1));
+      cbuf.SetCompression(compress != 0);
+      const std::string prefix = compress ? "packed" : "raw";
+      std::shared_ptr<DiskStreamWriter> writer = std::make_shared<DiskStreamWriter>(
+            dir.Path(), prefix, DiskStreamWriter::Options());
+      cbuf.SetDiskStreamWriter(writer);
+
+      unsigned inserted = 0;
+      std::vector<unsigned char> pixels = Frame(inserted, width * height);
+      while (cbuf.InsertImage(&pixels[0], width, height, 1, 1, 0))
+         pixels = Frame(++inserted, width * height);
+      EXPECT_LE(nSlots - 1, inserted);
+      EXPECT_GE(nSlots, inserted);
+      EXPECT_TRUE(cbuf.Overflow());
+      EXPECT_EQ(inserted, cbuf.GetRemainingImageCount());
+
+      cbuf.SetDiskStreamWriter(std::shared_ptr<DiskStreamWriter>());
+      writer->Stop();
+      EXPECT_EQ(inserted, writer->GetStatistics().framesWritten);
+      CheckWrittenFrames(dir.Path(), prefix, inserted, width * height);
+
+      // Written and popped slots are reused
+      while (cbuf.GetNextImageBuffer(0))
+         ;
+      EXPECT_TRUE(cbuf.InsertImage(&pixels[0], width, height, 1, 1, 0));
+   }
+}
+
+TEST(DiskStreamWriterTests, WrittenSlotsAreReusedAfterPopping)
+{
+   TempDir dir;
+   const unsigned width = 512, height = 512, nFrames = 40;
+   CircularBuffer cbuf(1);
+   ASSERT_TRUE(cbuf.Initialize(1, width, height, 1));
+   DiskStreamWriter::Options options;
+   options.blockWhenFull = true;
+   std::shared_ptr<DiskStreamWriter> writer = std::make_shared<DiskStreamWriter>(
+         dir.Path(), "reuse", options);
+   cbuf.SetDiskStreamWriter(writer);
+
+   for (unsigned n = 0; n < nFrames; ++n)
+   {
+      std::vector<unsigned char> pixels = Frame(n, width * height);
+      // The popped slots free up once written; wait for the writer if needed
+      while (!cbuf.InsertImage(&pixels[0], width, height, 1, 1, 0))
+      {
+         ASSERT_TRUE(cbuf.Overflow());
+         cbuf.Clear();
+         std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+      ASSERT_TRUE(cbuf.GetNextImageBuffer(0));
+   }
+   writer->Stop();
+   DiskStreamWriter::Statistics stats = writer->GetStatistics();
+   EXPECT_EQ(nFrames, stats.framesWritten);
+   EXPECT_EQ(0u, stats.framesDropped);
+}
+
+TEST(DiskStreamWriterTests, StreamOnlyNeedsNoPopping)
+{
+   TempDir dir;
+   const unsigned width = 512, height = 512, nFrames = 40; // 4 slots
+   CircularBuffer cbuf(1);
+   ASSERT_TRUE(cbuf.Initialize(1, width, height, 1));
+   DiskStreamWriter::Options options;
+   options.blockWhenFull = true;
+   std::shared_ptr<DiskStreamWriter> writer = std::make_shared<DiskStreamWriter>(
+         dir.Path(), "only", options);
+   cbuf.SetDiskStreamWriter(writer, true);
+
+   for (unsigned n = 0; n < nFrames; ++n)
+   {
+      std::vector<unsigned char> pixels = Frame(n, width * height);
+      // Slots free up once written; wait for the writer if it is behind
+      while (!cbuf.InsertImage(&pixels[0], width, height, 1, 1, 0))
+         std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      EXPECT_EQ(0u, cbuf.GetRemainingImageCount());
+   }
+   cbuf.SetDiskStreamWriter(std::shared_ptr<DiskStreamWriter>());
+   writer->Stop();
+   DiskStreamWriter::Statistics stats = writer->GetStatistics();
+   EXPECT_EQ(nFrames, stats.framesWritten);
+   EXPECT_EQ(0u, stats.framesDropped);
+   EXPECT_TRUE(cbuf.GetNextImageBuffer(0) == 0);
+   CheckWrittenFrames(dir.Path(), "only", nFrames, width * height);
+
+   // Images are queued for popping again once streaming has stopped
+   std::vector<unsigned char> pixels = Frame(0, width * height);
+   EXPECT_TRUE(cbuf.InsertImage(&pixels[0], width, height, 1, 1, 0));
+   EXPECT_EQ(1u, cbuf.GetRemainingImageCount());
+}
+
+TEST(DiskStreamWriterTests, UnwritableDirectoryThrows)
+{
+   EXPECT_THROW(DiskStreamWriter("/dev/null/sub", "x",
+            DiskStreamWriter::Options()), CMMError);
+}
+
+TEST(DiskStreamWriterTests, CoreStreamingLifecycle)
+{
+   TempDir dir;
+   CMMCore c;
+   EXPECT_FALSE(c.isDiskStreaming());
+   EXPECT_EQ("", c.getDiskStreamingStatistics());
+   EXPECT_THROW(c.setDiskStreamingOptions(16, 0, false), CMMError);
+   c.setDiskStreamingOptions(16, 1, true);
+
+   c.startDiskStreaming(dir.Path().c_str(), "core");
+   EXPECT_TRUE(c.isDiskStreaming());
+   EXPECT_THROW(c.startDiskStreaming(dir.Path().c_str(), "core"), CMMError);
+   c.stopDiskStreaming();
+   EXPECT_FALSE(c.isDiskStreaming());
+   EXPECT_EQ(0u, c.getDiskStreamingStatistics().find("Statistic\tValue\n"));
+   c.stopDiskStreaming(); // No-op
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
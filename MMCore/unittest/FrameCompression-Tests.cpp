@@ -0,0 +1,135 @@
+#include <gtest/gtest.h>
+
+#include "FrameCompression.h"
+#include "TaskSet_FrameCompression.h"
+#include "ThreadPool.h"
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <vector>
+
+namespace
+{
+   // Dim background with noise and a few bright spots, as in sparse
+   // fluorescence images
+   std::vector<unsigned char> SparseImage16(unsigned w, unsigned h)
+   {
+      std::mt19937 rng(42);
+      std::normal_distribution<double> noise(100.0, 3.0);
+      std::vector<unsigned char> pixels(2 * w * h);
+      for (unsigned i = 0; i < w * h; ++i)
+      {
+         uint16_t v = static_cast<uint16_t>(noise(rng));
+         if (i % 997 == 0)
+            v = 40000;
+         std::memcpy(&pixels[2 * i], &v, 2);
+      }
+      return pixels;
+   }
+}
+
+TEST(FrameCompressionTests, BlockRoundTripForAllSampleSizes)
+{
+   std::mt19937 rng(1);
+   for (unsigned sampleBytes = 1; sampleBytes <= 8; sampleBytes *= 2)
+   {
+      // Include a tail that is not a multiple of 8 samples
+      const std::size_t bytes = 1000 * sampleBytes + 5 * sampleBytes;
+      std::vector<unsigned char> src(bytes);
+      for (std::size_t i = 0; i < bytes; ++i)
+         src[i] = (i % 7 == 0) ? static_cast<unsigned char>(rng()) : 0;
+
+      std::vector<unsigned char> packed(mm::CompressedBlockBound(bytes));
+      std::vector<unsigned char> scratch(bytes);
+      std::size_t n = mm::CompressBlock(&src[0], bytes, sampleBytes,
+            &packed[0], &scratch[0]);
+      ASSERT_LE(n, mm::CompressedBlockBound(bytes));
+
+      std::vector<unsigned char> out(bytes);
+      ASSERT_TRUE(mm::DecompressBlock(&packed[0], n, sampleBytes, &out[0],
+               bytes, &scratch[0]));
+      EXPECT_TRUE(src == out) << "sampleBytes " << sampleBytes;
+   }
+}
+
+TEST(FrameCompressionTests, IncompressibleBlockIsStoredRaw)
+{
+   std::mt19937 rng(2);
+   const std::size_t bytes = 4096;
+   std::vector<unsigned char> src(bytes);
+   for (std::size_t i = 0; i < bytes; ++i)
+      src[i] = static_cast<unsigned char>(rng());
+   std::vector<unsigned char> packed(mm::CompressedBlockBound(bytes));
+   std::vector<unsigned char> scratch(bytes);
+   EXPECT_EQ(bytes + 1, mm::CompressBlock(&src[0], bytes, 1, &packed[0],
+            &scratch[0]));
+}
+
+TEST(FrameCompressionTests, EmptyBlockRoundTrip)
+{
+   unsigned char src[1] = { 0 };
+   unsigned char packed[1] = { 0xff };
+   unsigned char scratch[1];
+   std::size_t n = mm::CompressBlock(src, 0, 2, packed, scratch);
+   ASSERT_EQ(mm::CompressedBlockBound(0), n);
+
+   unsigned char out[1] = { 0 };
+   EXPECT_TRUE(mm::DecompressBlock(packed, n, 2, out, 0, scratch));
+   EXPECT_FALSE(mm::DecompressBlock(packed, n, 2, out, 1, scratch));
+}
+
+TEST(FrameCompressionTests, CorruptBlockIsRejected)
+{
+   const std::size_t bytes = 512;
+   std::vector<unsigned char> src(bytes, 7);
+   std::vector<unsigned char> packed(mm::CompressedBlockBound(bytes));
+   std::vector<unsigned char> scratch(bytes);
+   std::size_t n = mm::CompressBlock(&src[0], bytes, 2, &packed[0],
+         &scratch[0]);
+   std::vector<unsigned char> out(bytes);
+   EXPECT_FALSE(mm::DecompressBlock(&packed[0], n - 1, 2, &out[0], bytes,
+            &scratch[0]));
+   EXPECT_FALSE(mm::DecompressBlock(&packed[0], n, 2, &out[0], bytes + 1,
+            &scratch[0]));
+}
+
+TEST(FrameCompressionTests, SparseFrameRoundTripInParallel)
+{
+   const unsigned w = 2048, h = 1024; // Several tasks' worth
+   std::vector<unsigned char> src = SparseImage16(w, h);
+
+   std::shared_ptr<ThreadPool> pool = std::make_shared<ThreadPool>();
+   TaskSet_FrameCompression codec(pool);
+   std::vector<unsigned char> packed;
+   codec.Compress(&src[0], src.size(), 2, packed);
+   EXPECT_LT(packed.size(), src.size() / 2);
+
+   std::vector<unsigned char> out(src.size());
+   ASSERT_TRUE(codec.Decompress(&packed[0], packed.size(), &out[0], out.size()));
+   EXPECT_TRUE(src == out);
+
+   // Wrong size or truncated data
+   EXPECT_FALSE(codec.Decompress(&packed[0], packed.size(), &out[0], out.size() - 2));
+   EXPECT_FALSE(codec.Decompress(&packed[0], packed.size() - 1, &out[0], out.size()));
+}
+
+TEST(FrameCompressionTests, EmptyFrameRoundTrip)
+{
+   std::shared_ptr<ThreadPool> pool = std::make_shared<ThreadPool>();
+   TaskSet_FrameCompression codec(pool);
+   std::vector<unsigned char> packed;
+   codec.Compress(0, 0, 2, packed);
+   ASSERT_FALSE(packed.empty());
+
+   unsigned char out[1] = { 0 };
+   EXPECT_TRUE(codec.Decompress(&packed[0], packed.size(), out, 0));
+   EXPECT_FALSE(codec.Decompress(&packed[0], packed.size(), out, 1));
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
@@ -0,0 +1,117 @@
+#include <gtest/gtest.h>
+
+#include "FrameStatistics.h"
+#include "TaskSet_FrameStatistics.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <vector>
+
+namespace
+{
+   std::vector<unsigned char> RandomImage16(std::size_t pixels, unsigned bitDepth)
+   {
+      std::mt19937 rng(7);
+      std::uniform_int_distribution<unsigned> dist(0, (1u << bitDepth) - 1);
+      std::vector<unsigned char> bytes(2 * pixels);
+      for (std::size_t i = 0; i < pixels; ++i)
+      {
+         const uint16_t v = static_cast<uint16_t>(dist(rng));
+         std::memcpy(&bytes[2 * i], &v, 2);
+      }
+      return bytes;
+   }
+}
+
+TEST(FrameStatisticsTests, EightBitImage)
+{
+   std::vector<unsigned char> src(10000);
+   for (std::size_t i = 0; i < src.size(); ++i)
+      src[i] = static_cast<unsigned char>(i % 200 + 10);
+   src[1234] = 255;
+
+   mm::FrameStatistics stats;
+   stats.Reset(256);
+   std::vector<unsigned char> dst(src.size());
+   mm::AccumulateFrameStatistics(&src[0], &dst[0], src.size(), 1, 8, stats);
+
+   EXPECT_TRUE(src == dst);
+   EXPECT_EQ(10u, stats.min);
+   EXPECT_EQ(255u, stats.max);
+   EXPECT_EQ(src.size(), stats.pixels);
+   EXPECT_EQ(1u, stats.saturated);
+   unsigned long long sum = 0;
+   for (unsigned char v : src)
+      sum += v;
+   EXPECT_EQ(sum, stats.sum);
+   EXPECT_EQ(0u, stats.histogram[9]);
+   EXPECT_EQ(50u, stats.histogram[10]);
+   EXPECT_EQ(1u, stats.histogram[255]);
+}
+
+TEST(FrameStatisticsTests, ValuesBeyondBitDepthCountInLastBin)
+{
+   const uint16_t values[] = { 0, 1023, 1024, 4095, 4096, 65535 };
+   mm::FrameStatistics stats;
+   stats.Reset(4);
+   mm::AccumulateFrameStatistics(reinterpret_cast<const unsigned char*>(values),
+         0, 6, 2, 12, stats);
+
+   EXPECT_EQ(0u, stats.min);
+   EXPECT_EQ(65535u, stats.max);
+   EXPECT_EQ(3u, stats.saturated);
+   ASSERT_EQ(4u, stats.histogram.size());
+   EXPECT_EQ(2u, stats.histogram[0]);
+   EXPECT_EQ(1u, stats.histogram[1]);
+   EXPECT_EQ(0u, stats.histogram[2]);
+   EXPECT_EQ(3u, stats.histogram[3]);
+}
+
+TEST(FrameStatisticsTests, TagsAreAddedToMetadata)
+{
+   const unsigned char values[] = { 1, 2, 3, 6 };
+   mm::FrameStatistics stats;
+   stats.Reset(2);
+   mm::AccumulateFrameStatistics(values, 0, 4, 1, 0, stats);
+   Metadata md;
+   stats.AddToMetadata(md);
+   EXPECT_EQ("1", md.GetSingleTag(mm::g_Keyword_StatsMin).GetValue());
+   EXPECT_EQ("6", md.GetSingleTag(mm::g_Keyword_StatsMax).GetValue());
+   EXPECT_EQ("3", md.GetSingleTag(mm::g_Keyword_StatsMean).GetValue());
+   EXPECT_EQ("0", md.GetSingleTag(mm::g_Keyword_StatsSaturated).GetValue());
+   EXPECT_EQ("4 0", md.GetSingleTag(mm::g_Keyword_StatsHistogram).GetValue());
+}
+
+TEST(FrameStatisticsTests, ParallelResultMatchesSerial)
+{
+   const std::size_t pixels = 2048 * 1024 + 3; // Several tasks' worth
+   std::vector<unsigned char> src = RandomImage16(pixels, 14);
+
+   mm::FrameStatistics serial;
+   serial.Reset(1000);
+   mm::AccumulateFrameStatistics(&src[0], 0, pixels, 2, 14, serial);
+
+   std::shared_ptr<ThreadPool> pool = std::make_shared<ThreadPool>();
+   TaskSet_FrameStatistics tasks(pool);
+   mm::FrameStatistics parallel;
+   std::vector<unsigned char> dst(src.size());
+   tasks.Compute(&src[0], &dst[0], pixels, 2, 14, 1000, parallel);
+
+   EXPECT_TRUE(src == dst);
+   EXPECT_EQ(serial.min, parallel.min);
+   EXPECT_EQ(serial.max, parallel.max);
+   EXPECT_EQ(serial.sum, parallel.sum);
+   EXPECT_EQ(serial.pixels, parallel.pixels);
+   EXPECT_EQ(serial.saturated, parallel.saturated);
+   EXPECT_TRUE(serial.histogram == parallel.histogram);
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
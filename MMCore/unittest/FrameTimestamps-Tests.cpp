@@ -0,0 +1,175 @@
+#include <gtest/gtest.h>
+
+#include "CircularBuffer.h"
+#include "FrameTimestamps.h"
+
+#include <cstdlib>
+#include <vector>
+
+using namespace mm;
+
+namespace
+{
+   // Device ticks of 1 us, running 100 ppm fast relative to the host
+   const double hostMsPerTick = 1e-3 / 1.0001;
+
+   // Frames every 10 ms; every third one is delayed by 5 ms
+   double Delay(int frame)
+   {
+      return frame % 3 == 2 ? 7.0 : 2.0;
+   }
+}
+
+TEST(FrameTimestampsTests, NotFittedUntilEnoughFrames)
+{
+   DeviceClockModel model;
+   double corrected, latency;
+   for (int i = 0; i < 3; ++i)
+   {
+      EXPECT_FALSE(model.AddFrame(1e6 + i * 1e4, 100.0 + i * 10.0 + Delay(i),
+               corrected, latency));
+      EXPECT_EQ(100.0 + i * 10.0 + Delay(i), corrected);
+      EXPECT_EQ(0.0, latency);
+   }
+   EXPECT_FALSE(model.IsFitted());
+   EXPECT_TRUE(model.AddFrame(1e6 + 3e4, 130.0 + Delay(3), corrected, latency));
+   EXPECT_TRUE(model.IsFitted());
+}
+
+TEST(FrameTimestampsTests, FitsRateAndSeparatesDelay)
+{
+   DeviceClockModel model;
+   const double deviceEpoch = 123456789.0;
+   const double hostEpoch = 5e8;
+   double corrected = 0.0, latency = 0.0;
+   for (int i = 0; i < 3000; ++i)
+   {
+      const double ticks = i * 10000.0;
+      const double host = hostEpoch + ticks * hostMsPerTick + Delay(i);
+      model.AddFrame(deviceEpoch + ticks, host, corrected, latency);
+      if (i >= 1000) // Once the fit spans its window
+      {
+         // The fixed part of the delay is not observable; the corrected time
+         // is that of the fastest frames
+         EXPECT_NEAR(hostEpoch + ticks * hostMsPerTick + 2.0, corrected, 0.05);
+         EXPECT_NEAR(Delay(i) - 2.0, latency, 0.05);
+         EXPECT_LE(0.0, latency);
+      }
+   }
+   EXPECT_NEAR(hostMsPerTick, model.GetRate(), 1e-8);
+   EXPECT_NEAR(hostEpoch + 2.0, model.ToHostMs(deviceEpoch), 0.1);
+   EXPECT_EQ(0u, model.GetRestartCount());
+}
+
+TEST(FrameTimestampsTests, FollowsDrift)
+{
+   DeviceClockModel model(100.0);
+   double corrected, latency;
+   double host = 0.0;
+   for (int i = 0; i < 2000; ++i)
+   {
+      // The device clock slows down by 200 ppm halfway
+      host += 10.0 * (i < 1000 ? 1.0 : 1.0002);
+      model.AddFrame(i * 10.0, host, corrected, latency);
+   }
+   EXPECT_NEAR(1.0002, model.GetRate(), 1e-6);
+   EXPECT_NEAR(host, corrected, 0.01);
+   EXPECT_NEAR(0.0, latency, 0.01);
+}
+
+TEST(FrameTimestampsTests, RestartsWhenClocksDisagree)
+{
+   DeviceClockModel model;
+   double corrected, latency;
+   for (int i = 0; i < 10; ++i)
+      model.AddFrame(1000.0 + i, 10.0 * i, corrected, latency);
+   ASSERT_TRUE(model.IsFitted());
+   EXPECT_NEAR(10.0, model.GetRate(), 1e-9);
+
+   // The device clock was reset
+   EXPECT_FALSE(model.AddFrame(0.0, 100.0, corrected, latency));
+   EXPECT_EQ(1u, model.GetRestartCount());
+   EXPECT_EQ(100.0, corrected);
+   for (int i = 1; i < 10; ++i)
+      model.AddFrame(i, 100.0 + 10.0 * i, corrected, latency);
+   EXPECT_TRUE(model.IsFitted());
+
+   // The device clock stopped during a pause of 5 s
+   EXPECT_FALSE(model.AddFrame(10.0, 5200.0, corrected, latency));
+   EXPECT_EQ(2u, model.GetRestartCount());
+}
+
+TEST(FrameTimestampsTests, ModelPerCamera)
+{
+   FrameTimestamps timestamps;
+   int cam1, cam2;
+   double corrected, latency;
+   EXPECT_FALSE(timestamps.GetModel(&cam1));
+   for (int i = 0; i < 10; ++i)
+   {
+      timestamps.AddFrame(&cam1, i * 1000.0, 10.0 * i, corrected, latency);
+      timestamps.AddFrame(&cam2, i * 10.0, 10.0 * i, corrected, latency);
+   }
+   ASSERT_TRUE(timestamps.GetModel(&cam1));
+   ASSERT_TRUE(timestamps.GetModel(&cam2));
+   EXPECT_NEAR(0.01, timestamps.GetModel(&cam1)->GetRate(), 1e-12);
+   EXPECT_NEAR(1.0, timestamps.GetModel(&cam2)->GetRate(), 1e-12);
+   timestamps.Clear();
+   EXPECT_FALSE(timestamps.GetModel(&cam1));
+}
+
+TEST(FrameTimestampsTests, DeviceTimestampTag)
+{
+   Metadata md;
+   double deviceTime = -1.0;
+   EXPECT_FALSE(GetDeviceTimestamp(md, deviceTime));
+   md.PutImageTag(MM::g_Keyword_Metadata_DeviceTimestamp, "not a number");
+   EXPECT_FALSE(GetDeviceTimestamp(md, deviceTime));
+   md.PutImageTag(MM::g_Keyword_Metadata_DeviceTimestamp, 1234567890123LL);
+   EXPECT_TRUE(GetDeviceTimestamp(md, deviceTime));
+   EXPECT_EQ(1234567890123.0, deviceTime);
+}
+
+TEST(FrameTimestampsTests, CircularBufferAddsCorrectedTimes)
+{
+   CircularBuffer cbuf(10);
+   ASSERT_TRUE(cbuf.Initialize(1, 4, 4, 1));
+   std::vector<unsigned char> image(16);
+   int camera;
+   for (int i = 0; i < 6; ++i)
+   {
+      Metadata md;
+      md.PutImageTag(MM::g_Keyword_Metadata_DeviceTimestamp, i * 1000);
+      ASSERT_TRUE(cbuf.InsertImage(image.data(), 4, 4, 1, 1, &md, &camera));
+   }
+   ASSERT_TRUE(cbuf.InsertImage(image.data(), 4, 4, 1, 1, 0, &camera));
+
+   for (int i = 0; i < 6; ++i)
+   {
+      const Metadata& md = cbuf.GetNextImageBuffer(0)->GetMetadata();
+      EXPECT_EQ(i, std::atoi(md.GetSingleTag(MM::g_Keyword_Metadata_ImageNumber).GetValue().c_str()));
+      EXPECT_EQ("GRAY8", md.GetSingleTag("PixelType").GetValue());
+      const double received = std::atof(md.GetSingleTag(g_Keyword_ReceivedTimeMs).GetValue().c_str());
+      const double corrected = std::atof(md.GetSingleTag(g_Keyword_CorrectedTimeMs).GetValue().c_str());
+      const double latency = std::atof(md.GetSingleTag(g_Keyword_EstimatedLatencyMs).GetValue().c_str());
+      EXPECT_LE(0.0, received);
+      EXPECT_LE(0.0, latency);
+      EXPECT_NEAR(received, corrected + latency, 0.002); // Each to the us
+      if (i < 3)
+      {
+         EXPECT_EQ(0.0, latency);
+      }
+   }
+
+   // Only frames with a device timestamp are corrected
+   const Metadata& md = cbuf.GetNextImageBuffer(0)->GetMetadata();
+   EXPECT_TRUE(md.HasTag(MM::g_Keyword_Elapsed_Time_ms));
+   EXPECT_TRUE(md.HasTag(MM::g_Keyword_Metadata_TimeInCore));
+   EXPECT_FALSE(md.HasTag(g_Keyword_CorrectedTimeMs));
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
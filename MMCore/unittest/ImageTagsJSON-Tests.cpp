@@ -0,0 +1,140 @@
+#include <gtest/gtest.h>
+
+#include "Configuration.h"
+#include "ImageTagsJSON.h"
+#include "MMCore.h"
+
+#include <string>
+
+using namespace mm;
+
+TEST(ImageTagsJSONTests, StringsAreEscaped)
+{
+   std::string out;
+   AppendJSONString(out, "a\"b\\c\nd\x01");
+   EXPECT_EQ("\"a\\\"b\\\\c\\u000ad\\u0001\"", out);
+}
+
+TEST(ImageTagsJSONTests, ShortestDoubles)
+{
+   EXPECT_EQ("1.0", ToShortestString(1.0));
+   EXPECT_EQ("0.1", ToShortestString(0.1));
+   EXPECT_EQ("-2.5", ToShortestString(-2.5));
+   EXPECT_EQ("0.0", ToShortestString(0.0));
+   EXPECT_EQ("1e+20", ToShortestString(1e20));
+   EXPECT_EQ("0.3333333333333333", ToShortestString(1.0 / 3.0));
+}
+
+TEST(ImageTagsJSONTests, FirstValueOfEachKeyWins)
+{
+   Configuration config;
+   config.addSetting(PropertySetting("Cam", "Gain", "2"));
+   config.addSetting(PropertySetting("Stage", "Speed", "fast"));
+   std::shared_ptr<const JSONFragment> fragment = SerializeConfigurationJSON(config);
+   EXPECT_EQ("\"Cam-Gain\":\"2\",\"Stage-Speed\":\"fast\"", fragment->members);
+   EXPECT_EQ(2u, fragment->keys.size());
+
+   Metadata md;
+   md.PutImageTag("Width", 1);
+   md.PutTag("Gain", "Cam", 5);
+   md.PutTag("Temperature", "Cam", -10.5);
+   MetadataArrayTag array("Array", "_", true);
+   array.AddValue("x");
+   md.SetTag(array);
+
+   ImageTagsJSONWriter writer;
+   writer.AddInteger("Width", 512);
+   writer.AddDouble("PixelSizeUm", 0.5);
+   writer.AddString("Width", "ignored");
+   writer.AddFragment(*fragment);
+   writer.AddMetadata(md);
+   EXPECT_EQ("{\"Width\":512,\"PixelSizeUm\":0.5,"
+         "\"Cam-Gain\":\"2\",\"Stage-Speed\":\"fast\","
+         "\"Cam-Temperature\":\"-10.5\"}", writer.Finish());
+
+   // The writer can be reused
+   writer.AddDouble("Bad", 1.0 / 0.0);
+   EXPECT_EQ("{\"Bad\":null}", writer.Finish());
+   EXPECT_EQ("{}", writer.Finish());
+}
+
+TEST(ImageTagsJSONTests, ConfigurationRevisions)
+{
+   Configuration config;
+   const long long empty = config.getRevision();
+   config.addSetting(PropertySetting("Cam", "Gain", "2"));
+   const long long added = config.getRevision();
+   EXPECT_NE(empty, added);
+
+   config.addSetting(PropertySetting("Cam", "Gain", "2"));
+   EXPECT_EQ(added, config.getRevision());
+
+   Configuration copy = config;
+   EXPECT_EQ(added, copy.getRevision());
+   copy.addSetting(PropertySetting("Cam", "Gain", "3"));
+   EXPECT_NE(added, copy.getRevision());
+   EXPECT_EQ(added, config.getRevision());
+
+   // Independent changes never share a revision
+   config.addSetting(PropertySetting("Cam", "Gain", "3"));
+   EXPECT_NE(copy.getRevision(), config.getRevision());
+
+   config.deleteSetting("Cam", "Gain");
+   EXPECT_NE(empty, config.getRevision());
+   EXPECT_NE(added, config.getRevision());
+}
+
+TEST(ImageTagsJSONTests, CoreSerializesStateCacheOnChange)
+{
+   CMMCore core;
+   core.setAutoShutter(true);
+   const long long revision = core.getSystemStateCacheRevision();
+   std::string json = core.getSystemStateCacheJSON();
+   EXPECT_NE(std::string::npos, json.find("\"Core-AutoShutter\":\"1\""));
+   EXPECT_EQ(revision, core.getSystemStateCacheRevision());
+
+   core.setAutoShutter(false);
+   EXPECT_NE(revision, core.getSystemStateCacheRevision());
+   json = core.getSystemStateCacheJSON();
+   EXPECT_NE(std::string::npos, json.find("\"Core-AutoShutter\":\"0\""));
+   EXPECT_EQ('{', json[0]);
+   EXPECT_EQ('}', json[json.size() - 1]);
+
+   Metadata md;
+   md.PutImageTag("ImageNumber", 7);
+   std::string tags = core.getImageTagsJSON(md, true);
+   EXPECT_NE(std::string::npos, tags.find("\"ImageNumber\":\"7\""));
+   EXPECT_NE(std::string::npos, tags.find("\"Frame\":0"));
+   EXPECT_NE(std::string::npos, tags.find("\"Core-AutoShutter\":\"0\""));
+   EXPECT_NE(std::string::npos, tags.find("\"Channel\":\"Default\""));
+   EXPECT_NE(std::string::npos, tags.find("\"PixelSizeAffine\":"));
+
+   tags = core.getImageTagsJSON(md, false);
+   EXPECT_EQ(std::string::npos, tags.find("Core-AutoShutter"));
+}
+
+TEST(ImageTagsJSONTests, CoreDefaultsDoNotReplaceImageTags)
+{
+   CMMCore core;
+   ASSERT_NE(2048u, core.getImageWidth());
+
+   // As tagged by an acquisition, for an image of another geometry
+   Metadata md;
+   md.PutImageTag("FrameIndex", 3);
+   md.PutImageTag("Width", 2048);
+   std::string tags = core.getImageTagsJSON(md, false);
+   EXPECT_NE(std::string::npos, tags.find("\"FrameIndex\":\"3\""));
+   EXPECT_NE(std::string::npos, tags.find("\"Width\":\"2048\""));
+   EXPECT_EQ(std::string::npos, tags.find("\"FrameIndex\":0"));
+   EXPECT_EQ(std::string::npos, tags.find("\"Width\":0"));
+
+   // Defaults are still added for the other keys
+   EXPECT_NE(std::string::npos, tags.find("\"SliceIndex\":0"));
+   EXPECT_NE(std::string::npos, tags.find("\"Height\":"));
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
@@ -0,0 +1,272 @@
+#include <gtest/gtest.h>
+
+#include "CircularBuffer.h"
+#include "LatestFrameMailbox.h"
+#include "MMCore.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using namespace mm;
+
+namespace
+{
+   void Publish(LatestFrameMailbox& mailbox, const std::vector<std::uint16_t>& image,
+         unsigned width, unsigned height)
+   {
+      Metadata md;
+      md.PutImageTag("Width", width);
+      md.PutImageTag("Height", height);
+      mailbox.BeginFrame(1, width, height, 2, 1, 0);
+      mailbox.SetChannel(0, reinterpret_cast<const unsigned char*>(image.data()), md);
+      mailbox.PublishFrame();
+   }
+}
+
+TEST(LatestFrameMailboxTests, EmptyUntilPublished)
+{
+   LatestFrameMailbox mailbox(0);
+   EXPECT_FALSE(mailbox.GetLatest());
+   EXPECT_EQ(0u, mailbox.GetPublishedCount());
+
+   std::vector<std::uint16_t> image(6 * 4, 7);
+   Publish(mailbox, image, 6, 4);
+   std::shared_ptr<const LatestFrame> frame = mailbox.GetLatest();
+   ASSERT_TRUE(frame);
+   EXPECT_EQ(1u, frame->serial);
+   EXPECT_EQ(1u, mailbox.GetPublishedCount());
+   EXPECT_EQ(6u, frame->width);
+   EXPECT_EQ(4u, frame->height);
+   ASSERT_EQ(1u, frame->pixels.size());
+   ASSERT_EQ(image.size() * 2, frame->channelBytes);
+   EXPECT_EQ(0, std::memcmp(image.data(), frame->pixels[0], image.size() * 2));
+   EXPECT_EQ(1u, frame->previewBinning);
+   EXPECT_EQ(frame->pixels[0], frame->GetPreview(0));
+   EXPECT_EQ(frame->channelBytes, frame->GetPreviewBytes());
+}
+
+TEST(LatestFrameMailboxTests, HeldFramesAreNeverOverwritten)
+{
+   LatestFrameMailbox mailbox(0);
+   std::vector<std::shared_ptr<const LatestFrame> > held;
+   for (std::uint16_t i = 0; i < 10; ++i)
+   {
+      Publish(mailbox, std::vector<std::uint16_t>(16, i), 4, 4);
+      held.push_back(mailbox.GetLatest());
+   }
+   for (std::uint16_t i = 0; i < 10; ++i)
+   {
+      EXPECT_EQ(i + 1u, held[i]->serial);
+      const std::uint16_t* pixels =
+         reinterpret_cast<const std::uint16_t*>(held[i]->pixels[0]);
+      EXPECT_EQ(i, pixels[0]);
+      EXPECT_EQ(i, pixels[15]);
+   }
+
+   // Once released, frames are reused (without reallocating pixels)
+   held.clear();
+   std::shared_ptr<const LatestFrame> latest = mailbox.GetLatest();
+   const LatestFrame* seen[3] = { latest.get(), 0, 0 };
+   latest.reset();
+   for (int i = 1; i < 3; ++i)
+   {
+      Publish(mailbox, std::vector<std::uint16_t>(16, 0), 4, 4);
+      seen[i] = mailbox.GetLatest().get();
+   }
+   Publish(mailbox, std::vector<std::uint16_t>(16, 0), 4, 4);
+   latest = mailbox.GetLatest();
+   EXPECT_TRUE(latest.get() == seen[0] || latest.get() == seen[1]);
+}
+
+TEST(LatestFrameMailboxTests, PreviewIsBinnedAverage)
+{
+   // 5 x 3 image, binned by 2 into 3 x 2, with partial edge blocks
+   LatestFrameMailbox mailbox(3);
+   std::vector<std::uint16_t> image = {
+      1, 3, 10, 20, 1000,
+      5, 7, 30, 40, 2000,
+      100, 200, 60000, 60001, 9,
+   };
+   Publish(mailbox, image, 5, 3);
+   std::shared_ptr<const LatestFrame> frame = mailbox.GetLatest();
+   ASSERT_TRUE(frame);
+   EXPECT_EQ(2u, frame->previewBinning);
+   EXPECT_EQ(3u, frame->previewWidth);
+   EXPECT_EQ(2u, frame->previewHeight);
+   EXPECT_EQ(0, std::memcmp(image.data(), frame->pixels[0], image.size() * 2));
+
+   ASSERT_EQ(3u * 2u * 2u, frame->GetPreviewBytes());
+   const std::uint16_t* p = reinterpret_cast<const std::uint16_t*>(frame->GetPreview(0));
+   EXPECT_EQ(4, p[0]);
+   EXPECT_EQ(25, p[1]);
+   EXPECT_EQ(1500, p[2]);
+   EXPECT_EQ(150, p[3]);
+   EXPECT_EQ(60001, p[4]); // Rounded
+   EXPECT_EQ(9, p[5]);
+
+   Metadata md = frame->GetPreviewMetadata(0);
+   EXPECT_EQ("3", md.GetSingleTag("Width").GetValue());
+   EXPECT_EQ("2", md.GetSingleTag("Height").GetValue());
+   EXPECT_EQ("2", md.GetSingleTag("PreviewBinning").GetValue());
+   EXPECT_EQ("5", frame->metadata[0].GetSingleTag("Width").GetValue());
+}
+
+TEST(LatestFrameMailboxTests, RGBPreviewAveragesEachComponent)
+{
+   LatestFrameMailbox mailbox(1);
+   const unsigned char image[] = {
+      10, 20, 30, 0,   30, 40, 50, 0,
+      50, 60, 70, 0,   70, 80, 90, 0,
+   };
+   Metadata md;
+   mailbox.BeginFrame(1, 2, 2, 4, 4, 0);
+   mailbox.SetChannel(0, image, md);
+   mailbox.PublishFrame();
+   std::shared_ptr<const LatestFrame> frame = mailbox.GetLatest();
+   ASSERT_EQ(2u, frame->previewBinning);
+   const unsigned char* preview = frame->GetPreview(0);
+   ASSERT_EQ(4u, frame->GetPreviewBytes());
+   EXPECT_EQ(40, preview[0]);
+   EXPECT_EQ(50, preview[1]);
+   EXPECT_EQ(60, preview[2]);
+   EXPECT_EQ(0, preview[3]);
+}
+
+TEST(LatestFrameMailboxTests, ReadersSeeCompleteFrames)
+{
+   LatestFrameMailbox mailbox(8);
+   const unsigned width = 64, height = 64;
+   std::atomic<bool> done(false);
+   std::atomic<int> torn(0);
+   std::thread reader([&]
+   {
+      while (!done)
+      {
+         std::shared_ptr<const LatestFrame> frame = mailbox.GetLatest();
+         if (!frame)
+            continue;
+         const std::uint16_t* pixels =
+            reinterpret_cast<const std::uint16_t*>(frame->pixels[0]);
+         const std::uint16_t* preview =
+            reinterpret_cast<const std::uint16_t*>(frame->GetPreview(0));
+         const std::uint16_t expected = static_cast<std::uint16_t>(frame->serial);
+         if (pixels[0] != expected || pixels[width * height - 1] != expected ||
+               preview[0] != expected)
+            ++torn;
+      }
+   });
+
+   for (unsigned i = 1; i <= 2000; ++i)
+      Publish(mailbox, std::vector<std::uint16_t>(width * height,
+               static_cast<std::uint16_t>(i)), width, height);
+   done = true;
+   reader.join();
+   EXPECT_EQ(0, torn.load());
+}
+
+TEST(LatestFrameMailboxTests, CircularBufferFeedsMailbox)
+{
+   CircularBuffer cbuf(10);
+   ASSERT_TRUE(cbuf.Initialize(1, 8, 8, 1));
+   std::shared_ptr<LatestFrameMailbox> mailbox =
+      std::make_shared<LatestFrameMailbox>(4);
+   cbuf.SetLatestFrameMailbox(mailbox);
+
+   std::vector<unsigned char> image(2 * 8 * 8);
+   for (std::size_t i = 0; i < image.size(); ++i)
+      image[i] = static_cast<unsigned char>(i);
+   ASSERT_TRUE(cbuf.InsertMultiChannel(image.data(), 2, 8, 8, 1, 0));
+
+   std::shared_ptr<const LatestFrame> frame = mailbox->GetLatest();
+   ASSERT_TRUE(frame);
+   ASSERT_EQ(2u, frame->pixels.size());
+   EXPECT_EQ(0, std::memcmp(image.data() + 64, frame->pixels[1], 64));
+   EXPECT_EQ("0", frame->metadata[1].GetSingleTag(MM::g_Keyword_Metadata_ImageNumber).GetValue());
+   EXPECT_EQ(2u, frame->previewBinning);
+   EXPECT_EQ(16u, frame->GetPreviewBytes());
+
+   // Reading the mailbox does not consume images
+   EXPECT_EQ(1, (int)cbuf.GetRemainingImageCount());
+
+   cbuf.SetLatestFrameMailbox(std::shared_ptr<LatestFrameMailbox>());
+   ASSERT_TRUE(cbuf.InsertMultiChannel(image.data(), 2, 8, 8, 1, 0));
+   EXPECT_EQ(1u, mailbox->GetPublishedCount());
+}
+
+TEST(LatestFrameMailboxTests, CircularBufferSharesSlots)
+{
+   CircularBuffer cbuf(1);
+   ASSERT_TRUE(cbuf.Initialize(1, 512, 512, 1)); // 4 slots
+   std::shared_ptr<LatestFrameMailbox> mailbox =
+      std::make_shared<LatestFrameMailbox>(0);
+   cbuf.SetLatestFrameMailbox(mailbox);
+
+   std::vector<unsigned char> image(512 * 512, 1);
+   ASSERT_TRUE(cbuf.InsertImage(image.data(), 512, 512, 1, 0));
+   std::shared_ptr<const LatestFrame> held = mailbox->GetLatest();
+   ASSERT_TRUE(held);
+   const mm::ImgBuffer* popped = cbuf.GetNextImageBuffer(0);
+   ASSERT_TRUE(popped != 0);
+   EXPECT_EQ(popped->GetPixels(), held->pixels[0]); // Not copied
+
+   // The held image's slot is passed over, not overwritten, while the
+   // others are reused
+   for (int i = 2; i < 20; ++i)
+   {
+      std::fill(image.begin(), image.end(), static_cast<unsigned char>(i));
+      ASSERT_TRUE(cbuf.InsertImage(image.data(), 512, 512, 1, 0));
+      ASSERT_TRUE(cbuf.GetNextImageBuffer(0) != 0);
+      EXPECT_EQ(1, held->pixels[0][0]);
+      EXPECT_EQ(1, held->pixels[0][512 * 512 - 1]);
+   }
+   EXPECT_FALSE(cbuf.Overflow());
+   EXPECT_EQ(19, mailbox->GetLatest()->pixels[0][0]);
+
+   // Once let go of, it is reused too
+   const unsigned char* heldPixels = held->pixels[0];
+   held.reset();
+   bool reused = false;
+   for (int i = 0; i < 8; ++i)
+   {
+      ASSERT_TRUE(cbuf.InsertImage(image.data(), 512, 512, 1, 0));
+      reused = reused || mailbox->GetLatest()->pixels[0] == heldPixels;
+      ASSERT_TRUE(cbuf.GetNextImageBuffer(0) != 0);
+   }
+   EXPECT_TRUE(reused);
+
+   // Compressed images are copied
+   cbuf.SetCompression(true);
+   ASSERT_TRUE(cbuf.InsertImage(image.data(), 512, 512, 1, 0));
+   std::shared_ptr<const LatestFrame> frame = mailbox->GetLatest();
+   EXPECT_EQ(0, std::memcmp(image.data(), frame->pixels[0], image.size()));
+}
+
+TEST(LatestFrameMailboxTests, CoreMailboxAPI)
+{
+   CMMCore core;
+   EXPECT_FALSE(core.isLatestFrameMailboxEnabled());
+   EXPECT_THROW(core.getLatestFrame(), CMMError);
+   EXPECT_EQ(0, core.getLatestFrameCount());
+
+   core.enableLatestFrameMailbox(true, 256);
+   EXPECT_TRUE(core.isLatestFrameMailboxEnabled());
+   EXPECT_THROW(core.getLatestFrame(), CMMError); // Empty
+   EXPECT_EQ(0, core.getLatestFrameCount());
+
+   core.setCircularBufferMemoryFootprint(16); // Mailbox stays attached
+   EXPECT_TRUE(core.isLatestFrameMailboxEnabled());
+
+   core.enableLatestFrameMailbox(false, 0);
+   EXPECT_FALSE(core.isLatestFrameMailboxEnabled());
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
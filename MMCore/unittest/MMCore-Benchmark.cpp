@@ -0,0 +1,412 @@
+// Performance benchmarks of MMCore, run against the DemoCamera and
+// SequenceTester device adapters loaded through the normal adapter search
+// path. Not part of "make check"; run with "make benchmark".
+//
+// Usage: MMCore-Benchmark [--adapter-path DIR]... [--output FILE] [--quick]
+//
+// Results are written as JSON (to stdout unless --output is given). Every
+// result has a name and an iteration count; timed results add the mean,
+// median, 95th percentile, minimum and maximum in microseconds, and
+// throughput results add their own fields. Benchmarks whose device adapter
+// cannot be loaded are listed under "skipped".
+
+#include "MMCore.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace
+{
+
+typedef std::chrono::steady_clock Clock;
+
+struct Result
+{
+   std::string name;
+   long iterations;
+   std::vector<double> samplesUs;
+   std::vector<std::pair<std::string, double> > extras;
+
+   explicit Result(const std::string& n) : name(n), iterations(0) {}
+};
+
+struct Skipped
+{
+   std::string name;
+   std::string reason;
+};
+
+
+double MicrosecondsSince(Clock::time_point start)
+{
+   return std::chrono::duration<double, std::micro>(
+         Clock::now() - start).count();
+}
+
+// Times each call of f separately
+template <typename F>
+Result TimeEach(const std::string& name, long iterations, F f)
+{
+   Result r(name);
+   r.iterations = iterations;
+   r.samplesUs.reserve(iterations);
+   for (long i = 0; i < iterations; ++i)
+   {
+      Clock::time_point start = Clock::now();
+      f(i);
+      r.samplesUs.push_back(MicrosecondsSince(start));
+   }
+   return r;
+}
+
+// Times iterations calls of f as a whole, for operations too fast to time
+// individually; reports the rate in addition to the mean
+template <typename F>
+Result TimeRate(const std::string& name, long iterations, F f)
+{
+   Result r(name);
+   r.iterations = iterations;
+   Clock::time_point start = Clock::now();
+   for (long i = 0; i < iterations; ++i)
+      f(i);
+   double totalUs = MicrosecondsSince(start);
+   r.extras.push_back(std::make_pair("meanUs", totalUs / iterations));
+   r.extras.push_back(std::make_pair("perSecond", iterations / totalUs * 1e6));
+   return r;
+}
+
+
+void WriteString(std::ostream& os, const std::string& s)
+{
+   os << '"';
+   for (std::string::const_iterator it = s.begin(); it != s.end(); ++it)
+   {
+      if (*it == '"' || *it == '\\')
+         os << '\\' << *it;
+      else if (static_cast<unsigned char>(*it) < 0x20)
+         os << ' ';
+      else
+         os << *it;
+   }
+   os << '"';
+}
+
+void WriteNumber(std::ostream& os, double v)
+{
+   char buf[32];
+   std::snprintf(buf, sizeof(buf), "%.3f", v);
+   os << buf;
+}
+
+void WriteResult(std::ostream& os, const Result& r)
+{
+   os << "    {\"name\": ";
+   WriteString(os, r.name);
+   os << ", \"iterations\": " << r.iterations;
+   if (!r.samplesUs.empty())
+   {
+      std::vector<double> sorted(r.samplesUs);
+      std::sort(sorted.begin(), sorted.end());
+      double sum = 0.0;
+      for (size_t i = 0; i < sorted.size(); ++i)
+         sum += sorted[i];
+      os << ", \"meanUs\": ";
+      WriteNumber(os, sum / sorted.size());
+      os << ", \"medianUs\": ";
+      WriteNumber(os, sorted[sorted.size() / 2]);
+      os << ", \"p95Us\": ";
+      WriteNumber(os, sorted[(sorted.size() * 95) / 100]);
+      os << ", \"minUs\": ";
+      WriteNumber(os, sorted.front());
+      os << ", \"maxUs\": ";
+      WriteNumber(os, sorted.back());
+   }
+   for (size_t i = 0; i < r.extras.size(); ++i)
+   {
+      os << ", ";
+      WriteString(os, r.extras[i].first);
+      os << ": ";
+      WriteNumber(os, r.extras[i].second);
+   }
+   os << "}";
+}
+
+void WriteReport(std::ostream& os, const std::string& coreVersion,
+      const std::vector<Result>& results, const std::vector<Skipped>& skipped)
+{
+   char date[32];
+   std::time_t now = std::time(0);
+   std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+
+   os << "{\n  \"coreVersion\": ";
+   WriteString(os, coreVersion);
+   os << ",\n  \"date\": ";
+   WriteString(os, date);
+   os << ",\n  \"results\": [\n";
+   for (size_t i = 0; i < results.size(); ++i)
+   {
+      WriteResult(os, results[i]);
+      os << (i + 1 < results.size() ? ",\n" : "\n");
+   }
+   os << "  ],\n  \"skipped\": [\n";
+   for (size_t i = 0; i < skipped.size(); ++i)
+   {
+      os << "    {\"name\": ";
+      WriteString(os, skipped[i].name);
+      os << ", \"reason\": ";
+      WriteString(os, skipped[i].reason);
+      os << "}" << (i + 1 < skipped.size() ? ",\n" : "\n");
+   }
+   os << "  ]\n}\n";
+}
+
+
+class Benchmarks
+{
+   CMMCore core_;
+   bool quick_;
+   std::vector<Result> results_;
+   std::vector<Skipped> skipped_;
+
+public:
+   Benchmarks(const std::vector<std::string>& adapterPaths, bool quick) :
+      quick_(quick)
+   {
+      core_.enableStderrLog(false);
+      core_.setPrimaryLogFile("MMCore-Benchmark.log", true);
+      if (!adapterPaths.empty())
+         core_.setDeviceAdapterSearchPaths(adapterPaths);
+      core_.setCircularBufferMemoryFootprint(512);
+   }
+
+   void Run()
+   {
+      RunGuarded("DemoCamera", &Benchmarks::LoadDemoCamera,
+            &Benchmarks::RunCameraBenchmarks);
+      RunGuarded("SequenceTester", &Benchmarks::LoadSequenceTester,
+            &Benchmarks::RunStateBenchmarks);
+      RunLoggingBenchmarks();
+   }
+
+   void Write(std::ostream& os) const
+   { WriteReport(os, core_.getVersionInfo(), results_, skipped_); }
+
+private:
+   long N(long full) const { return quick_ ? std::max(full / 20, 2L) : full; }
+
+   void RunGuarded(const std::string& what, void (Benchmarks::*load)(),
+         void (Benchmarks::*run)())
+   {
+      try
+      {
+         (this->*load)();
+      }
+      catch (const CMMError& e)
+      {
+         Skipped s;
+         s.name = what;
+         s.reason = e.getFullMsg();
+         skipped_.push_back(s);
+         return;
+      }
+      (this->*run)();
+      core_.unloadAllDevices();
+   }
+
+   void LoadDemoCamera()
+   {
+      core_.loadDevice("Camera", "DemoCamera", "DCam");
+      core_.initializeDevice("Camera");
+      core_.setCameraDevice("Camera");
+      core_.setProperty("Camera", "FastImage", "1");
+      core_.setProperty("Camera", "PixelType", "16bit");
+      core_.setExposure(0.0);
+   }
+
+   void LoadSequenceTester()
+   {
+      core_.loadDevice("Hub", "SequenceTester", "THub");
+      const char* peripherals[][2] = {
+         { "Camera", "TCamera-0" },
+         { "Shutter", "TShutter-0" },
+         { "XY", "TXYStage-0" },
+         { "Z", "TZStage-0" },
+         { "Switcher", "TSwitcher-0" },
+      };
+      for (size_t i = 0; i < sizeof(peripherals) / sizeof(peripherals[0]); ++i)
+      {
+         core_.loadDevice(peripherals[i][0], "SequenceTester", peripherals[i][1]);
+         core_.setParentLabel(peripherals[i][0], "Hub");
+      }
+      core_.initializeAllDevices();
+      core_.setCameraDevice("Camera");
+   }
+
+   void SetFrameSize(long size)
+   {
+      std::string s = std::to_string(size);
+      core_.setProperty("Camera", "OnCameraCCDXSize", s.c_str());
+      core_.setProperty("Camera", "OnCameraCCDYSize", s.c_str());
+   }
+
+   void RunCameraBenchmarks()
+   {
+      CMMCore& core = core_;
+
+      SetFrameSize(512);
+      results_.push_back(TimeEach("snapImage+getImage 512x512", N(200),
+               [&](long) { core.snapImage(); core.getImage(); }));
+
+      const long sizes[] = { 512, 1024, 2048 };
+      for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i)
+         RunSequenceThroughput(sizes[i]);
+
+      // Fill the buffer first so that only the pop is timed
+      SetFrameSize(512);
+      const long frames = N(400);
+      core_.startSequenceAcquisition(frames, 0.0, true);
+      while (core_.isSequenceRunning())
+         core_.sleep(1.0);
+      Metadata md;
+      results_.push_back(TimeEach("popNextImageMD 512x512",
+               std::min(frames, core_.getRemainingImageCount()),
+               [&](long) { core.popNextImageMD(md); }));
+
+      results_.push_back(TimeRate("getProperty (no action)", N(100000),
+               [&](long) { core.getProperty("Camera", "Gain"); }));
+      results_.push_back(TimeRate("getProperty (with action)", N(100000),
+               [&](long) { core.getProperty("Camera", "Binning"); }));
+      results_.push_back(TimeRate("setProperty", N(100000),
+               [&](long i) { core.setProperty("Camera", "Gain", i % 2 ? "1" : "0"); }));
+   }
+
+   void RunSequenceThroughput(long size)
+   {
+      SetFrameSize(size);
+      const long frames = N(size >= 2048 ? 200 : 1000);
+      const double bytesPerFrame = static_cast<double>(core_.getImageBufferSize());
+
+      core_.initializeCircularBuffer();
+      long popped = 0;
+      Clock::time_point start = Clock::now();
+      core_.startSequenceAcquisition(frames, 0.0, false);
+      while (core_.isSequenceRunning() || core_.getRemainingImageCount() > 0)
+      {
+         if (core_.getRemainingImageCount() > 0)
+         {
+            core_.popNextImage();
+            ++popped;
+         }
+         else
+            core_.sleep(0.0);
+      }
+      double seconds = MicrosecondsSince(start) / 1e6;
+
+      std::string sizeName = std::to_string(size) + "x" + std::to_string(size);
+      Result r("sequence " + sizeName);
+      r.iterations = frames;
+      r.extras.push_back(std::make_pair("framesReceived", double(popped)));
+      r.extras.push_back(std::make_pair("framesPerSecond", popped / seconds));
+      r.extras.push_back(std::make_pair("megabytesPerSecond",
+               popped * bytesPerFrame / seconds / (1 << 20)));
+      results_.push_back(r);
+   }
+
+   void RunStateBenchmarks()
+   {
+      CMMCore& core = core_;
+
+      core_.defineConfigGroup("Bench");
+      core_.defineConfig("Bench", "A", "Camera", "Exposure", "10.0000");
+      core_.defineConfig("Bench", "A", "Switcher", "State", "0");
+      core_.defineConfig("Bench", "A", "Shutter", "State", "0");
+      core_.defineConfig("Bench", "B", "Camera", "Exposure", "20.0000");
+      core_.defineConfig("Bench", "B", "Switcher", "State", "1");
+      core_.defineConfig("Bench", "B", "Shutter", "State", "1");
+
+      results_.push_back(TimeEach("setConfig (3 settings)", N(2000),
+               [&](long i) { core.setConfig("Bench", i % 2 ? "B" : "A"); }));
+      results_.push_back(TimeEach("getSystemState", N(2000),
+               [&](long) { core.getSystemState(); }));
+      results_.push_back(TimeEach("getSystemStateCache", N(2000),
+               [&](long) { core.getSystemStateCache(); }));
+   }
+
+   void RunLoggingBenchmarks()
+   {
+      CMMCore& core = core_;
+
+      core_.enableDebugLog(false);
+      results_.push_back(TimeRate("logMessage (info)", N(100000),
+               [&](long) { core.logMessage("Benchmark message"); }));
+      results_.push_back(TimeRate("logMessage (debug, filtered)", N(100000),
+               [&](long) { core.logMessage("Benchmark message", true); }));
+      core_.enableDebugLog(true);
+      results_.push_back(TimeRate("logMessage (debug, written)", N(100000),
+               [&](long) { core.logMessage("Benchmark message", true); }));
+      core_.enableDebugLog(false);
+   }
+};
+
+void PrintUsage(const char* program)
+{
+   std::cerr << "Usage: " << program <<
+      " [--adapter-path DIR]... [--output FILE] [--quick]\n";
+}
+
+} // anonymous namespace
+
+
+int main(int argc, char** argv)
+{
+   std::vector<std::string> adapterPaths;
+   std::string output;
+   bool quick = false;
+   for (int i = 1; i < argc; ++i)
+   {
+      if (std::strcmp(argv[i], "--adapter-path") == 0 && i + 1 < argc)
+         adapterPaths.push_back(argv[++i]);
+      else if (std::strcmp(argv[i], "--output") == 0 && i + 1 < argc)
+         output = argv[++i];
+      else if (std::strcmp(argv[i], "--quick") == 0)
+         quick = true;
+      else
+      {
+         PrintUsage(argv[0]);
+         return 2;
+      }
+   }
+
+   try
+   {
+      Benchmarks benchmarks(adapterPaths, quick);
+      benchmarks.Run();
+      if (output.empty())
+         benchmarks.Write(std::cout);
+      else
+      {
+         std::ofstream os(output.c_str());
+         benchmarks.Write(os);
+         if (!os)
+         {
+            std::cerr << "Cannot write " << output << "\n";
+            return 1;
+         }
+      }
+   }
+   catch (const CMMError& e)
+   {
+      std::cerr << e.getFullMsg() << "\n";
+      return 1;
+   }
+   return 0;
+}
@@ -0,0 +1,136 @@
+#include <gtest/gtest.h>
+
+#include "SharedFrameRingFormat.h"
+#include "SharedFrameRingWriter.h"
+#include "../MMDevice/ImageMetadata.h"
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+using namespace mm;
+
+namespace
+{
+   std::string RingName(const char* test)
+   {
+      return "/mmcore-test-" + std::string(test) + "-" +
+         std::to_string(::getpid());
+   }
+
+   std::vector<unsigned char> Frame(unsigned n, std::size_t bytes)
+   {
+      std::vector<unsigned char> pixels(bytes);
+      for (std::size_t i = 0; i < bytes; ++i)
+         pixels[i] = static_cast<unsigned char>(n * 13 + i);
+      return pixels;
+   }
+
+   void Publish(SharedFrameRingWriter& writer, unsigned n)
+   {
+      std::vector<unsigned char> pixels = Frame(n, 32 * 16 * 2);
+      Metadata md;
+      md.PutImageTag<std::string>("Camera", "Cam");
+      md.PutImageTag(MM::g_Keyword_Metadata_ImageNumber, n);
+      ASSERT_TRUE(writer.Publish(&pixels[0], 32, 16, 2, 1, md));
+   }
+}
+
+TEST(SharedFrameRingTests, ReaderSeesPublishedFrames)
+{
+   const std::string name = RingName("read");
+   SharedFrameRingWriter writer(name, 4, 32 * 16 * 2);
+
+   std::size_t size = 0;
+   const MMSFRHeader* ring = mmsfr_attach(name.c_str(), &size);
+   ASSERT_TRUE(ring != 0);
+   EXPECT_EQ(4u, ring->slotCount);
+   EXPECT_EQ(0u, mmsfr_write_count(ring));
+
+   const MMSFRSlotHeader* slot = 0;
+   EXPECT_EQ(MMSFR_NOT_YET, mmsfr_begin_read(ring, 0, &slot));
+
+   for (unsigned n = 0; n < 3; ++n)
+      Publish(writer, n);
+   EXPECT_EQ(3u, mmsfr_write_count(ring));
+
+   for (unsigned n = 0; n < 3; ++n)
+   {
+      ASSERT_EQ(MMSFR_OK, mmsfr_begin_read(ring, n, &slot));
+      EXPECT_EQ(32u, slot->width);
+      EXPECT_EQ(16u, slot->height);
+      EXPECT_EQ(2u, slot->bytesPerPixel);
+      EXPECT_EQ(std::int64_t(n), slot->imageNumber);
+      EXPECT_STREQ("Cam", slot->camera);
+      std::vector<unsigned char> expected = Frame(n, 32 * 16 * 2);
+      ASSERT_EQ(expected.size(), slot->pixelBytes);
+      EXPECT_EQ(0, std::memcmp(&expected[0], mmsfr_pixels(ring, slot),
+               expected.size()));
+      EXPECT_EQ(MMSFR_OK, mmsfr_end_read(ring, n, slot));
+   }
+   mmsfr_detach(ring, size);
+}
+
+TEST(SharedFrameRingTests, OverrunsAreDetected)
+{
+   const std::string name = RingName("overrun");
+   SharedFrameRingWriter writer(name, 4, 32 * 16 * 2);
+   std::size_t size = 0;
+   const MMSFRHeader* ring = mmsfr_attach(name.c_str(), &size);
+   ASSERT_TRUE(ring != 0);
+
+   Publish(writer, 0);
+   Publish(writer, 1);
+   const MMSFRSlotHeader* slot = 0;
+   ASSERT_EQ(MMSFR_OK, mmsfr_begin_read(ring, 1, &slot));
+
+   // Frame 5 reuses frame 1's slot while it is being read
+   for (unsigned n = 2; n < 6; ++n)
+      Publish(writer, n);
+   EXPECT_EQ(MMSFR_OVERWRITTEN, mmsfr_end_read(ring, 1, slot));
+   EXPECT_EQ(MMSFR_OVERWRITTEN, mmsfr_begin_read(ring, 0, &slot));
+   EXPECT_EQ(MMSFR_OK, mmsfr_begin_read(ring, 2, &slot));
+   mmsfr_detach(ring, size);
+}
+
+TEST(SharedFrameRingTests, OversizedFramesSkipped)
+{
+   const std::string name = RingName("skip");
+   SharedFrameRingWriter writer(name, 2, 100);
+   std::vector<unsigned char> pixels(200);
+   EXPECT_FALSE(writer.Publish(&pixels[0], 20, 10, 1, 1, Metadata()));
+   EXPECT_EQ(1u, writer.GetSkippedCount());
+   EXPECT_EQ(0u, writer.GetPublishedCount());
+}
+
+TEST(SharedFrameRingTests, ClosedAndUnlinkedWhenDestroyed)
+{
+   const std::string name = RingName("close");
+   std::size_t size = 0;
+   const MMSFRHeader* ring;
+   {
+      SharedFrameRingWriter writer(name, 2, 64);
+      ring = mmsfr_attach(name.c_str(), &size);
+      ASSERT_TRUE(ring != 0);
+      EXPECT_FALSE(mmsfr_is_closed(ring));
+   }
+   EXPECT_TRUE(mmsfr_is_closed(ring));
+   std::size_t size2;
+   EXPECT_TRUE(mmsfr_attach(name.c_str(), &size2) == 0);
+   mmsfr_detach(ring, size);
+}
+
+TEST(SharedFrameRingTests, InvalidNamesRejected)
+{
+   EXPECT_THROW(SharedFrameRingWriter("noslash", 2, 64), CMMError);
+   EXPECT_THROW(SharedFrameRingWriter("/a/b", 2, 64), CMMError);
+   EXPECT_THROW(SharedFrameRingWriter(RingName("slots"), 1, 64), CMMError);
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
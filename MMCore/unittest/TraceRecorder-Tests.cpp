@@ -0,0 +1,149 @@
+#include <gtest/gtest.h>
+
+#include "Devices/DeviceCallStatistics.h"
+#include "TraceRecorder.h"
+
+#include <sstream>
+#include <string>
+#include <thread>
+
+using namespace mm;
+
+namespace
+{
+   class EnableTracing
+   {
+   public:
+      EnableTracing()
+      {
+         TraceRecorder::Clear();
+         TraceRecorder::SetEnabled(true);
+      }
+      ~EnableTracing()
+      {
+         TraceRecorder::SetEnabled(false);
+         TraceRecorder::Clear();
+      }
+   };
+
+   std::string TraceJSON()
+   {
+      std::ostringstream os;
+      TraceRecorder::WriteChromeJSON(os);
+      return os.str();
+   }
+
+   std::size_t CountOccurrences(const std::string& s, const std::string& sub)
+   {
+      std::size_t n = 0;
+      for (std::size_t pos = s.find(sub); pos != std::string::npos;
+            pos = s.find(sub, pos + sub.size()))
+         ++n;
+      return n;
+   }
+
+   struct FakeDevice
+   {
+      int Answer() { return 42; }
+   };
+}
+
+TEST(TraceRecorderTests, NothingRecordedWhileDisabled)
+{
+   TraceRecorder::Clear();
+   ASSERT_FALSE(TraceRecorder::IsEnabled());
+   {
+      TraceSpan span("DisabledSpan", "test");
+   }
+   TraceRecorder::RecordInstant("DisabledInstant", "test", 0);
+   std::string json = TraceJSON();
+   ASSERT_EQ(std::string::npos, json.find("Disabled"));
+   ASSERT_EQ(0u, json.find("{\"displayTimeUnit\":\"ms\",\"traceEvents\":["));
+}
+
+TEST(TraceRecorderTests, RecordsSpansAndInstants)
+{
+   EnableTracing enable;
+   const char* label = TraceRecorder::Intern("Cam \"1\"");
+   {
+      TraceSpan span("TestSpan", "test", label);
+   }
+   TraceRecorder::RecordInstant("TestInstant", "test", 0);
+
+   std::string json = TraceJSON();
+   ASSERT_NE(std::string::npos, json.find(
+            "{\"name\":\"TestSpan\",\"cat\":\"test\",\"ph\":\"X\",\"dur\":"));
+   ASSERT_NE(std::string::npos, json.find("\"args\":{\"device\":\"Cam \\\"1\\\"\"}"));
+   ASSERT_NE(std::string::npos, json.find(
+            "{\"name\":\"TestInstant\",\"cat\":\"test\",\"ph\":\"i\",\"s\":\"t\",\"ts\":"));
+   ASSERT_NE(std::string::npos, json.find("\"ph\":\"M\""));
+}
+
+TEST(TraceRecorderTests, InternReturnsSamePointerForSameString)
+{
+   const char* a = TraceRecorder::Intern("Stage");
+   const char* b = TraceRecorder::Intern(std::string("Sta") + "ge");
+   ASSERT_EQ(a, b);
+   ASSERT_STREQ("Stage", a);
+}
+
+TEST(TraceRecorderTests, ThreadsGetSeparateNamedLanes)
+{
+   EnableTracing enable;
+   TraceRecorder::SetCurrentThreadName("Main lane");
+   TraceRecorder::RecordInstant("OnMain", "test", 0);
+   std::thread t([]() {
+      TraceRecorder::SetCurrentThreadName("Worker lane");
+      TraceRecorder::RecordInstant("OnWorker", "test", 0);
+   });
+   t.join();
+
+   std::string json = TraceJSON();
+   ASSERT_NE(std::string::npos, json.find("\"name\":\"Main lane\""));
+   ASSERT_NE(std::string::npos, json.find("\"name\":\"Worker lane\""));
+   ASSERT_NE(std::string::npos, json.find("OnWorker"));
+
+   // Exited threads' events survive until cleared
+   TraceRecorder::Clear();
+   json = TraceJSON();
+   ASSERT_EQ(std::string::npos, json.find("OnWorker"));
+   ASSERT_EQ(std::string::npos, json.find("Worker lane"));
+   ASSERT_EQ(std::string::npos, json.find("OnMain"));
+}
+
+TEST(TraceRecorderTests, RingKeepsMostRecentEvents)
+{
+   EnableTracing enable;
+   const std::size_t extra = 10;
+   for (std::size_t i = 0; i < TraceRecorder::EventsPerThread + extra; ++i)
+      TraceRecorder::RecordInstant(i < extra ? "Old" : "New", "test", 0);
+
+   std::string json = TraceJSON();
+   ASSERT_EQ(0u, CountOccurrences(json, "\"Old\""));
+   // The slot the owner could be writing next is never reported
+   ASSERT_EQ(TraceRecorder::EventsPerThread - 1,
+         CountOccurrences(json, "\"New\""));
+}
+
+TEST(TraceRecorderTests, TimedDeviceCallRecordsSpan)
+{
+   DeviceCallSite site("TracedAnswer");
+   FakeDevice device;
+   const char* label = TraceRecorder::Intern("TracedDevice");
+
+   ASSERT_EQ(42, TimedDeviceCall<FakeDevice>(&device, 0, site, label)->Answer());
+   ASSERT_EQ(std::string::npos, TraceJSON().find("TracedAnswer"));
+
+   EnableTracing enable;
+   ASSERT_EQ(42, TimedDeviceCall<FakeDevice>(&device, 0, site, label)->Answer());
+   std::string json = TraceJSON();
+   ASSERT_NE(std::string::npos, json.find(
+            "{\"name\":\"TracedAnswer\",\"cat\":\"device\",\"ph\":\"X\""));
+   ASSERT_NE(std::string::npos, json.find("\"device\":\"TracedDevice\""));
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
@@ -401,113 +401,250 @@
 %typemap(javaout) void* {
    return $jnicall;
 }
+%{
+// Creates the Java array for an image of lSize pixels: byte[], short[] or
+// float[] by pixel depth, byte[] for RGB32 and short[] for RGB64. Returns 0
+// (with an OutOfMemoryError pending if the array could not be allocated)
+// if there is none.
+static jobject PixelsToJava(JNIEnv* jenv, const void* pixels, long lSize,
+      unsigned bytesPerPixel, unsigned numComponents)
+{
+   jarray data = 0;
+   if (bytesPerPixel == 1)
+      data = jenv->NewByteArray(lSize);
+   else if (bytesPerPixel == 2)
+      data = jenv->NewShortArray(lSize);
+   else if (bytesPerPixel == 4 && numComponents == 1)
+      data = jenv->NewFloatArray(lSize);
+   else if (bytesPerPixel == 4)
+      data = jenv->NewByteArray(lSize * 4);
+   else if (bytesPerPixel == 8)
+      data = jenv->NewShortArray(lSize * 4);
+   else
+   {
+      // don't know how to map
+      // TODO: throw exception?
+      return 0;
+   }
+
+   if (data == 0)
+   {
+      jclass excep = jenv->FindClass("java/lang/OutOfMemoryError");
+      if (excep)
+         jenv->ThrowNew(excep, "The system ran out of memory!");
+      return 0;
+   }
+
+   // copy pixels from the image buffer
+   if (bytesPerPixel == 1)
+      jenv->SetByteArrayRegion((jbyteArray)data, 0, lSize, (const jbyte*)pixels);
+   else if (bytesPerPixel == 2)
+      jenv->SetShortArrayRegion((jshortArray)data, 0, lSize, (const jshort*)pixels);
+   else if (numComponents == 1)
+      jenv->SetFloatArrayRegion((jfloatArray)data, 0, lSize, (const jfloat*)pixels);
+   else if (bytesPerPixel == 4)
+      jenv->SetByteArrayRegion((jbyteArray)data, 0, lSize * 4, (const jbyte*)pixels);
+   else
+      jenv->SetShortArrayRegion((jshortArray)data, 0, lSize * 4, (const jshort*)pixels);
+   return data;
+}
+%}
+
 %typemap(out) void*
 {
    long lSize = (arg1)->getImageWidth() * (arg1)->getImageHeight();
-   
-   if ((arg1)->getBytesPerPixel() == 1)
-   {
-      // create a new byte[] object in Java
-      jbyteArray data = JCALL1(NewByteArray, jenv, lSize);
-      if (data == 0)
-      {
-         jclass excep = jenv->FindClass("java/lang/OutOfMemoryError");
-         if (excep)
-            jenv->ThrowNew(excep, "The system ran out of memory!");
+   $result = PixelsToJava(jenv, result, lSize, (arg1)->getBytesPerPixel(),
+         (arg1)->getNumberOfComponents());
+}
 
-         $result = 0;
-         return $result;
-      }
-   
-      // copy pixels from the image buffer
-      JCALL4(SetByteArrayRegion, jenv, data, 0, lSize, (jbyte*)result);
+// Java typemap
+// map JavaBufferImage return values to a Java array of the pixels of an
+// image from the circular buffer. Images in the buffer need not have the
+// current camera's geometry (e.g. when several cameras insert images), so
+// the array is sized from the Width, Height and PixelType tags that the
+// buffer gives each image.
 
-      $result = data;
+%{
+#include "../MMCore/Error.h"
+#include "../MMDevice/ImageMetadata.h"
+#include <cstdlib>
+
+struct JavaBufferImage
+{
+   void* pixels;
+   unsigned width;
+   unsigned height;
+   unsigned bytesPerPixel;
+   unsigned numComponents;
+};
+
+static JavaBufferImage BufferImageFromMetadata(void* pixels,
+      const Metadata& md) throw (CMMError)
+{
+   JavaBufferImage image;
+   image.pixels = pixels;
+   std::string pixelType;
+   try
+   {
+      image.width = std::atoi(md.GetSingleTag("Width").GetValue().c_str());
+      image.height = std::atoi(md.GetSingleTag("Height").GetValue().c_str());
+      pixelType = md.GetSingleTag("PixelType").GetValue();
    }
-   else if ((arg1)->getBytesPerPixel() == 2)
+   catch (const MetadataKeyError&)
    {
-      // create a new short[] object in Java
-      jshortArray data = JCALL1(NewShortArray, jenv, lSize);
-      if (data == 0)
-      {
-         jclass excep = jenv->FindClass("java/lang/OutOfMemoryError");
-         if (excep)
-            jenv->ThrowNew(excep, "The system ran out of memory!");
-         $result = 0;
-         return $result;
-      }
-  
-      // copy pixels from the image buffer
-      JCALL4(SetShortArrayRegion, jenv, data, 0, lSize, (jshort*)result);
+      throw CMMError("Image from the circular buffer lacks its format tags");
+   }
 
-      $result = data;
+   image.numComponents = 1;
+   if (pixelType == "GRAY8")
+      image.bytesPerPixel = 1;
+   else if (pixelType == "GRAY16")
+      image.bytesPerPixel = 2;
+   else if (pixelType == "GRAY32")
+      image.bytesPerPixel = 4;
+   else if (pixelType == "RGB32")
+   {
+      image.bytesPerPixel = 4;
+      image.numComponents = 4;
    }
-   else if ((arg1)->getBytesPerPixel() == 4)
+   else if (pixelType == "RGB64")
    {
-      if ((arg1)->getNumberOfComponents() == 1)
-      {
-         // create a new float[] object in Java
-         jfloatArray data = JCALL1(NewFloatArray, jenv, lSize);
-         if (data == 0)
-         {
-            jclass excep = jenv->FindClass("java/lang/OutOfMemoryError");
-            if (excep)
-               jenv->ThrowNew(excep, "The system ran out of memory!");
-
-            $result = 0;
-            return $result;
-         }
+      image.bytesPerPixel = 8;
+      image.numComponents = 4;
+   }
+   else
+      throw CMMError("Pixel type " + pixelType +
+            " of image from the circular buffer cannot be mapped to Java");
+   return image;
+}
+%}
 
-         // copy pixels from the image buffer
-         JCALL4(SetFloatArrayRegion, jenv, data, 0, lSize, (jfloat*)result);
+%typemap(jni) JavaBufferImage    "jobject"
+%typemap(jtype) JavaBufferImage  "Object"
+%typemap(jstype) JavaBufferImage "Object"
+%typemap(javaout) JavaBufferImage {
+   return $jnicall;
+}
+%typemap(out) JavaBufferImage
+{
+   $result = PixelsToJava(jenv, $1.pixels, (long)$1.width * $1.height,
+         $1.bytesPerPixel, $1.numComponents);
+}
 
-         $result = data;
-      }
-      else
-      {
-         // create a new byte[] object in Java
-         jbyteArray data = JCALL1(NewByteArray, jenv, lSize * 4);
-         if (data == 0)
-         {
-            jclass excep = jenv->FindClass("java/lang/OutOfMemoryError");
-            if (excep)
-               jenv->ThrowNew(excep, "The system ran out of memory!");
-
-            $result = 0;
-            return $result;
-         }
+// Java typemap
+// map JavaPixelDestination arguments to a caller-supplied Java object into
+// which pixels are copied: a direct java.nio.ByteBuffer or a byte[],
+// short[], int[] or float[] array. This lets Java code reuse (pool) its
+// pixel buffers instead of receiving a newly allocated array per image.
 
-         // copy pixels from the image buffer
-         JCALL4(SetByteArrayRegion, jenv, data, 0, lSize * 4, (jbyte*)result);
+%{
+#include <cstring>
 
-         $result = data;
-      }
-   }
-   else if ((arg1)->getBytesPerPixel() == 8)
-   {
-      // create a new short[] object in Java
-      jshortArray data = JCALL1(NewShortArray, jenv, lSize * 4);
-      if (data == 0)
-      {
-         jclass excep = jenv->FindClass("java/lang/OutOfMemoryError");
-         if (excep)
-            jenv->ThrowNew(excep, "The system ran out of memory!");
-         $result = 0;
-         return $result;
-      }
-  
-      // copy pixels from the image buffer
-      JCALL4(SetShortArrayRegion, jenv, data, 0, lSize * 4, (jshort*)result);
+struct JavaPixelDestination
+{
+   JNIEnv* env;
+   jobject object;
+};
 
-      $result = data;
+// Checks that the destination can take numBytes pixel bytes
+static void CheckPixelDestination(const JavaPixelDestination& dest,
+      long numBytes) throw (CMMError)
+{
+   JNIEnv* jenv = dest.env;
+   if (dest.object == 0)
+      throw CMMError("Null pixel destination");
+
+   if (jenv->GetDirectBufferAddress(dest.object) != 0)
+   {
+      if (jenv->GetDirectBufferCapacity(dest.object) < numBytes)
+         throw CMMError("Direct ByteBuffer too small for image");
+      return;
    }
 
+   long elementSize = 0;
+   if (jenv->IsInstanceOf(dest.object, jenv->FindClass("[B")))
+      elementSize = sizeof(jbyte);
+   else if (jenv->IsInstanceOf(dest.object, jenv->FindClass("[S")))
+      elementSize = sizeof(jshort);
+   else if (jenv->IsInstanceOf(dest.object, jenv->FindClass("[I")))
+      elementSize = sizeof(jint);
+   else if (jenv->IsInstanceOf(dest.object, jenv->FindClass("[F")))
+      elementSize = sizeof(jfloat);
    else
+      throw CMMError("Pixel destination must be a direct ByteBuffer or a "
+            "byte[], short[], int[] or float[] array");
+
+   if (jenv->GetArrayLength(static_cast<jarray>(dest.object)) * elementSize < numBytes)
+      throw CMMError("Array too small for image");
+}
+
+// Copies numBytes pixel bytes into the destination; returns numBytes
+static long CopyPixelsToJava(const JavaPixelDestination& dest,
+      const void* pixels, long numBytes) throw (CMMError)
+{
+   CheckPixelDestination(dest, numBytes);
+   if (pixels == 0)
+      throw CMMError("No pixels to copy");
+
+   JNIEnv* jenv = dest.env;
+   void* address = jenv->GetDirectBufferAddress(dest.object);
+   if (address != 0)
    {
-      // don't know how to map
-      // TODO: throw exception?
-      $result = 0;
+      memcpy(address, pixels, numBytes);
+      return numBytes;
    }
+
+   jarray array = static_cast<jarray>(dest.object);
+   void* elements = jenv->GetPrimitiveArrayCritical(array, 0);
+   if (elements == 0)
+      throw CMMError("Cannot access array elements");
+   memcpy(elements, pixels, numBytes);
+   jenv->ReleasePrimitiveArrayCritical(array, elements, 0);
+   return numBytes;
+}
+
+// Copies an image from the circular buffer, whose size is given by its
+// metadata (see BufferImageFromMetadata())
+static long CopyBufferImageToJava(const JavaPixelDestination& dest,
+      void* pixels, const Metadata& md) throw (CMMError)
+{
+   JavaBufferImage image = BufferImageFromMetadata(pixels, md);
+   return CopyPixelsToJava(dest, pixels,
+         (long)image.width * image.height * image.bytesPerPixel);
+}
+%}
+
+%typemap(jni) JavaPixelDestination    "jobject"
+%typemap(jtype) JavaPixelDestination  "Object"
+%typemap(jstype) JavaPixelDestination "Object"
+%typemap(javain) JavaPixelDestination "$javainput"
+%typemap(in) JavaPixelDestination
+{
+   $1.env = jenv;
+   $1.object = $input;
+}
+
+// Java typemap
+// map JavaPinnedBuffer return values to a direct java.nio.ByteBuffer that
+// wraps the pixels of a pinned image without copying them
+
+%{
+struct JavaPinnedBuffer
+{
+   void* pixels;
+   long numBytes;
+};
+%}
+
+%typemap(jni) JavaPinnedBuffer    "jobject"
+%typemap(jtype) JavaPinnedBuffer  "java.nio.ByteBuffer"
+%typemap(jstype) JavaPinnedBuffer "java.nio.ByteBuffer"
+%typemap(javaout) JavaPinnedBuffer {
+   return $jnicall;
+}
+%typemap(out) JavaPinnedBuffer
+{
+   $result = jenv->NewDirectByteBuffer($1.pixels, $1.numBytes);
 }
 
 // Java typemap
@@ -632,6 +769,187 @@
 %ignore MetadataKeyError;
 %ignore MetadataIndexError;
 
+// Compare device handles in Java with getId()
+%ignore DeviceHandle::operator==;
+%ignore DeviceHandle::operator!=;
+
+// The pinned pixels are exposed through getPinnedImageBuffer() instead
+%ignore CMMCore::getPinnedImagePixels;
+// The latest frame is exposed through getLatest*Into() instead
+%ignore CMMCore::getLatestFrame;
+
+// The circular buffer getters return arrays sized from each image's own
+// format (see JavaBufferImage), through the extensions below under the
+// original names
+%ignore CMMCore::getLastImage;
+%ignore CMMCore::popNextImage;
+%ignore CMMCore::getLastImageMD;
+%ignore CMMCore::getNBeforeLastImageMD;
+%ignore CMMCore::popNextImageMD;
+%rename(getLastImage) CMMCore::getLastBufferImage;
+%rename(popNextImage) CMMCore::popNextBufferImage;
+%rename(getLastImageMD) CMMCore::getLastBufferImageMD;
+%rename(getNBeforeLastImageMD) CMMCore::getNBeforeLastBufferImageMD;
+%rename(popNextImageMD) CMMCore::popNextBufferImageMD;
+
+%extend CMMCore {
+   JavaBufferImage getLastBufferImage() throw (CMMError)
+   {
+      $self->getLastImage(); // Throws errors posted by cameras
+      // The same image, unless a newer one has just been inserted
+      Metadata md;
+      void* pixels = $self->getLastImageMD(md);
+      return BufferImageFromMetadata(pixels, md);
+   }
+
+   JavaBufferImage popNextBufferImage() throw (CMMError)
+   {
+      Metadata md;
+      void* pixels = $self->popNextImageMD(md);
+      return BufferImageFromMetadata(pixels, md);
+   }
+
+   JavaBufferImage getLastBufferImageMD(unsigned channel, unsigned slice,
+         Metadata& md) throw (CMMError)
+   {
+      void* pixels = $self->getLastImageMD(channel, slice, md);
+      return BufferImageFromMetadata(pixels, md);
+   }
+
+   JavaBufferImage getLastBufferImageMD(Metadata& md) throw (CMMError)
+   {
+      void* pixels = $self->getLastImageMD(md);
+      return BufferImageFromMetadata(pixels, md);
+   }
+
+   JavaBufferImage getLastBufferImageMD(const char* cameraLabel,
+         Metadata& md) throw (CMMError)
+   {
+      void* pixels = $self->getLastImageMD(cameraLabel, md);
+      return BufferImageFromMetadata(pixels, md);
+   }
+
+   JavaBufferImage getNBeforeLastBufferImageMD(unsigned long n, Metadata& md)
+      throw (CMMError)
+   {
+      void* pixels = $self->getNBeforeLastImageMD(n, md);
+      return BufferImageFromMetadata(pixels, md);
+   }
+
+   JavaBufferImage popNextBufferImageMD(unsigned channel, unsigned slice,
+         Metadata& md) throw (CMMError)
+   {
+      void* pixels = $self->popNextImageMD(channel, slice, md);
+      return BufferImageFromMetadata(pixels, md);
+   }
+
+   JavaBufferImage popNextBufferImageMD(Metadata& md) throw (CMMError)
+   {
+      void* pixels = $self->popNextImageMD(md);
+      return BufferImageFromMetadata(pixels, md);
+   }
+
+   JavaBufferImage popNextBufferImageMD(const char* cameraLabel,
+         Metadata& md) throw (CMMError)
+   {
+      void* pixels = $self->popNextImageMD(cameraLabel, md);
+      return BufferImageFromMetadata(pixels, md);
+   }
+}
+
+// Image transfer into caller-supplied buffers, and zero-copy access to
+// pinned images. Each *Into() method returns the number of bytes copied.
+%extend CMMCore {
+   long getImageInto(JavaPixelDestination dest) throw (CMMError)
+   {
+      return CopyPixelsToJava(dest, $self->getImage(),
+            $self->getImageBufferSize());
+   }
+
+   long getImageInto(unsigned numChannel, JavaPixelDestination dest)
+      throw (CMMError)
+   {
+      return CopyPixelsToJava(dest, $self->getImage(numChannel),
+            $self->getImageBufferSize());
+   }
+
+   long getLastImageInto(JavaPixelDestination dest) throw (CMMError)
+   {
+      $self->getLastImage(); // Throws errors posted by cameras
+      Metadata md;
+      return CopyBufferImageToJava(dest, $self->getLastImageMD(md), md);
+   }
+
+   long getLastImageMDInto(JavaPixelDestination dest, Metadata& md)
+      throw (CMMError)
+   {
+      return CopyBufferImageToJava(dest, $self->getLastImageMD(md), md);
+   }
+
+   /**
+    * The popNext*Into() methods check the destination before popping the
+    * image, so that an image is not lost to a destination that is too
+    * small. This assumes a single consumer popping images.
+    */
+   long popNextImageInto(JavaPixelDestination dest) throw (CMMError)
+   {
+      CheckPixelDestination(dest, $self->getNextImageBufferSize());
+      Metadata md;
+      return CopyBufferImageToJava(dest, $self->popNextImageMD(md), md);
+   }
+
+   long popNextImageMDInto(JavaPixelDestination dest, Metadata& md)
+      throw (CMMError)
+   {
+      CheckPixelDestination(dest, $self->getNextImageBufferSize());
+      return CopyBufferImageToJava(dest, $self->popNextImageMD(md), md);
+   }
+
+   /**
+    * Returns a direct ByteBuffer over the pixels of a pinned image (see
+    * popNextImagePinned()). The buffer must not be used after the image
+    * has been released with releasePinnedImage().
+    */
+   JavaPinnedBuffer getPinnedImageBuffer(long pinId) throw (CMMError)
+   {
+      JavaPinnedBuffer buffer;
+      buffer.pixels = $self->getPinnedImagePixels(pinId);
+      buffer.numBytes = $self->getPinnedImageBufferSize(pinId);
+      return buffer;
+   }
+
+   /**
+    * Copies a channel of the newest image in the latest-frame mailbox (see
+    * enableLatestFrameMailbox()) and its metadata, whose Width, Height and
+    * PixelType tags describe the pixels.
+    */
+   long getLatestImageInto(JavaPixelDestination dest, unsigned channel,
+         Metadata& md) throw (CMMError)
+   {
+      std::shared_ptr<const mm::LatestFrame> frame = $self->getLatestFrame();
+      if (channel >= frame->pixels.size())
+         throw CMMError("Channel out of range");
+      md = frame->metadata[channel];
+      return CopyPixelsToJava(dest, frame->pixels[channel],
+            static_cast<long>(frame->channelBytes));
+   }
+
+   /**
+    * Like getLatestImageInto(), but copies the binned preview; the Width and
+    * Height tags are those of the preview.
+    */
+   long getLatestPreviewInto(JavaPixelDestination dest, unsigned channel,
+         Metadata& md) throw (CMMError)
+   {
+      std::shared_ptr<const mm::LatestFrame> frame = $self->getLatestFrame();
+      if (channel >= frame->pixels.size())
+         throw CMMError("Channel out of range");
+      md = frame->GetPreviewMetadata(channel);
+      return CopyPixelsToJava(dest, frame->GetPreview(channel),
+            static_cast<long>(frame->GetPreviewBytes()));
+   }
+}
+
 
 %typemap(javaimports) CMMCore %{
    import mmcorej.org.json.JSONObject;
@@ -652,47 +970,6 @@
    }
 
 
-   private JSONObject metadataToMap(Metadata md) {
-      JSONObject tags = new JSONObject();
-      for (String key:md.GetKeys()) {
-         try {
-            tags.put(key, md.GetSingleTag(key).GetValue());
-         } catch (Exception e) {} 
-      }
-      return tags;
-   }
-
-   private String getROITag() throws java.lang.Exception {
-      String roi = "";
-      int [] x = new int[1];
-      int [] y = new int[1];
-      int [] xSize = new int[1];
-      int [] ySize = new int[1];
-      getROI(x, y, xSize, ySize);
-      roi += x[0] + "-" + y[0] + "-" + xSize[0] + "-" + ySize[0];
-      return roi;
-   }
-
-   private String getPixelType() {
-      int depth = (int) getBytesPerPixel();
-      int numComponents = (int) getNumberOfComponents();
-      switch (depth) {
-         case 1:
-            return "GRAY8";
-         case 2:
-            return "GRAY16";
-         case 4: {
-            if (numComponents == 1)
-               return "GRAY32";
-            else
-               return "RGB32";
-            }
-         case 8:
-            return "RGB64";
-     }
-     return "";
-   }
-
    private String getMultiCameraChannel(JSONObject tags, int cameraChannelIndex) {
 	  try {
 	  String camera = tags.getString("Core-Camera");
@@ -731,43 +1008,9 @@
    }
 
    private TaggedImage createTaggedImage(Object pixels, Metadata md) throws java.lang.Exception {
-      JSONObject tags = metadataToMap(md);
-      PropertySetting setting;
-      if (includeSystemStateCache_) {
-         Configuration config = getSystemStateCache();
-         for (int i = 0; i < config.size(); ++i) {
-            setting = config.getSetting(i);
-            String key = setting.getDeviceLabel() + "-" + setting.getPropertyName();
-            String value = setting.getPropertyValue();
-             tags.put(key, value);
-         }
-      }
-      tags.put("BitDepth", getImageBitDepth());
-      tags.put("PixelSizeUm", getPixelSizeUm(true));
-      tags.put("PixelSizeAffine", getPixelSizeAffineAsString());
-      tags.put("ROI", getROITag());
-      tags.put("Width", getImageWidth());
-      tags.put("Height", getImageHeight());
-      tags.put("PixelType", getPixelType());
-      tags.put("Frame", 0);
-      tags.put("FrameIndex", 0);
-      tags.put("Position", "Default");
-      tags.put("PositionIndex", 0);
-      tags.put("Slice", 0);
-      tags.put("SliceIndex", 0);
-      String channel = getCurrentConfigFromCache(getPropertyFromCache("Core","ChannelGroup"));
-      if ((channel == null) || (channel.length() == 0)) {
-         channel = "Default";
-      }
-      tags.put("Channel", channel);
-      tags.put("ChannelIndex", 0);
-
-
-      try {
-         tags.put("Binning", getProperty(getCameraDevice(), "Binning"));
-      } catch (Exception ex) {}
-      
-      return new TaggedImage(pixels, tags);	
+      // All tags are serialized by the Core in a single call
+      JSONObject tags = new JSONObject(getImageTagsJSON(md, includeSystemStateCache_));
+      return new TaggedImage(pixels, tags);
    }
 
    public TaggedImage getTaggedImage(int cameraChannelIndex) throws java.lang.Exception {
@@ -917,10 +1160,13 @@
 
 %{
 #include "../MMDevice/MMDeviceConstants.h"
+#include "../MMCore/AcquisitionPlan.h"
 #include "../MMCore/Configuration.h"
+#include "../MMCore/DeviceHandle.h"
 #include "../MMDevice/ImageMetadata.h"
 #include "../MMCore/MMEventCallback.h"
 #include "../MMCore/MMCore.h"
+#include "../MMCore/LatestFrameMailbox.h"
 %}
 
 
@@ -1235,7 +1481,9 @@ namespace std {
 
 
 %include "../MMDevice/MMDeviceConstants.h"
+%include "../MMCore/AcquisitionPlan.h"
 %include "../MMCore/Configuration.h"
+%include "../MMCore/DeviceHandle.h"
 %include "../MMCore/MMCore.h"
 %include "../MMDevice/ImageMetadata.h"
 %include "../MMCore/MMEventCallback.h"
@@ -36,6 +36,7 @@
 
 #include <math.h>
 #include <assert.h>
+#include <stdio.h>
 
 #include <string>
 #include <vector>
@@ -465,6 +466,43 @@ public:
       return pProp->AddToSequence(value);
    }
 
+   /**
+    * This function is used by the Core to communicate a sequence to the device
+    * Adds the values one by one with AddToPropertySequence(); override to
+    * receive numeric sequences without string formatting
+    * @param name - name of the sequenceable property
+    */
+   virtual int AddFloatArrayToPropertySequence(const char* name, const double* values, long count)
+   {
+      char buf[MM::MaxStrLength];
+      for (long i = 0; i < count; ++i)
+      {
+         snprintf(buf, sizeof(buf), "%.17g", values[i]);
+         int ret = AddToPropertySequence(name, buf);
+         if (ret != DEVICE_OK)
+            return ret;
+      }
+      return DEVICE_OK;
+   }
+
+   /**
+    * This function is used by the Core to communicate a sequence to the device
+    * Adds the values one by one with AddToPropertySequence()
+    * @param name - name of the sequenceable property
+    */
+   virtual int AddIntegerArrayToPropertySequence(const char* name, const long* values, long count)
+   {
+      char buf[MM::MaxStrLength];
+      for (long i = 0; i < count; ++i)
+      {
+         snprintf(buf, sizeof(buf), "%ld", values[i]);
+         int ret = AddToPropertySequence(name, buf);
+         if (ret != DEVICE_OK)
+            return ret;
+      }
+      return DEVICE_OK;
+   }
+
    /**
     * This function is used by the Core to communicate a sequence to the device
     * Sends the sequence to the device by calling the properties functor
@@ -526,6 +564,45 @@ public:
       return ret;
    }
 
+   /**
+   * Sets the cache policy of a property. Adapters normally call this after
+   * CreateProperty() for properties whose value only changes when set (or
+   * changes slowly); the core can override it from the configuration file.
+   * @param name - property name
+   * @param policy - when the BeforeGet handler runs
+   * @param ttlMs - validity of a queried value, for CacheTimeToLive
+   */
+   virtual int SetPropertyCachePolicy(const char* name, MM::PropertyCachePolicy policy, long ttlMs)
+   {
+      int ret = properties_.SetCachePolicy(name, policy, ttlMs);
+      if (ret != DEVICE_OK)
+         SetMorePropertyErrorInfo(name);
+      return ret;
+   }
+
+   virtual int GetPropertyCachePolicy(const char* name, MM::PropertyCachePolicy& policy, long& ttlMs) const
+   {
+      MM::Property* pProp = properties_.Find(name);
+      if (!pProp)
+      {
+         SetMorePropertyErrorInfo(name);
+         return DEVICE_INVALID_PROPERTY;
+      }
+      policy = pProp->GetCachePolicy();
+      ttlMs = pProp->GetCacheTimeToLiveMs();
+      return DEVICE_OK;
+   }
+
+   virtual unsigned long GetPropertyChangeCounter() const
+   {
+      return properties_.GetChangeCounter();
+   }
+
+   virtual bool HasUncachedProperties() const
+   {
+      return properties_.HasUncachedProperties();
+   }
+
    /**
    * Checks if device supports a given property.
    */
@@ -1070,6 +1147,7 @@ protected:
    */
    int OnPropertiesChanged()
    {
+      properties_.IncrementChangeCounter();
       if (callback_)
          return callback_->OnPropertiesChanged(this);
       return DEVICE_NO_CALLBACK_REGISTERED;
@@ -1080,6 +1158,11 @@ protected:
     */
    int OnPropertyChanged(const char* propName, const char* propValue)
    {
+      // The adapter may have changed its state behind the stored value
+      MM::Property* pProp = properties_.Find(propName);
+      if (pProp)
+         pProp->InvalidateCache();
+      properties_.IncrementChangeCounter();
       if (callback_)
          return callback_->OnPropertyChanged(this, propName, propValue);
       return DEVICE_NO_CALLBACK_REGISTERED;
@@ -1462,6 +1545,17 @@ public:
       return DEVICE_UNSUPPORTED_COMMAND;
    }
 
+   virtual int AddArrayToExposureSequence(const double* exposureTimes_ms, long count)
+   {
+      for (long i = 0; i < count; ++i)
+      {
+         int ret = AddToExposureSequence(exposureTimes_ms[i]);
+         if (ret != DEVICE_OK)
+            return ret;
+      }
+      return DEVICE_OK;
+   }
+
    virtual int SendExposureSequence() const
    {
       return DEVICE_UNSUPPORTED_COMMAND;
@@ -1803,6 +1897,17 @@ class CStageBase : public CDeviceBase<MM::Stage, U>
       return DEVICE_UNSUPPORTED_COMMAND;
    }
 
+   virtual int AddArrayToStageSequence(const double* positions, long count)
+   {
+      for (long i = 0; i < count; ++i)
+      {
+         int ret = AddToStageSequence(positions[i]);
+         if (ret != DEVICE_OK)
+            return ret;
+      }
+      return DEVICE_OK;
+   }
+
    virtual int SendStageSequence()
    {
       return DEVICE_UNSUPPORTED_COMMAND;
@@ -1998,6 +2103,17 @@ public:
       return DEVICE_UNSUPPORTED_COMMAND;
    }
 
+   virtual int AddArrayToXYStageSequence(const double* positionsX, const double* positionsY, long count)
+   {
+      for (long i = 0; i < count; ++i)
+      {
+         int ret = AddToXYStageSequence(positionsX[i], positionsY[i]);
+         if (ret != DEVICE_OK)
+            return ret;
+      }
+      return DEVICE_OK;
+   }
+
    virtual int SendXYStageSequence()
    {
       return DEVICE_UNSUPPORTED_COMMAND;
@@ -2099,6 +2215,17 @@ class CSignalIOBase : public CDeviceBase<MM::SignalIO, U>
       return DEVICE_UNSUPPORTED_COMMAND;
    }
 
+   virtual int AddArrayToDASequence(const double* voltages, long count)
+   {
+      for (long i = 0; i < count; ++i)
+      {
+         int ret = AddToDASequence(voltages[i]);
+         if (ret != DEVICE_OK)
+            return ret;
+      }
+      return DEVICE_OK;
+   }
+
    virtual int SendDASequence() {
       return DEVICE_UNSUPPORTED_COMMAND;
    }
@@ -305,6 +305,13 @@ public:
       tags_.clear();
    }
 
+#ifndef SWIG
+   // Read-only iteration over the tags, keyed by qualified name
+   typedef std::map<std::string, MetadataTag*>::const_iterator const_iterator;
+   const_iterator begin() const { return tags_.begin(); }
+   const_iterator end() const { return tags_.end(); }
+#endif
+
    std::vector<std::string> GetKeys() const
    {
       std::vector<std::string> keyList;
@@ -313,7 +320,7 @@ public:
       return keyList;
    }
 
-   bool HasTag(const char* key)
+   bool HasTag(const char* key) const
    {
       TagConstIter it = tags_.find(key);
       if (it != tags_.end())
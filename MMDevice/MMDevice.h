@@ -27,7 +27,7 @@
 // Header version
 // If any of the class definitions changes, the interface version
 // must be incremented
-#define DEVICE_INTERFACE_VERSION 71
+#define DEVICE_INTERFACE_VERSION 73
 ///////////////////////////////////////////////////////////////////////////////
 
 
@@ -272,11 +272,38 @@ namespace MM {
        * Add one value to the sequence
        */
       virtual int AddToPropertySequence(const char* propertyName, const char* value) = 0;
+      /**
+       * Add count values to the sequence at once, for Float and Integer
+       * properties. CDeviceBase formats each value and passes it to
+       * AddToPropertySequence().
+       */
+      virtual int AddFloatArrayToPropertySequence(const char* propertyName, const double* values, long count) = 0;
+      virtual int AddIntegerArrayToPropertySequence(const char* propertyName, const long* values, long count) = 0;
       /**
        * Signal that we are done sending sequence values so that the adapter can send the whole sequence to the device
        */
       virtual int SendPropertySequence(const char* propertyName) = 0;
 
+      /**
+       * Selects how long a value obtained from the device is reused before
+       * the property queries the device again (see MM::PropertyCachePolicy).
+       * ttlMs is only used with CacheTimeToLive.
+       */
+      virtual int SetPropertyCachePolicy(const char* name, PropertyCachePolicy policy, long ttlMs) = 0;
+      virtual int GetPropertyCachePolicy(const char* name, PropertyCachePolicy& policy, long& ttlMs) const = 0;
+      /**
+       * Returns a counter that increases whenever a property of this device
+       * is set, reported changed through OnPropertyChanged(), or found to
+       * have a new value when queried. Together with HasUncachedProperties()
+       * this lets the core reuse the last known property values of a device.
+       */
+      virtual unsigned long GetPropertyChangeCounter() const = 0;
+      /**
+       * True if reading at least one property would currently query the
+       * device.
+       */
+      virtual bool HasUncachedProperties() const = 0;
+
       virtual bool GetErrorText(int errorCode, char* errMessage) const = 0;
       virtual bool Busy() = 0;
       virtual double GetDelayMs() const = 0;
@@ -563,6 +590,9 @@ namespace MM {
       virtual int ClearExposureSequence() = 0;
       // Add one value to the sequence
       virtual int AddToExposureSequence(double exposureTime_ms) = 0;
+      // Add count values to the sequence at once (CCameraBase calls
+      // AddToExposureSequence() for each)
+      virtual int AddArrayToExposureSequence(const double* exposureTimes_ms, long count) = 0;
       // Signal that we are done sending sequence values so that the adapter can send the whole sequence to the device
       virtual int SendExposureSequence() const = 0;
    };
@@ -673,6 +703,11 @@ namespace MM {
        * Add one value to the sequence
        */
       virtual int AddToStageSequence(double position) = 0;
+      /**
+       * Add count values to the sequence at once (CStageBase calls
+       * AddToStageSequence() for each)
+       */
+      virtual int AddArrayToStageSequence(const double* positions, long count) = 0;
       /**
        * Signal that we are done sending sequence values so that the adapter
        * can send the whole sequence to the device
@@ -768,6 +803,11 @@ namespace MM {
        * Add one value to the sequence
        */
       virtual int AddToXYStageSequence(double positionX, double positionY) = 0;
+      /**
+       * Add count positions to the sequence at once (CXYStageBase calls
+       * AddToXYStageSequence() for each)
+       */
+      virtual int AddArrayToXYStageSequence(const double* positionsX, const double* positionsY, long count) = 0;
       /**
        * Signal that we are done sending sequence values so that the adapter
        * can send the whole sequence to the device
@@ -943,6 +983,12 @@ namespace MM {
        * @return errorcode (DEVICE_OK if no error)
        */
       virtual int AddToDASequence(double voltage) = 0;
+      /**
+       * Adds count data points to the sequence at once (CSignalIOBase calls
+       * AddToDASequence() for each)
+       * @return errorcode (DEVICE_OK if no error)
+       */
+      virtual int AddArrayToDASequence(const double* voltages, long count) = 0;
       /**
        * Sends the complete sequence to the device
        * If the individual data points were already send to the device, there is
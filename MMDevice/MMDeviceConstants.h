@@ -150,6 +150,9 @@ namespace MM {
    const char* const g_Keyword_Metadata_ROI_X       = "ROI-X-start";
    const char* const g_Keyword_Metadata_ROI_Y       = "ROI-Y-start";
    const char* const g_Keyword_Metadata_TimeInCore  = "TimeReceivedByCore";
+   // Hardware timestamp of the frame, in the camera's own unit and epoch (the
+   // Core correlates it with the host clock; see TimeReceivedByCore-ms)
+   const char* const g_Keyword_Metadata_DeviceTimestamp = "DeviceTimestamp";
 
    // configuration file format constants
    const char* const g_FieldDelimiters = ",";
@@ -166,6 +169,7 @@ namespace MM {
    const char* const g_CFGCommand_PixelSizeAffine = "PixelSizeAffine";
    const char* const g_CFGCommand_ParentID = "Parent";
    const char* const g_CFGCommand_FocusDirection = "FocusDirection";
+   const char* const g_CFGCommand_PropertyCache = "PropertyCache";
 
    // configuration groups
    const char* const g_CFGGroup_System = "System";
@@ -236,6 +240,22 @@ namespace MM {
       StopSequence
    };
 
+   // How long a property value obtained from the device stays valid before
+   // the BeforeGet handler has to run again
+   enum PropertyCachePolicy {
+      CacheAlwaysQuery, // run the handler on every read (the default)
+      CacheUntilSet,    // query once, then reuse until the property is set
+      CacheTimeToLive   // reuse for a fixed number of milliseconds
+   };
+
+   // How the Core serializes calls to a device (declared by the device
+   // adapter module with SetDeviceThreadSafety())
+   enum DeviceThreadSafety {
+      ThreadSafetyModule,           // one lock for all devices of the module (the default)
+      ThreadSafetyDevice,           // one lock per device
+      ThreadSafetyDeviceSharedReads // per device, but queries may run concurrently
+   };
+
    enum PortType {
       InvalidPort,
       SerialPort,
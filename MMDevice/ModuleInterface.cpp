@@ -35,11 +35,13 @@ struct DeviceInfo
    std::string name_;
    MM::DeviceType type_;
    std::string description_;
+   MM::DeviceThreadSafety threadSafety_;
 
    DeviceInfo(const char* name, MM::DeviceType type, const char* description) :
       name_(name),
       type_(type),
-      description_(description)
+      description_(description),
+      threadSafety_(MM::ThreadSafetyModule)
    {}
 };
 
@@ -119,6 +121,21 @@ MODULE_API bool GetDeviceDescription(const char* deviceName, char* description,
    return true;
 }
 
+MODULE_API bool GetDeviceThreadSafety(const char* deviceName, int* threadSafety)
+{
+   std::vector<DeviceInfo>::const_iterator it =
+      std::find_if(g_registeredDevices.begin(), g_registeredDevices.end(),
+            DeviceNameMatches(deviceName));
+   if (it == g_registeredDevices.end())
+   {
+      *threadSafety = MM::ThreadSafetyModule;
+      return false;
+   }
+
+   *threadSafety = static_cast<int>(it->threadSafety_);
+   return true;
+}
+
 void RegisterDevice(const char* deviceName, MM::DeviceType deviceType, const char* deviceDescription)
 {
    if (!deviceName)
@@ -135,3 +152,15 @@ void RegisterDevice(const char* deviceName, MM::DeviceType deviceType, const cha
 
    g_registeredDevices.push_back(DeviceInfo(deviceName, deviceType, deviceDescription));
 }
+
+void SetDeviceThreadSafety(const char* deviceName, MM::DeviceThreadSafety threadSafety)
+{
+   if (!deviceName)
+      return;
+
+   std::vector<DeviceInfo>::iterator it =
+      std::find_if(g_registeredDevices.begin(), g_registeredDevices.end(),
+            DeviceNameMatches(deviceName));
+   if (it != g_registeredDevices.end())
+      it->threadSafety_ = threadSafety;
+}
@@ -49,7 +49,7 @@
 // If any of the exported module API calls (below) changes, the interface
 // version must be incremented. Note that the signature and name of
 // GetModuleVersion() must never change.
-#define MODULE_INTERFACE_VERSION 10
+#define MODULE_INTERFACE_VERSION 11
 
 
 /*
@@ -104,6 +104,7 @@ extern "C" {
    MODULE_API bool GetDeviceName(unsigned deviceIndex, char* name, unsigned bufferLength);
    MODULE_API bool GetDeviceType(const char* deviceName, int* type);
    MODULE_API bool GetDeviceDescription(const char* deviceName, char* name, unsigned bufferLength);
+   MODULE_API bool GetDeviceThreadSafety(const char* deviceName, int* threadSafety);
 
    // Function pointer types for module interface functions
    // (Not for use by device adapters)
@@ -117,6 +118,7 @@ extern "C" {
    typedef bool (*fnGetDeviceName)(unsigned, char*, unsigned);
    typedef bool (*fnGetDeviceType)(const char*, int*);
    typedef bool (*fnGetDeviceDescription)(const char*, char*, unsigned);
+   typedef bool (*fnGetDeviceThreadSafety)(const char*, int*);
 #endif
 }
 
@@ -137,5 +139,29 @@ extern "C" {
  */
 void RegisterDevice(const char* deviceName, MM::DeviceType deviceType, const char* description);
 
+/// Declare how the Core may synchronize calls to a registered device.
+/**
+ * To be called in InitializeModuleData(), after RegisterDevice().
+ *
+ * By default (MM::ThreadSafetyModule), the Core never calls into two devices
+ * of the same module concurrently. A device may instead declare that it only
+ * needs its own calls serialized (MM::ThreadSafetyDevice), or additionally
+ * that its queries (Busy(), stage, XY stage and galvo positions, shutter
+ * state, exposure, image dimensions and ROI) may run concurrently with each
+ * other (MM::ThreadSafetyDeviceSharedReads). Property reads are always
+ * exclusive, and the queries of a SharedReads device must not read its
+ * properties either, because the property collection is not safe for
+ * concurrent use (note that the default CXYStageBase::GetPositionUm() reads
+ * the orientation properties).
+ *
+ * Only declare a finer contract if the device shares no unsynchronized
+ * state (such as a serial port or a hub's data) with other devices of the
+ * module, and never calls, from within a call made by the Core, another
+ * device that may in turn call it.
+ *
+ * \see RegisterDevice()
+ */
+void SetDeviceThreadSafety(const char* deviceName, MM::DeviceThreadSafety threadSafety);
+
 
 #endif //_MODULE_INTERFACE_H_
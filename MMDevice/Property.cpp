@@ -252,7 +252,8 @@ bool MM::IntegerProperty::Get(std::string& strVal) const
 // MM::PropertyCollection
 // ~~~~~~~~~~~~~~~~~~~~~
 //
-MM::PropertyCollection::PropertyCollection()
+MM::PropertyCollection::PropertyCollection() :
+   changeCounter_(0)
 {
 }
 
@@ -280,7 +281,13 @@ int MM::PropertyCollection::Set(const char* pszPropName, const char* pszValue)
       if (!pProp->Set(pszValue))
          return DEVICE_INVALID_PROPERTY_VALUE;
 
-      return pProp->Apply();
+      ++changeCounter_;
+      int nRet = pProp->Apply();
+      if (nRet == DEVICE_OK)
+         pProp->MarkCacheValid();
+      else
+         pProp->InvalidateCache();
+      return nRet;
    }
    else
       return DEVICE_INVALID_PROPERTY_VALUE;
@@ -292,9 +299,9 @@ int MM::PropertyCollection::Get(const char* pszPropName, string& strValue) const
    if (!pProp)
       return DEVICE_INVALID_PROPERTY; // name not found
 
-   if (!pProp->GetCached())
+   if (!pProp->IsCacheValid())
    {
-      int nRet = pProp->Update();
+      int nRet = Refresh(pProp);
       if (nRet != DEVICE_OK)
          return nRet;
    }
@@ -302,6 +309,28 @@ int MM::PropertyCollection::Get(const char* pszPropName, string& strValue) const
    return DEVICE_OK;
 }
 
+/**
+ * Runs the BeforeGet handler and records whether it changed the value.
+ */
+int MM::PropertyCollection::Refresh(MM::Property* pProp) const
+{
+   string oldValue;
+   pProp->Get(oldValue);
+   int nRet = pProp->Update();
+   if (nRet != DEVICE_OK)
+   {
+      pProp->InvalidateCache();
+      return nRet;
+   }
+   pProp->MarkCacheValid();
+
+   string newValue;
+   pProp->Get(newValue);
+   if (newValue != oldValue)
+      ++changeCounter_;
+   return DEVICE_OK;
+}
+
 MM::Property* MM::PropertyCollection::Find(const char* pszName) const
 {
    CPropArray::const_iterator it = properties_.find(pszName);
@@ -462,7 +491,7 @@ int MM::PropertyCollection::UpdateAll()
    for (it=properties_.begin(); it!=properties_.end(); it++)
    {
       int nRet;
-      nRet = it->second->Update();
+      nRet = Refresh(it->second);
       if (nRet != DEVICE_OK)
          return nRet;
    }
@@ -488,7 +517,7 @@ int MM::PropertyCollection::Update(const char* pszName)
    if (!pProp)
       return DEVICE_INVALID_PROPERTY;
 
-   return pProp->Update();
+   return Refresh(pProp);
 }
 
 int MM::PropertyCollection::Apply(const char* pszName)
@@ -499,3 +528,24 @@ int MM::PropertyCollection::Apply(const char* pszName)
 
    return pProp->Apply();
 }
+
+int MM::PropertyCollection::SetCachePolicy(const char* pszName, MM::PropertyCachePolicy policy, long ttlMs)
+{
+   MM::Property* pProp = Find(pszName);
+   if (!pProp)
+      return DEVICE_INVALID_PROPERTY;
+
+   pProp->SetCachePolicy(policy, ttlMs);
+   return DEVICE_OK;
+}
+
+bool MM::PropertyCollection::HasUncachedProperties() const
+{
+   CPropArray::const_iterator it;
+   for (it=properties_.begin(); it!=properties_.end(); it++)
+   {
+      if (!it->second->IsCacheValid())
+         return true;
+   }
+   return false;
+}
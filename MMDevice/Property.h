@@ -24,6 +24,8 @@
 #define _MMPROPERTY_H_
 
 #include "MMDeviceConstants.h"
+#include <atomic>
+#include <chrono>
 #include <string>
 #include <cstring>
 #include <cstdlib>
@@ -130,6 +132,9 @@ public:
       readOnly_(false),
       fpAction_(0),
       cached_(false),
+      cachePolicy_(CacheAlwaysQuery),
+      cacheTtlMs_(0),
+      cacheValid_(false),
       hasData_(false),
       initStatus_(true),
       limits_(false),
@@ -146,9 +151,53 @@ public:
       delete fpAction_;
    }
 
+   // Legacy switch: a cached property never runs its BeforeGet handler on
+   // reads, whatever its cache policy
    bool GetCached()const {return cached_;}
    void SetCached(bool bState=true) {cached_ = bState;}
 
+   /**
+    * Selects when the BeforeGet handler runs on a read. ttlMs is only used
+    * with CacheTimeToLive. Properties without an action handler hold their
+    * value locally and are unaffected.
+    */
+   void SetCachePolicy(PropertyCachePolicy policy, long ttlMs = 0)
+   {
+      cachePolicy_ = policy;
+      cacheTtlMs_ = ttlMs > 0 ? ttlMs : 0;
+      cacheValid_ = false;
+   }
+   PropertyCachePolicy GetCachePolicy() const {return cachePolicy_;}
+   long GetCacheTimeToLiveMs() const {return cacheTtlMs_;}
+
+   bool HasAction() const {return fpAction_ != 0;}
+
+   /**
+    * True if the stored value can be returned without running the BeforeGet
+    * handler.
+    */
+   bool IsCacheValid() const
+   {
+      if (!fpAction_ || cached_)
+         return true;
+      switch (cachePolicy_)
+      {
+         case CacheUntilSet:
+            return cacheValid_;
+         case CacheTimeToLive:
+            return cacheValid_ && std::chrono::steady_clock::now() - cacheTime_ <
+               std::chrono::milliseconds(cacheTtlMs_);
+         default:
+            return false;
+      }
+   }
+   void MarkCacheValid()
+   {
+      cacheValid_ = true;
+      cacheTime_ = std::chrono::steady_clock::now();
+   }
+   void InvalidateCache() {cacheValid_ = false;}
+
    bool GetReadOnly()const {return readOnly_;}
    void SetReadOnly(bool bState=true) {readOnly_ = bState;}
 
@@ -295,6 +344,10 @@ protected:
    bool readOnly_;
    ActionFunctor* fpAction_;
    bool cached_;
+   PropertyCachePolicy cachePolicy_;
+   long cacheTtlMs_;
+   bool cacheValid_;
+   std::chrono::steady_clock::time_point cacheTime_;
    bool hasData_;
    bool initStatus_;
    bool limits_;
@@ -440,9 +493,20 @@ public:
    int Update(const char* Name);
    int Apply(const char* Name);
 
+   int SetCachePolicy(const char* name, PropertyCachePolicy policy, long ttlMs);
+   // True if some property would have to query the device on its next read
+   bool HasUncachedProperties() const;
+   // Incremented whenever a property is set or a query returns a new value
+   unsigned long GetChangeCounter() const {return changeCounter_;}
+   void IncrementChangeCounter() {++changeCounter_;}
+
 private:
+   int Refresh(Property* pProp) const;
+
    typedef std::map<std::string, Property*> CPropArray;
    CPropArray properties_;
+   // Incremented by device threads and read by the Core concurrently
+   mutable std::atomic<unsigned long> changeCounter_;
 };
 
 
@@ -0,0 +1,141 @@
+#include <gtest/gtest.h>
+
+#include "Property.h"
+
+#include <chrono>
+#include <string>
+#include <thread>
+
+using namespace MM;
+
+
+class QueryCounter
+{
+public:
+   QueryCounter() : nrQueries(0), hardwareValue(0) {}
+
+   int OnValue(PropertyBase* pProp, ActionType eAct)
+   {
+      if (eAct == BeforeGet)
+      {
+         ++nrQueries;
+         pProp->Set(hardwareValue);
+      }
+      else if (eAct == AfterSet)
+      {
+         pProp->Get(hardwareValue);
+      }
+      return DEVICE_OK;
+   }
+
+   int nrQueries;
+   long hardwareValue;
+};
+
+
+class PropertyCacheTests : public ::testing::Test
+{
+protected:
+   void SetUp()
+   {
+      ASSERT_EQ(DEVICE_OK, props.CreateProperty("Value", "0", Integer, false,
+               new Action<QueryCounter>(&counter, &QueryCounter::OnValue)));
+      ASSERT_EQ(DEVICE_OK, props.CreateProperty("Plain", "a", String, false));
+   }
+
+   QueryCounter counter;
+   PropertyCollection props;
+   std::string value;
+};
+
+
+TEST_F(PropertyCacheTests, AlwaysQueryRunsHandlerOnEveryRead)
+{
+   ASSERT_EQ(DEVICE_OK, props.Get("Value", value));
+   ASSERT_EQ(DEVICE_OK, props.Get("Value", value));
+   ASSERT_EQ(2, counter.nrQueries);
+   ASSERT_TRUE(props.HasUncachedProperties());
+}
+
+TEST_F(PropertyCacheTests, UntilSetQueriesOnceUntilSet)
+{
+   ASSERT_EQ(DEVICE_OK, props.SetCachePolicy("Value", CacheUntilSet, 0));
+   ASSERT_TRUE(props.HasUncachedProperties());
+
+   ASSERT_EQ(DEVICE_OK, props.Get("Value", value));
+   ASSERT_EQ(DEVICE_OK, props.Get("Value", value));
+   ASSERT_EQ(1, counter.nrQueries);
+   ASSERT_FALSE(props.HasUncachedProperties());
+
+   counter.hardwareValue = 5; // not visible until the cache is invalidated
+   ASSERT_EQ(DEVICE_OK, props.Get("Value", value));
+   ASSERT_EQ("0", value);
+
+   ASSERT_EQ(DEVICE_OK, props.Set("Value", "7"));
+   ASSERT_EQ(DEVICE_OK, props.Get("Value", value));
+   ASSERT_EQ("7", value);
+   ASSERT_EQ(1, counter.nrQueries);
+}
+
+TEST_F(PropertyCacheTests, TimeToLiveExpires)
+{
+   ASSERT_EQ(DEVICE_OK, props.SetCachePolicy("Value", CacheTimeToLive, 20));
+   ASSERT_EQ(DEVICE_OK, props.Get("Value", value));
+   ASSERT_EQ(DEVICE_OK, props.Get("Value", value));
+   ASSERT_EQ(1, counter.nrQueries);
+
+   std::this_thread::sleep_for(std::chrono::milliseconds(40));
+   ASSERT_TRUE(props.HasUncachedProperties());
+   ASSERT_EQ(DEVICE_OK, props.Get("Value", value));
+   ASSERT_EQ(2, counter.nrQueries);
+}
+
+TEST_F(PropertyCacheTests, LegacySetCachedNeverQueries)
+{
+   Property* pProp = props.Find("Value");
+   ASSERT_NE(nullptr, pProp);
+   pProp->SetCached();
+   ASSERT_TRUE(pProp->GetCached());
+   ASSERT_EQ(CacheAlwaysQuery, pProp->GetCachePolicy());
+   ASSERT_FALSE(props.HasUncachedProperties());
+
+   counter.hardwareValue = 5;
+   ASSERT_EQ(DEVICE_OK, props.Get("Value", value));
+   ASSERT_EQ("0", value);
+   ASSERT_EQ(0, counter.nrQueries);
+
+   pProp->SetCached(false);
+   ASSERT_EQ(DEVICE_OK, props.Get("Value", value));
+   ASSERT_EQ("5", value);
+   ASSERT_EQ(1, counter.nrQueries);
+}
+
+TEST_F(PropertyCacheTests, ChangeCounterTracksSetsAndQueriedChanges)
+{
+   unsigned long start = props.GetChangeCounter();
+
+   ASSERT_EQ(DEVICE_OK, props.Get("Value", value));
+   ASSERT_EQ(start, props.GetChangeCounter());
+
+   counter.hardwareValue = 3;
+   ASSERT_EQ(DEVICE_OK, props.Get("Value", value));
+   ASSERT_EQ(start + 1, props.GetChangeCounter());
+
+   ASSERT_EQ(DEVICE_OK, props.Set("Plain", "b"));
+   ASSERT_EQ(start + 2, props.GetChangeCounter());
+
+   ASSERT_EQ(DEVICE_INVALID_PROPERTY, props.Set("Missing", "b"));
+   ASSERT_EQ(start + 2, props.GetChangeCounter());
+}
+
+TEST_F(PropertyCacheTests, UnknownPropertyIsAnError)
+{
+   ASSERT_EQ(DEVICE_INVALID_PROPERTY,
+         props.SetCachePolicy("Missing", CacheUntilSet, 0));
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
@@ -0,0 +1,142 @@
+#include <gtest/gtest.h>
+
+#include "DeviceBase.h"
+
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+
+class SequencedStage : public CStageBase<SequencedStage>
+{
+public:
+   SequencedStage() : maxLength(3) {}
+
+   int Initialize() { return DEVICE_OK; }
+   int Shutdown() { return DEVICE_OK; }
+   void GetName(char* name) const { CDeviceUtils::CopyLimitedString(name, "SequencedStage"); }
+   bool Busy() { return false; }
+
+   int SetPositionUm(double) { return DEVICE_OK; }
+   int GetPositionUm(double& pos) { pos = 0.0; return DEVICE_OK; }
+   int SetPositionSteps(long) { return DEVICE_OK; }
+   int GetPositionSteps(long& steps) { steps = 0; return DEVICE_OK; }
+   int SetOrigin() { return DEVICE_OK; }
+   int GetLimits(double& lower, double& upper) { lower = upper = 0.0; return DEVICE_OK; }
+   bool IsContinuousFocusDrive() const { return false; }
+
+   int IsStageSequenceable(bool& isSequenceable) const
+   { isSequenceable = true; return DEVICE_OK; }
+   int AddToStageSequence(double position)
+   {
+      if (positions.size() >= maxLength)
+         return DEVICE_SEQUENCE_TOO_LARGE;
+      positions.push_back(position);
+      return DEVICE_OK;
+   }
+
+   std::size_t maxLength;
+   std::vector<double> positions;
+};
+
+
+class PlainDA : public CSignalIOBase<PlainDA>
+{
+public:
+   int Initialize() { return DEVICE_OK; }
+   int Shutdown() { return DEVICE_OK; }
+   void GetName(char* name) const { CDeviceUtils::CopyLimitedString(name, "PlainDA"); }
+   bool Busy() { return false; }
+
+   int SetGateOpen(bool) { return DEVICE_OK; }
+   int GetGateOpen(bool& open) { open = true; return DEVICE_OK; }
+   int SetSignal(double) { return DEVICE_OK; }
+   int GetSignal(double& volts) { volts = 0.0; return DEVICE_OK; }
+   int GetLimits(double& minVolts, double& maxVolts) { minVolts = maxVolts = 0.0; return DEVICE_OK; }
+   int IsDASequenceable(bool& isSequenceable) const
+   { isSequenceable = false; return DEVICE_OK; }
+};
+
+
+class SequencedGeneric : public CGenericBase<SequencedGeneric>
+{
+public:
+   int Initialize()
+   {
+      CreateProperty("Volts", "0", MM::Float, false,
+            new CPropertyAction(this, &SequencedGeneric::OnSequenced));
+      return CreateProperty("Index", "0", MM::Integer, false,
+            new CPropertyAction(this, &SequencedGeneric::OnSequenced));
+   }
+   int Shutdown() { return DEVICE_OK; }
+   void GetName(char* name) const { CDeviceUtils::CopyLimitedString(name, "SequencedGeneric"); }
+   bool Busy() { return false; }
+
+   int OnSequenced(MM::PropertyBase* pProp, MM::ActionType eAct)
+   {
+      if (eAct == MM::IsSequenceable)
+         pProp->SetSequenceable(100);
+      else if (eAct == MM::AfterLoadSequence)
+         loaded = pProp->GetSequence();
+      return DEVICE_OK;
+   }
+
+   std::vector<std::string> loaded;
+};
+
+
+TEST(SequenceArrayTests, StageArrayForwardsEachPosition)
+{
+   SequencedStage stage;
+   MM::Stage& device = stage; // As called by the Core
+   const double positions[] = { 1.5, -2.0, 3.25 };
+   ASSERT_EQ(DEVICE_OK, device.AddArrayToStageSequence(positions, 3));
+   ASSERT_EQ(3u, stage.positions.size());
+   EXPECT_EQ(-2.0, stage.positions[1]);
+
+   // The first error is returned and the remaining values are not added
+   stage.positions.clear();
+   stage.maxLength = 1;
+   EXPECT_EQ(DEVICE_SEQUENCE_TOO_LARGE, device.AddArrayToStageSequence(positions, 3));
+   EXPECT_EQ(1u, stage.positions.size());
+
+   EXPECT_EQ(DEVICE_OK, device.AddArrayToStageSequence(0, 0));
+}
+
+TEST(SequenceArrayTests, UnsupportedWithoutPerElementImplementation)
+{
+   PlainDA da;
+   MM::SignalIO& device = da;
+   const double voltages[] = { 1.0, 2.0 };
+   EXPECT_EQ(DEVICE_UNSUPPORTED_COMMAND, device.AddArrayToDASequence(voltages, 2));
+}
+
+TEST(SequenceArrayTests, PropertyArraysAreFormattedExactly)
+{
+   SequencedGeneric device;
+   ASSERT_EQ(DEVICE_OK, device.Initialize());
+
+   const double volts[] = { 0.1, 2.5, 1.0 / 3.0, -1e-7 };
+   ASSERT_EQ(DEVICE_OK, device.ClearPropertySequence("Volts"));
+   ASSERT_EQ(DEVICE_OK, device.AddFloatArrayToPropertySequence("Volts", volts, 4));
+   ASSERT_EQ(DEVICE_OK, device.SendPropertySequence("Volts"));
+   ASSERT_EQ(4u, device.loaded.size());
+   for (int i = 0; i < 4; ++i)
+      EXPECT_EQ(volts[i], std::strtod(device.loaded[i].c_str(), 0));
+
+   const long indices[] = { 7, -3 };
+   ASSERT_EQ(DEVICE_OK, device.ClearPropertySequence("Index"));
+   ASSERT_EQ(DEVICE_OK, device.AddIntegerArrayToPropertySequence("Index", indices, 2));
+   ASSERT_EQ(DEVICE_OK, device.SendPropertySequence("Index"));
+   ASSERT_EQ(2u, device.loaded.size());
+   EXPECT_EQ("7", device.loaded[0]);
+   EXPECT_EQ("-3", device.loaded[1]);
+
+   EXPECT_NE(DEVICE_OK, device.AddFloatArrayToPropertySequence("NoSuchProperty", volts, 1));
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}